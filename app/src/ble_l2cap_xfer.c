@@ -0,0 +1,303 @@
+/*
+ * SPDX-License-Identifier: MIT
+ *
+ * Copyright (c) 2026 Ashwin Whitchurch, ProtoCentral Electronics
+ *
+ * Bulk session download over an LE L2CAP connection-oriented channel.
+ *
+ * The GATT download path sends 64-byte notifications with a 50 ms gap,
+ * about 1.3 KB/s. On a CoC the peer grants credits as it consumes data, so
+ * SDUs can be pushed back to back and the link paces itself.
+ *
+ * Protocol (all little endian), on PSM HPI_L2CAP_XFER_PSM:
+ *   request  -> [0] 0x01, [1..2] session id, [3] file no, [4..7] offset
+ *   header   <- [0] 0x81, [1] status (0 = ok, else errno magnitude),
+ *               [2..5] file size, [6..9] offset data starts at
+ *   data     <- raw file bytes from offset, SDUs of up to the peer's MTU
+ *   trailer  <- [0] 0x82, [1..4] bytes sent, [5..8] CRC-32 (IEEE) of the
+ *               whole file
+ *
+ * A broken download is resumed by reconnecting with the number of bytes
+ * already received as the offset. The CRC always covers the whole file so
+ * the host can check the reassembled result.
+ */
+
+#include <string.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/bluetooth/bluetooth.h>
+#include <zephyr/bluetooth/conn.h>
+#include <zephyr/bluetooth/l2cap.h>
+#include <zephyr/fs/fs.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/crc.h>
+
+#include "ble_module.h"
+#include "datalog_module.h"
+
+LOG_MODULE_REGISTER(ble_l2cap_xfer, LOG_LEVEL_INF);
+
+#define HPI_L2CAP_XFER_PSM 0x0081
+#define HPI_L2CAP_XFER_MTU 512
+#define HPI_L2CAP_XFER_TX_BUFS 3
+
+#define HPI_L2CAP_XFER_OP_REQUEST 0x01
+#define HPI_L2CAP_XFER_OP_HEADER 0x81
+#define HPI_L2CAP_XFER_OP_TRAILER 0x82
+
+#define HPI_L2CAP_XFER_REQ_LEN 8
+#define HPI_L2CAP_XFER_HDR_LEN 10
+#define HPI_L2CAP_XFER_TRAILER_LEN 9
+
+// Give up on a transfer if the peer stops granting credits for this long
+#define HPI_L2CAP_XFER_TX_TIMEOUT K_SECONDS(5)
+
+struct l2cap_xfer_req {
+	uint16_t session_id;
+	uint8_t file_no;
+	uint32_t offset;
+};
+
+NET_BUF_POOL_FIXED_DEFINE(l2cap_xfer_tx_pool, HPI_L2CAP_XFER_TX_BUFS,
+			  BT_L2CAP_SDU_BUF_SIZE(HPI_L2CAP_XFER_MTU),
+			  CONFIG_BT_CONN_TX_USER_DATA_SIZE, NULL);
+
+K_MSGQ_DEFINE(q_l2cap_xfer_req, sizeof(struct l2cap_xfer_req), 2, 4);
+
+static struct bt_l2cap_le_chan xfer_chan;
+static bool xfer_chan_connected;
+/* Requests queued or being sent */
+static atomic_t xfer_pending;
+static uint8_t xfer_file_buf[HPI_L2CAP_XFER_MTU];
+
+static int xfer_send(const uint8_t *data, uint16_t len)
+{
+	struct net_buf *buf;
+	int err;
+
+	if (!xfer_chan_connected) {
+		return -ENOTCONN;
+	}
+
+	// The pool bounds how many SDUs are queued in the stack; a buffer only
+	// comes back once the peer has given credits for the SDU using it
+	buf = net_buf_alloc(&l2cap_xfer_tx_pool, HPI_L2CAP_XFER_TX_TIMEOUT);
+	if (buf == NULL) {
+		return -ETIMEDOUT;
+	}
+
+	net_buf_reserve(buf, BT_L2CAP_SDU_CHAN_SEND_RESERVE);
+	net_buf_add_mem(buf, data, len);
+
+	err = bt_l2cap_chan_send(&xfer_chan.chan, buf);
+	if (err < 0) {
+		net_buf_unref(buf);
+		return err;
+	}
+
+	return 0;
+}
+
+static int xfer_send_header(uint8_t status, uint32_t size, uint32_t offset)
+{
+	uint8_t hdr[HPI_L2CAP_XFER_HDR_LEN];
+
+	hdr[0] = HPI_L2CAP_XFER_OP_HEADER;
+	hdr[1] = status;
+	sys_put_le32(size, &hdr[2]);
+	sys_put_le32(offset, &hdr[6]);
+
+	return xfer_send(hdr, sizeof(hdr));
+}
+
+static void xfer_run(const struct l2cap_xfer_req *req)
+{
+	char path[32];
+	struct fs_dirent entry;
+	struct fs_file_t file;
+	uint8_t trailer[HPI_L2CAP_XFER_TRAILER_LEN];
+	uint32_t size;
+	uint32_t crc = 0;
+	uint32_t sent = 0;
+	uint32_t pos = 0;
+	uint16_t sdu_len;
+	int64_t start = k_uptime_get();
+	int rc;
+
+	hpi_datalog_session_path(req->session_id, req->file_no, path, sizeof(path));
+
+	rc = fs_stat(path, &entry);
+
+	/* A session still recording is preallocated past its data */
+	size = hpi_log_session_get_length(req->session_id, req->file_no);
+	if (rc == 0 && (size == 0 || size > entry.size)) {
+		size = entry.size;
+	}
+
+	if (rc < 0 || req->offset > size) {
+		LOG_WRN("L2CAP fetch %s rejected (%d)", path, rc);
+		xfer_send_header((rc < 0) ? (uint8_t)-rc : EINVAL, 0, 0);
+		return;
+	}
+
+	fs_file_t_init(&file);
+	rc = fs_open(&file, path, FS_O_READ);
+	if (rc < 0) {
+		xfer_send_header((uint8_t)-rc, 0, 0);
+		return;
+	}
+
+	rc = xfer_send_header(0, size, req->offset);
+	if (rc < 0) {
+		goto out;
+	}
+
+	// SDUs no larger than the peer can reassemble
+	sdu_len = MIN(xfer_chan.tx.mtu, sizeof(xfer_file_buf));
+
+	while (pos < size) {
+		ssize_t n = fs_read(&file, xfer_file_buf, MIN(sdu_len, size - pos));
+
+		if (n <= 0) {
+			rc = (n < 0) ? (int)n : -EIO;
+			break;
+		}
+
+		crc = crc32_ieee_update(crc, xfer_file_buf, n);
+
+		// The resumed-from prefix only feeds the checksum
+		if (pos + n > req->offset) {
+			uint32_t skip = (pos < req->offset) ? (req->offset - pos) : 0;
+
+			rc = xfer_send(&xfer_file_buf[skip], n - skip);
+			if (rc < 0) {
+				break;
+			}
+			sent += n - skip;
+		}
+
+		pos += n;
+	}
+
+	if (rc < 0) {
+		LOG_WRN("L2CAP fetch %s aborted at %u (%d)", path, pos, rc);
+		goto out;
+	}
+
+	trailer[0] = HPI_L2CAP_XFER_OP_TRAILER;
+	sys_put_le32(sent, &trailer[1]);
+	sys_put_le32(crc, &trailer[5]);
+	xfer_send(trailer, sizeof(trailer));
+
+	LOG_INF("L2CAP fetch %s: %u bytes in %lld ms", path, sent, k_uptime_get() - start);
+
+out:
+	fs_close(&file);
+}
+
+static void xfer_connected(struct bt_l2cap_chan *chan)
+{
+	ARG_UNUSED(chan);
+
+	xfer_chan_connected = true;
+	LOG_INF("L2CAP transfer channel connected (tx mtu %u)", xfer_chan.tx.mtu);
+}
+
+static void xfer_disconnected(struct bt_l2cap_chan *chan)
+{
+	ARG_UNUSED(chan);
+
+	xfer_chan_connected = false;
+	LOG_INF("L2CAP transfer channel disconnected");
+}
+
+static int xfer_recv(struct bt_l2cap_chan *chan, struct net_buf *buf)
+{
+	struct l2cap_xfer_req req;
+
+	ARG_UNUSED(chan);
+
+	if (buf->len < HPI_L2CAP_XFER_REQ_LEN || buf->data[0] != HPI_L2CAP_XFER_OP_REQUEST) {
+		LOG_WRN("Malformed L2CAP transfer request (%u bytes)", buf->len);
+		return 0;
+	}
+
+	req.session_id = sys_get_le16(&buf->data[1]);
+	req.file_no = buf->data[3];
+	req.offset = sys_get_le32(&buf->data[4]);
+
+	atomic_inc(&xfer_pending);
+	if (k_msgq_put(&q_l2cap_xfer_req, &req, K_NO_WAIT) != 0) {
+		atomic_dec(&xfer_pending);
+		LOG_WRN("L2CAP transfer busy, request dropped");
+	}
+
+	return 0;
+}
+
+static const struct bt_l2cap_chan_ops xfer_chan_ops = {
+	.connected = xfer_connected,
+	.disconnected = xfer_disconnected,
+	.recv = xfer_recv,
+};
+
+static int xfer_accept(struct bt_conn *conn, struct bt_l2cap_server *server,
+		       struct bt_l2cap_chan **chan)
+{
+	ARG_UNUSED(conn);
+	ARG_UNUSED(server);
+
+	if (xfer_chan.chan.conn != NULL) {
+		return -ENOMEM;
+	}
+
+	memset(&xfer_chan, 0, sizeof(xfer_chan));
+	xfer_chan.chan.ops = &xfer_chan_ops;
+	xfer_chan.rx.mtu = HPI_L2CAP_XFER_MTU;
+	*chan = &xfer_chan.chan;
+
+	return 0;
+}
+
+static struct bt_l2cap_server xfer_server = {
+	.psm = HPI_L2CAP_XFER_PSM,
+	.sec_level = BT_SECURITY_L1,
+	.accept = xfer_accept,
+};
+
+int ble_l2cap_xfer_init(void)
+{
+	int err = bt_l2cap_server_register(&xfer_server);
+
+	if (err) {
+		LOG_ERR("L2CAP server register failed (err %d)", err);
+		return err;
+	}
+
+	LOG_INF("L2CAP transfer server on PSM 0x%04x", HPI_L2CAP_XFER_PSM);
+	return 0;
+}
+
+bool ble_l2cap_xfer_busy(void)
+{
+	return atomic_get(&xfer_pending) != 0;
+}
+
+static void l2cap_xfer_thread(void)
+{
+	struct l2cap_xfer_req req;
+
+	for (;;) {
+		k_msgq_get(&q_l2cap_xfer_req, &req, K_FOREVER);
+		LOG_INF("L2CAP fetch session %u file %u from %u", req.session_id, req.file_no, req.offset);
+		xfer_run(&req);
+		atomic_dec(&xfer_pending);
+	}
+}
+
+#define L2CAP_XFER_THREAD_STACKSIZE 2048
+#define L2CAP_XFER_THREAD_PRIORITY 8
+
+K_THREAD_DEFINE(l2cap_xfer_thread_id, L2CAP_XFER_THREAD_STACKSIZE, l2cap_xfer_thread, NULL, NULL, NULL,
+		L2CAP_XFER_THREAD_PRIORITY, 0, 0);
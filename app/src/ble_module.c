@@ -34,10 +34,13 @@
 #include <zephyr/bluetooth/services/bas.h>
 #include <zephyr/bluetooth/services/hrs.h>
 #include <zephyr/sys/ring_buffer.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/atomic.h>
 #include <zephyr/zbus/zbus.h>
 
 #include <zephyr/settings/settings.h>
 
+#include "ble_module.h"
 #include "cmd_module.h"
 #include "hpi_common_types.h"
 
@@ -70,6 +73,9 @@ LOG_MODULE_REGISTER(ble_module, LOG_LEVEL_DBG);
 // RESP Characteristic babe4a4c-7789-11ed-a1eb-0242ac120002
 #define UUID_HPI_RESP_CHAR BT_UUID_DECLARE_128(BT_UUID_128_ENCODE(0xbabe4a4c, 0x7789, 0x11ed, 0xa1eb, 0x0242ac120002))
 
+// Aggregated stream Characteristic babe4a4d-7789-11ed-a1eb-0242ac120002
+#define UUID_HPI_STREAM_CHAR BT_UUID_DECLARE_128(BT_UUID_128_ENCODE(0xbabe4a4d, 0x7789, 0x11ed, 0xa1eb, 0x0242ac120002))
+
 // PPG Service cd5c7491-4448-7db8-ae4c-d1da8cba36d0
 #define UUID_HPI_PPG_SERV BT_UUID_DECLARE_128(BT_UUID_128_ENCODE(0xcd5c7491, 0x4448, 0x7db8, 0xae4c, 0xd1da8cba36d0))
 
@@ -103,6 +109,83 @@ extern struct k_msgq q_cmd_msg;
 K_SEM_DEFINE(sem_ble_connected, 0, 1);
 K_SEM_DEFINE(sem_ble_disconnected, 0, 1);
 
+/*
+ * Aggregated stream frame, little endian:
+ *   [0..1] sequence number (per frame, wraps)
+ *   [2]    ECG sample count    [3] BioZ sample count
+ *   [4]    PPG sample count    [5] decimation level (log2 of rate divider)
+ *   then ECG, BioZ and PPG samples as int24, one channel after another.
+ * ECG is the 18-bit MAX30001 code.
+ * Frames are filled up to the negotiated ATT payload (MTU - 3).
+ */
+#define HPI_BLE_STREAM_HDR_LEN 6
+#define HPI_BLE_STREAM_MAX_PAYLOAD (CONFIG_BT_L2CAP_TX_MTU - 3)
+#define HPI_BLE_STREAM_MIN_PAYLOAD (BT_ATT_DEFAULT_LE_MTU - 3)
+#define HPI_BLE_STREAM_MAX_SAMPLES ((HPI_BLE_STREAM_MAX_PAYLOAD - HPI_BLE_STREAM_HDR_LEN) / 3)
+
+static bool stream_subscribed;
+static atomic_t stream_max_payload = ATOMIC_INIT(HPI_BLE_STREAM_MIN_PAYLOAD);
+// Set from BT callbacks, consumed by data_thread before the next sample
+static atomic_t stream_reset_req = ATOMIC_INIT(0);
+
+// Staging for the frame being built; only touched by data_thread
+static int32_t stream_ecg[HPI_BLE_STREAM_MAX_SAMPLES];
+static int32_t stream_bioz[HPI_BLE_STREAM_MAX_SAMPLES];
+static int32_t stream_ppg[HPI_BLE_STREAM_MAX_SAMPLES];
+static uint8_t stream_n_ecg;
+static uint8_t stream_n_bioz;
+static uint8_t stream_n_ppg;
+static uint16_t stream_seq;
+
+/*
+ * Adaptive decimation for the aggregated stream.
+ *
+ * Each channel runs through a cascade of half-band stages, a 7-tap
+ * [-1 0 9 16 9 0 -1]/32 low-pass followed by 2:1 decimation; flatter in
+ * the passband and steeper above it than a [1 2 1]/4, so less of what
+ * lies past the new Nyquist aliases back. Level n takes the output of stage
+ * n, so level 0..3 gives the full rate, 1/2, 1/4 or 1/8. All stages keep
+ * running regardless of the current level so their state is warm when
+ * the level changes. The level is carried in every frame header.
+ *
+ * Once a second the link is checked: new drops or a half-full TX pool step
+ * the level up; HPI_BLE_DECIM_RECOVER_S clean seconds step it back down.
+ * The connection interval sets a floor so the stream never asks for more
+ * than about half of what the current interval can carry.
+ */
+#define HPI_BLE_DECIM_MAX_LEVEL 3
+#define HPI_BLE_DECIM_AUTO 0xFF
+#define HPI_BLE_DECIM_EVAL_MS 1000
+#define HPI_BLE_DECIM_RECOVER_S 5
+#define HPI_BLE_STREAM_SAMPLE_RATE 128
+
+#define HB_STAGE_HIST 6
+
+struct hb_stage {
+	int32_t x[HB_STAGE_HIST];	/* x[k] is the input k + 1 samples back */
+	bool odd;
+};
+
+struct hb_chain {
+	struct hb_stage stage[HPI_BLE_DECIM_MAX_LEVEL];
+};
+
+static struct hb_chain decim_ecg;
+static struct hb_chain decim_bioz;
+static struct hb_chain decim_ppg;
+static uint8_t stream_level;
+static uint8_t stream_level_setting = HPI_BLE_DECIM_AUTO;
+static int64_t decim_last_eval;
+static uint32_t decim_last_dropped;
+static uint8_t decim_clean_secs;
+
+// Connection interval in 1.25 ms units, updated from the BT callbacks
+static atomic_t conn_interval = ATOMIC_INIT(0);
+static uint8_t stream_frame[HPI_BLE_STREAM_MAX_PAYLOAD];
+
+static void ble_link_tune_work_handler(struct k_work *work);
+K_WORK_DEFINE(ble_link_tune_work, ble_link_tune_work_handler);
+
 static void spo2_on_cccd_changed(const struct bt_gatt_attr *attr, uint16_t value)
 {
 }
@@ -155,6 +238,17 @@ static void cmd_on_cccd_changed(const struct bt_gatt_attr *attr, uint16_t value)
 	}
 }
 
+static void stream_on_cccd_changed(const struct bt_gatt_attr *attr, uint16_t value)
+{
+	ARG_UNUSED(attr);
+
+	stream_subscribed = (value == BT_GATT_CCC_NOTIFY);
+	if (stream_subscribed) {
+		atomic_set(&stream_reset_req, 1);
+	}
+	LOG_DBG("Stream CCCD %s", stream_subscribed ? "subscribed" : "unsubscribed");
+}
+
 static ssize_t on_receive_cmd(struct bt_conn *conn, const struct bt_gatt_attr *attr, const void *buf, uint16_t len, uint16_t offset, uint8_t flags)
 {
 	const uint8_t *buffer = buf;
@@ -169,11 +263,23 @@ static ssize_t on_receive_cmd(struct bt_conn *conn, const struct bt_gatt_attr *a
 	printk("\n");*/
 
 	struct hpi_cmd_data_obj_t cmd_data_obj;
+
+	/* A write is one unframed command; never copy past the queue entry */
+	if (offset != 0 || len == 0 || len > sizeof(cmd_data_obj.data)) {
+		LOG_WRN("Dropping BLE cmd, len %d offset %d", len, offset);
+		return BT_GATT_ERR(BT_ATT_ERR_INVALID_ATTRIBUTE_LEN);
+	}
+
+	cmd_data_obj.src = HPI_CMD_SRC_BLE;
 	cmd_data_obj.pkt_type = 0x00;
 	cmd_data_obj.data_len = (uint8_t)len;
 	memcpy(cmd_data_obj.data, buffer, len);
 
-	k_msgq_put(&q_cmd_msg, &cmd_data_obj, K_MSEC(100));
+	/* Runs in the BT RX thread, which must not wait on cmd_thread */
+	if (k_msgq_put(&q_cmd_msg, &cmd_data_obj, K_NO_WAIT) != 0) {
+		LOG_WRN("Command queue full, BLE command dropped");
+		return BT_GATT_ERR(BT_ATT_ERR_INSUFFICIENT_RESOURCES);
+	}
 
 	return len;
 }
@@ -218,6 +324,12 @@ BT_GATT_SERVICE_DEFINE(hpi_ecg_resp_service,
 											  BT_GATT_PERM_READ,
 											  NULL, NULL, NULL),
 					   BT_GATT_CCC(ecg_resp_on_cccd_changed,
+								   BT_GATT_PERM_READ | BT_GATT_PERM_WRITE),
+					   BT_GATT_CHARACTERISTIC(UUID_HPI_STREAM_CHAR,
+											  BT_GATT_CHRC_NOTIFY,
+											  BT_GATT_PERM_NONE,
+											  NULL, NULL, NULL),
+					   BT_GATT_CCC(stream_on_cccd_changed,
 								   BT_GATT_PERM_READ | BT_GATT_PERM_WRITE), );
 
 BT_GATT_SERVICE_DEFINE(hpi_ppg_resp_service,
@@ -248,6 +360,139 @@ BT_GATT_SERVICE_DEFINE(hpi_cmd_service,
 					   BT_GATT_CCC(cmd_on_cccd_changed,
 								   BT_GATT_PERM_READ | BT_GATT_PERM_WRITE), );
 
+/*
+ * Waveform notification scheduler.
+ *
+ * Producers (data_thread) copy each notification into a slot from a fixed
+ * pool and queue it; they never call into the GATT layer themselves. A work
+ * item drains the queue with bt_gatt_notify_cb(), keeping up to
+ * HPI_BLE_TX_INFLIGHT_TARGET notifications outstanding in the stack, and
+ * the completion callback pulls the next one in. When the pool is empty the
+ * new notification is dropped and counted, so a slow link costs whole
+ * packets at a known rate instead of blocking the data thread.
+ */
+#define HPI_BLE_TX_POOL_SIZE 12
+#define HPI_BLE_TX_INFLIGHT_TARGET 4
+
+struct ble_tx_pkt {
+	void *fifo_reserved;
+	const struct bt_gatt_attr *attr;
+	uint16_t len;
+	uint8_t data[HPI_BLE_STREAM_MAX_PAYLOAD];
+};
+
+K_MEM_SLAB_DEFINE_STATIC(ble_tx_slab, sizeof(struct ble_tx_pkt), HPI_BLE_TX_POOL_SIZE, 4);
+static K_FIFO_DEFINE(ble_tx_fifo);
+
+static atomic_t ble_tx_in_flight = ATOMIC_INIT(0);
+static atomic_t ble_tx_queued = ATOMIC_INIT(0);
+static atomic_t ble_tx_sent = ATOMIC_INIT(0);
+static atomic_t ble_tx_dropped = ATOMIC_INIT(0);
+
+// Head of the queue that the stack refused for lack of buffers; retried
+// first on the next completion. Only touched by the drain work item.
+static struct ble_tx_pkt *ble_tx_retry;
+
+static void ble_tx_work_handler(struct k_work *work);
+K_WORK_DEFINE(ble_tx_work, ble_tx_work_handler);
+
+static void ble_tx_complete(struct bt_conn *conn, void *user_data)
+{
+	ARG_UNUSED(conn);
+	ARG_UNUSED(user_data);
+
+	atomic_dec(&ble_tx_in_flight);
+	atomic_inc(&ble_tx_sent);
+	k_work_submit(&ble_tx_work);
+}
+
+static void ble_tx_free(struct ble_tx_pkt *pkt)
+{
+	atomic_dec(&ble_tx_queued);
+	k_mem_slab_free(&ble_tx_slab, pkt);
+}
+
+static void ble_tx_work_handler(struct k_work *work)
+{
+	struct bt_gatt_notify_params params = {0};
+	struct ble_tx_pkt *pkt;
+	int err;
+
+	ARG_UNUSED(work);
+
+	while (atomic_get(&ble_tx_in_flight) < HPI_BLE_TX_INFLIGHT_TARGET) {
+		pkt = ble_tx_retry;
+		ble_tx_retry = NULL;
+		if (pkt == NULL) {
+			pkt = k_fifo_get(&ble_tx_fifo, K_NO_WAIT);
+		}
+		if (pkt == NULL) {
+			return;
+		}
+
+		if (current_conn == NULL) {
+			ble_tx_free(pkt);
+			continue;
+		}
+
+		params.attr = pkt->attr;
+		params.data = pkt->data;
+		params.len = pkt->len;
+		params.func = ble_tx_complete;
+
+		atomic_inc(&ble_tx_in_flight);
+		err = bt_gatt_notify_cb(current_conn, &params);
+		if (err == -ENOMEM) {
+			// Stack buffers exhausted: hold on to it until a completion
+			atomic_dec(&ble_tx_in_flight);
+			ble_tx_retry = pkt;
+			return;
+		}
+
+		if (err) {
+			// Not subscribed, disconnected or too long for the MTU
+			atomic_dec(&ble_tx_in_flight);
+			atomic_inc(&ble_tx_dropped);
+		}
+
+		// The stack has copied the payload either way
+		ble_tx_free(pkt);
+	}
+}
+
+static int ble_tx_enqueue(const struct bt_gatt_attr *attr, const void *data, uint16_t len)
+{
+	struct ble_tx_pkt *pkt;
+
+	if (current_conn == NULL) {
+		return -ENOTCONN;
+	}
+
+	if (len > sizeof(pkt->data) ||
+	    k_mem_slab_alloc(&ble_tx_slab, (void **)&pkt, K_NO_WAIT) != 0) {
+		atomic_inc(&ble_tx_dropped);
+		return -ENOMEM;
+	}
+
+	pkt->attr = attr;
+	pkt->len = len;
+	memcpy(pkt->data, data, len);
+
+	atomic_inc(&ble_tx_queued);
+	k_fifo_put(&ble_tx_fifo, pkt);
+	k_work_submit(&ble_tx_work);
+
+	return 0;
+}
+
+void ble_tx_get_stats(struct hpi_ble_tx_stats *stats)
+{
+	stats->sent = (uint32_t)atomic_get(&ble_tx_sent);
+	stats->dropped = (uint32_t)atomic_get(&ble_tx_dropped);
+	stats->queued = (uint32_t)atomic_get(&ble_tx_queued);
+	stats->in_flight = (uint32_t)atomic_get(&ble_tx_in_flight);
+}
+
 void ble_spo2_notify(uint16_t spo2_val)
 {
 	spo2_att_ble[0] = 0x00;
@@ -304,14 +549,7 @@ void ble_ecg_notify(int32_t *ecg_data, uint8_t len)
 		out_data[i * 4 + 3] = (uint8_t)(ecg_data[i] >> 24);
 	}
 
-	// Check return value to prevent blocking data thread
-	// Returns -ENOMEM if BLE buffers full - drop packet instead of blocking
-	int ret = bt_gatt_notify(NULL, &hpi_ecg_resp_service.attrs[1], &out_data, len * 4);
-	
-	if (ret < 0 && ret != -ENOTCONN) {
-		// BLE stack busy - packet dropped (prevents data thread stall)
-		// Better to drop occasional packet than stall entire stream
-	}
+	ble_tx_enqueue(&hpi_ecg_resp_service.attrs[1], out_data, len * 4);
 }
 
 void ble_bioz_notify(int32_t *resp_data, uint8_t len)
@@ -326,13 +564,7 @@ void ble_bioz_notify(int32_t *resp_data, uint8_t len)
 		out_data[i * 4 + 3] = (uint8_t)(resp_data[i] >> 24);
 	}
 
-	// Check return value to prevent blocking data thread
-	// Returns -ENOMEM if BLE buffers full - drop packet instead of blocking
-	int ret = bt_gatt_notify(NULL, &hpi_ecg_resp_service.attrs[4], &out_data, len * 4);
-	
-	if (ret < 0 && ret != -ENOTCONN) {
-		// BLE stack busy - packet dropped (prevents data thread stall)
-	}
+	ble_tx_enqueue(&hpi_ecg_resp_service.attrs[4], out_data, len * 4);
 }
 
 void ble_ppg_notify(int16_t ppg_data)
@@ -342,7 +574,202 @@ void ble_ppg_notify(int16_t ppg_data)
 	out_data[0] = (uint8_t)(ppg_data);
 	out_data[1] = (uint8_t)(ppg_data >> 8);
 
-	bt_gatt_notify(NULL, &hpi_ppg_resp_service.attrs[1], &out_data, 2);
+	ble_tx_enqueue(&hpi_ppg_resp_service.attrs[1], out_data, 2);
+}
+
+bool ble_stream_enabled(void)
+{
+	return stream_subscribed;
+}
+
+static void ble_stream_flush(void)
+{
+	uint16_t pos = HPI_BLE_STREAM_HDR_LEN;
+
+	if (stream_n_ecg == 0 && stream_n_bioz == 0 && stream_n_ppg == 0) {
+		return;
+	}
+
+	sys_put_le16(stream_seq++, &stream_frame[0]);
+	stream_frame[2] = stream_n_ecg;
+	stream_frame[3] = stream_n_bioz;
+	stream_frame[4] = stream_n_ppg;
+	stream_frame[5] = stream_level;
+
+	for (int i = 0; i < stream_n_ecg; i++, pos += 3) {
+		sys_put_le24((uint32_t)stream_ecg[i], &stream_frame[pos]);
+	}
+	for (int i = 0; i < stream_n_bioz; i++, pos += 3) {
+		sys_put_le24((uint32_t)stream_bioz[i], &stream_frame[pos]);
+	}
+	for (int i = 0; i < stream_n_ppg; i++, pos += 3) {
+		sys_put_le24((uint32_t)stream_ppg[i], &stream_frame[pos]);
+	}
+
+	stream_n_ecg = 0;
+	stream_n_bioz = 0;
+	stream_n_ppg = 0;
+
+	ble_tx_enqueue(&hpi_ecg_resp_service.attrs[7], stream_frame, pos);
+}
+
+static bool hb_stage_push(struct hb_stage *st, int32_t in, int32_t *out)
+{
+	int32_t *x = st->x;
+	bool keep;
+
+	st->odd = !st->odd;
+
+	// Keep every second filtered sample, and only filter those
+	keep = !st->odd;
+	if (keep) {
+		*out = (16 * x[2] + 9 * (x[1] + x[3]) - (in + x[5])) / 32;
+	}
+
+	for (int k = HB_STAGE_HIST - 1; k > 0; k--) {
+		x[k] = x[k - 1];
+	}
+	x[0] = in;
+
+	return keep;
+}
+
+static bool hb_chain_push(struct hb_chain *chain, int32_t in, uint8_t level, int32_t *out)
+{
+	bool ready = (level == 0);
+	int32_t v = in;
+
+	*out = in;
+	for (int i = 0; i < HPI_BLE_DECIM_MAX_LEVEL; i++) {
+		if (!hb_stage_push(&chain->stage[i], v, &v)) {
+			break;
+		}
+		if (i + 1 == level) {
+			*out = v;
+			ready = true;
+		}
+	}
+
+	return ready;
+}
+
+// Lowest level the connection interval can sustain with 2x headroom
+static uint8_t ble_stream_min_level(void)
+{
+	uint32_t interval_us = (uint32_t)atomic_get(&conn_interval) * 1250U;
+	uint32_t payload = (uint32_t)atomic_get(&stream_max_payload);
+	uint32_t capacity, need;
+
+	if (interval_us == 0) {
+		return 0;
+	}
+
+	// Bytes/s: HPI_BLE_TX_INFLIGHT_TARGET full notifications per event
+	capacity = (uint32_t)(((uint64_t)HPI_BLE_TX_INFLIGHT_TARGET * payload * 1000000U) / interval_us);
+
+	for (uint8_t level = 0; level < HPI_BLE_DECIM_MAX_LEVEL; level++) {
+		// int24 ECG + PPG every sample, BioZ every other one, plus headers
+		uint32_t rate = HPI_BLE_STREAM_SAMPLE_RATE >> level;
+		uint32_t data = rate * 3 * 2 + (rate / 2) * 3;
+
+		need = data + (data / (payload - HPI_BLE_STREAM_HDR_LEN) + 1) * HPI_BLE_STREAM_HDR_LEN;
+		if (need * 2 <= capacity) {
+			return level;
+		}
+	}
+
+	return HPI_BLE_DECIM_MAX_LEVEL;
+}
+
+static void ble_stream_adapt(void)
+{
+	int64_t now = k_uptime_get();
+	uint32_t dropped, queued;
+	uint8_t level = stream_level;
+	uint8_t min_level;
+
+	if (now - decim_last_eval < HPI_BLE_DECIM_EVAL_MS) {
+		return;
+	}
+	decim_last_eval = now;
+
+	if (stream_level_setting != HPI_BLE_DECIM_AUTO) {
+		level = stream_level_setting;
+	} else {
+		dropped = (uint32_t)atomic_get(&ble_tx_dropped);
+		queued = (uint32_t)atomic_get(&ble_tx_queued);
+		min_level = ble_stream_min_level();
+
+		if (dropped != decim_last_dropped || queued > HPI_BLE_TX_POOL_SIZE / 2) {
+			if (level < HPI_BLE_DECIM_MAX_LEVEL) {
+				level++;
+			}
+			decim_clean_secs = 0;
+		} else if (++decim_clean_secs >= HPI_BLE_DECIM_RECOVER_S) {
+			if (level > 0) {
+				level--;
+			}
+			decim_clean_secs = 0;
+		}
+
+		level = MAX(level, min_level);
+		decim_last_dropped = dropped;
+	}
+
+	if (level != stream_level) {
+		// A frame only ever holds samples at one rate
+		ble_stream_flush();
+		LOG_INF("BLE stream decimation level %u -> %u", stream_level, level);
+		stream_level = level;
+	}
+}
+
+void ble_stream_set_decimation(uint8_t level)
+{
+	stream_level_setting = (level > HPI_BLE_DECIM_MAX_LEVEL) ? HPI_BLE_DECIM_AUTO : level;
+}
+
+void ble_stream_add_sample(int32_t ecg_sample, int32_t bioz_sample, int32_t ppg_sample, bool bioz_valid)
+{
+	size_t max_payload;
+	size_t needed;
+	bool have_ecg, have_bioz = false, have_ppg;
+
+	if (atomic_cas(&stream_reset_req, 1, 0)) {
+		stream_n_ecg = 0;
+		stream_n_bioz = 0;
+		stream_n_ppg = 0;
+		stream_seq = 0;
+		stream_level = 0;
+		decim_clean_secs = 0;
+		decim_last_dropped = (uint32_t)atomic_get(&ble_tx_dropped);
+	}
+
+	ble_stream_adapt();
+
+	have_ecg = hb_chain_push(&decim_ecg, ecg_sample, stream_level, &ecg_sample);
+	if (bioz_valid) {
+		have_bioz = hb_chain_push(&decim_bioz, bioz_sample, stream_level, &bioz_sample);
+	}
+	have_ppg = hb_chain_push(&decim_ppg, ppg_sample, stream_level, &ppg_sample);
+
+	max_payload = (size_t)atomic_get(&stream_max_payload);
+	needed = HPI_BLE_STREAM_HDR_LEN +
+			3 * (stream_n_ecg + have_ecg + stream_n_bioz + have_bioz + stream_n_ppg + have_ppg);
+
+	if (needed > max_payload) {
+		ble_stream_flush();
+	}
+
+	if (have_ecg) {
+		stream_ecg[stream_n_ecg++] = ecg_sample;
+	}
+	if (have_bioz) {
+		stream_bioz[stream_n_bioz++] = bioz_sample;
+	}
+	if (have_ppg) {
+		stream_ppg[stream_n_ppg++] = ppg_sample;
+	}
 }
 
 void ble_temp_notify(int16_t temp_val)
@@ -367,6 +794,92 @@ void ble_bas_notify(uint8_t batt_level)
 	bt_bas_set_battery_level(batt_level);
 }
 
+static void mtu_exchange_cb(struct bt_conn *conn, uint8_t err,
+			    struct bt_gatt_exchange_params *params)
+{
+	ARG_UNUSED(params);
+
+	if (err) {
+		LOG_WRN("MTU exchange failed (err %u)", err);
+		return;
+	}
+
+	LOG_INF("MTU exchanged: %u", bt_gatt_get_mtu(conn));
+}
+
+static struct bt_gatt_exchange_params mtu_exchange_params = {
+	.func = mtu_exchange_cb,
+};
+
+/* Ask for the fastest link the central will give us. These issue HCI
+ * commands and wait for their status, so they run from the system
+ * workqueue rather than the connected callback. Each request is optional:
+ * a central that refuses simply leaves that parameter as it was.
+ */
+static void ble_link_tune_work_handler(struct k_work *work)
+{
+	struct bt_conn *conn = current_conn;
+	int err;
+
+	ARG_UNUSED(work);
+
+	if (conn == NULL) {
+		return;
+	}
+
+	err = bt_gatt_exchange_mtu(conn, &mtu_exchange_params);
+	if (err && err != -EALREADY) {
+		LOG_WRN("MTU exchange request failed (err %d)", err);
+	}
+
+	err = bt_conn_le_data_len_update(conn, BT_LE_DATA_LEN_PARAM_MAX);
+	if (err) {
+		LOG_WRN("Data length update failed (err %d)", err);
+	}
+
+	err = bt_conn_le_phy_update(conn, BT_CONN_LE_PHY_PARAM_2M);
+	if (err) {
+		LOG_WRN("2M PHY request failed (err %d)", err);
+	}
+}
+
+static void att_mtu_updated(struct bt_conn *conn, uint16_t tx, uint16_t rx)
+{
+	ARG_UNUSED(conn);
+
+	atomic_set(&stream_max_payload,
+		   CLAMP(MIN(tx, rx) - 3, HPI_BLE_STREAM_MIN_PAYLOAD, HPI_BLE_STREAM_MAX_PAYLOAD));
+	LOG_DBG("ATT MTU updated: tx %u rx %u", tx, rx);
+}
+
+static struct bt_gatt_cb gatt_callbacks = {
+	.att_mtu_updated = att_mtu_updated,
+};
+
+static void le_phy_updated(struct bt_conn *conn, struct bt_conn_le_phy_info *param)
+{
+	ARG_UNUSED(conn);
+
+	LOG_INF("PHY updated: tx %u rx %u", param->tx_phy, param->rx_phy);
+}
+
+static void le_data_len_updated(struct bt_conn *conn, struct bt_conn_le_data_len_info *info)
+{
+	ARG_UNUSED(conn);
+
+	LOG_INF("Data length updated: tx %u/%u us, rx %u/%u us",
+		info->tx_max_len, info->tx_max_time, info->rx_max_len, info->rx_max_time);
+}
+
+static void le_param_updated(struct bt_conn *conn, uint16_t interval,
+			     uint16_t latency, uint16_t timeout)
+{
+	ARG_UNUSED(conn);
+
+	atomic_set(&conn_interval, interval);
+	LOG_DBG("Conn params updated: interval %u latency %u timeout %u", interval, latency, timeout);
+}
+
 static void connected(struct bt_conn *conn, uint8_t err)
 {
 	if (err)
@@ -377,6 +890,16 @@ static void connected(struct bt_conn *conn, uint8_t err)
 	{
 		LOG_DBG("BLE Connected");
 		current_conn = bt_conn_ref(conn);
+		atomic_set(&stream_max_payload, HPI_BLE_STREAM_MIN_PAYLOAD);
+		atomic_set(&stream_reset_req, 1);
+		atomic_set(&ble_tx_in_flight, 0);
+
+		struct bt_conn_info info;
+		if (bt_conn_get_info(conn, &info) == 0) {
+			atomic_set(&conn_interval, info.le.interval);
+		}
+
+		k_work_submit(&ble_link_tune_work);
 		k_sem_give(&sem_ble_connected);
 		//show_state_ble_connected();
 	}
@@ -389,6 +912,9 @@ static void disconnected(struct bt_conn *conn, uint8_t reason)
 	{
 		bt_conn_unref(current_conn);
 		current_conn = NULL;
+		stream_subscribed = false;
+		// Let the scheduler discard whatever is still queued
+		k_work_submit(&ble_tx_work);
 		k_sem_give(&sem_ble_disconnected);
 	}
 }
@@ -414,6 +940,9 @@ static void disconnected(struct bt_conn *conn, uint8_t reason)
 BT_CONN_CB_DEFINE(conn_callbacks) = {
 	.connected = connected,
 	.disconnected = disconnected,
+	.le_param_updated = le_param_updated,
+	.le_phy_updated = le_phy_updated,
+	.le_data_len_updated = le_data_len_updated,
 	//.security_changed = security_changed,
 };
 
@@ -428,6 +957,8 @@ static void bt_ready(int init_err)
 
 	LOG_INF("Bluetooth initialized");
 
+	ble_l2cap_xfer_init();
+
 	if (IS_ENABLED(CONFIG_SETTINGS))
 	{
 		// settings_load();
@@ -504,6 +1035,8 @@ void ble_module_init()
 {
 	int err = 0;
 
+	bt_gatt_cb_register(&gatt_callbacks);
+
 	err = bt_enable(bt_ready);
 	if (err)
 	{
@@ -25,6 +25,9 @@
 
 #pragma once
 
+#include <stdbool.h>
+#include <stdint.h>
+
 void ble_module_init();
 
 void ble_bas_notify(uint8_t batt_level);
@@ -39,5 +42,28 @@ void ble_bioz_notify_single(int32_t resp_data);
 void ble_ecg_notify(int32_t *ecg_data, uint8_t len);
 void ble_bioz_notify(int32_t *resp_data, uint8_t len);
 
+struct hpi_ble_tx_stats
+{
+    uint32_t sent;      // Notifications completed by the stack
+    uint32_t dropped;   // Lost to a full TX pool or rejected by the stack
+    uint32_t queued;    // Waiting in the TX pool right now
+    uint32_t in_flight; // Handed to the stack, not yet completed
+};
+
+void ble_tx_get_stats(struct hpi_ble_tx_stats *stats);
+
+// Aggregated stream characteristic: ECG, BioZ and PPG packed as int24 into
+// MTU-sized notifications. Only active while a client is subscribed.
+bool ble_stream_enabled(void);
+void ble_stream_add_sample(int32_t ecg_sample, int32_t bioz_sample, int32_t ppg_sample, bool bioz_valid);
+// Pin the stream to a decimation level (0..3 = 1/1..1/8 rate), or pass any
+// larger value to let it adapt to link congestion (the default)
+void ble_stream_set_decimation(uint8_t level);
+
 void healthypi5_service_send_data(const uint8_t *data, uint16_t len);
 
+// Session download server on an LE L2CAP CoC (ble_l2cap_xfer.c)
+int ble_l2cap_xfer_init(void);
+// A download is queued or being sent
+bool ble_l2cap_xfer_busy(void);
+
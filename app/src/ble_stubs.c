@@ -32,6 +32,7 @@
 
 #include <zephyr/kernel.h>
 #include <stdint.h>
+#include <string.h>
 
 #include "ble_module.h"
 
@@ -52,6 +53,23 @@ void ble_ecg_notify_single(int32_t ecg_data) { (void)ecg_data; }
 void ble_bioz_notify_single(int32_t resp_data) { (void)resp_data; }
 void ble_ecg_notify(int32_t *ecg_data, uint8_t len) { (void)ecg_data; (void)len; }
 void ble_bioz_notify(int32_t *resp_data, uint8_t len) { (void)resp_data; (void)len; }
+void ble_ppg_notify(int16_t ppg_data) { (void)ppg_data; }
+
+/* Aggregated stream: never subscribed when BLE is disabled */
+bool ble_stream_enabled(void) { return false; }
+void ble_stream_add_sample(int32_t ecg_sample, int32_t bioz_sample, int32_t ppg_sample, bool bioz_valid)
+{
+    (void)ecg_sample;
+    (void)bioz_sample;
+    (void)ppg_sample;
+    (void)bioz_valid;
+}
+void ble_stream_set_decimation(uint8_t level) { (void)level; }
+
+void ble_tx_get_stats(struct hpi_ble_tx_stats *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+}
 
 /* Command service data sender: no-op */
 void healthypi5_service_send_data(const uint8_t *data, uint16_t len)
@@ -33,9 +33,11 @@
 #include <stdio.h>
 #include <string.h>
 #include <zephyr/random/random.h>
+#include <zephyr/sys/byteorder.h>
 
 #include "fs_module.h"
 #include "cmd_module.h"
+#include "hpi_cmd_frame.h"
 
 #include "ble_module.h"
 #include "data_module.h"
@@ -43,13 +45,18 @@
 #include "hpi_common_types.h"
 
 #include "datalog_module.h"
+#include "usb_flow_ctrl.h"
+#include "log_ring.h"
+#include "log_event.h"
+#ifdef CONFIG_HEALTHYPI_USB_MSC_ENABLED
+#include "usbd_msc_disk.h"
+#endif
 
 // #include "tdcs3.h"
 
 LOG_MODULE_REGISTER(cmd_module, LOG_LEVEL_DBG);
 
 // #define ESP_UART_DEVICE_NODE DT_ALIAS(esp_uart)
-#define MAX_MSG_SIZE 32
 
 #define FILE_TRANSFER_BLE_PACKET_SIZE 64 // (16*7)
 #define CMDIF_BLE_UART_MAX_PKT_SIZE 128  // Max Packet Size in bytes
@@ -57,12 +64,7 @@ LOG_MODULE_REGISTER(cmd_module, LOG_LEVEL_DBG);
 K_MSGQ_DEFINE(q_cmd_msg, sizeof(struct hpi_cmd_data_obj_t), 16, 1);
 
 // static const struct device *const esp_uart_dev = DEVICE_DT_GET(ESP_UART_DEVICE_NODE);
-static volatile int ecs_rx_state = 0;
 
-int cmd_pkt_len;
-int cmd_pkt_pos_counter, cmd_pkt_data_counter;
-int cmd_pkt_pkttype;
-uint8_t ces_pkt_data_buffer[1000]; // = new char[1000];
 volatile bool cmd_module_ble_connected = false;
 
 extern struct k_msgq q_sample;
@@ -71,148 +73,605 @@ extern bool sd_card_present;
 bool settings_log_data_enabled = false;
 int8_t data_pkt[272];
 
+// Transport of the command cmd_thread is decoding. Every cmdif_send_*
+// helper below routes its response through it, or through cmd_job.src on
+// the worker thread.
+static enum hpi_cmd_src m_cmd_reply_src = HPI_CMD_SRC_BLE;
 
-struct wiser_cmd_data_fifo_obj_t
-{
-    void *fifo_reserved; /* 1st word reserved for use by FIFO */
+#define CMD_USB_RSP_TIMEOUT_MS 500
+
+#define CMD_JOB_QUEUE_LEN 4
+#define CMD_PROGRESS_INTERVAL_MS 500
 
-    uint8_t pkt_type;
-    uint8_t data_len;
-    uint8_t data[MAX_MSG_SIZE];
+typedef void (*hpi_cmd_handler_t)(uint8_t *in_pkt_buf, uint8_t pkt_len);
+
+struct hpi_cmd_entry
+{
+    uint8_t cmd;
+    uint8_t min_len;    // Including the command byte; shorter packets get HPI_CMD_STATUS_INVALID_ARG
+    uint8_t flags;      // CMD_F_*
+    hpi_cmd_handler_t handler;
 };
 
-K_FIFO_DEFINE(cmd_data_fifo);
+K_MSGQ_DEFINE(q_cmd_job, sizeof(struct hpi_cmd_data_obj_t), CMD_JOB_QUEUE_LEN, 1);
 
-struct wiser_cmd_data_fifo_obj_t cmd_data_obj;
+// Command cmd_worker_thread is running
+static struct hpi_cmd_data_obj_t cmd_job;
+static const struct hpi_cmd_entry *cmd_job_entry;
+static k_tid_t cmd_worker_tid;
+// Worker commands queued or running
+static atomic_t cmd_jobs_pending;
+static atomic_t cmd_job_cancel;
 
-void ces_parse_packet(char rxch)
+// A frame from the USB parser; the data view is only good until the next
+// call on the parser
+static void cmd_usb_frame_received(const struct hpi_cmd_frame *frame)
 {
-    // printk("%0x\n", rxch);
+    struct hpi_cmd_data_obj_t cmd_data_obj;
 
-    switch (ecs_rx_state)
+    LOG_DBG("Packet Received len: %d, type: %d", frame->len, frame->pkt_type);
+
+    // Credit grants are transport-level and arrive continuously while
+    // streaming; apply them here instead of queueing them behind slow
+    // commands in cmd_thread
+    if (frame->len >= 5 && frame->data[0] == HPI_CMD_USB_FC_GRANT)
     {
-    case CMD_SM_STATE_INIT:
-        if (rxch == CES_CMDIF_PKT_START_1)
-            ecs_rx_state = CMD_SM_STATE_SOF1_FOUND;
-        break;
+        hpi_usb_fc_grant(sys_get_le32(&frame->data[1]));
+        return;
+    }
 
-    case CMD_SM_STATE_SOF1_FOUND:
-        if (rxch == CES_CMDIF_PKT_START_2)
-            ecs_rx_state = CMD_SM_STATE_SOF2_FOUND;
-        else
-            ecs_rx_state = CMD_SM_STATE_INIT; // Invalid Packet, reset state to init
-        break;
+    cmd_data_obj.src = HPI_CMD_SRC_USB;
+    cmd_data_obj.pkt_type = frame->pkt_type;
+    cmd_data_obj.data_len = frame->len;
+    memcpy(cmd_data_obj.data, frame->data, frame->len);
+
+    if (k_msgq_put(&q_cmd_msg, &cmd_data_obj, K_NO_WAIT) != 0)
+    {
+        LOG_WRN("Command queue full, USB command dropped");
+    }
+}
+
+static enum hpi_cmd_src cmdif_reply_src(void)
+{
+    return (k_current_get() == cmd_worker_tid) ? (enum hpi_cmd_src)cmd_job.src : m_cmd_reply_src;
+}
+
+bool cmdif_reply_is_usb(void)
+{
+    return cmdif_reply_src() == HPI_CMD_SRC_USB;
+}
+
+static void cmdif_send_usb_response(const uint8_t *m_data, uint16_t m_data_len)
+{
+    // One contiguous write so the response can't be split by a waveform
+    // packet from data_thread landing in the ring between header and payload
+    uint8_t usb_pkt[CES_CMDIF_PKT_OVERHEAD + sizeof(data_pkt) + 2];
+
+    if (m_data_len > sizeof(data_pkt))
+    {
+        return;
+    }
+
+    usb_pkt[0] = CES_CMDIF_PKT_START_1;
+    usb_pkt[1] = CES_CMDIF_PKT_START_2;
+    usb_pkt[2] = (uint8_t)(m_data_len & 0xFF);
+    usb_pkt[3] = (uint8_t)(m_data_len >> 8);
+    usb_pkt[4] = CES_CMDIF_TYPE_USB_RSP;
+    memcpy(&usb_pkt[CES_CMDIF_PKT_OVERHEAD], m_data, m_data_len);
+    usb_pkt[CES_CMDIF_PKT_OVERHEAD + m_data_len] = CES_CMDIF_PKT_STOP_1;
+    usb_pkt[CES_CMDIF_PKT_OVERHEAD + m_data_len + 1] = CES_CMDIF_PKT_STOP_2;
+
+    int rc = send_usb_cdc_wait((const char *)usb_pkt, CES_CMDIF_PKT_OVERHEAD + m_data_len + 2,
+                               K_MSEC(CMD_USB_RSP_TIMEOUT_MS));
+    if (rc < 0)
+    {
+        LOG_WRN("USB response dropped: %d", rc);
+    }
+}
+
+static void cmdif_send_response(const uint8_t *m_data, uint16_t m_data_len)
+{
+    enum hpi_cmd_src src = cmdif_reply_src();
+
+    if (src == HPI_CMD_SRC_USB)
+    {
+        cmdif_send_usb_response(m_data, m_data_len);
+    }
+    else if (src == HPI_CMD_SRC_BLE)
+    {
+        healthypi5_service_send_data(m_data, m_data_len);
+    }
+}
+
+static void cmd_get_device_status(uint8_t *in_pkt_buf, uint8_t pkt_len)
+{
+    LOG_DBG("Recd Get Device Status Command");
+    // cmdif_send_ble_device_status_response();
+}
+
+static void cmd_set_stream_mode(uint8_t *in_pkt_buf, uint8_t pkt_len)
+{
+    LOG_DBG("Command to set stream mode: %d", in_pkt_buf[1]);
+    if (in_pkt_buf[1] > HPI_STREAM_MODE_PLOT)
+    {
+        cmdif_send_cmd_ack(in_pkt_buf[0], HPI_CMD_STATUS_INVALID_ARG);
+        return;
+    }
+    hpi_data_set_stream_mode((enum hpi_stream_modes)in_pkt_buf[1]);
+    cmdif_send_cmd_ack(in_pkt_buf[0], HPI_CMD_STATUS_OK);
+}
+
+static void cmd_set_data_format(uint8_t *in_pkt_buf, uint8_t pkt_len)
+{
+    LOG_DBG("Command to set data format: %d", in_pkt_buf[1]);
+    if (in_pkt_buf[1] > DATA_FMT_HPI5_COMPACT)
+    {
+        cmdif_send_cmd_ack(in_pkt_buf[0], HPI_CMD_STATUS_INVALID_ARG);
+        return;
+    }
+    hpi_data_set_stream_format((enum hpi5_data_format)in_pkt_buf[1]);
+    cmdif_send_cmd_ack(in_pkt_buf[0], HPI_CMD_STATUS_OK);
+}
+
+static void cmd_usb_fc_config(uint8_t *in_pkt_buf, uint8_t pkt_len)
+{
+    LOG_DBG("Command to configure USB flow control");
+    if (in_pkt_buf[2] > HPI_USB_FC_UNIT_PACKETS || in_pkt_buf[3] > HPI_USB_FC_POLICY_SPOOL_SD)
+    {
+        cmdif_send_cmd_ack(in_pkt_buf[0], HPI_CMD_STATUS_INVALID_ARG);
+        return;
+    }
+    hpi_usb_fc_configure(in_pkt_buf[1] != 0, (enum hpi_usb_fc_credit_unit)in_pkt_buf[2],
+                         (enum hpi_usb_fc_policy)in_pkt_buf[3]);
+    cmdif_send_cmd_ack(in_pkt_buf[0], HPI_CMD_STATUS_OK);
+}
+
+static void cmd_usb_fc_grant(uint8_t *in_pkt_buf, uint8_t pkt_len)
+{
+    // Normally consumed in the USB frame parser; BLE has its own flow
+    // control. Never acknowledged, so a short grant is dropped silently.
+    if (pkt_len >= 5)
+    {
+        hpi_usb_fc_grant(sys_get_le32(&in_pkt_buf[1]));
+    }
+}
+
+static void cmd_usb_fc_get_stats(uint8_t *in_pkt_buf, uint8_t pkt_len)
+{
+    struct hpi_usb_fc_stats fc_stats;
+    uint8_t stats_pkt[7 * 4];
+
+    hpi_usb_fc_get_stats(&fc_stats);
+    sys_put_le32(fc_stats.credits, &stats_pkt[0]);
+    sys_put_le32(fc_stats.sent, &stats_pkt[4]);
+    sys_put_le32(fc_stats.dropped_vitals, &stats_pkt[8]);
+    sys_put_le32(fc_stats.dropped_waveform, &stats_pkt[12]);
+    sys_put_le32(fc_stats.decimated, &stats_pkt[16]);
+    sys_put_le32(fc_stats.spooled, &stats_pkt[20]);
+    sys_put_le32(fc_stats.spool_dropped, &stats_pkt[24]);
+    cmdif_send_cmd_rsp_data(in_pkt_buf[0], stats_pkt, sizeof(stats_pkt));
+}
+
+static void cmd_usb_fc_spool_fetch(uint8_t *in_pkt_buf, uint8_t pkt_len)
+{
+    LOG_DBG("Command to fetch USB spool");
+    hpi_usb_fc_spool_fetch();
+}
+
+static void cmd_ble_tx_get_stats(uint8_t *in_pkt_buf, uint8_t pkt_len)
+{
+    struct hpi_ble_tx_stats tx_stats;
+    uint8_t stats_pkt[4 * 4];
+
+    ble_tx_get_stats(&tx_stats);
+    sys_put_le32(tx_stats.sent, &stats_pkt[0]);
+    sys_put_le32(tx_stats.dropped, &stats_pkt[4]);
+    sys_put_le32(tx_stats.queued, &stats_pkt[8]);
+    sys_put_le32(tx_stats.in_flight, &stats_pkt[12]);
+    cmdif_send_cmd_rsp_data(in_pkt_buf[0], stats_pkt, sizeof(stats_pkt));
+}
+
+static void cmd_ble_set_decimation(uint8_t *in_pkt_buf, uint8_t pkt_len)
+{
+    LOG_DBG("Command to set BLE stream decimation: %d", in_pkt_buf[1]);
+    ble_stream_set_decimation(in_pkt_buf[1]);
+    cmdif_send_cmd_ack(in_pkt_buf[0], HPI_CMD_STATUS_OK);
+}
+
+static uint8_t cmd_status_from_errno(int rc)
+{
+    switch (rc)
+    {
+    case -EINVAL:
+        return HPI_CMD_STATUS_INVALID_ARG;
+    case -ECANCELED:
+        return HPI_CMD_STATUS_CANCELLED;
+    default:
+        return HPI_CMD_STATUS_NOT_FOUND;
+    }
+}
+
+static void cmd_log_fetch_range(uint8_t *in_pkt_buf, uint8_t pkt_len)
+{
+    uint8_t rsp[9];
+    uint32_t bytes = 0;
+    int points;
+
+    LOG_DBG("Command to fetch log range");
+
+    // Samples arrive as data packets, then a summary:
+    // [0] status, [1..4] points, [5..8] bytes (LE)
+    points = hpi_session_fetch_range(sys_get_be16(&in_pkt_buf[1]), in_pkt_buf[3], sys_get_le32(&in_pkt_buf[4]),
+                                     sys_get_le32(&in_pkt_buf[8]), &bytes);
+    if (points < 0)
+    {
+        cmdif_send_cmd_ack(in_pkt_buf[0], cmd_status_from_errno(points));
+        return;
+    }
+
+    rsp[0] = HPI_CMD_STATUS_OK;
+    sys_put_le32((uint32_t)points, &rsp[1]);
+    sys_put_le32(bytes, &rsp[5]);
+    cmdif_send_cmd_rsp_data(in_pkt_buf[0], rsp, sizeof(rsp));
+}
+
+#ifdef CONFIG_HEALTHYPI_LOG_FLASH_RING
+static void cmd_log_ring_info(uint8_t *in_pkt_buf, uint8_t pkt_len)
+{
+    // [0] status, then first segment and segment count per ring (LE)
+    uint8_t rsp[1 + HPI_LOG_RING_COUNT * 8];
+    struct hpi_log_ring_info info;
+
+    LOG_DBG("Command to get flash ring info");
+    if (!hpi_log_ring_active())
+    {
+        cmdif_send_cmd_ack(in_pkt_buf[0], HPI_CMD_STATUS_NOT_FOUND);
+        return;
+    }
+
+    rsp[0] = HPI_CMD_STATUS_OK;
+    for (int i = 0; i < HPI_LOG_RING_COUNT; i++)
+    {
+        hpi_log_ring_get_info((enum hpi_log_ring_id)i, &info);
+        sys_put_le32(info.first, &rsp[1 + i * 8]);
+        sys_put_le32(info.count, &rsp[5 + i * 8]);
+    }
+    cmdif_send_cmd_rsp_data(in_pkt_buf[0], rsp, sizeof(rsp));
+}
+
+static void cmd_log_ring_fetch(uint8_t *in_pkt_buf, uint8_t pkt_len)
+{
+    int rc;
 
-    case CMD_SM_STATE_SOF2_FOUND:
+    LOG_DBG("Command to fetch flash ring segment");
 
-        ecs_rx_state = CMD_SM_STATE_PKTLEN_FOUND;
-        cmd_pkt_len = (int)rxch;
-        cmd_pkt_pos_counter = CES_CMDIF_IND_LEN;
-        cmd_pkt_data_counter = 0;
-        break;
+    // The segment file arrives as data packets, then the status
+    rc = hpi_log_ring_send_segment((enum hpi_log_ring_id)in_pkt_buf[1], sys_get_le32(&in_pkt_buf[2]));
+    cmdif_send_cmd_ack(in_pkt_buf[0], (rc < 0) ? cmd_status_from_errno(rc) : HPI_CMD_STATUS_OK);
+}
+#endif
 
-    case CMD_SM_STATE_PKTLEN_FOUND:
+#ifdef CONFIG_HEALTHYPI_LOG_EVENT_CAPTURE
+static void cmd_log_event_config(uint8_t *in_pkt_buf, uint8_t pkt_len)
+{
+    // [0] status, [1..6] settings as in the command, [7] capturing,
+    // [8..11] captures since boot (LE)
+    uint8_t rsp[12];
+    struct hpi_log_event_config cfg;
 
-        cmd_pkt_pos_counter++;
-        if (cmd_pkt_pos_counter < CES_CMDIF_PKT_OVERHEAD) // Read Header
+    LOG_DBG("Command to configure event capture");
+    if (pkt_len >= 7)
+    {
+        cfg = (struct hpi_log_event_config){
+            .source_mask = in_pkt_buf[1],
+            .pre_s = in_pkt_buf[2],
+            .post_s = in_pkt_buf[3],
+            .hr_low = in_pkt_buf[4],
+            .hr_high = in_pkt_buf[5],
+            .spo2_low = in_pkt_buf[6],
+        };
+        if (hpi_log_event_set_config(&cfg) < 0)
         {
-            if (cmd_pkt_pos_counter == CES_CMDIF_IND_LEN_MSB)
-                cmd_pkt_len = (int)((rxch << 8) | cmd_pkt_len);
-            else if (cmd_pkt_pos_counter == CES_CMDIF_IND_PKTTYPE)
-                cmd_pkt_pkttype = (int)rxch;
+            cmdif_send_cmd_ack(in_pkt_buf[0], HPI_CMD_STATUS_INVALID_ARG);
+            return;
         }
-        else if ((cmd_pkt_pos_counter >= CES_CMDIF_PKT_OVERHEAD) && (cmd_pkt_pos_counter < CES_CMDIF_PKT_OVERHEAD + cmd_pkt_len + 1)) // Read Data
+        if (pkt_len >= 13)
         {
-            ces_pkt_data_buffer[cmd_pkt_data_counter++] = (char)(rxch); // Buffer that assigns the data separated from the packet
+            const uint8_t clock[6] = {in_pkt_buf[12], in_pkt_buf[11], in_pkt_buf[10],
+                                      in_pkt_buf[9], in_pkt_buf[8], in_pkt_buf[7]};
+
+            hpi_log_event_set_clock(clock);
         }
-        else // All data received
+    }
+    else if (pkt_len != 1)
+    {
+        cmdif_send_cmd_ack(in_pkt_buf[0], HPI_CMD_STATUS_INVALID_ARG);
+        return;
+    }
+
+    hpi_log_event_get_config(&cfg);
+    rsp[0] = HPI_CMD_STATUS_OK;
+    rsp[1] = cfg.source_mask;
+    rsp[2] = cfg.pre_s;
+    rsp[3] = cfg.post_s;
+    rsp[4] = cfg.hr_low;
+    rsp[5] = cfg.hr_high;
+    rsp[6] = cfg.spo2_low;
+    rsp[7] = hpi_log_event_capturing();
+    sys_put_le32(hpi_log_event_captures(), &rsp[8]);
+    cmdif_send_cmd_rsp_data(in_pkt_buf[0], rsp, sizeof(rsp));
+}
+
+static void cmd_log_event_trigger(uint8_t *in_pkt_buf, uint8_t pkt_len)
+{
+    LOG_DBG("Command to trigger an event capture");
+    hpi_log_event_trigger(HPI_LOG_EVENT_EXTERNAL, (pkt_len >= 2) ? in_pkt_buf[1] : 0,
+                          (pkt_len >= 4) ? (int16_t)sys_get_le16(&in_pkt_buf[2]) : 0);
+    cmdif_send_cmd_ack(in_pkt_buf[0], HPI_CMD_STATUS_OK);
+}
+#endif
+
+#ifdef CONFIG_HEALTHYPI_USB_MSC_ENABLED
+static void cmd_usb_msc_attach(uint8_t *in_pkt_buf, uint8_t pkt_len)
+{
+    LOG_DBG("Command to hand the SD card to USB");
+    int rc = hpi_usb_msc_attach();
+
+    if (rc == -EBUSY)
+    {
+        cmdif_send_cmd_ack(in_pkt_buf[0], HPI_CMD_STATUS_BUSY);
+        return;
+    }
+    cmdif_send_cmd_ack(in_pkt_buf[0], (rc == 0) ? HPI_CMD_STATUS_OK : HPI_CMD_STATUS_NOT_FOUND);
+}
+
+static void cmd_usb_msc_detach(uint8_t *in_pkt_buf, uint8_t pkt_len)
+{
+    LOG_DBG("Command to take the SD card back from USB");
+    cmdif_send_cmd_ack(in_pkt_buf[0], (hpi_usb_msc_detach() == 0) ? HPI_CMD_STATUS_OK : HPI_CMD_STATUS_NOT_FOUND);
+}
+#endif
+
+static void cmd_usb_set_transport(uint8_t *in_pkt_buf, uint8_t pkt_len)
+{
+    LOG_DBG("Command to set USB stream transport: %d", in_pkt_buf[1]);
+    if (hpi_usb_set_transport((enum hpi_usb_transport)in_pkt_buf[1]) != 0)
+    {
+        cmdif_send_cmd_ack(in_pkt_buf[0], HPI_CMD_STATUS_INVALID_ARG);
+        return;
+    }
+    cmdif_send_cmd_ack(in_pkt_buf[0], HPI_CMD_STATUS_OK);
+}
+
+static void cmd_cancel(uint8_t *in_pkt_buf, uint8_t pkt_len)
+{
+    LOG_DBG("Command to cancel the running command");
+    if (atomic_get(&cmd_jobs_pending) == 0)
+    {
+        cmdif_send_cmd_ack(in_pkt_buf[0], HPI_CMD_STATUS_NOT_FOUND);
+        return;
+    }
+    atomic_set(&cmd_job_cancel, 1);
+    cmdif_send_cmd_ack(in_pkt_buf[0], HPI_CMD_STATUS_OK);
+}
+
+static void cmd_reset(uint8_t *in_pkt_buf, uint8_t pkt_len)
+{
+    LOG_DBG("Recd Reset Command");
+    LOG_DBG("Rebooting...");
+    k_sleep(K_MSEC(1000));
+    sys_reboot(SYS_REBOOT_COLD);
+}
+
+static void cmd_log_get_count(uint8_t *in_pkt_buf, uint8_t pkt_len)
+{
+    LOG_DBG("Comamnd to send log count");
+    hpi_get_session_count();
+}
+
+static void cmd_fetch_sd_card_status(uint8_t *in_pkt_buf, uint8_t pkt_len)
+{
+    if (sd_card_present)
+        cmdif_send_memory_status(CMD_SD_CARD_PRESENT);
+    else
+        cmdif_send_memory_status(CMD_SD_CARD_NOT_PRESENT);
+}
+
+static void cmd_log_session_headers(uint8_t *in_pkt_buf, uint8_t pkt_len)
+{
+    LOG_DBG("Sending all session headers");
+    hpi_get_session_index();
+}
+
+static void cmd_fetch_log_file_data(uint8_t *in_pkt_buf, uint8_t pkt_len)
+{
+    LOG_DBG("Command to fetch file data");
+    hpi_session_fetch(in_pkt_buf[2] | (in_pkt_buf[1] << 8), in_pkt_buf[3]);
+}
+
+static void cmd_session_wipe_all(uint8_t *in_pkt_buf, uint8_t pkt_len)
+{
+    LOG_DBG("Command to delete all files");
+    if (hpi_datalog_delete_all() == -EBUSY)
+    {
+        cmdif_send_cmd_ack(in_pkt_buf[0], HPI_CMD_STATUS_BUSY);
+    }
+}
+
+static void cmd_session_delete(uint8_t *in_pkt_buf, uint8_t pkt_len)
+{
+    LOG_DBG("Command to delete file");
+    if (hpi_datalog_delete_session(in_pkt_buf[2] | (in_pkt_buf[1] << 8), in_pkt_buf[3]) == -EBUSY)
+    {
+        cmdif_send_cmd_ack(in_pkt_buf[0], HPI_CMD_STATUS_BUSY);
+    }
+}
+
+static void cmd_logging_end(uint8_t *in_pkt_buf, uint8_t pkt_len)
+{
+    LOG_DBG("Command to end logging");
+    // AKW: Replace with a function to stop logging
+    settings_log_data_enabled = false;
+    if (flush_current_session_logs() < 0)
+    {
+        // Still being written out; the session stays open until a retry
+        cmdif_send_cmd_ack(CMD_LOGGING_END, HPI_CMD_STATUS_BUSY);
+    }
+}
+
+static void cmd_logging_start(uint8_t *in_pkt_buf, uint8_t pkt_len)
+{
+    LOG_DBG("Command to start logging");
+    hpi_datalog_start_session(in_pkt_buf, pkt_len);
+}
+
+// Commands flagged CMD_F_WORKER run on cmd_worker_thread, in order. Any
+// other command that arrives while worker commands are queued or running
+// is queued behind them, unless flagged CMD_F_ANYTIME, so a host's command
+// sequence is still carried out in order.
+#define CMD_F_WORKER BIT(0)     // May take seconds: reads, deletes or closes files
+#define CMD_F_ANYTIME BIT(1)    // Touches no storage; may overtake worker commands
+#define CMD_F_PROGRESS BIT(2)   // Reports progress while it runs
+
+static const struct hpi_cmd_entry cmd_table[] = {
+    {HPI_CMD_GET_DEVICE_STATUS, 1, CMD_F_ANYTIME, cmd_get_device_status},
+    {HPI_CMD_RESET, 1, 0, cmd_reset},
+    {HPI_CMD_SET_STREAM_MODE, 2, CMD_F_ANYTIME, cmd_set_stream_mode},
+    {HPI_CMD_SET_DATA_FORMAT, 2, CMD_F_ANYTIME, cmd_set_data_format},
+    {HPI_CMD_USB_FC_CONFIG, 4, CMD_F_ANYTIME, cmd_usb_fc_config},
+    {HPI_CMD_USB_FC_GRANT, 1, CMD_F_ANYTIME, cmd_usb_fc_grant},
+    {HPI_CMD_USB_FC_GET_STATS, 1, CMD_F_ANYTIME, cmd_usb_fc_get_stats},
+    {HPI_CMD_USB_FC_SPOOL_FETCH, 1, CMD_F_WORKER, cmd_usb_fc_spool_fetch},
+    {HPI_CMD_USB_SET_TRANSPORT, 2, CMD_F_ANYTIME, cmd_usb_set_transport},
+    {HPI_CMD_BLE_TX_GET_STATS, 1, CMD_F_ANYTIME, cmd_ble_tx_get_stats},
+    {HPI_CMD_BLE_SET_DECIMATION, 2, CMD_F_ANYTIME, cmd_ble_set_decimation},
+    {HPI_CMD_LOG_FETCH_RANGE, 12, CMD_F_WORKER | CMD_F_PROGRESS, cmd_log_fetch_range},
+#ifdef CONFIG_HEALTHYPI_LOG_FLASH_RING
+    {HPI_CMD_LOG_RING_INFO, 1, CMD_F_ANYTIME, cmd_log_ring_info},
+    {HPI_CMD_LOG_RING_FETCH, 6, CMD_F_WORKER | CMD_F_PROGRESS, cmd_log_ring_fetch},
+#endif
+#ifdef CONFIG_HEALTHYPI_USB_MSC_ENABLED
+    {HPI_CMD_USB_MSC_ATTACH, 1, CMD_F_WORKER, cmd_usb_msc_attach},
+    {HPI_CMD_USB_MSC_DETACH, 1, CMD_F_WORKER, cmd_usb_msc_detach},
+#endif
+#ifdef CONFIG_HEALTHYPI_LOG_EVENT_CAPTURE
+    {HPI_CMD_LOG_EVENT_CONFIG, 1, CMD_F_ANYTIME, cmd_log_event_config},
+    {HPI_CMD_LOG_EVENT_TRIGGER, 1, CMD_F_ANYTIME, cmd_log_event_trigger},
+#endif
+    {HPI_CMD_CANCEL, 1, CMD_F_ANYTIME, cmd_cancel},
+    {CMD_LOG_SESSION_HEADERS, 1, CMD_F_WORKER, cmd_log_session_headers},
+    {CMD_FETCH_LOG_FILE_DATA, 4, CMD_F_WORKER, cmd_fetch_log_file_data},
+    {CMG_SESSION_DELETE, 4, CMD_F_WORKER, cmd_session_delete},
+    {CMD_SESSION_WIPE_ALL, 1, CMD_F_WORKER, cmd_session_wipe_all},
+    {CMD_LOG_GET_COUNT, 1, 0, cmd_log_get_count},
+    {CMD_LOGGING_START, 1, CMD_F_WORKER, cmd_logging_start},
+    {CMD_LOGGING_END, 1, CMD_F_WORKER, cmd_logging_end},
+    {CMD_FETCH_SD_CARD_STATUS, 1, 0, cmd_fetch_sd_card_status},
+};
+
+static const struct hpi_cmd_entry *cmd_lookup(uint8_t cmd)
+{
+    for (int i = 0; i < ARRAY_SIZE(cmd_table); i++)
+    {
+        if (cmd_table[i].cmd == cmd)
         {
-            if (rxch == CES_CMDIF_PKT_STOP_2)
-            {
-                LOG_DBG("Packet Received len: %d, type: %d", cmd_pkt_len, cmd_pkt_pkttype);
-                cmd_pkt_pos_counter = 0;
-                cmd_pkt_data_counter = 0;
-                ecs_rx_state = 0;
-                cmd_data_obj.pkt_type = cmd_pkt_pkttype;
-                cmd_data_obj.data_len = cmd_pkt_len;
-                memcpy(cmd_data_obj.data, ces_pkt_data_buffer, cmd_pkt_len);
-
-                k_fifo_put(&cmd_data_fifo, &cmd_data_obj);
-            }
+            return &cmd_table[i];
         }
     }
+
+    return NULL;
 }
 
-void hpi_decode_data_packet(uint8_t *in_pkt_buf, uint8_t pkt_len)
+bool hpi_cmd_worker_busy(void)
 {
-    //int rc;
-    uint8_t cmd_cmd_id = in_pkt_buf[0];
+    atomic_val_t own = (k_current_get() == cmd_worker_tid) ? 1 : 0;
 
-    // printk("Recd Command: %X\n", cmd_cmd_id);
+    return atomic_get(&cmd_jobs_pending) > own;
+}
 
-    switch (cmd_cmd_id)
+int hpi_cmd_submit_local(uint8_t cmd)
+{
+    struct hpi_cmd_data_obj_t job = {
+        .src = HPI_CMD_SRC_LOCAL,
+        .data_len = 1,
+        .data = {cmd},
+    };
+
+    atomic_inc(&cmd_jobs_pending);
+    if (k_msgq_put(&q_cmd_job, &job, K_NO_WAIT) != 0)
     {
+        atomic_dec(&cmd_jobs_pending);
+        return -EBUSY;
+    }
 
-    case HPI_CMD_GET_DEVICE_STATUS:
-        LOG_DBG("Recd Get Device Status Command");
-        // cmdif_send_ble_device_status_response();
-        break;
+    return 0;
+}
 
-    case HPI_CMD_RESET:
-        LOG_DBG("Recd Reset Command");
-        LOG_DBG("Rebooting...");
-        k_sleep(K_MSEC(1000));
-        sys_reboot(SYS_REBOOT_COLD);
-        break;
+bool hpi_cmd_job_cancelled(void)
+{
+    return k_current_get() == cmd_worker_tid && atomic_get(&cmd_job_cancel) != 0;
+}
 
-    case CMD_LOG_GET_COUNT:
-        LOG_DBG("Comamnd to send log count");
-        hpi_get_session_count();
-        break;
+void hpi_cmd_job_progress(uint32_t done, uint32_t total)
+{
+    static int64_t last_progress;
+    uint8_t rsp[9];
 
-    case CMD_FETCH_SD_CARD_STATUS:
-        if (sd_card_present)
-            cmdif_send_memory_status(CMD_SD_CARD_PRESENT);
-        else
-            cmdif_send_memory_status(CMD_SD_CARD_NOT_PRESENT);
-        break;
-
-    case CMD_LOG_SESSION_HEADERS:
-        LOG_DBG("Sending all session headers");
-        hpi_get_session_index();
-        break;
-
-    case CMD_FETCH_LOG_FILE_DATA:
-        LOG_DBG("Command to fetch file data");
-        hpi_session_fetch(in_pkt_buf[2] | (in_pkt_buf[1] << 8),in_pkt_buf[3]);
-        break;
-
-    case CMD_SESSION_WIPE_ALL:
-        LOG_DBG("Command to delete all files");
-        hpi_datalog_delete_all();
-        break;
-
-    case CMG_SESSION_DELETE:
-        LOG_DBG("Command to delete file");
-        hpi_datalog_delete_session(in_pkt_buf[2] | (in_pkt_buf[1] << 8),in_pkt_buf[3]);
-        break;
-
-    case CMD_LOGGING_END:
-        LOG_DBG("Command to end logging");
-        // AKW: Replace with a function to stop logging
-        settings_log_data_enabled = false;
-        flush_current_session_logs();
-        break;
-
-    case CMD_LOGGING_START:
-        // bool header_set_flag = false;
-        LOG_DBG("Command to start logging");
-        hpi_datalog_start_session(in_pkt_buf);
-        break;
+    if (k_current_get() != cmd_worker_tid || !(cmd_job_entry->flags & CMD_F_PROGRESS) ||
+        k_uptime_get() - last_progress < CMD_PROGRESS_INTERVAL_MS)
+    {
+        return;
+    }
+    last_progress = k_uptime_get();
+
+    // [0] HPI_CMD_STATUS_IN_PROGRESS, [1..4] done, [5..8] total (LE), in
+    // units of the command's choosing
+    rsp[0] = HPI_CMD_STATUS_IN_PROGRESS;
+    sys_put_le32(done, &rsp[1]);
+    sys_put_le32(total, &rsp[5]);
+    cmdif_send_cmd_rsp_data(cmd_job.data[0], rsp, sizeof(rsp));
+}
 
-    default:
-        LOG_ERR("Recd Unknown Command");
-        break;
+// Runs a command from cmd_thread, or queues it for the worker
+void hpi_decode_data_packet(uint8_t *in_pkt_buf, uint8_t pkt_len)
+{
+    const struct hpi_cmd_entry *entry;
+    struct hpi_cmd_data_obj_t job;
+
+    if (pkt_len == 0)
+    {
+        return;
+    }
+
+    entry = cmd_lookup(in_pkt_buf[0]);
+    if (entry == NULL)
+    {
+        LOG_ERR("Recd Unknown Command %02X", in_pkt_buf[0]);
+        return;
+    }
+
+    if (pkt_len < entry->min_len)
+    {
+        cmdif_send_cmd_ack(in_pkt_buf[0], HPI_CMD_STATUS_INVALID_ARG);
+        return;
+    }
+
+    if (!(entry->flags & CMD_F_WORKER) && ((entry->flags & CMD_F_ANYTIME) || atomic_get(&cmd_jobs_pending) == 0))
+    {
+        entry->handler(in_pkt_buf, pkt_len);
+        return;
+    }
+
+    job.src = m_cmd_reply_src;
+    job.pkt_type = 0;
+    job.data_len = pkt_len;
+    memcpy(job.data, in_pkt_buf, pkt_len);
+
+    atomic_inc(&cmd_jobs_pending);
+    if (k_msgq_put(&q_cmd_job, &job, K_NO_WAIT) != 0)
+    {
+        atomic_dec(&cmd_jobs_pending);
+        cmdif_send_cmd_ack(in_pkt_buf[0], HPI_CMD_STATUS_BUSY);
     }
 }
 
@@ -226,7 +685,7 @@ void cmdif_send_ble_data_idx(uint8_t *m_data, uint8_t m_data_len)
         cmd_pkt[1 + i] = m_data[i];
     }
 
-    healthypi5_service_send_data(cmd_pkt, 1 + m_data_len);
+    cmdif_send_response(cmd_pkt, 1 + m_data_len);
 }
 
 void cmdif_send_memory_status(uint8_t m_cmd)
@@ -238,7 +697,7 @@ void cmdif_send_memory_status(uint8_t m_cmd)
     cmd_pkt[1] = 0x55;
     cmd_pkt[2] = m_cmd;
 
-    healthypi5_service_send_data(cmd_pkt, 3);
+    cmdif_send_response(cmd_pkt, 3);
 }
 
 void cmdif_send_session_count(uint8_t m_cmd,uint8_t indication)
@@ -251,7 +710,29 @@ void cmdif_send_session_count(uint8_t m_cmd,uint8_t indication)
     cmd_pkt[2] = m_cmd;
 
     // printk("sending response\n");
-    healthypi5_service_send_data(cmd_pkt, 3);
+    cmdif_send_response(cmd_pkt, 3);
+}
+
+void cmdif_send_cmd_rsp_data(uint8_t m_cmd, const uint8_t *m_data, uint8_t m_data_len)
+{
+    uint8_t cmd_pkt[2 + m_data_len];
+
+    cmd_pkt[0] = CES_CMDIF_TYPE_CMD_RSP;
+    cmd_pkt[1] = m_cmd;
+    memcpy(&cmd_pkt[2], m_data, m_data_len);
+
+    cmdif_send_response(cmd_pkt, 2 + m_data_len);
+}
+
+void cmdif_send_cmd_ack(uint8_t m_cmd, uint8_t m_status)
+{
+    uint8_t cmd_pkt[3];
+
+    cmd_pkt[0] = CES_CMDIF_TYPE_CMD_RSP;
+    cmd_pkt[1] = m_cmd;
+    cmd_pkt[2] = m_status;
+
+    cmdif_send_response(cmd_pkt, 3);
 }
 
 void cmdif_send_ble_session_data(int8_t *m_data, uint8_t m_data_len)
@@ -264,7 +745,7 @@ void cmdif_send_ble_session_data(int8_t *m_data, uint8_t m_data_len)
     {
         data_pkt[1 + i] = m_data[i];
     }
-    healthypi5_service_send_data(data_pkt, 1 + m_data_len);
+    cmdif_send_response(data_pkt, 1 + m_data_len);
 }
 
 // TODO: implement BLE UART
@@ -495,27 +976,86 @@ void cmd_thread(void)
 
     LOG_INF("CMD Thread Started");
 
-    
+    for (;;)
+    {
+        k_msgq_get(&q_cmd_msg, &rx_cmd_data_obj, K_FOREVER);
+
+        LOG_DBG("Recd %s Packet len: %d",
+                rx_cmd_data_obj.src == HPI_CMD_SRC_USB ? "USB" : "BLE",
+                rx_cmd_data_obj.data_len);
+        m_cmd_reply_src = rx_cmd_data_obj.src;
+
+        hpi_decode_data_packet(rx_cmd_data_obj.data, rx_cmd_data_obj.data_len);
+    }
+}
+
+// Runs CMD_F_WORKER commands, and the commands queued behind them, one at
+// a time so cmd_thread stays free for short commands and HPI_CMD_CANCEL
+void cmd_worker_thread(void)
+{
+    cmd_worker_tid = k_current_get();
 
     for (;;)
     {
-        if (k_msgq_get(&q_cmd_msg, &rx_cmd_data_obj, K_NO_WAIT) == 0)
-        {
+        k_msgq_get(&q_cmd_job, &cmd_job, K_FOREVER);
 
-            LOG_DBG("Recd BLE Packet len: %d", rx_cmd_data_obj.data_len);
-            for (int i = 0; i < rx_cmd_data_obj.data_len; i++)
-            {
-                // printk("%02X\t", rx_cmd_data_obj.data[i]);
-            }
-            
-            hpi_decode_data_packet(rx_cmd_data_obj.data, rx_cmd_data_obj.data_len);
+        cmd_job_entry = cmd_lookup(cmd_job.data[0]);
+        cmd_job_entry->handler(cmd_job.data, cmd_job.data_len);
+
+        // Cleared only now: a cancel that arrives between two commands
+        // applies to the next one
+        atomic_set(&cmd_job_cancel, 0);
+        atomic_dec(&cmd_jobs_pending);
+    }
+}
+
+#ifdef CONFIG_HEALTHYPI_USB_CDC_ENABLED
+// Drains the USB CDC RX ring filled by the hw_module ISR and runs each read
+// through the frame parser. Completed frames land in q_cmd_msg tagged as USB,
+// so cmd_thread handles them exactly like BLE commands.
+void cmd_usb_rx_thread(void)
+{
+    static struct hpi_cmd_parser parser;
+    struct hpi_cmd_frame frame;
+    uint8_t rx_buf[64];
+    uint32_t dropped = 0;
+
+    LOG_INF("CMD USB RX Thread Started");
+
+    hpi_cmd_parser_init(&parser);
+
+    for (;;)
+    {
+        size_t rx_len = receive_usb_cdc(rx_buf, sizeof(rx_buf), K_FOREVER);
+        const uint8_t *rx = rx_buf;
+
+        while (hpi_cmd_parser_next(&parser, &rx, &rx_len, &frame))
+        {
+            cmd_usb_frame_received(&frame);
         }
 
-        k_sleep(K_MSEC(1000));
+        if (parser.dropped != dropped)
+        {
+            LOG_WRN("Dropped %u malformed cmd frames", parser.dropped - dropped);
+            dropped = parser.dropped;
+        }
     }
 }
+#endif
 
 #define CMD_THREAD_STACKSIZE 2048
 #define CMD_THREAD_PRIORITY 7
 
-K_THREAD_DEFINE(cmd_thread_id, CMD_THREAD_STACKSIZE, cmd_thread, NULL, NULL, NULL, CMD_THREAD_PRIORITY, 0, 0);
\ No newline at end of file
+#define CMD_USB_RX_THREAD_STACKSIZE 1024
+#define CMD_USB_RX_THREAD_PRIORITY 7
+
+#define CMD_WORKER_THREAD_STACKSIZE 2048
+// Below cmd_thread, which must be able to take a cancel while a fetch runs
+#define CMD_WORKER_THREAD_PRIORITY 8
+
+K_THREAD_DEFINE(cmd_thread_id, CMD_THREAD_STACKSIZE, cmd_thread, NULL, NULL, NULL, CMD_THREAD_PRIORITY, 0, 0);
+K_THREAD_DEFINE(cmd_worker_thread_id, CMD_WORKER_THREAD_STACKSIZE, cmd_worker_thread, NULL, NULL, NULL,
+                CMD_WORKER_THREAD_PRIORITY, 0, 0);
+#ifdef CONFIG_HEALTHYPI_USB_CDC_ENABLED
+K_THREAD_DEFINE(cmd_usb_rx_thread_id, CMD_USB_RX_THREAD_STACKSIZE, cmd_usb_rx_thread, NULL, NULL, NULL, CMD_USB_RX_THREAD_PRIORITY, 0, 0);
+#endif
\ No newline at end of file
@@ -54,17 +54,23 @@ void cmdif_send_memory_status(uint8_t m_cmd);
 void cmdif_send_session_count(uint8_t m_cmd,uint8_t indication);
 void cmdif_send_ble_session_data(int8_t *m_data, uint8_t m_data_len);
 void cmdif_send_ble_data_idx(uint8_t *m_data, uint8_t m_data_len);
+void cmdif_send_cmd_ack(uint8_t m_cmd, uint8_t m_status);
+void cmdif_send_cmd_rsp_data(uint8_t m_cmd, const uint8_t *m_data, uint8_t m_data_len);
+bool cmdif_reply_is_usb(void);
+// For long commands, which run on the command worker thread: send an
+// HPI_CMD_STATUS_IN_PROGRESS response now and then, if the command reports
+// progress, and poll for HPI_CMD_CANCEL. Both do nothing on other threads.
+void hpi_cmd_job_progress(uint32_t done, uint32_t total);
+bool hpi_cmd_job_cancelled(void);
+// A worker command other than the caller's own is queued or running
+bool hpi_cmd_worker_busy(void);
+// Queue a worker command on the firmware's own behalf, for work that must
+// not run on the system workqueue. Safe from any context. Returns -EBUSY if
+// the job queue is full.
+int hpi_cmd_submit_local(uint8_t cmd);
 
 
 
-enum cmdsm_state
-{
-    CMD_SM_STATE_INIT = 0,
-    CMD_SM_STATE_SOF1_FOUND,
-    CMD_SM_STATE_SOF2_FOUND,
-    CMD_SM_STATE_PKTLEN_FOUND,
-};
-
 enum cmdsm_index
 {
     CES_CMDIF_IND_LEN = 2,
@@ -77,8 +83,36 @@ enum hpi_cmds
 {
     HPI_CMD_GET_DEVICE_STATUS = 0x40,
     HPI_CMD_RESET = 0x41,
+    HPI_CMD_SET_STREAM_MODE = 0x42,   // [1] = enum hpi_stream_modes
+    HPI_CMD_SET_DATA_FORMAT = 0x43,   // [1] = enum hpi5_data_format
+    HPI_CMD_USB_FC_CONFIG = 0x44,     // [1] = enable, [2] = credit unit, [3] = policy
+    HPI_CMD_USB_FC_GRANT = 0x45,      // [1..4] = credits (LE), USB only, no response
+    HPI_CMD_USB_FC_GET_STATS = 0x46,
+    HPI_CMD_USB_FC_SPOOL_FETCH = 0x47,
+    HPI_CMD_USB_SET_TRANSPORT = 0x48, // [1] = enum hpi_usb_transport
+    HPI_CMD_BLE_TX_GET_STATS = 0x49,
+    HPI_CMD_BLE_SET_DECIMATION = 0x4A, // [1] = level 0..3, 0xFF = adaptive
+    HPI_CMD_LOG_FETCH_RANGE = 0x4B,   // [1..2] = session id (BE, as in 0x51/0x52), [3] = channel mask,
+                                      // [4..7] = start ms, [8..11] = end ms (LE)
+    HPI_CMD_LOG_RING_INFO = 0x4C,     // Flash ring log segments, if running
+    HPI_CMD_LOG_RING_FETCH = 0x4D,    // [1] = enum hpi_log_ring_id, [2..5] = segment (LE)
+    HPI_CMD_USB_MSC_ATTACH = 0x4E,    // Stop logging and hand the SD card to the USB host
+    HPI_CMD_USB_MSC_DETACH = 0x4F,    // Take the SD card back and remount it
+    // 0x50-0x59 are the session log commands above
+    HPI_CMD_LOG_EVENT_CONFIG = 0x5A,  // [1] = source mask, [2] = pre s, [3] = post s, [4] = HR low, [5] = HR high,
+                                      // [6] = SpO2 low, [7..12] = optional clock (sec, min, hour, day, month, year);
+                                      // no arguments reads the settings
+    HPI_CMD_LOG_EVENT_TRIGGER = 0x5B, // [1] = detail, [2..3] = value (LE), both optional
+    HPI_CMD_CANCEL = 0x5C,            // Stop the fetch or other long command that is running
 };
 
+#define HPI_CMD_STATUS_OK 0x00
+#define HPI_CMD_STATUS_INVALID_ARG 0x01
+#define HPI_CMD_STATUS_NOT_FOUND 0x02
+#define HPI_CMD_STATUS_BUSY 0x03        // Too many long commands queued
+#define HPI_CMD_STATUS_CANCELLED 0x04
+#define HPI_CMD_STATUS_IN_PROGRESS 0x05 // Followed by done and total (LE32 each)
+
 enum wiser_device_state
 {
     HPI_STATUS_IDLE = 0x20,
@@ -93,6 +127,17 @@ enum cmdif_pkt_type
     CES_CMDIF_TYPE_PROGRESS = 0x04,
     CES_CMDIF_TYPE_LOG_IDX = 0x05,
     CES_CMDIF_TYPE_CMD_RSP = 0x06,
+    // USB only: wraps a BLE-format response (first payload byte is one of the
+    // types above) so it can't be confused with waveform packets on the wire
+    CES_CMDIF_TYPE_USB_RSP = 0x10,
+};
+
+// Transport a command arrived on; responses go back the same way
+enum hpi_cmd_src
+{
+    HPI_CMD_SRC_BLE = 0,
+    HPI_CMD_SRC_USB,
+    HPI_CMD_SRC_LOCAL,      // Queued by the firmware itself; responses are discarded
 };
 
 enum ble_status
@@ -106,15 +151,10 @@ enum ble_status
 
 struct hpi_cmd_data_obj_t
 {
+    uint8_t src;        // enum hpi_cmd_src
     uint8_t pkt_type;
     uint8_t data_len;
     uint8_t data[MAX_MSG_SIZE];
 };
 
-struct hpi_sensor_logging_data_t {
-    int32_t log_ecg_sample;
-    int16_t log_ppg_sample;
-    int32_t log_bioz_sample;
-};
-
 
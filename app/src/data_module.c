@@ -29,6 +29,7 @@
 #include <zephyr/drivers/sensor.h>
 #include <zephyr/fs/fs.h>
 #include <zephyr/fs/littlefs.h>
+#include <zephyr/sys/byteorder.h>
 #include <stdio.h>
 #include <string.h>
 
@@ -55,16 +56,23 @@ LOG_MODULE_REGISTER(data_module, LOG_LEVEL_INF);  // Changed from DBG to reduce
 
 #include "spo2_process.h"
 #include "resp_process.h"
+#include "hpi_log_format.h"
 #include "datalog_module.h"
 #include "hw_module.h"
 #include "hpi_common_types.h"
 #include "settings_module.h"
+#include "usb_flow_ctrl.h"
+#include "log_ring.h"
+#include "log_event.h"
 
 // ProtoCentral data formats
 #define CES_CMDIF_PKT_START_1 0x0A
 #define CES_CMDIF_PKT_START_2 0xFA
 #define CES_CMDIF_TYPE_ECG_BIOZ_DATA 0x03
 #define CES_CMDIF_TYPE_PPG_DATA 0x04
+#define CES_CMDIF_TYPE_VITALS 0x07
+#define CES_CMDIF_TYPE_ECG_BIOZ_COMPACT 0x08
+#define CES_CMDIF_TYPE_PPG_COMPACT 0x09
 #define CES_CMDIF_PKT_STOP 0x0B
 
 #define SAMPLING_FREQ 104 // in Hz.
@@ -75,14 +83,6 @@ LOG_MODULE_REGISTER(data_module, LOG_LEVEL_INF);  // Changed from DBG to reduce
 
 K_MSGQ_DEFINE(q_computed_val, sizeof(struct hpi_computed_data_t), 50, 1);
 
-enum hpi5_data_format
-{
-    DATA_FMT_OPENVIEW,
-    DATA_FMT_PLAIN_TEXT,
-    DATA_FMT_HPI5_OV3,
-
-} hpi5_data_format_t;
-
 #define HPI_OV3_DATA_ECG_BIOZ_LEN 50
 #define HPI_OV3_DATA_PPG_LEN 19
 #define HPI_OV3_DATA_ECG_LEN 8
@@ -94,6 +94,16 @@ const uint8_t hpi_ov3_ecg_bioz_packet_header[5] = {CES_CMDIF_PKT_START_1, CES_CM
 const uint8_t hpi_ov3_ppg_packet_header[5] = {CES_CMDIF_PKT_START_1, CES_CMDIF_PKT_START_2, HPI_OV3_DATA_PPG_LEN, 0, CES_CMDIF_TYPE_PPG_DATA};
 const uint8_t hpi_ov3_packet_footer[2] = {0, CES_CMDIF_PKT_STOP};
 
+// Compact format: waveform packets carry samples only (ECG/BioZ as int24,
+// PPG as int16); vitals and status travel in their own low-rate packet
+#define HPI_COMPACT_ECG_BIOZ_LEN ((HPI_OV3_DATA_ECG_LEN + HPI_OV3_DATA_BIOZ_LEN) * 3)
+#define HPI_COMPACT_PPG_LEN (HPI_OV3_DATA_RED_LEN * 2)
+
+#define HPI_VITALS_LEN 12
+#define HPI_VITALS_INTERVAL_MS 1000
+#define HPI_VITALS_FLAG_ECG_LEAD_OFF BIT(0)
+#define HPI_VITALS_FLAG_PPG_LEAD_OFF BIT(1)
+
 #define DATA_LEN 22
 uint8_t DataPacket[DATA_LEN];
 const char DataPacketFooter[2] = {0, CES_CMDIF_PKT_STOP};
@@ -115,17 +125,9 @@ static bool settings_plot_enabled = true;
 
 static bool settings_send_rpi_uart_enabled = false;
 
-// struct hpi_sensor_data_t log_buffer[LOG_BUFFER_LENGTH];
-struct hpi_sensor_logging_data_t log_buffer[LOG_BUFFER_LENGTH];
-
-uint16_t current_session_ecg_counter = 0;
 uint16_t serial_ecg_counter = 0;
 uint16_t serial_bioz_counter = 0;
 uint16_t serial_ppg_counter = 0;
-uint16_t current_session_bioz_counter = 0;
-uint16_t current_session_ppg_counter = 0;
-uint16_t current_session_log_id = 0;
-char session_id_str[15];
 
 static volatile uint16_t m_resp_rate = 0;
 
@@ -174,6 +176,8 @@ int16_t hr_serial;
 int16_t rr_serial;
 int16_t temp_serial;
 
+extern uint8_t global_batt_level;
+
 ZBUS_CHAN_DECLARE(hr_chan);
 ZBUS_CHAN_DECLARE(spo2_chan);
 ZBUS_CHAN_DECLARE(resp_rate_chan);
@@ -184,6 +188,8 @@ ZBUS_CHAN_DECLARE(lead_off_chan);  // Lead-off state channel
 static enum hpi_stream_modes m_stream_mode = HPI_STREAM_MODE_USB;
 K_MUTEX_DEFINE(mutex_stream_mode);
 
+static enum hpi5_data_format m_stream_format = DATA_FMT_OPENVIEW;
+
 // HR source selection (ECG vs PPG)
 static enum hpi_hr_source m_hr_source = HR_SOURCE_ECG;
 K_MUTEX_DEFINE(mutex_hr_source);
@@ -224,6 +230,16 @@ void hpi_data_set_stream_mode(enum hpi_stream_modes mode)
     k_mutex_unlock(&mutex_stream_mode);
 }
 
+void hpi_data_set_stream_format(enum hpi5_data_format format)
+{
+    k_mutex_lock(&mutex_stream_mode, K_FOREVER);
+    if (m_stream_format != format) {
+        LOG_INF("Stream format: %d -> %d", m_stream_format, format);
+    }
+    m_stream_format = format;
+    k_mutex_unlock(&mutex_stream_mode);
+}
+
 void hpi_data_set_hr_source(enum hpi_hr_source source)
 {
     k_mutex_lock(&mutex_hr_source, K_FOREVER);
@@ -257,7 +273,9 @@ void send_ppg_data_ov3_format()
 
     hpi_ov3_ppg_data[pkt_ppg_pos_counter++] = (uint8_t)spo2_serial;
 
-    hpi_ov3_ppg_data[pkt_ppg_pos_counter++] = (uint8_t)(temp_serial >> 8);
+    // Little endian like the other fields. Before the USB command work
+    // this sent the high byte twice, so the low byte was garbage.
+    hpi_ov3_ppg_data[pkt_ppg_pos_counter++] = (uint8_t)temp_serial;
     hpi_ov3_ppg_data[pkt_ppg_pos_counter++] = (uint8_t)(temp_serial >> 8);
 
     if (settings_send_usb_enabled)
@@ -267,7 +285,7 @@ void send_ppg_data_ov3_format()
         memcpy(consolidated_ppg_packet, hpi_ov3_ppg_packet_header, 5);
         memcpy(consolidated_ppg_packet + 5, hpi_ov3_ppg_data, pkt_ppg_pos_counter);
         memcpy(consolidated_ppg_packet + 5 + pkt_ppg_pos_counter, hpi_ov3_packet_footer, 2);
-        send_usb_cdc(consolidated_ppg_packet, 5 + pkt_ppg_pos_counter + 2);
+        hpi_usb_stream_send(HPI_USB_PKT_WAVEFORM, consolidated_ppg_packet, 5 + pkt_ppg_pos_counter + 2);
     }
 
     if (settings_send_rpi_uart_enabled)
@@ -308,7 +326,7 @@ void send_ecg_bioz_data_ov3_format(int32_t *ecg_data, int32_t ecg_sample_count,
         memcpy(consolidated_ecg_bioz_packet, hpi_ov3_ecg_bioz_packet_header, 5);
         memcpy(consolidated_ecg_bioz_packet + 5, hpi_ov3_ecg_bioz_data, pkt_ecg_bioz_pos_counter);
         memcpy(consolidated_ecg_bioz_packet + 5 + pkt_ecg_bioz_pos_counter, hpi_ov3_packet_footer, 2);
-        send_usb_cdc(consolidated_ecg_bioz_packet, 5 + pkt_ecg_bioz_pos_counter + 2);
+        hpi_usb_stream_send(HPI_USB_PKT_WAVEFORM, consolidated_ecg_bioz_packet, 5 + pkt_ecg_bioz_pos_counter + 2);
     }
 
     if (settings_send_rpi_uart_enabled)
@@ -319,6 +337,181 @@ void send_ecg_bioz_data_ov3_format(int32_t *ecg_data, int32_t ecg_sample_count,
     }
 }
 
+static void send_framed_packet(uint8_t type, const uint8_t *payload, uint8_t len, enum hpi_usb_pkt_class pkt_class)
+{
+    uint8_t pkt[5 + HPI_COMPACT_ECG_BIOZ_LEN + 2];
+
+    if (!settings_send_usb_enabled || len > HPI_COMPACT_ECG_BIOZ_LEN)
+    {
+        return;
+    }
+
+    pkt[0] = CES_CMDIF_PKT_START_1;
+    pkt[1] = CES_CMDIF_PKT_START_2;
+    pkt[2] = len;
+    pkt[3] = 0;
+    pkt[4] = type;
+    memcpy(&pkt[5], payload, len);
+    pkt[5 + len] = 0;
+    pkt[5 + len + 1] = CES_CMDIF_PKT_STOP;
+
+    hpi_usb_stream_send(pkt_class, pkt, 5 + len + 2);
+}
+
+static void send_ecg_bioz_data_compact_format(const int32_t *ecg_data, int ecg_sample_count,
+                                              const int32_t *bioz_samples, int bioz_sample_count)
+{
+    uint8_t payload[HPI_COMPACT_ECG_BIOZ_LEN];
+    uint8_t pos = 0;
+
+    // MAX30001 ECG is 18-bit and BioZ 20-bit, so the top byte is sign only.
+    // ECG goes out as the code, without the driver's << 8
+    for (int i = 0; i < ecg_sample_count; i++)
+    {
+        sys_put_le24((uint32_t)(ecg_data[i] >> HPI_ECG_CODE_SHIFT), &payload[pos]);
+        pos += 3;
+    }
+
+    for (int i = 0; i < bioz_sample_count; i++)
+    {
+        sys_put_le24((uint32_t)bioz_samples[i], &payload[pos]);
+        pos += 3;
+    }
+
+    send_framed_packet(CES_CMDIF_TYPE_ECG_BIOZ_COMPACT, payload, pos, HPI_USB_PKT_WAVEFORM);
+}
+
+static void send_ppg_data_compact_format(const int16_t *ppg_data, int ppg_sample_count)
+{
+    uint8_t payload[HPI_COMPACT_PPG_LEN];
+    uint8_t pos = 0;
+
+    for (int i = 0; i < ppg_sample_count; i++)
+    {
+        sys_put_le16((uint16_t)ppg_data[i], &payload[pos]);
+        pos += 2;
+    }
+
+    send_framed_packet(CES_CMDIF_TYPE_PPG_COMPACT, payload, pos, HPI_USB_PKT_WAVEFORM);
+}
+
+// Vitals/status packet for the compact format. Sent when any field changes,
+// and at least once per HPI_VITALS_INTERVAL_MS so a host that connects late
+// (or lost a packet to flow control) catches up within a second.
+//  [0]     HR (bpm)           [1]  HR source (enum hpi_hr_source)
+//  [2]     SpO2 (%)           [3]  Respiration rate (bpm)
+//  [4..5]  Temp (0.01 C, LE)  [6..7] IR perfusion index (x100, LE)
+//  [8]     SpO2 confidence    [9]  PPG probe-off reason
+//  [10]    Lead-off flags     [11] Battery (%)
+static void send_vitals_if_due(const spo2_quality_metrics_t *quality)
+{
+    static uint8_t last_vitals[HPI_VITALS_LEN];
+    static int64_t last_vitals_time;
+    uint8_t vitals[HPI_VITALS_LEN];
+    int64_t now = k_uptime_get();
+
+    vitals[0] = (uint8_t)hr_serial;
+    vitals[1] = (uint8_t)m_hr_source;
+    vitals[2] = (uint8_t)spo2_serial;
+    vitals[3] = (uint8_t)rr_serial;
+    sys_put_le16((uint16_t)temp_serial, &vitals[4]);
+    sys_put_le16(quality->perfusion_ir, &vitals[6]);
+    vitals[8] = quality->confidence;
+    vitals[9] = quality->probe_off_reason;
+    vitals[10] = (ecg_lead_off_state ? HPI_VITALS_FLAG_ECG_LEAD_OFF : 0) |
+                 (ppg_lead_off_state ? HPI_VITALS_FLAG_PPG_LEAD_OFF : 0);
+    vitals[11] = global_batt_level;
+
+    if (memcmp(vitals, last_vitals, sizeof(vitals)) == 0 &&
+        (now - last_vitals_time) < HPI_VITALS_INTERVAL_MS)
+    {
+        return;
+    }
+
+    memcpy(last_vitals, vitals, sizeof(vitals));
+    last_vitals_time = now;
+
+    send_framed_packet(CES_CMDIF_TYPE_VITALS, vitals, sizeof(vitals), HPI_USB_PKT_VITALS);
+}
+
+// Typed records go on the session log timeline, next to the waveform
+// blocks, and to the flash ring when it is running (no SD card)
+static bool log_records_enabled(void)
+{
+#ifdef CONFIG_HEALTHYPI_LOG_FLASH_RING
+    return settings_log_data_enabled || hpi_log_ring_active();
+#else
+    return settings_log_data_enabled;
+#endif
+}
+
+static void log_record(uint8_t type, const void *rec, uint8_t len)
+{
+    if (settings_log_data_enabled)
+    {
+        hpi_datalog_add_record(type, rec, len);
+    }
+#ifdef CONFIG_HEALTHYPI_LOG_FLASH_RING
+    hpi_log_ring_add_record(type, rec, len);
+#endif
+}
+
+static void log_vitals_if_due(void)
+{
+    static int64_t last_log_time;
+    struct hpi_log_rec_vitals rec;
+    int64_t now = k_uptime_get();
+
+    if (!log_records_enabled() || (now - last_log_time) < HPI_VITALS_INTERVAL_MS)
+    {
+        return;
+    }
+    last_log_time = now;
+
+    rec.hr = (uint8_t)hr_serial;
+    rec.hr_source = (uint8_t)m_hr_source;
+    rec.spo2 = (uint8_t)spo2_serial;
+    rec.resp_rate = (uint8_t)rr_serial;
+    rec.temp = sys_cpu_to_le16(temp_serial);
+    rec.flags = (ecg_lead_off_state ? HPI_LOG_REC_FLAG_ECG_LEAD_OFF : 0) |
+                (ppg_lead_off_state ? HPI_LOG_REC_FLAG_PPG_LEAD_OFF : 0);
+
+    log_record(HPI_LOG_REC_VITALS, &rec, sizeof(rec));
+}
+
+static void log_ppg_quality(const spo2_quality_metrics_t *quality)
+{
+    struct hpi_log_rec_ppg_quality rec = {
+        .perfusion_ir = sys_cpu_to_le16(quality->perfusion_ir),
+        .perfusion_red = sys_cpu_to_le16(quality->perfusion_red),
+        .signal_strength = sys_cpu_to_le16(quality->signal_strength),
+        .confidence = quality->confidence,
+        .flags = (quality->valid ? HPI_LOG_REC_PPG_VALID : 0) |
+                 (quality->probe_off ? HPI_LOG_REC_PPG_PROBE_OFF : 0) |
+                 (quality->probe_off_filtered ? HPI_LOG_REC_PPG_PROBE_OFF_FILTERED : 0),
+        .probe_off_reason = quality->probe_off_reason,
+    };
+
+    log_record(HPI_LOG_REC_PPG_QUALITY, &rec, sizeof(rec));
+}
+
+static void log_lead_off(enum hpi_log_lead lead, bool lead_off)
+{
+    struct hpi_log_rec_lead_off rec = {
+        .lead = lead,
+        .lead_off = lead_off,
+    };
+
+    log_record(HPI_LOG_REC_LEAD_OFF, &rec, sizeof(rec));
+
+#ifdef CONFIG_HEALTHYPI_LOG_EVENT_CAPTURE
+    if (lead_off)
+    {
+        hpi_log_event_trigger(HPI_LOG_EVENT_LEAD_OFF, lead, 1);
+    }
+#endif
+}
+
 void sendData(int32_t ecg_sample, int32_t bioz_sample, int32_t raw_red, int32_t raw_ir, int32_t temp, uint8_t hr,
               uint8_t rr, uint8_t spo2, bool _bioZSkipSample)
 {
@@ -367,7 +560,7 @@ void sendData(int32_t ecg_sample, int32_t bioz_sample, int32_t raw_red, int32_t
         memcpy(consolidated_packet, DataPacketHeader, 5);
         memcpy(consolidated_packet + 5, DataPacket, DATA_LEN);
         memcpy(consolidated_packet + 5 + DATA_LEN, DataPacketFooter, 2);
-        send_usb_cdc(consolidated_packet, sizeof(consolidated_packet));
+        hpi_usb_stream_send(HPI_USB_PKT_WAVEFORM, consolidated_packet, sizeof(consolidated_packet));
     }
 
     if (settings_send_rpi_uart_enabled)
@@ -462,32 +655,12 @@ void send_data_text_1(int32_t in_sample)
     send_usb_cdc(data, strlen(data));
 }*/
 
-// Start a new session log
-void flush_current_session_logs()
+// Write out the partially filled log block and clear the session header;
+// -ETIMEDOUT if the log writer has not closed the file yet
+int flush_current_session_logs()
 {
-    // if data is pending in the log Buffer
-
-    /*if ((current_session_ecg_counter > 0) && (write_to_file))
-    {
-        hpi_log_session_write_file(ECG_DATA);
-    }
-
-    if ((current_session_ppg_counter > 0) && (write_to_file))
-    {
-        hpi_log_session_write_file(PPG_DATA);
-    }*/
-
-    // current_session_log_id = 0;
-    for (int i = 0; i < LOG_BUFFER_LENGTH; i++)
-    {
-        log_buffer[i].log_ecg_sample = 0;
-        log_buffer[i].log_ppg_sample = 0;
-        log_buffer[i].log_bioz_sample = 0;
-    }
+    int rc = hpi_datalog_flush();
 
-    current_session_ecg_counter = 0;
-    current_session_ppg_counter = 0;
-    current_session_bioz_counter = 0;
     hpi_log_session_header.session_start_time.day = 0;
     hpi_log_session_header.session_start_time.hour = 0;
     hpi_log_session_header.session_start_time.minute = 0;
@@ -498,70 +671,76 @@ void flush_current_session_logs()
     hpi_log_session_header.session_id = 0;
     hpi_log_session_header.session_size = 0;
     hpi_log_session_header.file_no = 0;
+
+    return rc;
 }
 
-void record_session_add_ppg_point(int16_t ppg_sample)
+void ppg_buff_for_pkt(int16_t ppg_data_in)
 {
-    if (current_session_ppg_counter < LOG_BUFFER_LENGTH)
+    if (serial_ppg_counter < HPI_OV3_DATA_IR_LEN)
     {
-        log_buffer[current_session_ppg_counter++].log_ppg_sample = ppg_sample;
+        ppg_serial_streaming[serial_ppg_counter++] = ppg_data_in;
     }
     else
     {
-        hpi_log_session_write_file(PPG_DATA);
-        current_session_ppg_counter = 0;
-        log_buffer[current_session_ppg_counter++].log_ppg_sample = ppg_sample;
+        send_ppg_data_ov3_format();
+        serial_ppg_counter = 0;
+        memset(ppg_serial_streaming, 0, sizeof(ppg_serial_streaming));
+        ppg_serial_streaming[serial_ppg_counter++] = ppg_data_in;
     }
 }
 
-// Add a log point to the current session log
-void record_session_add_ecg_point(int32_t *ecg_samples, uint8_t ecg_len, int32_t *bioz_samples, uint8_t bioz_len)
+// OV3 batching: 8 ECG samples + 4 BioZ samples (BioZ runs at half the ECG
+// rate and is duplicated in the data points) per ECG/BioZ packet, and 8 PPG
+// samples per PPG packet. The compact format uses the same batches.
+static void hpi_ov3_add_sample(const struct hpi_sensor_data_point_t *data_point, bool compact)
 {
-    if (current_session_ecg_counter < LOG_BUFFER_LENGTH)
+    ecg_serial_streaming[serial_ecg_counter] = data_point->ecg_sample;
+    if ((serial_ecg_counter & 0x01) == 0 && serial_bioz_counter < HPI_OV3_DATA_BIOZ_LEN)
     {
-        // printk("Writing dataa to the file\n");
-        for (int i = 0; i < ecg_len; i++)
+        resp_serial_streaming[serial_bioz_counter++] = data_point->bioz_sample;
+    }
+    serial_ecg_counter++;
+
+    if (serial_ecg_counter >= HPI_OV3_DATA_ECG_LEN)
+    {
+        if (compact)
         {
-            // k_sem_give(&log_sem);
-            log_buffer[current_session_ecg_counter++].log_ecg_sample = ecg_samples[i];
+            send_ecg_bioz_data_compact_format(ecg_serial_streaming, serial_ecg_counter,
+                                              resp_serial_streaming, serial_bioz_counter);
         }
-
-        for (int i = 0; i < bioz_len; i++)
+        else
         {
-            // k_sem_give(&log_sem);
-            log_buffer[current_session_bioz_counter++].log_bioz_sample = bioz_samples[i];
+            send_ecg_bioz_data_ov3_format(ecg_serial_streaming, serial_ecg_counter,
+                                          resp_serial_streaming, serial_bioz_counter, hr_serial, rr_serial);
         }
+        serial_ecg_counter = 0;
+        serial_bioz_counter = 0;
     }
-    else
-    {
 
-        hpi_log_session_write_file(ECG_DATA);
-        current_session_ecg_counter = 0;
-        current_session_bioz_counter = 0;
-        for (int i = 0; i < ecg_len; i++)
+    ppg_serial_streaming[serial_ppg_counter++] = (int16_t)data_point->ppg_sample_red;
+    if (serial_ppg_counter >= HPI_OV3_DATA_RED_LEN)
+    {
+        if (compact)
         {
-            log_buffer[current_session_ecg_counter++].log_ecg_sample = ecg_samples[i];
+            send_ppg_data_compact_format(ppg_serial_streaming, serial_ppg_counter);
         }
-
-        for (int i = 0; i < bioz_len; i++)
+        else
         {
-            log_buffer[current_session_bioz_counter++].log_bioz_sample = bioz_samples[i];
+            send_ppg_data_ov3_format();
         }
+        serial_ppg_counter = 0;
     }
 }
 
-void ppg_buff_for_pkt(int16_t ppg_data_in)
+static void send_data_text(int32_t ecg_sample, int32_t bioz_sample, int32_t raw_red)
 {
-    if (serial_ppg_counter < HPI_OV3_DATA_IR_LEN)
-    {
-        ppg_serial_streaming[serial_ppg_counter++] = ppg_data_in;
-    }
-    else
+    char data[40];
+    int len = snprintf(data, sizeof(data), "%d\t%d\t%d\r\n", ecg_sample, bioz_sample, raw_red);
+
+    if (settings_send_usb_enabled && len > 0)
     {
-        send_ppg_data_ov3_format();
-        serial_ppg_counter = 0;
-        memset(ppg_serial_streaming, 0, sizeof(ppg_serial_streaming));
-        ppg_serial_streaming[serial_ppg_counter++] = ppg_data_in;
+        hpi_usb_stream_send(HPI_USB_PKT_WAVEFORM, (const uint8_t *)data, len);
     }
 }
 
@@ -753,6 +932,7 @@ void data_thread(void)
                 spo2_time_count = 0;
                 maxim_heart_rate_and_oxygen_saturation_with_quality(irBuffer, bufferLength, redBuffer, 
                     &m_spo2, &validSPO2, &m_hr, &validHeartRate, &quality_metrics, &spo2_probe_state);
+                log_ppg_quality(&quality_metrics);
                 
                 // Log quality metrics for debugging
                 if (validSPO2 || validHeartRate) {
@@ -917,6 +1097,7 @@ void data_thread(void)
                         ppg_lead_off_state = probe_off_filtered;
                         LOG_INF("PPG UI state updated: %s (after %lld ms)",
                                 ppg_lead_off_state ? "LEAD-OFF" : "CONNECTED", elapsed_ms);
+                        log_lead_off(HPI_LOG_LEAD_PPG, ppg_lead_off_state);
                         
                         // Immediately publish lead-off state change for both SpO2 and HR (PPG source)
                         // This ensures display updates to show "--" even if no valid readings
@@ -1022,6 +1203,7 @@ void data_thread(void)
                     // Transitioning to lead-off
                     ecg_lead_off_state = true;
                     LOG_INF("ECG Lead-Off DETECTED (electrodes disconnected for %lld ms)", elapsed_ms);
+                    log_lead_off(HPI_LOG_LEAD_ECG, true);
                     
                     // Immediately publish lead-off state change for ECG HR and RR
                     // This ensures display updates to show "--" even if no valid readings
@@ -1043,6 +1225,7 @@ void data_thread(void)
                     // Transitioning to connected
                     ecg_lead_off_state = false;
                     LOG_INF("ECG Lead-On DETECTED (electrodes connected for %lld ms)", elapsed_ms);
+                    log_lead_off(HPI_LOG_LEAD_ECG, false);
                     
                     // Immediately publish lead-on state change for ECG HR and RR
                     if (hpi_data_get_hr_source() == HR_SOURCE_ECG) {
@@ -1066,36 +1249,85 @@ void data_thread(void)
                 resp_i16_buf[i] = (int16_t)(ecg_bioz_sensor_sample.bioz_samples[i] >> 4);
             }*/
 
+            // Storage and the int24 BLE stream carry the 18-bit ECG code;
+            // the USB formats keep the driver's value for host compatibility
+            struct hpi_sensor_data_point_t code_point = hpi_sensor_data_point;
+            code_point.ecg_sample >>= HPI_ECG_CODE_SHIFT;
+
             if (m_stream_mode == HPI_STREAM_MODE_USB)
             {
                 usb_send_count++;
-                sendData(hpi_sensor_data_point.ecg_sample, hpi_sensor_data_point.bioz_sample, hpi_sensor_data_point.ppg_sample_red,
-                         hpi_sensor_data_point.ppg_sample_ir, temp_serial, hr_serial, rr_serial, spo2_serial, 0);
-            }
-            else if (m_stream_mode == HPI_STREAM_MODE_BLE)
-            {
-                ble_send_count++;
-                if (ecg_buffer_count < BLE_ECG_BUFFER_SIZE)
+
+                // Restart OV3 batching on a format switch so a half-filled
+                // batch from an earlier OV3 run isn't flushed later
+                static enum hpi5_data_format last_stream_format = DATA_FMT_OPENVIEW;
+                if (m_stream_format != last_stream_format)
                 {
-                    ble_ecg_buffer[ecg_buffer_count++] = hpi_sensor_data_point.ecg_sample;
+                    serial_ecg_counter = 0;
+                    serial_bioz_counter = 0;
+                    serial_ppg_counter = 0;
+                    last_stream_format = m_stream_format;
                 }
-                else
+
+                switch (m_stream_format)
                 {
-                    ble_ecg_notify(ble_ecg_buffer, BLE_ECG_BUFFER_SIZE);
-                    ecg_buffer_count = 0;
+                case DATA_FMT_HPI5_COMPACT:
+                    hpi_ov3_add_sample(&hpi_sensor_data_point, true);
+                    send_vitals_if_due(&quality_metrics);
+                    break;
+                case DATA_FMT_HPI5_OV3:
+                    hpi_ov3_add_sample(&hpi_sensor_data_point, false);
+                    break;
+                case DATA_FMT_PLAIN_TEXT:
+                    send_data_text(hpi_sensor_data_point.ecg_sample, hpi_sensor_data_point.bioz_sample,
+                                   hpi_sensor_data_point.ppg_sample_red);
+                    break;
+                case DATA_FMT_OPENVIEW:
+                default:
+                    sendData(hpi_sensor_data_point.ecg_sample, hpi_sensor_data_point.bioz_sample, hpi_sensor_data_point.ppg_sample_red,
+                             hpi_sensor_data_point.ppg_sample_ir, temp_serial, hr_serial, rr_serial, spo2_serial, 0);
+                    break;
                 }
+            }
+            else if (m_stream_mode == HPI_STREAM_MODE_BLE)
+            {
+                ble_send_count++;
 
-                if (bioz_buffer_count < BLE_ECG_BUFFER_SIZE)
+                // Aggregated stream characteristic supersedes the per-channel
+                // notifications for clients that subscribe to it
+                if (ble_stream_enabled())
                 {
-                    ble_bioz_buffer[bioz_buffer_count++] = hpi_sensor_data_point.bioz_sample;
+                    static bool ble_bioz_phase = false;
+
+                    // BioZ runs at half the ECG rate; every other data point repeats it
+                    ble_bioz_phase = !ble_bioz_phase;
+                    ble_stream_add_sample(code_point.ecg_sample, hpi_sensor_data_point.bioz_sample,
+                                          hpi_sensor_data_point.ppg_sample_red, ble_bioz_phase);
                 }
                 else
                 {
-                    ble_bioz_notify(ble_bioz_buffer, BLE_ECG_BUFFER_SIZE);
-                    bioz_buffer_count = 0;
+                    if (ecg_buffer_count < BLE_ECG_BUFFER_SIZE)
+                    {
+                        ble_ecg_buffer[ecg_buffer_count++] = hpi_sensor_data_point.ecg_sample;
+                    }
+                    else
+                    {
+                        ble_ecg_notify(ble_ecg_buffer, BLE_ECG_BUFFER_SIZE);
+                        ecg_buffer_count = 0;
+                    }
+
+                    if (bioz_buffer_count < BLE_ECG_BUFFER_SIZE)
+                    {
+                        ble_bioz_buffer[bioz_buffer_count++] = hpi_sensor_data_point.bioz_sample;
+                    }
+                    else
+                    {
+                        ble_bioz_notify(ble_bioz_buffer, BLE_ECG_BUFFER_SIZE);
+                        bioz_buffer_count = 0;
+                    }
+
+                    ble_ppg_notify(hpi_sensor_data_point.ppg_sample_red);
                 }
-                
-                ble_ppg_notify(hpi_sensor_data_point.ppg_sample_red);
 
                 // Move HR notify to ZBus
                 // ble_hrs_notify(ecg_bioz_sensor_sample.hr);
@@ -1111,6 +1343,34 @@ void data_thread(void)
                 // Plot data is handled below by automatic screen detection
             }
 
+            if (settings_log_data_enabled)
+            {
+                hpi_datalog_add_point(&code_point);
+            }
+#ifdef CONFIG_HEALTHYPI_LOG_FLASH_RING
+            hpi_log_ring_add_point(&code_point);
+#endif
+#ifdef CONFIG_HEALTHYPI_LOG_EVENT_CAPTURE
+            hpi_log_event_add_point(&code_point);
+            hpi_log_event_check_vitals(hr_serial, spo2_serial);
+#endif
+
+            if (log_records_enabled())
+            {
+                // rtor_new follows the MAX30001 RRINT status bit, so beats
+                // with equal intervals are each logged
+                if (hpi_sensor_data_point.rtor_new && hpi_sensor_data_point.rtor != 0)
+                {
+                    struct hpi_log_rec_rr_interval rec = {
+                        .rr_ms = sys_cpu_to_le16(hpi_sensor_data_point.rtor),
+                    };
+
+                    log_record(HPI_LOG_REC_RR_INTERVAL, &rec, sizeof(rec));
+                }
+
+                log_vitals_if_due();
+            }
+
             // Automatic plot updates: Always send to plot queue when display enabled 
             // and on a waveform screen, regardless of streaming mode (USB/BLE/Plot)
             // This implements Phase 3 Option A: plots auto-pause/resume based on screen
@@ -1146,6 +1406,10 @@ void data_thread(void)
 
         if (loop_samples_processed == 0) {
             k_sleep(K_USEC(500));  // 500us sleep when idle (no samples)
+        } else if (hpi_usb_fc_enabled()) {
+            // Host-granted credits already bound what we put in the ring;
+            // degradation is handled per packet, so never stall here
+            k_sleep(K_USEC(100));
         } else {
             // Check USB buffer health for backpressure
             uint8_t usb_util = get_usb_buffer_utilization();
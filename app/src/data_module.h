@@ -27,15 +27,6 @@
 
 #include "hpi_common_types.h"
 
-#define LOG_SAMPLE_RATE_SPS 125
-#define LOG_WRITE_INTERVAL 10      // Write to file every 10 seconds
-#define LOG_BUFFER_LENGTH 1250 + 1 // 125Hz * 10 seconds
-
-#define ECG_DATA 0
-#define PPG_DATA 1
-#define RESP_DATA 2
-#define ALL_DATA 3
-
 struct hpi_computed_data_t {
     int32_t hr;
     uint32_t rr;
@@ -51,8 +42,19 @@ enum hpi_stream_modes {
     HPI_STREAM_MODE_PLOT,
 };
 
+// Wire format used for USB streaming
+enum hpi5_data_format {
+    DATA_FMT_OPENVIEW,      // One 22-byte packet per sample (OpenView 2)
+    DATA_FMT_PLAIN_TEXT,    // Tab separated ECG/BioZ/PPG text lines
+    DATA_FMT_HPI5_OV3,      // Batched ECG/BioZ and PPG packets
+    DATA_FMT_HPI5_COMPACT,  // Sample-only int24/int16 batches + separate 1 Hz vitals packet
+};
+
+void hpi_data_set_stream_mode(enum hpi_stream_modes mode);
+void hpi_data_set_stream_format(enum hpi5_data_format format);
+
 // HR source selection functions
 void hpi_data_set_hr_source(enum hpi_hr_source source);
 enum hpi_hr_source hpi_data_get_hr_source(void);
 
-void flush_current_session_logs(void);
\ No newline at end of file
+int flush_current_session_logs(void);
\ No newline at end of file
@@ -33,453 +33,2167 @@
 #include <stdio.h>
 #include <string.h>
 #include <zephyr/random/random.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/crc.h>
+#include <zephyr/devicetree.h>
 
 #include "ble_module.h"
 #include "datalog_module.h"
 #include "cmd_module.h"
 #include "data_module.h"
+#include "hpi_common_types.h"
+#include "hpi_log_format.h"
+#include "hpi_log_codec.h"
+#include "hpi_log_edf.h"
+#include "log_catalog.h"
+#include "fs_module.h"
+#include "log_ring.h"
+#include "log_event.h"
 
 uint8_t buf_log[1024]; // 56 bytes / session, 18 sessions / packet
 
 extern struct fs_mount_t *mp_sd;
-extern uint16_t current_session_ecg_counter;
-extern uint16_t current_session_ppg_counter;
-extern uint16_t current_session_bioz_counter;
-extern struct hpi_sensor_logging_data_t log_buffer[LOG_BUFFER_LENGTH];
 struct hpi_log_session_header_t hpi_log_session_header;
 extern bool settings_log_data_enabled;
 extern bool sd_card_present;
 
+// MAX30001: ECG LSB = VREF / (2^17 * gain), VREF = 1 V, gain = 20 V/V << ecg-gain.
+// Sessions store the 18-bit code (data_module drops the driver's << 8), so
+// one stored count is one LSB
+#define HPI_LOG_ECG_GAIN_VV (20 << DT_PROP_OR(DT_ALIAS(max30001), ecg_gain, 2))
+#define HPI_LOG_ECG_SCALE_UV (1000000.0f / (131072.0f * HPI_LOG_ECG_GAIN_VV))
+
+// Log blocks cycle between data_thread, which fills them, and the writer
+// thread, which owns all SD I/O for block data. A full block is handed over
+// through q_log_full and comes back through q_log_free once it is on disk,
+// so the sample path never waits for the card. data_thread can hold two
+// at once, a data block and a record block.
+#define HPI_LOG_NUM_BLOCKS 5
+#define HPI_LOG_FLUSH_TIMEOUT_MS 2000
+
+#ifdef CONFIG_HEALTHYPI_LOG_SYNC_INTERVAL_MS
+#define HPI_LOG_SYNC_INTERVAL_MS CONFIG_HEALTHYPI_LOG_SYNC_INTERVAL_MS
+#else
+#define HPI_LOG_SYNC_INTERVAL_MS 5000
+#endif
+
+static struct hpi_log_block log_blocks[HPI_LOG_NUM_BLOCKS];
+K_MSGQ_DEFINE(q_log_free, sizeof(struct hpi_log_block *), HPI_LOG_NUM_BLOCKS, 4);
+// One extra slot for the NULL end-of-session marker
+K_MSGQ_DEFINE(q_log_full, sizeof(struct hpi_log_block *), HPI_LOG_NUM_BLOCKS + 1, 4);
+K_SEM_DEFINE(sem_log_closed, 0, 1);
+// Serialises hpi_datalog_flush() callers; log_close_pending is set while
+// an end marker is queued that the writer hasn't reached yet
+K_MUTEX_DEFINE(mutex_log_flush);
+static bool log_close_pending;
+
+// Writer thread only: the session file stays open between blocks
+static struct fs_file_t log_file;
+static bool log_file_open;
+static bool log_file_dirty;
+static uint16_t log_file_session;
+static int64_t log_file_last_sync;
+static uint32_t log_file_seq;       // Next block number in the open file
+static uint32_t log_file_points;    // Points in the blocks handed to log_chunk_write()
+static uint8_t log_file_no;         // HPI_LOG_FILE_NO_BIN or _EDF
+
+// Blocks are staged and written in chunks that end on a multiple of the
+// chunk size in the file, so the card sees whole, aligned clusters rather
+// than a read-modify-write per block. log_file_pos is where the staged
+// data goes; the file itself is preallocated and may be longer until it
+// is truncated at close.
+#ifdef CONFIG_HEALTHYPI_LOG_WRITE_CHUNK
+#define HPI_LOG_WRITE_CHUNK CONFIG_HEALTHYPI_LOG_WRITE_CHUNK
+#else
+#define HPI_LOG_WRITE_CHUNK 4096
+#endif
+
+#ifdef CONFIG_HEALTHYPI_LOG_EDF_DEFAULT
+#define HPI_LOG_DEFAULT_OUTPUT HPI_LOG_OUTPUT_EDF
+#else
+#define HPI_LOG_DEFAULT_OUTPUT HPI_LOG_OUTPUT_BIN
+#endif
+
+#ifdef CONFIG_HEALTHYPI_LOG_PREALLOC_KB
+#define HPI_LOG_PREALLOC_BYTES ((off_t)CONFIG_HEALTHYPI_LOG_PREALLOC_KB * 1024)
+#else
+#define HPI_LOG_PREALLOC_BYTES ((off_t)8192 * 1024)
+#endif
+
+BUILD_ASSERT(HPI_LOG_WRITE_CHUNK % HPI_LOG_BLOCK_SIZE == 0, "Write chunk must be whole blocks");
+
+static uint8_t log_chunk[HPI_LOG_WRITE_CHUNK] __aligned(4);
+static size_t log_chunk_len;
+static size_t log_chunk_size;       // Cluster size, capped at HPI_LOG_WRITE_CHUNK
+static off_t log_file_pos;
+
+// The open file's written length, for readers on other threads: its
+// directory size is the preallocation until it is closed
+static struct k_spinlock log_live_lock;
+static bool log_live_open;
+static uint16_t log_live_session;
+static uint8_t log_live_file_no;
+static uint32_t log_live_len;
+
+static void log_live_publish(void)
+{
+    k_spinlock_key_t key = k_spin_lock(&log_live_lock);
+
+    log_live_open = log_file_open;
+    log_live_session = log_file_session;
+    log_live_file_no = log_file_no;
+    log_live_len = (uint32_t)log_file_pos;
+    k_spin_unlock(&log_live_lock, key);
+}
+
+// Sparse time index of the open session, appended to the file on close.
+// When it fills up every other entry is dropped and the stride doubles, so
+// any session length fits in a fixed buffer.
+#define HPI_LOG_INDEX_MAX_ENTRIES 256
+#define HPI_LOG_INDEX_STRIDE 8      // Blocks, ~5 s of data
+
+static struct hpi_log_index_entry log_index[HPI_LOG_INDEX_MAX_ENTRIES];
+static uint16_t log_index_count;
+static uint32_t log_index_stride;
+static uint32_t log_index_offset;   // Where the last closed session's index went, 0 if none
+
+// Block being filled; NULL while waiting for the writer to return one
+static struct hpi_log_block *log_block;
+static uint16_t log_block_points;
+static uint16_t log_session_id;
+static uint32_t log_session_nonce;
+static int64_t log_session_start;
+static uint32_t log_session_points;
+static bool log_session_active;
+static uint8_t log_session_file_no = HPI_LOG_FILE_NO_BIN;
+static struct hpi_datalog_stats log_stats;
+
+// Record block being filled. It goes out when full or once its first record
+// is HPI_LOG_RECORD_MAX_AGE_MS old, which bounds how far records trail the
+// data blocks around them in the file.
+#define HPI_LOG_RECORD_MAX_AGE_MS 5000
+
+static struct hpi_log_block *log_rec_block;
+static uint16_t log_rec_count;
+static uint16_t log_rec_len;
+static uint32_t log_rec_first_ms;
+K_MUTEX_DEFINE(mutex_log_block);
+
+void hpi_datalog_init_header(struct hpi_log_file_header *hdr, uint16_t session_id,
+                             const struct healthypi_time_t *start, uint8_t codec)
+{
+    memset(hdr, 0, sizeof(*hdr));
+    hdr->magic = sys_cpu_to_le32(HPI_LOG_FILE_MAGIC);
+    hdr->version = sys_cpu_to_le16(HPI_LOG_VERSION);
+    hdr->header_size = sys_cpu_to_le16(HPI_LOG_HEADER_SIZE);
+    hdr->block_size = sys_cpu_to_le16(HPI_LOG_BLOCK_SIZE);
+    hdr->session_id = sys_cpu_to_le16(session_id);
+    if (start != NULL)
+    {
+        hdr->start_time[0] = start->year;
+        hdr->start_time[1] = start->month;
+        hdr->start_time[2] = start->day;
+        hdr->start_time[3] = start->hour;
+        hdr->start_time[4] = start->minute;
+        hdr->start_time[5] = start->second;
+    }
+    hdr->points_per_frame = HPI_LOG_POINTS_PER_FRAME;
+    hdr->codec = codec;
+
+    // Zero is what the catalog records for formats without a nonce
+    do
+    {
+        hdr->nonce = sys_rand32_get();
+    } while (hdr->nonce == 0);
+
+    // BioZ and PPG are logged as raw ADC codes
+    hdr->n_channels = 3;
+    hdr->channels[0] = (struct hpi_log_channel_desc){HPI_LOG_CH_ECG, HPI_LOG_SAMPLE_BYTES, 128, HPI_LOG_ECG_SCALE_UV, "uV"};
+    hdr->channels[1] = (struct hpi_log_channel_desc){HPI_LOG_CH_BIOZ, HPI_LOG_SAMPLE_BYTES, 64, 1.0f, "raw"};
+    hdr->channels[2] = (struct hpi_log_channel_desc){HPI_LOG_CH_PPG, HPI_LOG_SAMPLE_BYTES, 64, 1.0f, "raw"};
+
+    hdr->crc32 = sys_cpu_to_le32(crc32_ieee((const uint8_t *)hdr, offsetof(struct hpi_log_file_header, crc32)));
+}
+
 void write_header_to_new_session()
 {
-    struct fs_file_t file;
-    int rc;
-    char session_name[200] = "/SD:/";
-    char ppg_session_name[200] = "/SD:/";
-    char resp_session_name[200] = "/SD:/";
+    static uint8_t edf_hdr[HPI_LOG_EDF_HEADER_SIZE];
+    struct hpi_log_file_header hdr;
+    struct fs_file_t file;
+    const void *hdr_data = &hdr;
+    size_t hdr_len = sizeof(hdr);
+    char path[32];
+    int rc;
+
+    hpi_datalog_init_header(&hdr, hpi_log_session_header.session_id, &hpi_log_session_header.session_start_time,
+                            IS_ENABLED(CONFIG_HEALTHYPI_LOG_COMPRESSION) ? HPI_LOG_CODEC_RICE : HPI_LOG_CODEC_RAW24);
+
+    if (log_session_file_no == HPI_LOG_FILE_NO_EDF)
+    {
+        hpi_log_edf_init_header(edf_hdr, hdr.start_time, HPI_LOG_ECG_GAIN_VV);
+        hdr_data = edf_hdr;
+        hdr_len = sizeof(edf_hdr);
+    }
+
+    hpi_datalog_session_path(hpi_log_session_header.session_id, log_session_file_no, path, sizeof(path));
+
+    fs_file_t_init(&file);
+    rc = fs_open(&file, path, FS_O_CREATE | FS_O_WRITE | FS_O_TRUNC);
+    if (rc < 0)
+    {
+        printk("FAIL: open %s: %d\n", path, rc);
+    }
+    else
+    {
+        // Reserve the session's space up front while the file is still
+        // empty, so it can be one contiguous extent. The writer truncates
+        // it to the real length at close.
+        if (HPI_LOG_PREALLOC_BYTES > 0 && hpi_fs_preallocate(&file, HPI_LOG_PREALLOC_BYTES) < 0)
+        {
+            printk("Log preallocation failed, growing on demand\n");
+        }
+
+        rc = fs_write(&file, hdr_data, hdr_len);
+        if (rc < 0)
+        {
+            printk("File %s header write Fail %d\n", path, rc);
+        }
+        fs_close(&file);
+    }
+
+    if (rc >= 0)
+    {
+        struct hpi_log_catalog_entry entry = {
+            .session_id = hpi_log_session_header.session_id,
+            .file_no = log_session_file_no,
+            .flags = HPI_LOG_CAT_OPEN,
+            .size = hdr_len,
+            .nonce = (log_session_file_no == HPI_LOG_FILE_NO_EDF) ? 0 : sys_le32_to_cpu(hdr.nonce),
+        };
+
+        memcpy(entry.start_time, hdr.start_time, sizeof(entry.start_time));
+        hpi_log_catalog_add(&entry);
+    }
+
+    // Logging is off until the caller enables it, so no block of this
+    // session can reach the writer before the header is on disk
+    k_mutex_lock(&mutex_log_block, K_FOREVER);
+    log_session_id = hpi_log_session_header.session_id;
+    log_session_nonce = hdr.nonce;
+    log_session_start = k_uptime_get();
+    log_session_points = 0;
+    log_session_active = (rc >= 0);
+    log_block_points = 0;
+    log_rec_count = 0;
+    log_rec_len = 0;
+    memset(&log_stats, 0, sizeof(log_stats));
+    k_mutex_unlock(&mutex_log_block);
+
+    printk("Header written to file... %d\n", hpi_log_session_header.session_id);
+}
+
+// Hand the current block to the writer thread. Called with
+// mutex_log_block held; never blocks.
+static void hpi_datalog_submit_block(void)
+{
+    if (log_block == NULL || log_block_points == 0)
+    {
+        return;
+    }
+
+    log_block->hdr.magic = sys_cpu_to_le32(HPI_LOG_BLOCK_MAGIC);
+    log_block->hdr.session_id = sys_cpu_to_le16(log_session_id);
+    log_block->hdr.nonce = log_session_nonce;
+    log_block->hdr.n_points = sys_cpu_to_le16(log_block_points);
+
+    // Every block is either free, being filled or queued, so q_log_full
+    // (one slot per block) can't be full here
+    k_msgq_put(&q_log_full, &log_block, K_NO_WAIT);
+
+    log_block = NULL;
+    log_block_points = 0;
+}
+
+// As hpi_datalog_submit_block, for the record block
+static void hpi_datalog_submit_records(void)
+{
+    if (log_rec_block == NULL || log_rec_count == 0)
+    {
+        return;
+    }
+
+    log_rec_block->hdr.magic = sys_cpu_to_le32(HPI_LOG_RECORD_MAGIC);
+    log_rec_block->hdr.session_id = sys_cpu_to_le16(log_session_id);
+    log_rec_block->hdr.nonce = log_session_nonce;
+    log_rec_block->hdr.n_points = sys_cpu_to_le16(log_rec_count);
+    log_rec_block->hdr.timestamp_ms = sys_cpu_to_le32(log_rec_first_ms);
+
+    k_msgq_put(&q_log_full, &log_rec_block, K_NO_WAIT);
+
+    log_rec_block = NULL;
+    log_rec_count = 0;
+    log_rec_len = 0;
+}
+
+void hpi_datalog_add_record(uint8_t type, const void *data, uint8_t len)
+{
+    struct hpi_log_record_header rec;
+    uint32_t now = (uint32_t)(k_uptime_get() - log_session_start);
+
+    if (sizeof(rec) + len > HPI_LOG_BLOCK_PAYLOAD)
+    {
+        return;
+    }
+
+    k_mutex_lock(&mutex_log_block, K_FOREVER);
+
+    if (log_rec_count > 0 &&
+        (log_rec_len + sizeof(rec) + len > HPI_LOG_BLOCK_PAYLOAD || now - log_rec_first_ms >= HPI_LOG_RECORD_MAX_AGE_MS))
+    {
+        hpi_datalog_submit_records();
+    }
+
+    if (log_rec_count == 0)
+    {
+        if (log_rec_block == NULL && k_msgq_get(&q_log_free, &log_rec_block, K_NO_WAIT) != 0)
+        {
+            log_rec_block = NULL;
+            log_stats.dropped_records++;
+            k_mutex_unlock(&mutex_log_block);
+            return;
+        }
+
+        memset(log_rec_block->payload, 0, sizeof(log_rec_block->payload));
+        log_rec_first_ms = now;
+    }
+
+    rec.type = type;
+    rec.len = len;
+    rec.timestamp_ms = sys_cpu_to_le32(now);
+    memcpy(&log_rec_block->payload[log_rec_len], &rec, sizeof(rec));
+    memcpy(&log_rec_block->payload[log_rec_len + sizeof(rec)], data, len);
+    log_rec_len += sizeof(rec) + len;
+    log_rec_count++;
+
+    k_mutex_unlock(&mutex_log_block);
+}
+
+void hpi_datalog_add_point(const struct hpi_sensor_data_point_t *point)
+{
+    uint8_t *frame;
+
+    k_mutex_lock(&mutex_log_block, K_FOREVER);
+
+    if (log_block_points == 0)
+    {
+        // Writer has fallen behind: drop samples rather than wait for it.
+        // The next block's timestamp marks the gap.
+        if (log_block == NULL && k_msgq_get(&q_log_free, &log_block, K_NO_WAIT) != 0)
+        {
+            log_block = NULL;
+            log_stats.overrun_points++;
+            k_mutex_unlock(&mutex_log_block);
+            return;
+        }
+
+        memset(log_block->payload, 0, sizeof(log_block->payload));
+        log_block->hdr.timestamp_ms = sys_cpu_to_le32((uint32_t)(k_uptime_get() - log_session_start));
+    }
+
+    // ECG every point; BioZ and PPG (64 SPS) once per frame
+    frame = &log_block->payload[(log_block_points / HPI_LOG_POINTS_PER_FRAME) * HPI_LOG_FRAME_SIZE];
+    if ((log_block_points % HPI_LOG_POINTS_PER_FRAME) == 0)
+    {
+        sys_put_le24((uint32_t)point->ecg_sample, &frame[0]);
+        sys_put_le24((uint32_t)point->bioz_sample, &frame[6]);
+        sys_put_le24((uint32_t)point->ppg_sample_red, &frame[9]);
+    }
+    else
+    {
+        sys_put_le24((uint32_t)point->ecg_sample, &frame[3]);
+    }
+
+    log_session_points++;
+
+    if (++log_block_points >= HPI_LOG_POINTS_PER_BLOCK)
+    {
+        hpi_datalog_submit_block();
+    }
+
+    k_mutex_unlock(&mutex_log_block);
+}
+
+// Submit the partial block and wait for the writer to drain the queue and
+// close the file, so it is complete once a session has been stopped.
+// -ETIMEDOUT if the writer is still busy: the session stays open in the
+// catalog and the next call waits for the same close.
+int hpi_datalog_flush(void)
+{
+    struct hpi_log_block *end_marker = NULL;
+
+    k_mutex_lock(&mutex_log_flush, K_FOREVER);
+
+    if (!log_close_pending)
+    {
+        k_mutex_lock(&mutex_log_block, K_FOREVER);
+        hpi_datalog_submit_block();
+        hpi_datalog_submit_records();
+        k_mutex_unlock(&mutex_log_block);
+
+        k_sem_reset(&sem_log_closed);
+        k_msgq_put(&q_log_full, &end_marker, K_NO_WAIT);
+        log_close_pending = true;
+    }
+
+    if (k_sem_take(&sem_log_closed, K_MSEC(HPI_LOG_FLUSH_TIMEOUT_MS)) != 0)
+    {
+        printk("Log writer did not drain in time\n");
+        k_mutex_unlock(&mutex_log_flush);
+        return -ETIMEDOUT;
+    }
+    log_close_pending = false;
+
+    // Record the final size in the catalog; the writer has truncated the
+    // file to it
+    if (log_session_active)
+    {
+        struct hpi_log_catalog_entry entry;
+
+        log_session_active = false;
+
+        if (hpi_log_catalog_find(log_session_id, log_session_file_no, &entry) == 0)
+        {
+            k_spinlock_key_t key = k_spin_lock(&log_live_lock);
+
+            if (log_live_session == log_session_id && log_live_file_no == log_session_file_no)
+            {
+                entry.size = log_live_len;
+            }
+            k_spin_unlock(&log_live_lock, key);
+
+            entry.n_points = log_session_points;
+            entry.index_offset = log_index_offset;
+            entry.flags &= ~HPI_LOG_CAT_OPEN;
+            hpi_log_catalog_update(&entry);
+        }
+    }
+
+    if (log_stats.blocks_written > 0 || log_stats.overrun_points > 0)
+    {
+        printk("Log: %u blocks written, %u write errors, %u points overrun, %u records dropped\n",
+               log_stats.blocks_written, log_stats.write_errors, log_stats.overrun_points,
+               log_stats.dropped_records);
+        printk("Log writes: p50 < %u us, p90 < %u us, p99 < %u us, max %u us\n",
+               hpi_datalog_write_percentile_us(&log_stats, 50), hpi_datalog_write_percentile_us(&log_stats, 90),
+               hpi_datalog_write_percentile_us(&log_stats, 99), log_stats.max_write_us);
+    }
+
+    k_mutex_unlock(&mutex_log_flush);
+
+    return 0;
+}
+
+// End any recording and wait for its file to be closed, before the card
+// is unmounted; -ETIMEDOUT if the writer still has it open
+int hpi_datalog_seal(void)
+{
+    bool recording = settings_log_data_enabled;
+
+    settings_log_data_enabled = false;
+    if (recording || log_close_pending)
+    {
+        return flush_current_session_logs();
+    }
+
+    return 0;
+}
+
+void hpi_datalog_get_stats(struct hpi_datalog_stats *stats)
+{
+    k_mutex_lock(&mutex_log_block, K_FOREVER);
+    *stats = log_stats;
+    k_mutex_unlock(&mutex_log_block);
+}
+
+uint32_t hpi_datalog_write_percentile_us(const struct hpi_datalog_stats *stats, uint8_t pct)
+{
+    uint32_t total = 0;
+    uint32_t count = 0;
+    uint32_t rank;
+
+    for (int i = 0; i < HPI_LOG_WRITE_HIST_BUCKETS; i++)
+    {
+        total += stats->write_hist[i];
+    }
+    if (total == 0)
+    {
+        return 0;
+    }
+
+    rank = (uint32_t)(((uint64_t)total * pct + 99) / 100);
+    for (int i = 0; i < HPI_LOG_WRITE_HIST_BUCKETS - 1; i++)
+    {
+        count += stats->write_hist[i];
+        if (count >= rank)
+        {
+            return HPI_LOG_WRITE_HIST_BASE_US << i;
+        }
+    }
+
+    return stats->max_write_us;
+}
+
+static void log_write_stats_add(int rc, uint32_t n_blocks, uint32_t elapsed_us)
+{
+    int bucket = 0;
+
+    while (bucket < HPI_LOG_WRITE_HIST_BUCKETS - 1 && elapsed_us >= (HPI_LOG_WRITE_HIST_BASE_US << bucket))
+    {
+        bucket++;
+    }
+
+    k_mutex_lock(&mutex_log_block, K_FOREVER);
+    if (rc < 0)
+    {
+        log_stats.write_errors++;
+    }
+    else
+    {
+        log_stats.blocks_written += n_blocks;
+    }
+    log_stats.write_hist[bucket]++;
+    log_stats.max_write_us = MAX(log_stats.max_write_us, elapsed_us);
+    k_mutex_unlock(&mutex_log_block);
+}
+
+// Write out whatever is staged. Normally a whole chunk; less only when a
+// sync or close cuts it short.
+static int log_chunk_write(void)
+{
+    uint32_t start;
+    int rc;
+
+    if (!log_file_open || log_chunk_len == 0)
+    {
+        return 0;
+    }
+
+    start = k_cycle_get_32();
+    rc = fs_seek(&log_file, log_file_pos, FS_SEEK_SET);
+    if (rc == 0)
+    {
+        rc = fs_write(&log_file, log_chunk, log_chunk_len);
+    }
+    log_write_stats_add(rc, log_chunk_len / HPI_LOG_BLOCK_SIZE, k_cyc_to_us_floor32(k_cycle_get_32() - start));
+
+    if (rc < 0)
+    {
+        printk("Log write at %u Fail %d\n", (uint32_t)log_file_pos, rc);
+    }
+    else
+    {
+        log_file_dirty = true;
+    }
+
+    // A failed chunk is dropped rather than retried forever; its blocks
+    // leave a gap in the sequence numbers
+    log_file_pos += log_chunk_len;
+    log_chunk_len = 0;
+    log_live_publish();
+
+    return rc;
+}
+
+static void log_index_add(uint32_t seq, uint32_t timestamp_ms)
+{
+    if (seq % log_index_stride != 0)
+    {
+        return;
+    }
+
+    if (log_index_count == HPI_LOG_INDEX_MAX_ENTRIES)
+    {
+        for (int i = 0; i < HPI_LOG_INDEX_MAX_ENTRIES / 2; i++)
+        {
+            log_index[i] = log_index[2 * i];
+        }
+        log_index_count = HPI_LOG_INDEX_MAX_ENTRIES / 2;
+        log_index_stride *= 2;
+
+        if (seq % log_index_stride != 0)
+        {
+            return;
+        }
+    }
+
+    log_index[log_index_count].timestamp_ms = sys_cpu_to_le32(timestamp_ms);
+    log_index[log_index_count].seq = sys_cpu_to_le32(seq);
+    log_index_count++;
+}
+
+// Append the time index after the last data block, padded to whole blocks
+static void log_file_write_index(void)
+{
+    static const uint8_t zeros[64];
+    struct hpi_log_index_header hdr;
+    size_t len = sizeof(hdr) + log_index_count * sizeof(struct hpi_log_index_entry);
+    size_t pad = ROUND_UP(len, HPI_LOG_BLOCK_SIZE) - len;
+    off_t offset;
+    int rc;
+
+    if (log_index_count == 0 || fs_seek(&log_file, log_file_pos, FS_SEEK_SET) != 0)
+    {
+        return;
+    }
+    offset = log_file_pos;
+
+    hdr.magic = sys_cpu_to_le32(HPI_LOG_INDEX_MAGIC);
+    hdr.session_id = sys_cpu_to_le16(log_file_session);
+    hdr.n_entries = sys_cpu_to_le16(log_index_count);
+    hdr.stride_blocks = sys_cpu_to_le32(log_index_stride);
+    hdr.crc32 = sys_cpu_to_le32(crc32_ieee((const uint8_t *)log_index, log_index_count * sizeof(struct hpi_log_index_entry)));
+
+    rc = fs_write(&log_file, &hdr, sizeof(hdr));
+    if (rc >= 0)
+    {
+        rc = fs_write(&log_file, log_index, log_index_count * sizeof(struct hpi_log_index_entry));
+    }
+    while (rc >= 0 && pad > 0)
+    {
+        rc = fs_write(&log_file, zeros, MIN(pad, sizeof(zeros)));
+        pad -= MIN(pad, sizeof(zeros));
+    }
+
+    if (rc < 0)
+    {
+        printk("Log index write Fail %d\n", rc);
+        return;
+    }
+
+    log_file_pos = ROUND_UP(offset + len, HPI_LOG_BLOCK_SIZE);
+    log_index_offset = (uint32_t)offset;
+}
+
+static void log_edf_finish(void);
+
+static void log_file_close(void)
+{
+    if (log_file_open)
+    {
+        if (log_file_no == HPI_LOG_FILE_NO_EDF)
+        {
+            log_edf_finish();
+        }
+        else
+        {
+            log_chunk_write();
+            log_file_write_index();
+        }
+
+        // Give back the unused part of the preallocation
+        fs_truncate(&log_file, log_file_pos);
+        fs_close(&log_file);
+        log_file_open = false;
+        log_file_dirty = false;
+        log_live_publish();
+    }
+}
+
+static void log_file_sync(void)
+{
+    log_chunk_write();
+
+    if (log_file_dirty)
+    {
+        fs_sync(&log_file);
+        log_file_dirty = false;
+
+        // Journal what is now safely on the card; recovery after a reset
+        // starts from here
+        hpi_log_catalog_checkpoint(log_file_session, log_file_no, (uint32_t)log_file_pos, log_file_points);
+    }
+    log_file_last_sync = k_uptime_get();
+}
+
+// Make the file of the block's session the open one. The session comes
+// from the block itself: blocks of a finished session may still be queued
+// when the next one starts. Its format is the one it was started with, as
+// the next session's header is only written once the queue has drained.
+static bool log_file_open_session(const struct hpi_log_block *block)
+{
+    uint16_t session_id = sys_le16_to_cpu(block->hdr.session_id);
+    struct fs_statvfs sbuf;
+    char path[32];
+    int rc;
+
+    if (log_file_open && log_file_session != session_id)
+    {
+        log_file_close();
+    }
+
+    if (log_file_open)
+    {
+        return true;
+    }
+
+    hpi_datalog_session_path(session_id, log_session_file_no, path, sizeof(path));
+
+    // No append: the file is preallocated, so its end is not ours
+    fs_file_t_init(&log_file);
+    rc = fs_open(&log_file, path, FS_O_WRITE);
+    if (rc < 0)
+    {
+        k_mutex_lock(&mutex_log_block, K_FOREVER);
+        log_stats.write_errors++;
+        k_mutex_unlock(&mutex_log_block);
+        printk("Log block %u write Fail %d\n", sys_le32_to_cpu(block->hdr.seq), rc);
+        return false;
+    }
+
+    log_file_open = true;
+    log_file_session = session_id;
+    log_file_no = log_session_file_no;
+    log_file_last_sync = k_uptime_get();
+    log_file_seq = 0;
+    log_file_points = 0;
+    log_file_pos = (log_file_no == HPI_LOG_FILE_NO_EDF) ? HPI_LOG_EDF_HEADER_SIZE : HPI_LOG_HEADER_SIZE;
+    log_chunk_len = 0;
+    log_index_count = 0;
+    log_index_stride = HPI_LOG_INDEX_STRIDE;
+    log_index_offset = 0;
+    log_live_publish();
+
+    log_chunk_size = HPI_LOG_WRITE_CHUNK;
+    if (fs_statvfs(mp_sd->mnt_point, &sbuf) == 0 && sbuf.f_frsize >= HPI_LOG_BLOCK_SIZE)
+    {
+        log_chunk_size = MIN(ROUND_DOWN(sbuf.f_frsize, HPI_LOG_BLOCK_SIZE), HPI_LOG_WRITE_CHUNK);
+    }
+
+    return true;
+}
+
+// With write-through, staged data goes out as soon as the writer has
+// nothing else queued: inside the preallocated file that puts it on the
+// card without a sync, so a reset loses only the blocks being filled (with
+// compression, the coded block too, which spans several raw blocks). A
+// backlog is still written in whole chunks.
+static bool log_write_through(void)
+{
+    return IS_ENABLED(CONFIG_HEALTHYPI_LOG_WRITE_THROUGH) && k_msgq_num_used_get(&q_log_full) == 0;
+}
+
+static void hpi_datalog_write_block(struct hpi_log_block *block)
+{
+    if (!log_file_open_session(block))
+    {
+        return;
+    }
+
+    // Data and record blocks are numbered together, in file order
+    block->hdr.seq = sys_cpu_to_le32(log_file_seq);
+    block->crc32 = sys_cpu_to_le32(crc32_ieee((const uint8_t *)block, offsetof(struct hpi_log_block, crc32)));
+
+    // Record timestamps trail the data, so only data blocks are indexed
+    if (sys_le32_to_cpu(block->hdr.magic) == HPI_LOG_BLOCK_MAGIC)
+    {
+        log_index_add(log_file_seq, sys_le32_to_cpu(block->hdr.timestamp_ms));
+        log_file_points += sys_le16_to_cpu(block->hdr.n_points);
+    }
+    log_file_seq++;
+
+    memcpy(&log_chunk[log_chunk_len], block, sizeof(*block));
+    log_chunk_len += sizeof(*block);
+
+    if ((log_file_pos + log_chunk_len) % log_chunk_size == 0 || log_chunk_len == sizeof(log_chunk) ||
+        log_write_through())
+    {
+        log_chunk_write();
+    }
+}
+
+// Raw data blocks are points in sequence from their block's timestamp; an
+// overrun gap between two blocks shows up as a jump in the timestamps
+#define HPI_LOG_GAP_MS 250
+
+// EDF+ output: data blocks are cut into one-second records and record
+// blocks become annotations. The records go through the same chunk
+// staging as binary blocks, so writes still end on cluster boundaries.
+static struct hpi_log_edf_writer log_edf;
+
+// Stage bytes at log_file_pos + log_chunk_len, writing out each chunk as
+// its end is reached. EDF records don't divide a cluster, so they may be
+// split across two writes.
+static void log_stage(const void *data, size_t len)
+{
+    const uint8_t *p = data;
+
+    while (len > 0)
+    {
+        size_t room = log_chunk_size - (size_t)((log_file_pos + log_chunk_len) % log_chunk_size);
+        size_t n = MIN(len, room);
+
+        memcpy(&log_chunk[log_chunk_len], p, n);
+        log_chunk_len += n;
+        p += n;
+        len -= n;
+
+        if (n == room)
+        {
+            log_chunk_write();
+        }
+    }
+}
+
+static void log_edf_patch(off_t offset, const void *field, size_t len)
+{
+    int rc = fs_seek(&log_file, offset, FS_SEEK_SET);
+
+    if (rc == 0)
+    {
+        rc = fs_write(&log_file, field, len);
+    }
+
+    if (rc < 0)
+    {
+        printk("EDF header update Fail %d\n", rc);
+    }
+    else
+    {
+        log_file_dirty = true;
+    }
+}
+
+static void log_edf_emit(void)
+{
+    log_stage(&log_edf.rec, sizeof(log_edf.rec));
+    log_file_points += HPI_LOG_EDF_RECORD_POINTS;
+    hpi_log_edf_next_record(&log_edf);
+}
+
+// Lead-off changes, the only records an EDF viewer has a use for
+static void log_edf_records(const struct hpi_log_block *block)
+{
+    uint16_t n_records = sys_le16_to_cpu(block->hdr.n_points);
+    size_t pos = 0;
+
+    for (uint16_t i = 0; i < n_records && pos + sizeof(struct hpi_log_record_header) <= HPI_LOG_BLOCK_PAYLOAD; i++)
+    {
+        struct hpi_log_record_header rec;
+        struct hpi_log_rec_lead_off lead_off;
+
+        memcpy(&rec, &block->payload[pos], sizeof(rec));
+        pos += sizeof(rec);
+        if (pos + rec.len > HPI_LOG_BLOCK_PAYLOAD)
+        {
+            break;
+        }
+
+        if (rec.type == HPI_LOG_REC_LEAD_OFF && rec.len >= sizeof(lead_off))
+        {
+            const char *text;
+
+            memcpy(&lead_off, &block->payload[pos], sizeof(lead_off));
+            if (lead_off.lead == HPI_LOG_LEAD_PPG)
+                text = lead_off.lead_off ? "PPG probe off" : "PPG probe on";
+            else
+                text = lead_off.lead_off ? "ECG lead off" : "ECG lead on";
+
+            hpi_log_edf_annotate(&log_edf, sys_le32_to_cpu(rec.timestamp_ms), text);
+        }
+        pos += rec.len;
+    }
+}
+
+static void log_edf_block(const struct hpi_log_block *block)
+{
+    uint16_t n_points = MIN(sys_le16_to_cpu(block->hdr.n_points), HPI_LOG_POINTS_PER_BLOCK);
+    uint32_t ts = sys_le32_to_cpu(block->hdr.timestamp_ms);
+    bool same_file = log_file_open && log_file_session == sys_le16_to_cpu(block->hdr.session_id);
+
+    if (!log_file_open_session(block))
+    {
+        return;
+    }
+    if (!same_file)
+    {
+        hpi_log_edf_writer_init(&log_edf);
+    }
+
+    if (sys_le32_to_cpu(block->hdr.magic) == HPI_LOG_RECORD_MAGIC)
+    {
+        log_edf_records(block);
+        return;
+    }
+
+    // The first data block sets the first record's onset. After an overrun
+    // the partial record is padded out and the next starts at the block's
+    // own time, which makes the file EDF+D.
+    if (!log_edf.started || ts > hpi_log_edf_next_time_ms(&log_edf) + HPI_LOG_GAP_MS)
+    {
+        if (log_edf.started && !log_edf.discontinuous)
+        {
+            log_edf_patch(HPI_LOG_EDF_RESERVED_OFFSET, "EDF+D", 5);
+        }
+        if (hpi_log_edf_pad(&log_edf))
+        {
+            log_edf_emit();
+        }
+        hpi_log_edf_restart(&log_edf, ts);
+    }
+
+    for (uint16_t i = 0; i < n_points; i++)
+    {
+        const uint8_t *frame = &block->payload[(i / HPI_LOG_POINTS_PER_FRAME) * HPI_LOG_FRAME_SIZE];
+        bool even = (i % HPI_LOG_POINTS_PER_FRAME) == 0;
+        int32_t ecg = sign_extend(sys_get_le24(even ? &frame[0] : &frame[3]), 23);
+        int32_t bioz = sign_extend(sys_get_le24(&frame[6]), 23);
+        int32_t ppg = sign_extend(sys_get_le24(&frame[9]), 23);
+
+        if (hpi_log_edf_add_point(&log_edf, ecg, bioz, ppg))
+        {
+            log_edf_emit();
+        }
+    }
+
+    if (log_write_through())
+    {
+        log_chunk_write();
+    }
+}
+
+// Pad out the last record and fill in the record count. Recording stops
+// at most a second short of a record, so it is kept rather than dropped.
+static void log_edf_finish(void)
+{
+    char field[HPI_LOG_EDF_NUM_RECORDS_LEN];
+
+    if (hpi_log_edf_pad(&log_edf))
+    {
+        log_edf_emit();
+    }
+    log_chunk_write();
+
+    hpi_log_edf_records_field(field, log_edf.n_records);
+    log_edf_patch(HPI_LOG_EDF_NUM_RECORDS_OFFSET, field, sizeof(field));
+
+    if (log_edf.dropped_annots > 0)
+    {
+        printk("EDF: %u annotations dropped\n", (unsigned int)log_edf.dropped_annots);
+    }
+}
+
+#ifdef CONFIG_HEALTHYPI_LOG_COMPRESSION
+// Raw data blocks from data_thread are re-coded into compressed output
+// blocks; record blocks pass straight through
+static struct hpi_log_block log_out;
+static struct hpi_log_encoder log_enc;
+static uint16_t log_out_session;
+static uint32_t log_out_nonce;
+
+static void log_out_emit(void)
+{
+    if (log_enc.st.n_points > 0)
+    {
+        log_out.hdr.magic = sys_cpu_to_le32(HPI_LOG_BLOCK_MAGIC);
+        log_out.hdr.session_id = sys_cpu_to_le16(log_out_session);
+        log_out.hdr.nonce = log_out_nonce;
+        log_out.hdr.n_points = sys_cpu_to_le16(log_enc.st.n_points);
+        hpi_datalog_write_block(&log_out);
+    }
+
+    hpi_log_encoder_init(&log_enc, log_out.payload, sizeof(log_out.payload));
+}
+
+static void log_encode_block(const struct hpi_log_block *raw)
+{
+    uint16_t session_id = sys_le16_to_cpu(raw->hdr.session_id);
+    uint16_t n_points = MIN(sys_le16_to_cpu(raw->hdr.n_points), HPI_LOG_POINTS_PER_BLOCK);
+    uint32_t ts = sys_le32_to_cpu(raw->hdr.timestamp_ms);
+
+    if (session_id != log_out_session || raw->hdr.nonce != log_out_nonce)
+    {
+        log_out_emit();
+        log_out_session = session_id;
+        log_out_nonce = raw->hdr.nonce;
+    }
+    else if (log_enc.st.n_points > 0)
+    {
+        // Points in a block are assumed evenly spaced from its timestamp, so
+        // an overrun gap between raw blocks starts a new one
+        uint32_t expected = sys_le32_to_cpu(log_out.hdr.timestamp_ms) +
+                            (uint32_t)log_enc.st.n_points * 1000 / 128;
+
+        if (ts > expected + HPI_LOG_GAP_MS || ts + HPI_LOG_GAP_MS < expected)
+        {
+            log_out_emit();
+        }
+    }
+
+    for (uint16_t i = 0; i < n_points; i++)
+    {
+        const uint8_t *frame = &raw->payload[(i / HPI_LOG_POINTS_PER_FRAME) * HPI_LOG_FRAME_SIZE];
+        bool even = (i % HPI_LOG_POINTS_PER_FRAME) == 0;
+        int32_t ecg = sign_extend(sys_get_le24(even ? &frame[0] : &frame[3]), 23);
+        int32_t bioz = sign_extend(sys_get_le24(&frame[6]), 23);
+        int32_t ppg = sign_extend(sys_get_le24(&frame[9]), 23);
+
+        if (!hpi_log_encoder_add(&log_enc, ecg, bioz, ppg))
+        {
+            log_out_emit();
+            hpi_log_encoder_add(&log_enc, ecg, bioz, ppg);
+        }
+
+        if (log_enc.st.n_points == 1)
+        {
+            log_out.hdr.timestamp_ms = sys_cpu_to_le32(ts + (uint32_t)i * 1000 / 128);
+        }
+    }
+}
+#endif
+
+static void log_writer_thread(void)
+{
+    struct hpi_log_block *block;
+
+    for (int i = 0; i < HPI_LOG_NUM_BLOCKS; i++)
+    {
+        block = &log_blocks[i];
+        k_msgq_put(&q_log_free, &block, K_NO_WAIT);
+    }
+
+#ifdef CONFIG_HEALTHYPI_LOG_COMPRESSION
+    hpi_log_encoder_init(&log_enc, log_out.payload, sizeof(log_out.payload));
+#endif
+
+    for (;;)
+    {
+        k_timeout_t timeout = K_FOREVER;
+
+        if (log_file_dirty || log_chunk_len > 0)
+        {
+            int64_t due = log_file_last_sync + HPI_LOG_SYNC_INTERVAL_MS - k_uptime_get();
+            timeout = K_MSEC(MAX(due, 0));
+        }
+
+        if (k_msgq_get(&q_log_full, &block, timeout) != 0)
+        {
+            log_file_sync();
+            continue;
+        }
+
+        if (block == NULL)
+        {
+            // End of session: everything queued before the marker is written
+            log_index_offset = 0;
+#ifdef CONFIG_HEALTHYPI_LOG_COMPRESSION
+            log_out_emit();
+#endif
+            log_file_close();
+            k_sem_give(&sem_log_closed);
+            continue;
+        }
+
+        if (log_session_file_no == HPI_LOG_FILE_NO_EDF)
+        {
+            log_edf_block(block);
+        }
+#ifdef CONFIG_HEALTHYPI_LOG_COMPRESSION
+        else if (sys_le32_to_cpu(block->hdr.magic) == HPI_LOG_BLOCK_MAGIC)
+        {
+            log_encode_block(block);
+        }
+        else
+        {
+            hpi_datalog_write_block(block);
+        }
+#else
+        else
+        {
+            hpi_datalog_write_block(block);
+        }
+#endif
+        k_msgq_put(&q_log_free, &block, K_NO_WAIT);
+
+        // Blocks arriving back to back would otherwise hold off the timeout
+        if ((log_file_dirty || log_chunk_len > 0) &&
+            k_uptime_get() - log_file_last_sync >= HPI_LOG_SYNC_INTERVAL_MS)
+        {
+            log_file_sync();
+        }
+    }
+}
+
+#define LOG_WRITER_THREAD_STACKSIZE 2048
+// Below every sampling, data, display and command thread
+#define LOG_WRITER_THREAD_PRIORITY 10
+
+K_THREAD_DEFINE(log_writer_thread_id, LOG_WRITER_THREAD_STACKSIZE, log_writer_thread, NULL, NULL, NULL,
+                LOG_WRITER_THREAD_PRIORITY, 0, 0);
+
+int hpi_datalog_new_session_id(uint16_t *session_id)
+{
+    uint8_t start;
+
+    // Ids are 8 bits to keep file names 8.3. Start the search somewhere
+    // random so ids differ from card to card, then try each one in turn
+    sys_rand_get(&start, sizeof(start));
+
+    for (int n = 0; n <= UINT8_MAX; n++)
+    {
+        uint8_t id = (uint8_t)(start + n);
+
+        if (!hpi_log_catalog_has_session(id))
+        {
+            *session_id = id;
+            return 0;
+        }
+    }
+
+    return -ENOSPC;
+}
+
+static int set_current_session_id(uint8_t m_sec, uint8_t m_min, uint8_t m_hour, uint8_t m_day, uint8_t m_month, uint8_t m_year)
+{
+    // printk("m_sec %d m_min %d, m_hour %d m_day %d m_month %d m_year %d\n", m_sec, m_min, m_hour, m_day, m_month, m_year);
+    uint8_t second, minute, hour, day, month, year;
+    year = m_year;
+    month = m_month;
+    day = m_day;
+    hour = m_hour;
+    minute = m_min;
+    second = m_sec;
+
+#ifdef CONFIG_HEALTHYPI_LOG_EVENT_CAPTURE
+    const uint8_t clock[6] = {year, month, day, hour, minute, second};
+
+    hpi_log_event_set_clock(clock);
+#endif
+
+    if (sd_card_present)
+    {
+        // The previous session's file must be closed before the writer
+        // sees blocks of a new one
+        if (flush_current_session_logs() < 0)
+        {
+            return -EBUSY;
+        }
+
+        // update structure with new session start time
+        hpi_log_session_header.session_start_time.year = year;
+        hpi_log_session_header.session_start_time.month = month;
+        hpi_log_session_header.session_start_time.day = day;
+        hpi_log_session_header.session_start_time.hour = hour;
+        hpi_log_session_header.session_start_time.minute = minute;
+        hpi_log_session_header.session_start_time.second = second;
+
+        if (hpi_datalog_new_session_id(&hpi_log_session_header.session_id) < 0)
+        {
+            printk("No free session id, delete a session first\n");
+            return -ENOSPC;
+        }
+        hpi_log_session_header.session_size = 0;
+
+        printk("Header data for session %d set\n", hpi_log_session_header.session_id);
+    }
+    else
+    {
+        printk(" No SD card mounted\n");
+
+#ifdef CONFIG_HEALTHYPI_LOG_FLASH_RING
+        // The flash ring keeps time from boot; this ties it to the host's clock
+        struct hpi_log_rec_clock clock = {{year, month, day, hour, minute, second}};
+
+        hpi_log_ring_add_record(HPI_LOG_REC_CLOCK, &clock, sizeof(clock));
+#endif
+    }
+
+    return 0;
+}
+
+// Start time of a binary session log, from its file header
+static int get_log_file_header(const char *file_name, struct hpi_log_session_header_t *session_header_data,
+                               uint32_t *nonce)
+{
+    char m_session_name[32];
+    struct hpi_log_file_header hdr;
+    struct fs_file_t m_file;
+    int rc;
+
+    snprintf(m_session_name, sizeof(m_session_name), "/SD:/%s", file_name);
+
+    fs_file_t_init(&m_file);
+    rc = fs_open(&m_file, m_session_name, FS_O_READ);
+    if (rc != 0)
+    {
+        printk("Error opening file %d\n", rc);
+        return rc;
+    }
+
+    rc = fs_read(&m_file, &hdr, sizeof(hdr));
+    fs_close(&m_file);
+
+    if (rc != sizeof(hdr) || sys_le32_to_cpu(hdr.magic) != HPI_LOG_FILE_MAGIC ||
+        sys_le16_to_cpu(hdr.version) != HPI_LOG_VERSION)
+    {
+        printk("Bad log header in %s\n", m_session_name);
+        return -EINVAL;
+    }
+
+    session_header_data->session_start_time.year = hdr.start_time[0];
+    session_header_data->session_start_time.month = hdr.start_time[1];
+    session_header_data->session_start_time.day = hdr.start_time[2];
+    session_header_data->session_start_time.hour = hdr.start_time[3];
+    session_header_data->session_start_time.minute = hdr.start_time[4];
+    session_header_data->session_start_time.second = hdr.start_time[5];
+    *nonce = sys_le32_to_cpu(hdr.nonce);
+
+    return 0;
+}
+
+void get_session_header(char *session_id, struct hpi_log_session_header_t *session_header_data)
+{
+    char m_session_name[100] = "/SD:/";
+    strcat(m_session_name,session_id);
+    //printk("m_session_name %s\n",m_session_name);
+
+    struct fs_file_t m_file;
+    fs_file_t_init(&m_file);
 
+    int rc = 0;
+    rc = fs_open(&m_file, m_session_name, FS_O_READ);
 
-    char session_id_str[20];
-    sprintf(session_id_str, "%d", hpi_log_session_header.session_id);
-    strcat(session_name, session_id_str);
-    strcat(session_name, "_ecg.csv");
+    if (rc != 0)
+    {
+        printk("Error opening file %d\n", rc);
+    }
 
-    strcat(ppg_session_name, session_id_str);
-    strcat(ppg_session_name, "_ppg.csv");
+    char header_data[36];
 
-    strcat(resp_session_name, session_id_str);
-    strcat(resp_session_name, "_resp.csv");
+    rc = fs_read(&m_file, header_data, 37);
+    if (rc < 0)
+    {
+        printk("Error reading file %d\n", rc);
+    }
 
+    rc = fs_close(&m_file);
+    if (rc != 0)
+    {
+        printk("Error closing file %d\n", rc);
+        // return;
+    }
 
-    char session_record_details[200];
+    char *saveptr;
+    strtok_r(header_data, " ", &saveptr); // "Session"
+    strtok_r(NULL, " ", &saveptr);        // "started"
+    strtok_r(NULL, " ", &saveptr);        // "at:"
 
-    sprintf(session_record_details, "Session started at: %d/%d/%d %d:%d:%d\n",
-            hpi_log_session_header.session_start_time.day,
-            hpi_log_session_header.session_start_time.month,
-            hpi_log_session_header.session_start_time.year,
-            hpi_log_session_header.session_start_time.hour,
-            hpi_log_session_header.session_start_time.minute,
-            hpi_log_session_header.session_start_time.second);
+    // Get the date part (14/10/24)
+    session_header_data->session_start_time.day = (uint8_t)atoi(strtok_r(NULL, "/", &saveptr));
+    session_header_data->session_start_time.month = (uint8_t)atoi(strtok_r(NULL, "/", &saveptr));
+    session_header_data->session_start_time.year = (uint8_t)atoi(strtok_r(NULL, " ", &saveptr)); // Space after year
 
-    char session_vital_header[100] = "ECG\n";
-    char ppg_session_vital_header[100] = "PPG\n";
-    char resp_session_vital_header[100] = "RESP\n";
+    // Get the time part (11:15:20)
+    session_header_data->session_start_time.hour = (uint8_t)atoi(strtok_r(NULL, ":", &saveptr));
+    session_header_data->session_start_time.minute = (uint8_t)atoi(strtok_r(NULL, ":", &saveptr));
+    session_header_data->session_start_time.second = (uint8_t)atoi(strtok_r(NULL, " ", &saveptr));
+}
 
-    fs_file_t_init(&file);
+// Whether block n holds a block of this session in its place. Past the
+// last block written there is the time index, or in a file that was
+// preallocated and never closed, whatever the clusters held before,
+// possibly blocks of a deleted session with the same id; only the nonce
+// sets those apart.
+static bool log_block_written(struct fs_file_t *file, uint16_t session_id, uint32_t nonce, uint32_t n,
+                              struct hpi_log_block_header *hdr)
+{
+    uint32_t magic;
 
-    rc = fs_open(&file, session_name, FS_O_CREATE | FS_O_RDWR);
-    if (rc < 0)
+    if (fs_seek(file, HPI_LOG_HEADER_SIZE + (off_t)n * HPI_LOG_BLOCK_SIZE, FS_SEEK_SET) != 0 ||
+        fs_read(file, hdr, sizeof(*hdr)) != sizeof(*hdr))
     {
-        printk("FAIL: open %s_ecg.csv: %d", session_name, rc);
+        return false;
     }
-    rc = fs_write(&file, session_record_details, strlen(session_record_details));
-    if (rc < 0)
+
+    magic = sys_le32_to_cpu(hdr->magic);
+    return (magic == HPI_LOG_BLOCK_MAGIC || magic == HPI_LOG_RECORD_MAGIC) &&
+           sys_le16_to_cpu(hdr->session_id) == session_id && sys_le32_to_cpu(hdr->seq) == n &&
+           sys_le32_to_cpu(hdr->nonce) == nonce;
+}
+
+// Blocks written to a file of the given size, found by bisection
+static uint32_t log_blocks_written(struct fs_file_t *file, uint16_t session_id, uint32_t nonce, off_t size)
+{
+    struct hpi_log_block_header hdr;
+    uint32_t lo = 0;
+    uint32_t hi = (size > HPI_LOG_HEADER_SIZE) ? (size - HPI_LOG_HEADER_SIZE) / HPI_LOG_BLOCK_SIZE : 0;
+
+    while (lo < hi)
     {
-        printk("File %s_ecg.csv Header write Fail %d\n",session_name, rc);
+        uint32_t mid = lo + (hi - lo + 1) / 2;
+
+        if (log_block_written(file, session_id, nonce, mid - 1, &hdr))
+            lo = mid;
+        else
+            hi = mid - 1;
     }
-    rc = fs_write(&file, session_vital_header, strlen(session_vital_header));
-    if (rc < 0)
+
+    return lo;
+}
+
+// Whether record n of an EDF+ log opens with a timekeeping TAL. Records
+// carry no session id or CRC, so stale clusters holding an older EDF+ log
+// could pass; this only serves files without a record count.
+static bool log_edf_record_written(struct fs_file_t *file, uint32_t n)
+{
+    char tal[16];
+
+    if (fs_seek(file, HPI_LOG_EDF_HEADER_SIZE + (off_t)n * HPI_LOG_EDF_RECORD_SIZE +
+                          offsetof(struct hpi_log_edf_record, annot), FS_SEEK_SET) != 0 ||
+        fs_read(file, tal, sizeof(tal)) != sizeof(tal))
     {
-        printk("File %s_ecg.csv vital header write Fail %d\n",session_name, rc);
+        return false;
     }
-    rc = fs_close(&file);
 
-    rc = fs_open(&file, ppg_session_name, FS_O_CREATE | FS_O_RDWR);
+    return hpi_log_edf_record_valid(tal, sizeof(tal));
+}
+
+// Start time and length of an EDF+ log, from the record count in its
+// header, or for one never closed, by bisection over its records
+static int log_edf_describe(const char *path, struct hpi_log_catalog_entry *entry)
+{
+    static uint8_t hdr[256];
+    struct fs_file_t file;
+    int32_t n_records = -1;
+    uint32_t n_max = (entry->size > HPI_LOG_EDF_HEADER_SIZE) ?
+                         (entry->size - HPI_LOG_EDF_HEADER_SIZE) / HPI_LOG_EDF_RECORD_SIZE : 0;
+    int rc;
+
+    fs_file_t_init(&file);
+    rc = fs_open(&file, path, FS_O_READ);
     if (rc < 0)
     {
-        printk("FAIL: open %s_ppg.csv: %d", ppg_session_name, rc);
+        return rc;
     }
-    rc = fs_write(&file, session_record_details, strlen(session_record_details));
-    if (rc < 0)
+
+    rc = fs_read(&file, hdr, sizeof(hdr));
+    rc = (rc == sizeof(hdr)) ? hpi_log_edf_parse_header(hdr, entry->start_time, &n_records) : -EINVAL;
+
+    if (rc == 0 && (n_records < 0 || (uint32_t)n_records > n_max))
+    {
+        uint32_t lo = 0;
+        uint32_t hi = n_max;
+
+        while (lo < hi)
+        {
+            uint32_t mid = lo + (hi - lo + 1) / 2;
+
+            if (log_edf_record_written(&file, mid - 1))
+                lo = mid;
+            else
+                hi = mid - 1;
+        }
+        n_records = lo;
+    }
+    fs_close(&file);
+
+    if (rc == 0)
     {
-        printk("File %s_ppg.csv Header write Fail %d\n",session_name, rc);
+        entry->size = HPI_LOG_EDF_HEADER_SIZE + (uint32_t)n_records * HPI_LOG_EDF_RECORD_SIZE;
+        entry->n_points = (uint32_t)n_records * HPI_LOG_EDF_RECORD_POINTS;
     }
 
-    rc = fs_write(&file, ppg_session_vital_header, strlen(ppg_session_vital_header));
+    return rc;
+}
+
+// Close an EDF+ log that never ended cleanly at its last checkpoint,
+// which is always on a record boundary, and fill in its record count
+static int log_edf_recover(const char *path, struct hpi_log_catalog_entry *entry)
+{
+    char field[HPI_LOG_EDF_NUM_RECORDS_LEN];
+    struct fs_file_t file;
+    struct fs_dirent dirent;
+    uint32_t n;
+    int rc;
+
+    rc = fs_stat(path, &dirent);
     if (rc < 0)
     {
-        printk("File %s_ppg.csv vital header write Fail %d\n",session_name, rc);
+        return rc;
+    }
+
+    if (entry->size < HPI_LOG_EDF_HEADER_SIZE || entry->size > dirent.size)
+    {
+        rc = hpi_datalog_describe_file(path, entry);
+        if (rc < 0)
+        {
+            return rc;
+        }
     }
-    rc = fs_close(&file);
 
-    rc = fs_open(&file, resp_session_name, FS_O_CREATE | FS_O_RDWR);
+    n = (entry->size - HPI_LOG_EDF_HEADER_SIZE) / HPI_LOG_EDF_RECORD_SIZE;
+    entry->size = HPI_LOG_EDF_HEADER_SIZE + n * HPI_LOG_EDF_RECORD_SIZE;
+    entry->n_points = n * HPI_LOG_EDF_RECORD_POINTS;
+    entry->index_offset = 0;
+    entry->flags &= ~HPI_LOG_CAT_OPEN;
+
+    fs_file_t_init(&file);
+    rc = fs_open(&file, path, FS_O_RDWR);
     if (rc < 0)
     {
-        printk("FAIL: open %s_resp.csv: %d", resp_session_name, rc);
+        return rc;
+    }
+
+    hpi_log_edf_records_field(field, n);
+    rc = fs_seek(&file, HPI_LOG_EDF_NUM_RECORDS_OFFSET, FS_SEEK_SET);
+    if (rc == 0)
+    {
+        rc = fs_write(&file, field, sizeof(field));
+    }
+    if (rc >= 0)
+    {
+        rc = fs_truncate(&file, entry->size);
+    }
+    fs_close(&file);
+
+    return rc;
+}
+
+// Seal a session that never ended cleanly. Blocks up to the checkpoint in
+// its catalog entry were on the card at the last sync, so only the few
+// after it are read and checked (CRC, session, nonce, position); the file
+// is cut after the last good one. Anything else falls back to a full
+// describe.
+int hpi_datalog_recover_file(const char *path, struct hpi_log_catalog_entry *entry)
+{
+    static struct hpi_log_block block;
+    struct fs_file_t file;
+    struct fs_dirent dirent;
+    uint32_t n, n_max;
+    int rc;
+
+    if (entry->file_no == HPI_LOG_FILE_NO_EDF)
+    {
+        return log_edf_recover(path, entry);
+    }
+    if (entry->file_no != HPI_LOG_FILE_NO_BIN && entry->file_no != HPI_LOG_FILE_NO_EVENT)
+    {
+        return hpi_datalog_describe_file(path, entry);
     }
-    rc = fs_write(&file, session_record_details, strlen(session_record_details));
+
+    rc = fs_stat(path, &dirent);
     if (rc < 0)
     {
-        printk("File %s_resp.csv Header write Fail %d\n",session_name, rc);
+        return rc;
+    }
+
+    n_max = (dirent.size > HPI_LOG_HEADER_SIZE) ? (dirent.size - HPI_LOG_HEADER_SIZE) / HPI_LOG_BLOCK_SIZE : 0;
+    n = (entry->size > HPI_LOG_HEADER_SIZE) ? (entry->size - HPI_LOG_HEADER_SIZE) / HPI_LOG_BLOCK_SIZE : 0;
+    if (entry->size < HPI_LOG_HEADER_SIZE || n > n_max)
+    {
+        return hpi_datalog_describe_file(path, entry);
     }
-    rc = fs_write(&file, resp_session_vital_header, strlen(resp_session_vital_header));
+
+    fs_file_t_init(&file);
+    rc = fs_open(&file, path, FS_O_RDWR);
     if (rc < 0)
     {
-        printk("File %s_resp.csv vital header write Fail %d\n",session_name, rc);
+        return rc;
     }
-    rc = fs_close(&file);
 
-    printk("Header written to file... %d\n", hpi_log_session_header.session_id);
+    for (; n < n_max; n++)
+    {
+        uint32_t magic;
+
+        if (fs_seek(&file, HPI_LOG_HEADER_SIZE + (off_t)n * HPI_LOG_BLOCK_SIZE, FS_SEEK_SET) != 0 ||
+            fs_read(&file, &block, sizeof(block)) != sizeof(block))
+        {
+            break;
+        }
+
+        magic = sys_le32_to_cpu(block.hdr.magic);
+        if ((magic != HPI_LOG_BLOCK_MAGIC && magic != HPI_LOG_RECORD_MAGIC) ||
+            sys_le16_to_cpu(block.hdr.session_id) != entry->session_id || sys_le32_to_cpu(block.hdr.seq) != n ||
+            sys_le32_to_cpu(block.hdr.nonce) != entry->nonce ||
+            sys_le32_to_cpu(block.crc32) != crc32_ieee((const uint8_t *)&block, offsetof(struct hpi_log_block, crc32)))
+        {
+            break;
+        }
+
+        if (magic == HPI_LOG_BLOCK_MAGIC)
+        {
+            entry->n_points += sys_le16_to_cpu(block.hdr.n_points);
+        }
+    }
+
+    // No index: range fetches bisect an unindexed file by block timestamps
+    entry->size = HPI_LOG_HEADER_SIZE + n * HPI_LOG_BLOCK_SIZE;
+    entry->index_offset = 0;
+    entry->flags &= ~HPI_LOG_CAT_OPEN;
+
+    rc = fs_truncate(&file, entry->size);
+    fs_close(&file);
+
+    return rc;
 }
 
-void set_current_session_id(uint8_t m_sec, uint8_t m_min, uint8_t m_hour, uint8_t m_day, uint8_t m_month, uint8_t m_year)
+// Catalog entry for a session file, derived from the file itself. Used to
+// build the catalog for cards without one and to recover sessions that
+// never closed. Returns -EINVAL for files that aren't session logs.
+// Session id and file_no from a session file name, "<id>_<TYPE>.<EXT>",
+// e.g. 42_LOG.BIN, 9_LOG.EDF, 3_EVT.BIN or 17_ECG.CSV; false for any other
+// file, such as the catalog or the USB spool
+static bool log_parse_session_name(const char *name, uint16_t *session_id, uint8_t *file_no)
 {
-    // printk("m_sec %d m_min %d, m_hour %d m_day %d m_month %d m_year %d\n", m_sec, m_min, m_hour, m_day, m_month, m_year);
-    uint8_t second, minute, hour, day, month, year;
-    year = m_year;
-    month = m_month;
-    day = m_day;
-    hour = m_hour;
-    minute = m_min;
-    second = m_sec;
+    char type[5];
+    unsigned int id;
+
+    if (sscanf(name, "%u_%4[A-Z].", &id, type) != 2 || id > UINT16_MAX)
+    {
+        return false;
+    }
+
+    if (strcmp(type, "LOG") == 0)
+        *file_no = (strstr(name, ".EDF") != NULL) ? HPI_LOG_FILE_NO_EDF : HPI_LOG_FILE_NO_BIN;
+    else if (strcmp(type, "EVT") == 0)
+        *file_no = HPI_LOG_FILE_NO_EVENT;
+    else if (strcmp(type, "ECG") == 0)
+        *file_no = 1;
+    else if (strcmp(type, "PPG") == 0)
+        *file_no = 2;
+    else if (strcmp(type, "RESP") == 0)
+        *file_no = 3;
+    else
+        return false;
+
+    *session_id = id;
+    return true;
+}
+
+int hpi_datalog_describe_file(const char *path, struct hpi_log_catalog_entry *entry)
+{
+    struct hpi_log_session_header_t header = {0};
+    struct fs_dirent dirent;
+    const char *name = strrchr(path, '/');
+    uint16_t session_id;
+    uint8_t file_no;
+    int rc;
+
+    name = (name != NULL) ? name + 1 : path;
+
+    if (!log_parse_session_name(name, &session_id, &file_no))
+    {
+        return -EINVAL;
+    }
+
+    memset(entry, 0, sizeof(*entry));
+    entry->session_id = session_id;
+    entry->file_no = file_no;
+
+    rc = fs_stat(path, &dirent);
+    if (rc < 0)
+    {
+        return rc;
+    }
+    entry->size = dirent.size;
+
+    if (entry->file_no == HPI_LOG_FILE_NO_EDF)
+    {
+        return log_edf_describe(path, entry);
+    }
+    else if (entry->file_no == HPI_LOG_FILE_NO_BIN || entry->file_no == HPI_LOG_FILE_NO_EVENT)
+    {
+        struct hpi_log_block_header last = {0};
+        struct fs_file_t file;
+        uint32_t n_blocks = (entry->size > HPI_LOG_HEADER_SIZE) ? (entry->size - HPI_LOG_HEADER_SIZE) / HPI_LOG_BLOCK_SIZE : 0;
+
+        rc = get_log_file_header(name, &header, &entry->nonce);
+        if (rc < 0)
+        {
+            return rc;
+        }
+
+        // Block sizes vary with compression and record blocks hold no
+        // points, so add up the data block headers
+        fs_file_t_init(&file);
+        if (fs_open(&file, path, FS_O_READ) == 0)
+        {
+            uint32_t n;
+
+            for (n = 0; n < n_blocks; n++)
+            {
+                if (!log_block_written(&file, entry->session_id, entry->nonce, n, &last))
+                {
+                    break;
+                }
+                if (sys_le32_to_cpu(last.magic) == HPI_LOG_BLOCK_MAGIC)
+                {
+                    entry->n_points += sys_le16_to_cpu(last.n_points);
+                }
+            }
+
+            // Without an index after the last block, the file was never
+            // closed and the rest is preallocated space
+            if (n < n_blocks && sys_le32_to_cpu(last.magic) != HPI_LOG_INDEX_MAGIC)
+            {
+                entry->size = HPI_LOG_HEADER_SIZE + n * HPI_LOG_BLOCK_SIZE;
+            }
+            fs_close(&file);
+        }
+    }
+    else
+    {
+        get_session_header((char *)name, &header);
+    }
 
+    entry->start_time[0] = header.session_start_time.year;
+    entry->start_time[1] = header.session_start_time.month;
+    entry->start_time[2] = header.session_start_time.day;
+    entry->start_time[3] = header.session_start_time.hour;
+    entry->start_time[4] = header.session_start_time.minute;
+    entry->start_time[5] = header.session_start_time.second;
+
+    return 0;
+}
+
+void hpi_get_session_count(void)
+{
     if (sd_card_present)
     {
+        uint32_t session_count = hpi_log_catalog_count();
 
-        flush_current_session_logs();
+        printk("Total session count: %d\n", session_count);
 
-        // update structure with new session start time
-        hpi_log_session_header.session_start_time.year = year;
-        hpi_log_session_header.session_start_time.month = month;
-        hpi_log_session_header.session_start_time.day = day;
-        hpi_log_session_header.session_start_time.hour = hour;
-        hpi_log_session_header.session_start_time.minute = minute;
-        hpi_log_session_header.session_start_time.second = second;
+        cmdif_send_session_count(session_count,84);
+    }
+    else
+    {
+        cmdif_send_session_count(0,87);
+    }
+}
 
-        uint8_t rand[1];
-        sys_rand_get(rand, sizeof(rand));
-        hpi_log_session_header.session_id = (rand[0]);
-        hpi_log_session_header.session_size = 0;
+// Bytes of a session file that hold data. A session still recording is
+// preallocated, so its directory size says nothing: use what the writer
+// has put on the card, or for a session that never closed, its last
+// checkpoint.
+static uint32_t log_entry_length(const struct hpi_log_catalog_entry *entry)
+{
+    uint32_t len = entry->size;
+    k_spinlock_key_t key;
 
-        printk("Header data for session %d set\n", hpi_log_session_header.session_id);
+    if (entry->flags & HPI_LOG_CAT_OPEN)
+    {
+        key = k_spin_lock(&log_live_lock);
+        if (log_live_open && log_live_session == entry->session_id && log_live_file_no == entry->file_no)
+        {
+            len = log_live_len;
+        }
+        k_spin_unlock(&log_live_lock, key);
+    }
+
+    return len;
+}
+
+static int send_session_index_entry(const struct hpi_log_catalog_entry *entry, void *user_data)
+{
+    ARG_UNUSED(user_data);
+
+    hpi_log_session_header.session_id = entry->session_id;
+    hpi_log_session_header.session_size = entry->size;
+    hpi_log_session_header.file_no = entry->file_no;
+    hpi_log_session_header.session_start_time.year = entry->start_time[0];
+    hpi_log_session_header.session_start_time.month = entry->start_time[1];
+    hpi_log_session_header.session_start_time.day = entry->start_time[2];
+    hpi_log_session_header.session_start_time.hour = entry->start_time[3];
+    hpi_log_session_header.session_start_time.minute = entry->start_time[4];
+    hpi_log_session_header.session_start_time.second = entry->start_time[5];
+
+    // The session being recorded is still growing
+    hpi_log_session_header.session_size = log_entry_length(entry);
+
+    memcpy(&buf_log, &hpi_log_session_header, 15);
+    cmdif_send_ble_data_idx(buf_log, 15);
+    printk("Header of session id: %d size %d sent\n", hpi_log_session_header.session_id,hpi_log_session_header.session_size);
+
+    return 0;
+}
+
+void hpi_get_session_index(void)
+{
+    struct hpi_log_session_header_t current = hpi_log_session_header;
+
+    if (sd_card_present)
+    {
+        hpi_log_catalog_foreach(send_session_index_entry, NULL);
+
+        // hpi_log_session_header doubles as the running session's header
+        hpi_log_session_header = current;
     }
     else
     {
-        printk(" No SD card mounted\n");
+        printk("No SD card mounted\n");
     }
 }
 
-void get_session_header(char *session_id, struct hpi_log_session_header_t *session_header_data)
+uint32_t hpi_log_session_get_length(uint16_t session_id, uint8_t file_no)
 {
-    char m_session_name[100] = "/SD:/";
-    strcat(m_session_name,session_id);
-    //printk("m_session_name %s\n",m_session_name);
+    struct hpi_log_catalog_entry entry;
+
+    if (hpi_log_catalog_find(session_id, file_no, &entry) != 0)
+    {
+        return 0;
+    }
 
+    return log_entry_length(&entry);
+}
+
+// Stream up to max_len bytes of a file to the requester of the current
+// command in FILE_TRANSFER_BLE_PACKET_SIZE chunks; -ECANCELED if the host
+// cancels
+static int log_send_file(const char *m_file_path, uint32_t max_len)
+{
+    int8_t m_buffer[FILE_TRANSFER_BLE_PACKET_SIZE];
+    struct fs_dirent m_entry;
     struct fs_file_t m_file;
+    uint32_t size;
+    int rc = 0;
+
+    rc = fs_stat(m_file_path, &m_entry);
+    if (rc != 0)
+    {
+        printk("Error finding file %s %d\n", m_file_path, rc);
+        return rc;
+    }
+    size = MIN((uint32_t)m_entry.size, max_len);
+
+    uint32_t number_writes = size / FILE_TRANSFER_BLE_PACKET_SIZE;
+
+    if (size % FILE_TRANSFER_BLE_PACKET_SIZE != 0)
+    {
+        number_writes++; // Last write will be smaller than 64 bytes
+    }
+
+    printk("file: %s Size: %d NW: %d \n", m_file_path, size, number_writes);
+
     fs_file_t_init(&m_file);
 
-    int rc = 0;
-    rc = fs_open(&m_file, m_session_name, FS_O_READ);
+    rc = fs_open(&m_file, m_file_path, FS_O_READ);
 
     if (rc != 0)
     {
         printk("Error opening file %d\n", rc);
+        return rc;
     }
 
-    char header_data[36];
+    for (uint32_t i = 0; i < number_writes; i++)
+    {
+        if (hpi_cmd_job_cancelled())
+        {
+            fs_close(&m_file);
+            return -ECANCELED;
+        }
+        hpi_cmd_job_progress(i, number_writes);
+
+        memset(m_buffer, 0, sizeof(m_buffer));
+
+        rc = fs_read(&m_file, m_buffer, MIN(FILE_TRANSFER_BLE_PACKET_SIZE, size - i * FILE_TRANSFER_BLE_PACKET_SIZE));
+        if (rc < 0)
+        {
+            printk("Error reading file %d\n", rc);
+            fs_close(&m_file);
+            return rc;
+        }
 
-    rc = fs_read(&m_file, header_data, 37);
-    if (rc < 0)
-    {
-        printk("Error reading file %d\n", rc);
+        cmdif_send_ble_session_data(m_buffer, FILE_TRANSFER_BLE_PACKET_SIZE);
+        // BLE notifications need pacing; over USB the response path already
+        // waits for ring space, so pull the file at full USB speed
+        if (!cmdif_reply_is_usb())
+        {
+            k_sleep(K_MSEC(50));
+        }
     }
 
     rc = fs_close(&m_file);
     if (rc != 0)
     {
         printk("Error closing file %d\n", rc);
-        // return;
+        return rc;
     }
 
-    char *saveptr;
-    strtok_r(header_data, " ", &saveptr); // "Session"
-    strtok_r(NULL, " ", &saveptr);        // "started"
-    strtok_r(NULL, " ", &saveptr);        // "at:"
+    return 0;
+}
 
-    // Get the date part (14/10/24)
-    session_header_data->session_start_time.day = (uint8_t)atoi(strtok_r(NULL, "/", &saveptr));
-    session_header_data->session_start_time.month = (uint8_t)atoi(strtok_r(NULL, "/", &saveptr));
-    session_header_data->session_start_time.year = (uint8_t)atoi(strtok_r(NULL, " ", &saveptr)); // Space after year
+int hpi_datalog_send_file(const char *m_file_path)
+{
+    return log_send_file(m_file_path, UINT32_MAX);
+}
 
-    // Get the time part (11:15:20)
-    session_header_data->session_start_time.hour = (uint8_t)atoi(strtok_r(NULL, ":", &saveptr));
-    session_header_data->session_start_time.minute = (uint8_t)atoi(strtok_r(NULL, ":", &saveptr));
-    session_header_data->session_start_time.second = (uint8_t)atoi(strtok_r(NULL, " ", &saveptr));
+// Path of a session file on the SD card; file_no as in the session index
+// (1 = ECG, 2 = PPG, 3 = RESP CSV from older firmware, 4 = binary log,
+// 5 = EDF+ log, 6 = event capture)
+int hpi_datalog_session_path(uint16_t session_id, uint8_t file_no, char *path, size_t len)
+{
+    const char *m_session_file_type;
+
+    if (file_no == HPI_LOG_FILE_NO_BIN)
+        return snprintf(path, len, "/SD:/%d_LOG.BIN", session_id);
+    else if (file_no == HPI_LOG_FILE_NO_EDF)
+        return snprintf(path, len, "/SD:/%d_LOG.EDF", session_id);
+    else if (file_no == HPI_LOG_FILE_NO_EVENT)
+        return snprintf(path, len, "/SD:/%d_EVT.BIN", session_id);
+    else if (file_no == 2)
+        m_session_file_type = "PPG";
+    else if (file_no == 3)
+        m_session_file_type = "RESP";
+    else
+        m_session_file_type = "ECG";
+
+    return snprintf(path, len, "/SD:/%d_%s.CSV", session_id, m_session_file_type);
 }
 
-void hpi_get_session_count(void)
+void hpi_session_fetch(uint16_t session_id,uint8_t file_no)
 {
-    int res;
-    struct fs_dir_t dirp;
-    static struct fs_dirent entry;
+    char m_session_path[50];
 
-    uint16_t session_count = 0;
+    uint32_t len = hpi_log_session_get_length(session_id, file_no);
 
-    if (sd_card_present)
-    {
+    hpi_datalog_session_path(session_id, file_no, m_session_path, sizeof(m_session_path));
+    printk("m_session_path %s\n", m_session_path);
 
-        fs_dir_t_init(&dirp);
+    // Only the data of a session still recording, not its preallocation
+    if (log_send_file(m_session_path, (len > 0) ? len : UINT32_MAX) == 0)
+    {
+        printk("sess sent\n");
+    }
+}
 
-        const char *path = "/SD:";
+// Output of hpi_session_fetch_range(), packed into
+// FILE_TRANSFER_BLE_PACKET_SIZE data packets as it is produced
+struct range_stream
+{
+    int8_t pkt[FILE_TRANSFER_BLE_PACKET_SIZE];
+    uint8_t len;
+    uint32_t bytes;
+};
 
-        /* Verify fs_opendir() */
-        res = fs_opendir(&dirp, path);
-        if (res)
-        {
-            printk("Error opening dir %s [%d]\n", path, res);
-            //return res;
-        }
+static void range_stream_put(struct range_stream *rs, const uint8_t *data, size_t len)
+{
+    rs->bytes += len;
 
-        for (;;)
-        {
-            /* Verify fs_readdir() */
-            res = fs_readdir(&dirp, &entry);
+    while (len > 0)
+    {
+        size_t n = MIN(len, sizeof(rs->pkt) - rs->len);
 
-            /* entry.name[0] == 0 means end-of-dir */
-            if (res || entry.name[0] == 0)
-            {
-                if (res < 0)
-                {
-                    printk("Error reading dir [%d]\n", res);
-                }
-                break;
-            }
+        memcpy(&rs->pkt[rs->len], data, n);
+        rs->len += n;
+        data += n;
+        len -= n;
 
-            if (entry.type != FS_DIR_ENTRY_DIR)
+        if (rs->len == sizeof(rs->pkt))
+        {
+            cmdif_send_ble_session_data(rs->pkt, rs->len);
+            rs->len = 0;
+            if (!cmdif_reply_is_usb())
             {
-                session_count++;
+                k_sleep(K_MSEC(50));
             }
         }
+    }
+}
 
-        /* Verify fs_closedir() */
-        fs_closedir(&dirp);
+static void range_stream_flush(struct range_stream *rs)
+{
+    if (rs->len > 0)
+    {
+        cmdif_send_ble_session_data(rs->pkt, rs->len);
+        rs->len = 0;
+    }
+}
 
-        printk("Total session count: %d\n", session_count);
+// Timestamp of data block n, or UINT32_MAX past the data or on a bad block.
+// A record block takes the time of the next data block: records trail the
+// data around them, and a data block's points all precede the next one's.
+static uint32_t range_block_time(struct fs_file_t *file, uint32_t n)
+{
+    struct hpi_log_block_header hdr;
 
-        cmdif_send_session_count(session_count,84);
-    }
-    else
+    do
     {
-        cmdif_send_session_count(0,87);
+        if (fs_seek(file, HPI_LOG_HEADER_SIZE + (off_t)n * HPI_LOG_BLOCK_SIZE, FS_SEEK_SET) != 0 ||
+            fs_read(file, &hdr, sizeof(hdr)) != sizeof(hdr))
+        {
+            return UINT32_MAX;
+        }
+        n++;
+    } while (sys_le32_to_cpu(hdr.magic) == HPI_LOG_RECORD_MAGIC);
+
+    if (sys_le32_to_cpu(hdr.magic) != HPI_LOG_BLOCK_MAGIC)
+    {
+        return UINT32_MAX;
     }
+
+    return sys_le32_to_cpu(hdr.timestamp_ms);
 }
 
-void hpi_get_session_index(void)
+// Narrow [lo, hi) from the time index to the stride containing start_ms
+static void range_index_bounds(struct fs_file_t *file, uint32_t index_offset, uint32_t start_ms,
+                               uint32_t *lo, uint32_t *hi)
 {
-    int res;
-    struct fs_dir_t dirp;
-    static struct fs_dirent entry;
+    struct hpi_log_index_header hdr;
+    struct hpi_log_index_entry entry;
 
-    if (sd_card_present)
+    if (index_offset == 0 || fs_seek(file, index_offset, FS_SEEK_SET) != 0 ||
+        fs_read(file, &hdr, sizeof(hdr)) != sizeof(hdr) ||
+        sys_le32_to_cpu(hdr.magic) != HPI_LOG_INDEX_MAGIC)
     {
+        return;
+    }
 
-        fs_dir_t_init(&dirp);
+    for (uint16_t i = 0; i < sys_le16_to_cpu(hdr.n_entries); i++)
+    {
+        if (fs_read(file, &entry, sizeof(entry)) != sizeof(entry))
+        {
+            return;
+        }
 
-        const char *path = "/SD:/";
+        uint32_t seq = sys_le32_to_cpu(entry.seq);
 
-        /* Verify fs_opendir() */
-        res = fs_opendir(&dirp, path);
-        if (res)
+        if (seq >= *hi)
         {
-            printk("Error opening dir %s [%d]\n", path, res);
-            //return res;
+            return;
         }
 
-        for (;;)
+        if (sys_le32_to_cpu(entry.timestamp_ms) <= start_ms)
+        {
+            *lo = seq;
+        }
+        else
         {
-            /* Verify fs_readdir() */
-            res = fs_readdir(&dirp, &entry);
+            *hi = seq;
+            return;
+        }
+    }
+}
 
-            /* entry.name[0] == 0 means end-of-dir */
-            if (res || entry.name[0] == 0)
-            {
-                if (res < 0)
-                {
-                    printk("Error reading dir [%d]\n", res);
-                }
+// Stream the samples of the selected channels between start_ms and end_ms
+// (relative to session start) of a binary session log. The output is a
+// series of records, one per log block touched:
+//
+//   [0..3] time of the first point (ms), [4..5] n points, [6] channel mask
+//   then per point: ECG (mask bit 0) and, on even points, BioZ (bit 1) and
+//   PPG (bit 2), each int24 LE
+//
+// Records always start on an even point. Returns the number of points
+// sent, or a negative errno (-ECANCELED on HPI_CMD_CANCEL).
+int hpi_session_fetch_range(uint16_t session_id, uint8_t channel_mask, uint32_t start_ms, uint32_t end_ms,
+                            uint32_t *bytes_sent)
+{
+    static struct hpi_log_block block;
+    static struct hpi_log_file_header file_hdr;
+    static struct range_stream rs;
+    struct hpi_log_catalog_entry entry;
+    struct hpi_log_decoder dec;
+    struct fs_file_t file;
+    char path[32];
+    uint32_t n_blocks, lo, hi;
+    uint16_t max_points;
+    int points = 0;
+    int rc;
 
-                break;
-            }
+    channel_mask &= 0x07;
+    if (channel_mask == 0 || end_ms < start_ms)
+    {
+        return -EINVAL;
+    }
 
-            if (entry.type != FS_DIR_ENTRY_DIR)
-            {
-                //char session_header[80];
-
-                hpi_log_session_header.session_id =(uint16_t)atoi(entry.name);
-                hpi_log_session_header.session_size = (uint32_t)entry.size;
-
-                //printk("entry.name %s",entry.name);
-                get_session_header(entry.name, &hpi_log_session_header);  
-
-
-                char file_name[50];
-                strcpy(file_name,entry.name);
-                char *saveptr;
-                strtok_r(file_name, "_", &saveptr);
-                char *extension =  strtok_r(NULL, ".", &saveptr);
-                if (strncmp(extension,"ECG",strlen(extension)) == 0)
-                    hpi_log_session_header.file_no = 1;
-                else if (strncmp(extension,"PPG",strlen(extension)) == 0)
-                    hpi_log_session_header.file_no = 2;
-                else if (strncmp(extension,"RESP",strlen(extension)) == 0)
-                    hpi_log_session_header.file_no = 3;
-                else
-                    hpi_log_session_header.file_no = 1;
-                
-                memcpy(&buf_log, &hpi_log_session_header, 15);
-                cmdif_send_ble_data_idx(buf_log, 15);
-                printk("Header of session id: %d size %d sent\n", hpi_log_session_header.session_id,hpi_log_session_header.session_size);
-            }
-        }
-        fs_closedir(&dirp);
+    rc = hpi_log_catalog_find(session_id, HPI_LOG_FILE_NO_BIN, &entry);
+    if (rc < 0)
+    {
+        return rc;
     }
-    else
+
+    hpi_datalog_session_path(session_id, HPI_LOG_FILE_NO_BIN, path, sizeof(path));
+
+    fs_file_t_init(&file);
+    rc = fs_open(&file, path, FS_O_READ);
+    if (rc < 0)
     {
-        printk("No SD card mounted\n");
+        return rc;
     }
-}
 
-uint32_t hpi_log_session_get_length(char *m_file_name)
-{
-    int res;
-    struct fs_dir_t dirp;
-    static struct fs_dirent entry;
-    uint32_t session_len = 0;
+    if (fs_read(&file, &file_hdr, sizeof(file_hdr)) != sizeof(file_hdr) ||
+        sys_le32_to_cpu(file_hdr.magic) != HPI_LOG_FILE_MAGIC ||
+        sys_le16_to_cpu(file_hdr.version) != HPI_LOG_VERSION)
+    {
+        fs_close(&file);
+        return -EBADMSG;
+    }
+    max_points = (file_hdr.codec == HPI_LOG_CODEC_RICE) ? HPI_LOG_CODEC_MAX_POINTS : HPI_LOG_POINTS_PER_BLOCK;
 
-    fs_dir_t_init(&dirp);
+    // A session still recording or never closed has no index, and its
+    // file may still be preallocated; find where the blocks end
+    if (entry.index_offset != 0)
+    {
+        n_blocks = (entry.index_offset - HPI_LOG_HEADER_SIZE) / HPI_LOG_BLOCK_SIZE;
+    }
+    else
+    {
+        struct fs_dirent dirent;
 
-    const char *path = "/SD:/";
+        n_blocks = (fs_stat(path, &dirent) == 0) ? log_blocks_written(&file, session_id, sys_le32_to_cpu(file_hdr.nonce), dirent.size) : 0;
+    }
 
-    res = fs_opendir(&dirp, path);
-    if (res)
+    // Last block starting at or before start_ms: the index narrows the
+    // search to one stride, bisection on block timestamps does the rest
+    lo = 0;
+    hi = n_blocks;
+    range_index_bounds(&file, entry.index_offset, start_ms, &lo, &hi);
+    while (hi - lo > 1)
     {
-        printk("Error opening dir %s [%d]\n", path, res);
-        return res;
+        uint32_t mid = lo + (hi - lo) / 2;
+
+        if (range_block_time(&file, mid) <= start_ms)
+            lo = mid;
+        else
+            hi = mid;
     }
 
-    for (;;)
+    rs.len = 0;
+    rs.bytes = 0;
+
+    for (uint32_t n = lo; n < n_blocks; n++)
     {
-        res = fs_readdir(&dirp, &entry);
-        if (res || entry.name[0] == 0)
+        uint8_t rec[7];
+        uint32_t ts;
+        uint16_t n_points, first, last;
+
+        if (hpi_cmd_job_cancelled())
         {
-            if (res < 0)
-            {
-                printk("Error reading dir [%d]\n", res);
-            }
+            points = -ECANCELED;
             break;
         }
+        hpi_cmd_job_progress(n - lo, n_blocks - lo);
 
-        printk("m_file_name %s entry.name %s %d %d\n",m_file_name,entry.name,sizeof(m_file_name),sizeof(entry.name));
-        if (strcmp(m_file_name, entry.name) == 0)
+        if (fs_seek(&file, HPI_LOG_HEADER_SIZE + (off_t)n * HPI_LOG_BLOCK_SIZE, FS_SEEK_SET) != 0 ||
+            fs_read(&file, &block, sizeof(block)) != sizeof(block))
         {
-            session_len = entry.size;
             break;
         }
-    }
-    fs_closedir(&dirp);
-    return session_len;
-}
 
-void hpi_session_fetch(uint16_t session_id,uint8_t file_no)
-{
-    int8_t m_buffer[FILE_TRANSFER_BLE_PACKET_SIZE];
-    //char m_session_id[20];
-    char m_session_name[30];
-    char m_session_path[50] = "/SD:/";
-    char m_session_file_type[5];
+        if (sys_le32_to_cpu(block.hdr.magic) != HPI_LOG_BLOCK_MAGIC ||
+            sys_le32_to_cpu(block.crc32) != crc32_ieee((const uint8_t *)&block, offsetof(struct hpi_log_block, crc32)))
+        {
+            continue;
+        }
 
-    if (file_no == 1)
-        strcpy(m_session_file_type, "ECG");
-    else if (file_no == 2)
-        strcpy(m_session_file_type, "PPG");
-    else if (file_no == 3)
-        strcpy(m_session_file_type, "RESP");
-    else
-        strcpy(m_session_file_type, "ECG");
+        ts = sys_le32_to_cpu(block.hdr.timestamp_ms);
+        if (ts > end_ms)
+        {
+            break;
+        }
 
-    snprintf(m_session_name, sizeof(m_session_name), "%d_%s.CSV", session_id,m_session_file_type);
-    printk("m_session_name %s\n",m_session_name);
+        // Point i of the block is at ts + i * 1000 / 128 ms
+        n_points = MIN(sys_le16_to_cpu(block.hdr.n_points), max_points);
+        first = (start_ms > ts) ? MIN((uint64_t)(start_ms - ts) * 128 / 1000, n_points) : 0;
+        first &= ~1;
+        last = MIN((uint64_t)(end_ms - ts) * 128 / 1000 + 1, n_points);
+        if (first >= last)
+        {
+            continue;
+        }
 
+        sys_put_le32(ts + (uint32_t)first * 1000 / 128, &rec[0]);
+        sys_put_le16(last - first, &rec[4]);
+        rec[6] = channel_mask;
+        range_stream_put(&rs, rec, sizeof(rec));
 
-    uint32_t session_len = hpi_log_session_get_length(m_session_name);
+        hpi_log_decoder_init(&dec, block.payload, sizeof(block.payload));
 
-    uint16_t number_writes = session_len / FILE_TRANSFER_BLE_PACKET_SIZE;
+        for (uint16_t i = 0; i < last; i++)
+        {
+            uint8_t v[HPI_LOG_CODEC_CHANNELS][HPI_LOG_SAMPLE_BYTES];
+            bool even = (i % HPI_LOG_POINTS_PER_FRAME) == 0;
 
-    uint32_t i = 0;
-    struct fs_file_t m_file;
-    int rc = 0;
+            if (file_hdr.codec == HPI_LOG_CODEC_RICE)
+            {
+                int32_t out[HPI_LOG_CODEC_CHANNELS] = {0};
 
-    if (session_len % FILE_TRANSFER_BLE_PACKET_SIZE != 0)
-    {
-        number_writes++; // Last write will be smaller than 64 bytes
-    }
+                // Compressed points only decode in order
+                if (hpi_log_decoder_next(&dec, out) < 0)
+                {
+                    break;
+                }
+                for (int ch = 0; ch < HPI_LOG_CODEC_CHANNELS; ch++)
+                {
+                    sys_put_le24((uint32_t)out[ch], v[ch]);
+                }
+            }
+            else if (i >= first)
+            {
+                const uint8_t *frame = &block.payload[(i / HPI_LOG_POINTS_PER_FRAME) * HPI_LOG_FRAME_SIZE];
 
-    printk("session id: %s Size: %d NW: %d \n", m_session_name, session_len, number_writes);
-    strcat(m_session_path,m_session_name);
+                memcpy(v[0], even ? &frame[0] : &frame[3], HPI_LOG_SAMPLE_BYTES);
+                memcpy(v[1], &frame[6], HPI_LOG_SAMPLE_BYTES);
+                memcpy(v[2], &frame[9], HPI_LOG_SAMPLE_BYTES);
+            }
 
-    fs_file_t_init(&m_file);
+            if (i < first)
+            {
+                continue;
+            }
 
-    rc = fs_open(&m_file, m_session_path, FS_O_READ);
+            if (channel_mask & BIT(0))
+                range_stream_put(&rs, v[0], HPI_LOG_SAMPLE_BYTES);
+            if (even && (channel_mask & BIT(1)))
+                range_stream_put(&rs, v[1], HPI_LOG_SAMPLE_BYTES);
+            if (even && (channel_mask & BIT(2)))
+                range_stream_put(&rs, v[2], HPI_LOG_SAMPLE_BYTES);
+        }
 
-    if (rc != 0)
-    {
-        printk("Error opening file %d\n", rc);
-        return;
+        points += last - first;
     }
 
-    for (i = 0; i < number_writes; i++)
-    {
-        memset(m_buffer,0,64);
+    range_stream_flush(&rs);
+    fs_close(&file);
 
-        rc = fs_read(&m_file, m_buffer, FILE_TRANSFER_BLE_PACKET_SIZE);
-        if (rc < 0)
-        {
-            printk("Error reading file %d\n", rc);
-            return;
-        }
-        printk("Writing %d\n write",i);
-        
-        cmdif_send_ble_session_data(m_buffer, FILE_TRANSFER_BLE_PACKET_SIZE); // FILE_TRANSFER_BLE_PACKET_SIZE);
-        k_sleep(K_MSEC(50));
+    if (bytes_sent != NULL)
+    {
+        *bytes_sent = rs.bytes;
     }
 
-    rc = fs_close(&m_file);
-    if (rc != 0)
+    return points;
+}
+
+// A session or event capture file is open for writing. Unlinking it would
+// free clusters the writer is still filling.
+static bool log_files_in_use(void)
+{
+    if (settings_log_data_enabled || log_session_active || log_close_pending)
     {
-        printk("Error closing file %d\n", rc);
-        return;
+        return true;
     }
-
-    printk("sess sent\n");
+#ifdef CONFIG_HEALTHYPI_LOG_EVENT_CAPTURE
+    if (hpi_log_event_capturing())
+    {
+        return true;
+    }
+#endif
+    return false;
 }
 
-void hpi_datalog_delete_all(void)
+int hpi_datalog_delete_all(void)
 {
     int res;
     struct fs_dir_t dir;
+    uint16_t session_id;
+    uint8_t file_no;
 
     char session_name[100] = "";
 
+    if (log_files_in_use())
+    {
+        return -EBUSY;
+    }
+
     fs_dir_t_init(&dir);
 
     res = fs_opendir(&dir, "/SD:/");
@@ -509,7 +2223,8 @@ void hpi_datalog_delete_all(void)
             break;
         }
 
-        if (entry.type != FS_DIR_ENTRY_DIR)
+        // Sessions only; the catalog is cleared below
+        if (entry.type != FS_DIR_ENTRY_DIR && log_parse_session_name(entry.name, &session_id, &file_no))
         {
             strcpy(session_name, "/SD:/");
             strcat(session_name, entry.name);
@@ -521,35 +2236,51 @@ void hpi_datalog_delete_all(void)
 
     fs_closedir(&dir);
 
+    hpi_log_catalog_clear();
+
     printk("All sessions deleted\n");
+    return 0;
 }
 
-void hpi_datalog_delete_session(uint16_t session_id,uint8_t file_no)
+int hpi_datalog_delete_session(uint16_t session_id,uint8_t file_no)
 {
-    struct fs_dir_t dir;
-    fs_dir_t_init(&dir);
-
-    char session_name[20];
-    char m_session_file_type[5];
+    char session_name[32];
     printk("session_id %d file_no %d\n",session_id,file_no);
 
-    if (file_no == 1)
-        strcpy(m_session_file_type, "ECG");
-    else if (file_no == 2)
-        strcpy(m_session_file_type, "PPG");
-    else
-        strcpy(m_session_file_type, "RESP");
+    if (log_files_in_use())
+    {
+        return -EBUSY;
+    }
 
-    snprintf(session_name, sizeof(session_name), "/SD:/%d_%s.CSV", session_id,m_session_file_type);
+    hpi_datalog_session_path(session_id, file_no, session_name, sizeof(session_name));
     fs_unlink(session_name);
+    hpi_log_catalog_remove(session_id, file_no);
     printk("%s\n",session_name);
-        
+
+    return 0;
 }
 
-void hpi_datalog_start_session(uint8_t *in_pkt_buf)
+void hpi_datalog_start_session(uint8_t *in_pkt_buf, uint8_t pkt_len)
 {
-    set_current_session_id(in_pkt_buf[1], in_pkt_buf[2], in_pkt_buf[3], in_pkt_buf[4], in_pkt_buf[5], in_pkt_buf[6]);
-    if (sd_card_present)
+    // Older hosts send the start time only
+    uint8_t format = (pkt_len > 7) ? in_pkt_buf[7] : HPI_LOG_DEFAULT_OUTPUT;
+
+    int id_rc = set_current_session_id(in_pkt_buf[1], in_pkt_buf[2], in_pkt_buf[3], in_pkt_buf[4], in_pkt_buf[5],
+                                       in_pkt_buf[6]);
+
+    if (sd_card_present && id_rc == -EBUSY)
+    {
+        // The last session's file isn't closed yet; the host can retry
+        settings_log_data_enabled = false;
+        cmdif_send_cmd_ack(CMD_LOGGING_START, HPI_CMD_STATUS_BUSY);
+    }
+    else if (sd_card_present && id_rc < 0)
+    {
+        // Every id is taken: don't overwrite an existing session
+        settings_log_data_enabled = false;
+        cmdif_send_memory_status(CMD_LOGGING_MEMORY_NOT_AVAILABLE);
+    }
+    else if (sd_card_present)
     {
         struct fs_statvfs sbuf;
         int rc = fs_statvfs(mp_sd->mnt_point, &sbuf);
@@ -563,9 +2294,17 @@ void hpi_datalog_start_session(uint8_t *in_pkt_buf)
 
         if (sbuf.f_bfree >= (0.25 * sbuf.f_blocks))
         {
-            settings_log_data_enabled = true;
             cmdif_send_memory_status(CMD_LOGGING_MEMORY_FREE);
+            // The previous session has been flushed, so the writer is idle
+            log_session_file_no = (format == HPI_LOG_OUTPUT_EDF) ? HPI_LOG_FILE_NO_EDF : HPI_LOG_FILE_NO_BIN;
             write_header_to_new_session();
+            // Only once the file exists, so data_thread never appends to a stale path
+            settings_log_data_enabled = true;
+#ifdef CONFIG_HEALTHYPI_LOG_EVENT_CAPTURE
+            // No new capture starts while logging; close one already running
+            // so the two never write to the card together
+            hpi_log_event_seal();
+#endif
         }
         else
         {
@@ -579,137 +2318,3 @@ void hpi_datalog_start_session(uint8_t *in_pkt_buf)
         cmdif_send_memory_status(CMD_SD_CARD_NOT_PRESENT);
     }
 }
-
-void hpi_log_session_write_file(int parameter_to_be_written)
-{
-    switch (parameter_to_be_written)
-    {
-        case ECG_DATA:
-            struct fs_file_t ecg_file;
-            fs_file_t_init(&ecg_file);
-
-            char ecg_session_name[100] = "/SD:/";
-            char ecg_session_id_str[100];
-            char ecg_sensor_data[32];
-
-            
-            sprintf(ecg_session_id_str, "%d", hpi_log_session_header.session_id);
-            strcat(ecg_session_name, ecg_session_id_str);
-            strcat(ecg_session_name, "_ecg.csv");
-
-            //printk("session_name %s\n",session_name);
-
-            int ecg_rc = fs_open(&ecg_file, ecg_session_name, FS_O_CREATE | FS_O_RDWR | FS_O_APPEND);
-            if (ecg_rc < 0)
-            {
-                printk("FAIL: open %s: %d", ecg_session_name, ecg_rc);
-            }
-
-            for (int i = 0; i < current_session_ecg_counter; i++)
-            {
-                snprintf(ecg_sensor_data, sizeof(ecg_sensor_data), "%d\n", log_buffer[i].log_ecg_sample);
-                ecg_rc = fs_write(&ecg_file, ecg_sensor_data, strlen(ecg_sensor_data));
-                //printk("ecg_rc %d\n",ecg_rc);
-            }
-
-
-            ecg_rc = fs_close(&ecg_file);
-
-            struct fs_file_t resp_file;
-            fs_file_t_init(&resp_file);
-
-            char resp_session_name[100] = "/SD:/";
-            char resp_session_id_str[100];
-            char resp_sensor_data[32];
-
-            
-            sprintf(resp_session_id_str, "%d", hpi_log_session_header.session_id);
-            strcat(resp_session_name, resp_session_id_str);
-            strcat(resp_session_name, "_resp.csv");
-
-            //printk("session_name %s\n",session_name);
-
-            int resp_rc = fs_open(&resp_file, resp_session_name, FS_O_CREATE | FS_O_RDWR | FS_O_APPEND);
-            if (resp_rc < 0)
-            {
-                printk("FAIL: open %s: %d", resp_session_name, resp_rc);
-            }
-
-            for (int i = 0; i < current_session_bioz_counter; i++)
-            {
-                snprintf(resp_sensor_data, sizeof(resp_sensor_data), "%d\n", log_buffer[i].log_bioz_sample);
-                resp_rc = fs_write(&resp_file, resp_sensor_data, strlen(resp_sensor_data));
-            }
-
-
-            resp_rc = fs_close(&resp_file);
-
-            break;
-
-        case PPG_DATA:
-            struct fs_file_t ppg_file;
-            fs_file_t_init(&ppg_file);
-
-            char ppg_session_name[100] = "/SD:/";
-            char ppg_session_id_str[100];
-            char ppg_sensor_data[32];
-
-            
-            sprintf(ppg_session_id_str, "%d", hpi_log_session_header.session_id);
-            strcat(ppg_session_name, ppg_session_id_str);
-            strcat(ppg_session_name, "_ppg.csv");
-
-            //printk("session_name %s\n",session_name);
-
-            int ppg_rc = fs_open(&ppg_file, ppg_session_name, FS_O_CREATE | FS_O_RDWR | FS_O_APPEND);
-            if (ppg_rc < 0)
-            {
-                printk("FAIL: open %s: %d", ppg_session_name, ppg_rc);
-            }
-
-            for (int i = 0; i < current_session_ppg_counter; i++)
-            {
-                snprintf(ppg_sensor_data, sizeof(ppg_sensor_data), "%d\n", log_buffer[i].log_ppg_sample);
-                ppg_rc = fs_write(&ppg_file, ppg_sensor_data, strlen(ppg_sensor_data));
-            }
-
-
-            ppg_rc = fs_close(&ppg_file);
-            break;
-
-        case RESP_DATA:
-            /*struct fs_file_t resp_file;
-            fs_file_t_init(&resp_file);
-
-            char resp_session_name[100] = "/SD:/";
-            char resp_session_id_str[100];
-            char resp_sensor_data[32];
-
-            
-            sprintf(resp_session_id_str, "%d", hpi_log_session_header.session_id);
-            strcat(resp_session_name, resp_session_id_str);
-            strcat(resp_session_name, "_resp.csv");
-
-            //printk("session_name %s\n",session_name);
-
-            int resp_rc = fs_open(&resp_file, resp_session_name, FS_O_CREATE | FS_O_RDWR | FS_O_APPEND);
-            if (resp_rc < 0)
-            {
-                printk("FAIL: open %s: %d", resp_session_name, resp_rc);
-            }
-
-            for (int i = 0; i < current_session_bioz_counter; i++)
-            {
-                snprintf(resp_sensor_data, sizeof(resp_sensor_data), "%d\n", log_buffer[i].log_bioz_sample);
-                resp_rc = fs_write(&resp_file, resp_sensor_data, strlen(resp_sensor_data));
-            }
-
-
-            resp_rc = fs_close(&resp_file);*/
-            break;
-
-        default:
-            break;
-
-    }
-}
\ No newline at end of file
@@ -25,6 +25,23 @@
 
 #pragma once
 
+#include <stddef.h>
+#include <stdint.h>
+
+// Session index file_no of a binary log (see hpi_log_format.h)
+#define HPI_LOG_FILE_NO_BIN 4
+// ... and of an EDF+ log (see hpi_log_edf.h)
+#define HPI_LOG_FILE_NO_EDF 5
+// ... and of an event capture, a binary log (see log_event.h)
+#define HPI_LOG_FILE_NO_EVENT 6
+
+// Output format, byte 7 of CMD_LOGGING_START
+enum hpi_log_output_format
+{
+    HPI_LOG_OUTPUT_BIN = 0,
+    HPI_LOG_OUTPUT_EDF = 1,
+};
+
 struct healthypi_time_t
 {
     uint8_t year;
@@ -43,12 +60,53 @@ struct hpi_log_session_header_t
     struct healthypi_time_t session_start_time;
 };
 
-void hpi_datalog_start_session(uint8_t *in_pkt_buf);
+// Write latency histogram: bucket i counts writes faster than
+// HPI_LOG_WRITE_HIST_BASE_US << i, the last one everything slower
+#define HPI_LOG_WRITE_HIST_BUCKETS 13
+#define HPI_LOG_WRITE_HIST_BASE_US 250
+
+struct hpi_datalog_stats
+{
+    uint32_t blocks_written;
+    uint32_t write_errors;
+    uint32_t overrun_points;    // Points dropped because no free block was ready
+    uint32_t dropped_records;   // Likewise for records
+    uint32_t max_write_us;      // Slowest write this session
+    uint32_t write_hist[HPI_LOG_WRITE_HIST_BUCKETS];
+};
+
+struct hpi_sensor_data_point_t;
+struct hpi_log_catalog_entry;
+struct hpi_log_file_header;
+
+void hpi_datalog_start_session(uint8_t *in_pkt_buf, uint8_t pkt_len);
+// Fill in a binary log file header, CRC included; start may be NULL
+void hpi_datalog_init_header(struct hpi_log_file_header *hdr, uint16_t session_id,
+                             const struct healthypi_time_t *start, uint8_t codec);
 void hpi_session_fetch(uint16_t session_id,uint8_t file_no);
+int hpi_session_fetch_range(uint16_t session_id, uint8_t channel_mask, uint32_t start_ms, uint32_t end_ms,
+                            uint32_t *bytes_sent);
+int hpi_datalog_send_file(const char *m_file_path);
+int hpi_datalog_session_path(uint16_t session_id, uint8_t file_no, char *path, size_t len);
+// A session id no file on the card uses yet; -ENOSPC once all 256 are taken
+int hpi_datalog_new_session_id(uint16_t *session_id);
 void hpi_get_session_count(void);
-void hpi_log_session_write_file();
-void hpi_datalog_delete_session(uint16_t session_id,uint8_t file_no);
-void hpi_datalog_delete_all(void);
+// Bytes of a session file that hold data, which for a session still
+// recording is less than its preallocated size; 0 if not in the catalog
+uint32_t hpi_log_session_get_length(uint16_t session_id, uint8_t file_no);
+int hpi_datalog_describe_file(const char *path, struct hpi_log_catalog_entry *entry);
+int hpi_datalog_recover_file(const char *path, struct hpi_log_catalog_entry *entry);
+void hpi_datalog_add_point(const struct hpi_sensor_data_point_t *point);
+// Log a typed record (enum hpi_log_record_type) on the session timeline
+void hpi_datalog_add_record(uint8_t type, const void *data, uint8_t len);
+int hpi_datalog_flush(void);
+int hpi_datalog_seal(void);
+void hpi_datalog_get_stats(struct hpi_datalog_stats *stats);
+// Upper bound of the write latency under which pct percent of writes fell
+uint32_t hpi_datalog_write_percentile_us(const struct hpi_datalog_stats *stats, uint8_t pct);
+// -EBUSY while a session or event capture is being written
+int hpi_datalog_delete_session(uint16_t session_id,uint8_t file_no);
+int hpi_datalog_delete_all(void);
 void hpi_get_session_index(void);
 
 
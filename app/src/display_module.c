@@ -52,6 +52,10 @@ LOG_MODULE_REGISTER(display_module, LOG_LEVEL_INF);  // Changed from DBG to redu
 
 #define HPI_DISP_RR_REFR_INT 4000
 
+#define HPI_DISP_PLOT_REFR_INT 20    // ~50 Hz redraw of the waveforms screen
+#define HPI_DISP_SETTLE_MS 20        // Wait after a screen change before the next LVGL pass
+#define HPI_DISP_MAX_IDLE_MS 1000    // Longest wait, so the watchdog heartbeat keeps moving
+
 // Downsampling ratio for waveform plots
 // ECG: 128 Hz → 64 Hz (2:1 downsample)
 // PPG: ~100 Hz → 50 Hz (2:1 downsample)  
@@ -109,23 +113,24 @@ static uint8_t m_disp_batt_level = 0;
 static bool m_disp_batt_charging = false;
 
 uint16_t m_disp_hr = 0;  // Non-static - accessed by detail screens
-static int last_hr_refresh = 0;
+static uint32_t last_hr_refresh = 0;
 
 float m_disp_temp_f = 0;  // Non-static - accessed by detail screens
 float m_disp_temp_c = 0;  // Non-static - accessed by detail screens
 
-static int last_temp_refresh = 0;
+static uint32_t last_temp_refresh = 0;
 
 uint8_t m_disp_spo2 = 0;  // Non-static - accessed by detail screens
-static int last_spo2_refresh = 0;
+static uint32_t last_spo2_refresh = 0;
 
 uint8_t m_disp_rr = 0;  // Non-static - accessed by detail screens
-static int last_rr_refresh = 0;
+static uint32_t last_rr_refresh = 0;
+
+static uint32_t last_plot_refresh = 0;
 
-// Lead-off state variables (updated by Zbus listener, read by display thread and screen modules)
+// Lead-off state variables (updated from zbus notifications in the display thread, read by screen modules)
 bool m_disp_ecg_lead_off = false;  // Non-static - accessed by detail screens
 bool m_disp_ppg_lead_off = true;   // Non-static - accessed by detail screens (start as lead-off)
-static int last_lead_off_refresh = 0;
 
 K_MSGQ_DEFINE(q_plot_ecg_bioz, sizeof(struct hpi_ecg_bioz_sensor_data_t), 32, 4);
 K_MSGQ_DEFINE(q_plot_ppg, sizeof(struct hpi_ppg_sensor_data_t), 32, 4);
@@ -187,6 +192,26 @@ extern struct k_sem sem_up_key_pressed;
 extern struct k_sem sem_down_key_pressed;
 extern struct k_msgq q_computed_val;
 
+// Vital signs and battery state: the zbus listener at the bottom of this
+// file marks which channels published, and raises this signal when a
+// lead-off state changes
+static struct k_poll_signal disp_vitals_sig = K_POLL_SIGNAL_INITIALIZER(disp_vitals_sig);
+static void disp_process_vitals(void);
+
+// Everything the display thread sleeps on between LVGL passes
+enum disp_poll_evt
+{
+    DISP_EVT_SCREEN_CHANGE,
+    DISP_EVT_KEY_UP,
+    DISP_EVT_KEY_DOWN,
+    DISP_EVT_KEY_OK_LONG,
+    DISP_EVT_ZBUS,
+    DISP_EVT_PLOT,
+    DISP_EVT_COUNT,
+};
+
+static struct k_poll_event disp_events[DISP_EVT_COUNT];
+
 // Software debounce for UP/DOWN buttons to prevent rapid screen changes
 #define BUTTON_DEBOUNCE_MS 1200  // 1.2 seconds between UP/DOWN button presses
 static uint32_t last_up_press_time = 0;
@@ -202,7 +227,8 @@ int hpi_disp_get_op_mode()
 
 bool hpi_disp_is_plot_screen_active(void)
 {
-    return false;  // No plot screens anymore, only detail screens with charts
+    // Called by data_thread for every point to decide whether to queue it
+    return hpi_disp_get_curr_screen() == SCR_WAVEFORMS;
 }
 
 void display_init_styles()
@@ -600,6 +626,7 @@ void draw_scr_hr(enum scroll_dir m_scroll_dir);
 void draw_scr_spo2(enum scroll_dir m_scroll_dir);
 void draw_scr_rr(enum scroll_dir m_scroll_dir);
 void draw_scr_temp(enum scroll_dir m_scroll_dir);
+void draw_scr_waveforms(enum scroll_dir m_scroll_dir);
 
 void hpi_disp_set_curr_screen(int screen)
 {
@@ -629,8 +656,77 @@ static const screen_func_table_entry_t screen_func_table[] = {
     [SCR_SPO2] = {draw_scr_spo2, NULL},
     [SCR_RR] = {draw_scr_rr, NULL},
     [SCR_TEMP] = {draw_scr_temp, NULL},
+    [SCR_WAVEFORMS] = {draw_scr_waveforms, NULL},
 };
 
+// True if interval has passed since *last, and restarts it; otherwise lowers
+// *next_ms to the time left
+static bool disp_refresh_due(uint32_t now, uint32_t *last, uint32_t interval, uint32_t *next_ms)
+{
+    uint32_t age = now - *last;
+
+    if (age >= interval)
+    {
+        *last = now;
+        *next_ms = MIN(*next_ms, interval);
+        return true;
+    }
+
+    *next_ms = MIN(*next_ms, interval - age);
+    return false;
+}
+
+static void disp_poll_init(void)
+{
+    k_poll_event_init(&disp_events[DISP_EVT_SCREEN_CHANGE], K_POLL_TYPE_SEM_AVAILABLE,
+                      K_POLL_MODE_NOTIFY_ONLY, &sem_change_screen);
+    k_poll_event_init(&disp_events[DISP_EVT_KEY_UP], K_POLL_TYPE_SEM_AVAILABLE,
+                      K_POLL_MODE_NOTIFY_ONLY, &sem_up_key_pressed);
+    k_poll_event_init(&disp_events[DISP_EVT_KEY_DOWN], K_POLL_TYPE_SEM_AVAILABLE,
+                      K_POLL_MODE_NOTIFY_ONLY, &sem_down_key_pressed);
+    k_poll_event_init(&disp_events[DISP_EVT_KEY_OK_LONG], K_POLL_TYPE_SEM_AVAILABLE,
+                      K_POLL_MODE_NOTIFY_ONLY, &sem_ok_key_longpress);
+    k_poll_event_init(&disp_events[DISP_EVT_ZBUS], K_POLL_TYPE_SIGNAL,
+                      K_POLL_MODE_NOTIFY_ONLY, &disp_vitals_sig);
+    k_poll_event_init(&disp_events[DISP_EVT_PLOT], K_POLL_TYPE_IGNORE,
+                      K_POLL_MODE_NOTIFY_ONLY, &q_hpi_plot_all_sample);
+}
+
+// Block for up to timeout_ms, or until one of disp_events fires. The events
+// only wake the thread; the loop takes the semaphores and drains the queues.
+static void disp_wait(uint32_t timeout_ms)
+{
+    // Plot points arrive at 128 Hz: only wake for them once a redraw is due,
+    // so each pass batches a few columns
+    if (hpi_disp_is_plot_screen_active())
+    {
+        uint32_t age = k_uptime_get_32() - last_plot_refresh;
+
+        if (age >= HPI_DISP_PLOT_REFR_INT)
+        {
+            disp_events[DISP_EVT_PLOT].type = K_POLL_TYPE_MSGQ_DATA_AVAILABLE;
+        }
+        else
+        {
+            disp_events[DISP_EVT_PLOT].type = K_POLL_TYPE_IGNORE;
+            timeout_ms = MIN(timeout_ms, HPI_DISP_PLOT_REFR_INT - age);
+        }
+    }
+    else
+    {
+        disp_events[DISP_EVT_PLOT].type = K_POLL_TYPE_IGNORE;
+    }
+
+    timeout_ms = MIN(timeout_ms, HPI_DISP_MAX_IDLE_MS);
+
+    for (int i = 0; i < DISP_EVT_COUNT; i++)
+    {
+        disp_events[i].state = K_POLL_STATE_NOT_READY;
+    }
+
+    (void)k_poll(disp_events, DISP_EVT_COUNT, K_MSEC(timeout_ms));
+}
+
 void display_screens_thread(void)
 {
     k_sem_take(&sem_hw_inited, K_FOREVER);
@@ -673,65 +769,45 @@ void display_screens_thread(void)
         //draw_scr_welcome();
     }
 
+    disp_poll_init();
+
     while (1)
     {
+        uint32_t lv_next_ms = HPI_DISP_SETTLE_MS;
+        uint32_t next_ms;
+        uint32_t now;
+
         // Update heartbeat for software watchdog
         heartbeat_display_thread = k_uptime_get_32();
 
-        /*if (k_msgq_get(&q_plot_ecg_bioz, &ecg_bioz_sensor_sample, K_NO_WAIT) == 0)
-        {
-            if (hpi_disp_get_curr_screen() == SCR_ECG)
-            {
-                hpi_ecg_disp_draw_plot_ecg(ecg_bioz_sensor_sample.ecg_samples, ecg_bioz_sensor_sample.ecg_num_samples, ecg_bioz_sensor_sample.ecg_lead_off);
-            }
-            else if (hpi_disp_get_curr_screen() == SCR_RESP)
-            {
-                hpi_resp_disp_draw_plot_resp(ecg_bioz_sensor_sample.bioz_samples, ecg_bioz_sensor_sample.bioz_num_samples, ecg_bioz_sensor_sample.bioz_lead_off);
-            }
-        }
-
-        if (k_msgq_get(&q_plot_ppg, &ppg_sensor_sample, K_NO_WAIT) == 0)
-        {
-            if (hpi_disp_get_curr_screen() == SCR_PPG)
-            {
-                hpi_ppg_disp_draw_plot_ppg(ppg_sensor_sample.ppg_red_sample, ppg_sensor_sample.ppg_ir_sample, ppg_sensor_sample.ppg_lead_off);
-            }
-        }*/
-
-        // CRITICAL: Process lv_task_handler() FIRST to handle screen changes immediately
-        // BUT skip immediately after screen change to let new screen stabilize
-        if (!screen_transitioning && !skip_next_lvgl_handler) {
-            lv_task_handler();
-        }
-        
-        // Clear skip flag after one iteration
-        if (skip_next_lvgl_handler) {
-            skip_next_lvgl_handler = false;
-        }
-
         /*
-         * REAL-TIME PLOTTING DISABLED
-         * RP2040 + SPI display cannot handle real-time waveform rendering at 128 Hz.
-         * Hardware limitations:
-         * - M0+ CPU @ 133 MHz (no GPU acceleration)
-         * - SPI display bandwidth ~10-20 MHz
-         * - LVGL software rendering takes ~50ms per chart update
-         * - Maximum achievable: ~20 Hz, Required: 128 Hz
-         * 
-         * For waveform viewing, use USB streaming to PC-based display.
-         * Display shows vital signs only (HR, SpO2, RR, Temp).
+         * Real-time plotting on the waveforms screen.
+         * lv_chart redraws the whole series for every point (~50 ms per update
+         * on the M0+), which can't keep up with 128 Hz. The sweep widget
+         * (ui/hpi_waveform.c) instead decimates into one min/max span per pixel
+         * column and invalidates only the few columns each pass adds, so the
+         * lv_timer_handler() call at the end of the pass flushes narrow strips
+         * over SPI.
          */
-        
+
         // Drain plot queue ONLY when on plot screens to prevent overflow
         // This ensures zero interference with USB/BLE streaming when on Home screen
-        if (hpi_disp_is_plot_screen_active()) {
+        if (hpi_disp_is_plot_screen_active() && !screen_transitioning &&
+            k_uptime_get_32() - last_plot_refresh >= HPI_DISP_PLOT_REFR_INT) {
             struct hpi_sensor_data_point_t sensor_all_data_point;
+            // Checked once for the batch; points for a dead screen are dropped
+            bool plot_valid = hpi_scr_waveforms_is_valid();
+
             for (int i = 0; i < 64; i++) {
                 if (k_msgq_get(&q_hpi_plot_all_sample, &sensor_all_data_point, K_NO_WAIT) != 0) {
                     break;  // Queue empty
                 }
-                // Sample discarded - plotting disabled
+                if (plot_valid) {
+                    hpi_scr_waveforms_add_point(&sensor_all_data_point);
+                }
             }
+            update_scr_waveforms(m_disp_ecg_lead_off, m_disp_ppg_lead_off);
+            last_plot_refresh = k_uptime_get_32();
         }
 
         // Process async screen change requests FIRST (from healthypi-move-fw pattern)
@@ -773,6 +849,11 @@ void display_screens_thread(void)
             else if (valid_change && screen_func_table[g_screen].draw)
             {
                 screen_func_table[g_screen].draw(g_scroll_dir);
+
+                // Points queued before an earlier visit would plot as a glitch
+                if (g_screen == SCR_WAVEFORMS) {
+                    k_msgq_purge(&q_hpi_plot_all_sample);
+                }
                 
                 // Force LVGL to process all pending operations (layouts, animations)
                 // This ensures the screen is fully rendered before resuming updates
@@ -801,13 +882,18 @@ void display_screens_thread(void)
             }
         }
 
+        // Latest vital signs and lead-off state from zbus
+        disp_process_vitals();
+
+        now = k_uptime_get_32();
+        next_ms = HPI_DISP_MAX_IDLE_MS;
+
         // Periodic vital signs updates (only when not transitioning screens)
         if (!screen_transitioning)
         {
-            if (k_uptime_get_32() - last_temp_refresh > HPI_DISP_TEMP_REFR_INT)
+            if (disp_refresh_due(now, &last_temp_refresh, HPI_DISP_TEMP_REFR_INT, &next_ms))
             {
                 hpi_disp_update_temp(m_disp_temp_f, m_disp_temp_c);
-                last_temp_refresh = k_uptime_get_32();
                 
                 // Update detail screens when active
                 int curr = hpi_disp_get_curr_screen();
@@ -818,10 +904,9 @@ void display_screens_thread(void)
                   // }
             }
 
-            if (k_uptime_get_32() - last_hr_refresh > HPI_DISP_HR_REFR_INT)
+            if (disp_refresh_due(now, &last_hr_refresh, HPI_DISP_HR_REFR_INT, &next_ms))
             {
                 hpi_scr_update_hr(m_disp_hr);
-                last_hr_refresh = k_uptime_get_32();
                 
                 // Update detail screens when active (skip during transitions)
                 int curr = hpi_disp_get_curr_screen();
@@ -832,10 +917,9 @@ void display_screens_thread(void)
                   // }
             }
 
-            if (k_uptime_get_32() - last_spo2_refresh > HPI_DISP_SPO2_REFR_INT)
+            if (disp_refresh_due(now, &last_spo2_refresh, HPI_DISP_SPO2_REFR_INT, &next_ms))
             {
                 hpi_scr_update_spo2(m_disp_spo2);
-                last_spo2_refresh = k_uptime_get_32();
                 
                 // Update detail screens when active (skip during transitions)
                 int curr = hpi_disp_get_curr_screen();
@@ -846,10 +930,9 @@ void display_screens_thread(void)
                   // }
             }
 
-            if (k_uptime_get_32() - last_rr_refresh > HPI_DISP_RR_REFR_INT)
+            if (disp_refresh_due(now, &last_rr_refresh, HPI_DISP_RR_REFR_INT, &next_ms))
             {
                 hpi_scr_update_rr(m_disp_rr);
-                last_rr_refresh = k_uptime_get_32();
                 
                 // Update detail screens when active (skip during transitions)
                 int curr = hpi_disp_get_curr_screen();
@@ -863,14 +946,10 @@ void display_screens_thread(void)
             // Lead-off status update - ONLY on state changes to reduce LVGL overhead
             // Updates home screen warning icons and detail screen overlays
             // CRITICAL: Only runs in display thread - safe for LVGL operations
-            // Reduced frequency: only update when state actually changes (not every 100ms)
+            // Checked on every wake; a zbus notification wakes us as soon as it changes
             // Note: State vars initialized to 0xFF to force initial update on boot
-            if (k_uptime_get_32() - last_lead_off_refresh > 100 &&
-                k_uptime_get_32() - last_spo2_refresh > 50 &&  // Wait 50ms after SpO2 update
-                k_uptime_get_32() - last_hr_refresh > 50)       // Wait 50ms after HR update
             {
                 int curr = hpi_disp_get_curr_screen();
-                last_lead_off_refresh = k_uptime_get_32();
                 
                 // Check if state has actually changed before updating (reduces LVGL calls by 90%)
                 // On first run, 0xFF != (0 or 1) so update always happens
@@ -937,37 +1016,57 @@ void display_screens_thread(void)
             }
         }
 
-        // lv_task_handler() now called at TOP of loop for better responsiveness
-
-        // Sleep for responsiveness without wasting CPU (plotting disabled)
-        k_sleep(K_MSEC(20));  // Moderate sleep - responsive to button presses and vital sign updates
+        // Render what this pass invalidated, LAST, so the delay it returns until
+        // its next timer accounts for it. Skipped right after a screen change to
+        // let the new screen stabilize.
+        if (!screen_transitioning && !skip_next_lvgl_handler) {
+            lv_next_ms = lv_timer_handler();
+        }
+        
+        // Clear skip flag after one iteration
+        if (skip_next_lvgl_handler) {
+            skip_next_lvgl_handler = false;
+        }
 
+        // Sleep until LVGL's next timer, the next periodic refresh, or an event:
+        // a key, a screen change request, a zbus notification or plot data
+        disp_wait(MIN(lv_next_ms, next_ms));
     }
 }
 
-static void disp_batt_status_listener(const struct zbus_channel *chan)
+ZBUS_CHAN_DECLARE(batt_chan, hr_chan, temp_chan, spo2_chan, resp_rate_chan);
+
+static void disp_batt_status_update(const struct zbus_channel *chan)
 {
-    const struct hpi_batt_status_t *batt_s = zbus_chan_const_msg(chan);
+    struct hpi_batt_status_t batt_s;
+
+    if (zbus_chan_read(chan, &batt_s, K_MSEC(10)) != 0)
+    {
+        return;
+    }
 
-    // LOG_DBG("Ch Batt: %d, Charge: %d", batt_s->batt_level, batt_s->batt_charging);
-    m_disp_batt_level = batt_s->batt_level;
-    m_disp_batt_charging = batt_s->batt_charging;
+    // LOG_DBG("Ch Batt: %d, Charge: %d", batt_s.batt_level, batt_s.batt_charging);
+    m_disp_batt_level = batt_s.batt_level;
+    m_disp_batt_charging = batt_s.batt_charging;
 }
-ZBUS_LISTENER_DEFINE(disp_batt_lis, disp_batt_status_listener);
 
-static void disp_hr_listener(const struct zbus_channel *chan)
+static void disp_hr_update(const struct zbus_channel *chan)
 {
-    const struct hpi_hr_t *hpi_hr = zbus_chan_const_msg(chan);
+    struct hpi_hr_t hpi_hr;
+
+    if (zbus_chan_read(chan, &hpi_hr, K_MSEC(10)) != 0)
+    {
+        return;
+    }
     
     // Update lead-off status from HR message
-    m_disp_ecg_lead_off = hpi_hr->lead_off;
+    m_disp_ecg_lead_off = hpi_hr.lead_off;
     
-    // CRITICAL: Do NOT call LVGL functions from Zbus listener - causes hard fault!
-    // Lead-off overlay updates handled in display_screens_thread periodic loop
+    // Lead-off overlay updates handled in display_screens_thread on the same pass
     
     // Only update HR value if not in lead-off state
-    if (!hpi_hr->lead_off) {
-        m_disp_hr = hpi_hr->hr;
+    if (!hpi_hr.lead_off) {
+        m_disp_hr = hpi_hr.hr;
         
         // Update vital stats history - throttle to once per second like other vitals
         // HR updates come at ~83 Hz (PPG sample rate), but stats should update at 1 Hz
@@ -975,7 +1074,7 @@ static void disp_hr_listener(const struct zbus_channel *chan)
         static uint32_t last_stats_update = 0;
         uint32_t now = k_uptime_get_32();
         if (now - last_stats_update >= 1000) {  // Update stats once per second
-            vital_stats_update_hr(hpi_hr->hr);
+            vital_stats_update_hr(hpi_hr.hr);
             last_stats_update = now;
         }
     } else {
@@ -983,63 +1082,155 @@ static void disp_hr_listener(const struct zbus_channel *chan)
         // Debug log removed to reduce console clutter during lead-off
     }
 }
-ZBUS_LISTENER_DEFINE(disp_hr_lis, disp_hr_listener);
 
-static void disp_temp_listener(const struct zbus_channel *chan)
+static void disp_temp_update(const struct zbus_channel *chan)
 {
-    const struct hpi_temp_t *hpi_temp = zbus_chan_const_msg(chan);
-    m_disp_temp_f = hpi_temp->temp_f;
-    m_disp_temp_c = hpi_temp->temp_c;
+    struct hpi_temp_t hpi_temp;
+
+    if (zbus_chan_read(chan, &hpi_temp, K_MSEC(10)) != 0)
+    {
+        return;
+    }
+
+    m_disp_temp_f = hpi_temp.temp_f;
+    m_disp_temp_c = hpi_temp.temp_c;
     
     // Update vital stats history
-    vital_stats_update_temp((float)hpi_temp->temp_f);
+    vital_stats_update_temp((float)hpi_temp.temp_f);
 }
-ZBUS_LISTENER_DEFINE(disp_temp_lis, disp_temp_listener);
 
-static void disp_spo2_listener(const struct zbus_channel *chan)
+static void disp_spo2_update(const struct zbus_channel *chan)
 {
-    const struct hpi_spo2_t *hpi_spo2 = zbus_chan_const_msg(chan);
+    struct hpi_spo2_t hpi_spo2;
+
+    if (zbus_chan_read(chan, &hpi_spo2, K_MSEC(10)) != 0)
+    {
+        return;
+    }
     
     // Update lead-off status from SpO2 message
-    m_disp_ppg_lead_off = hpi_spo2->lead_off;
+    m_disp_ppg_lead_off = hpi_spo2.lead_off;
     
-    LOG_DBG("SpO2 ZBUS update: %d, lead_off=%d", hpi_spo2->spo2, hpi_spo2->lead_off);
+    LOG_DBG("SpO2 ZBUS update: %d, lead_off=%d", hpi_spo2.spo2, hpi_spo2.lead_off);
     
     // Only update SpO2 value if not in lead-off state
-    if (!hpi_spo2->lead_off) {
-        m_disp_spo2 = hpi_spo2->spo2;
+    if (!hpi_spo2.lead_off) {
+        m_disp_spo2 = hpi_spo2.spo2;
         
         // Update vital stats history
-        vital_stats_update_spo2(hpi_spo2->spo2);
+        vital_stats_update_spo2(hpi_spo2.spo2);
     } else {
         // Lead-off detected - don't update value (keep last good value or show "--")
         // Debug log removed to reduce console clutter during lead-off
     }
-    // hpi_scr_update_spo2(hpi_spo2->spo2);
 }
-ZBUS_LISTENER_DEFINE(disp_spo2_lis, disp_spo2_listener);
 
-static void disp_resp_rate_listener(const struct zbus_channel *chan)
+static void disp_resp_rate_update(const struct zbus_channel *chan)
 {
-    const struct hpi_resp_rate_t *hpi_resp_rate = zbus_chan_const_msg(chan);
+    struct hpi_resp_rate_t hpi_resp_rate;
+
+    if (zbus_chan_read(chan, &hpi_resp_rate, K_MSEC(10)) != 0)
+    {
+        return;
+    }
     
     // Respiration uses same lead-off as ECG (BioZ requires ECG electrodes)
     // Update lead-off status from respiration message
-    m_disp_ecg_lead_off = hpi_resp_rate->lead_off;
+    m_disp_ecg_lead_off = hpi_resp_rate.lead_off;
     
     // Only update RR value if not in lead-off state
-    if (!hpi_resp_rate->lead_off) {
-        m_disp_rr = hpi_resp_rate->resp_rate;
+    if (!hpi_resp_rate.lead_off) {
+        m_disp_rr = hpi_resp_rate.resp_rate;
         
         // Update vital stats history
-        vital_stats_update_rr((uint8_t)hpi_resp_rate->resp_rate);
+        vital_stats_update_rr((uint8_t)hpi_resp_rate.resp_rate);
     } else {
         // Lead-off detected - don't update value (keep last good value or show "--")
         // Debug log removed to reduce console clutter during lead-off
     }
-    // hpi_scr_update_rr(hpi_resp_rate->resp_rate);
 }
-ZBUS_LISTENER_DEFINE(disp_resp_rate_lis, disp_resp_rate_listener);
+
+// Lead-off state of a message, read in the listener with the channel locked
+static bool disp_hr_lead_off(const struct zbus_channel *chan)
+{
+    return ((const struct hpi_hr_t *)zbus_chan_const_msg(chan))->lead_off;
+}
+
+static bool disp_spo2_lead_off(const struct zbus_channel *chan)
+{
+    return ((const struct hpi_spo2_t *)zbus_chan_const_msg(chan))->lead_off;
+}
+
+static bool disp_resp_rate_lead_off(const struct zbus_channel *chan)
+{
+    return ((const struct hpi_resp_rate_t *)zbus_chan_const_msg(chan))->lead_off;
+}
+
+static const struct
+{
+    const struct zbus_channel *chan;
+    void (*update)(const struct zbus_channel *chan);
+    bool (*lead_off)(const struct zbus_channel *chan);
+} disp_chan_table[] = {
+    {&batt_chan, disp_batt_status_update, NULL},
+    {&hr_chan, disp_hr_update, disp_hr_lead_off},
+    {&temp_chan, disp_temp_update, NULL},
+    {&spo2_chan, disp_spo2_update, disp_spo2_lead_off},
+    {&resp_rate_chan, disp_resp_rate_update, disp_resp_rate_lead_off},
+};
+
+// One bit per disp_chan_table entry that published since the last pass
+static atomic_t disp_vitals_pending;
+// One bit per entry: the lead-off state its last message carried
+static atomic_t disp_vitals_lead_off;
+
+// The display's zbus observer. It runs in the publisher's thread, at up to
+// 128 Hz for HR, so it only marks the channel. Values are read on the
+// display thread's next pass, which comes at least every
+// HPI_DISP_MAX_IDLE_MS and so by every vitals refresh deadline. Only a
+// lead-off change wakes the thread early, since its overlay should not lag.
+static void disp_vitals_cb(const struct zbus_channel *chan)
+{
+    for (int i = 0; i < ARRAY_SIZE(disp_chan_table); i++)
+    {
+        if (disp_chan_table[i].chan == chan)
+        {
+            atomic_or(&disp_vitals_pending, BIT(i));
+
+            if (disp_chan_table[i].lead_off != NULL)
+            {
+                bool lead_off = disp_chan_table[i].lead_off(chan);
+
+                if (lead_off != atomic_test_bit(&disp_vitals_lead_off, i))
+                {
+                    atomic_set_bit_to(&disp_vitals_lead_off, i, lead_off);
+                    k_poll_signal_raise(&disp_vitals_sig, 0);
+                }
+            }
+            return;
+        }
+    }
+}
+
+ZBUS_LISTENER_DEFINE(disp_vitals_lis, disp_vitals_cb);
+
+// Read each channel that published once
+static void disp_process_vitals(void)
+{
+    uint32_t published;
+
+    // Reset before taking the bits, so a publish in between raises it again
+    k_poll_signal_reset(&disp_vitals_sig);
+    published = (uint32_t)atomic_clear(&disp_vitals_pending);
+
+    for (int i = 0; i < ARRAY_SIZE(disp_chan_table); i++)
+    {
+        if (published & BIT(i))
+        {
+            disp_chan_table[i].update(disp_chan_table[i].chan);
+        }
+    }
+}
 
 // Lead-off status is now embedded in vital sign messages
 // No separate lead-off listener needed
@@ -52,6 +52,7 @@ enum hpi_disp_screens
     SCR_SPO2,
     SCR_RR,
     SCR_TEMP,
+    SCR_WAVEFORMS,
 
     SCR_LIST_END
 };
@@ -131,6 +132,14 @@ void update_scr_rr(uint8_t rr_value, bool ecg_lead_off);
 void draw_scr_temp(enum scroll_dir m_scroll_dir);
 void update_scr_temp(void);
 
+// Waveforms Screen functions
+struct hpi_sensor_data_point_t;
+void draw_scr_waveforms(enum scroll_dir m_scroll_dir);
+bool hpi_scr_waveforms_is_valid(void);
+// Only while hpi_scr_waveforms_is_valid()
+void hpi_scr_waveforms_add_point(const struct hpi_sensor_data_point_t *point);
+void update_scr_waveforms(bool ecg_lead_off, bool ppg_lead_off);
+
 // All Trends Screen functions
 void draw_scr_all_trends(enum scroll_dir m_scroll_dir);
 void update_scr_all_trends(void);
@@ -38,6 +38,8 @@
 #include "hpi_common_types.h"
 #include "fs_module.h"
 #include "cmd_module.h"
+#include "log_catalog.h"
+#include "log_ring.h"
 
 
 #if defined(CONFIG_FAT_FILESYSTEM_ELM)
@@ -55,6 +57,19 @@ static struct fs_mount_t sd_fs_mnt = {
 };
 struct fs_mount_t *mp_sd = &sd_fs_mnt;
 
+#ifdef CONFIG_FILE_SYSTEM_LITTLEFS
+// Internal flash: settings and, without a card, the ring log
+FS_LITTLEFS_DECLARE_DEFAULT_CONFIG(lfs_storage);
+static struct fs_mount_t lfs_fs_mnt = {
+    .type = FS_LITTLEFS,
+    .fs_data = &lfs_storage,
+    .storage_dev = (void *)FIXED_PARTITION_ID(storage_partition),
+    .mnt_point = "/lfs",
+};
+struct fs_mount_t *mp_lfs = &lfs_fs_mnt;
+bool lfs_mounted = false;
+#endif
+
 
 
 /*static int littlefs_flash_erase(unsigned int id)
@@ -205,6 +220,9 @@ static int mount_sd_fs()
 
         //rc = lsdir("/SD:");
 
+        // Builds the catalog on first mount of a card from older firmware
+        hpi_log_catalog_init();
+
         return rc;
 
     }
@@ -215,13 +233,112 @@ static int mount_sd_fs()
     return 0;
 }
 
+int hpi_fs_sd_unmount(void)
+{
+    int rc;
+
+    if (!sd_card_present)
+    {
+        return -ENODEV;
+    }
+
+    // Cleared first, so no new file operation starts on the card
+    sd_card_present = false;
+    rc = fs_unmount(&sd_fs_mnt);
+    if (rc < 0)
+    {
+        LOG_ERR("Failed to unmount SD FS %s: %d", sd_fs_mnt.mnt_point, rc);
+        sd_card_present = true;
+    }
+
+    return rc;
+}
+
+int hpi_fs_sd_remount(void)
+{
+    int rc;
+
+    rc = fs_mount(&sd_fs_mnt);
+    if (rc < 0)
+    {
+        LOG_ERR("Failed to remount SD FS %s: %d", sd_fs_mnt.mnt_point, rc);
+        return rc;
+    }
+
+    sd_card_present = true;
+    return hpi_log_catalog_rebuild();
+}
+
 #endif
 
+#ifdef CONFIG_FILE_SYSTEM_LITTLEFS
+
+// An unformatted partition is formatted by the LittleFS mount itself
+static int mount_lfs_fs(void)
+{
+    int rc;
+
+    rc = fs_mount(&lfs_fs_mnt);
+    if (rc < 0)
+    {
+        LOG_ERR("Failed to mount %s: %d", lfs_fs_mnt.mnt_point, rc);
+        return rc;
+    }
+
+    lfs_mounted = true;
+    LOG_DBG("Mounted %s", lfs_fs_mnt.mnt_point);
+    return 0;
+}
+
+#endif
+
+int hpi_fs_preallocate(struct fs_file_t *file, off_t size)
+{
+#if defined(CONFIG_FAT_FILESYSTEM_ELM)
+    FIL *fp = file->filep;
+    FSIZE_t pos = f_tell(fp);
+    FRESULT res;
+
+#if FF_USE_EXPAND
+    // Contiguous allocation is only possible while the file is empty
+    if (f_size(fp) == 0 && f_expand(fp, size, 1) == FR_OK)
+    {
+        return 0;
+    }
+#endif
+
+    // Seeking past the end of a writable file extends the cluster chain
+    // without writing it, unlike fs_truncate(), which zero fills byte by byte
+    res = f_lseek(fp, size);
+    if (res == FR_OK)
+    {
+        res = f_lseek(fp, pos);
+    }
+
+    return (res == FR_OK) ? 0 : -EIO;
+#else
+    ARG_UNUSED(file);
+    ARG_UNUSED(size);
+    return -ENOTSUP;
+#endif
+}
+
 void fs_module_init(void)
 {
+    #ifdef CONFIG_FILE_SYSTEM_LITTLEFS
+        mount_lfs_fs();
+    #endif
+
     #ifdef CONFIG_HEALTHYPI_SD_CARD_ENABLED
         mount_sd_fs();
     #endif
+
+    #ifdef CONFIG_HEALTHYPI_LOG_FLASH_RING
+        if (!sd_card_present && lfs_mounted)
+        {
+            hpi_log_ring_start();
+        }
+    #endif
 }
 
 
@@ -26,6 +26,8 @@
 #ifndef fs_module_h
 #define fs_module_h
 
+#include <sys/types.h>
+
 #include "hpi_common_types.h"
 
 void fs_module_init(void);
@@ -34,4 +36,17 @@ void init_settings(void);
 void set_current_session_log_id(uint8_t m_sec, uint8_t m_min, uint8_t m_hour, uint8_t m_day, uint8_t m_month, uint8_t m_year);
 void write_header_to_new_file();
 
+struct fs_file_t;
+
+// Grow an open SD file to size without writing to it, as one contiguous
+// extent when the file is still empty and FatFS has f_expand(). The file
+// position is left alone; the content of the new space is undefined.
+int hpi_fs_preallocate(struct fs_file_t *file, off_t size);
+
+// Unmount the SD card for another owner (USB mass storage) and mount it
+// again afterwards. sd_card_present follows; remounting rebuilds the
+// session catalog, as files may have changed meanwhile.
+int hpi_fs_sd_unmount(void);
+int hpi_fs_sd_remount(void);
+
 #endif
\ No newline at end of file
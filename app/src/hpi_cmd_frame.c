@@ -0,0 +1,292 @@
+/*
+ * SPDX-License-Identifier: MIT
+ *
+ * Copyright (c) 2026 Ashwin Whitchurch, ProtoCentral Electronics
+ *
+ * Host command frame parser (see hpi_cmd_frame.h).
+ */
+
+#include <string.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/crc.h>
+#include <zephyr/sys/byteorder.h>
+
+#include "hpi_cmd_frame.h"
+
+// Header bytes after START_2: len_lsb, len_msb, pkt_type
+#define FRAME_HDR_LEN 3
+#define FRAME_OVERHEAD HPI_CMD_FRAME_OVERHEAD
+#define FRAME_PAYLOAD_OFS (2 + FRAME_HDR_LEN)
+
+BUILD_ASSERT(FRAME_OVERHEAD == 2 + FRAME_HDR_LEN + 2, "Frame overhead mismatch");
+
+enum frame_state
+{
+    FRAME_STATE_SOF1 = 0,
+    FRAME_STATE_SOF2,
+    FRAME_STATE_LEN_LSB,
+    FRAME_STATE_LEN_MSB,
+    FRAME_STATE_TYPE,
+    FRAME_STATE_PAYLOAD,
+    FRAME_STATE_CRC,
+    FRAME_STATE_STOP,
+};
+
+void hpi_cmd_parser_init(struct hpi_cmd_parser *p)
+{
+    memset(p, 0, sizeof(*p));
+    p->state = FRAME_STATE_SOF1;
+}
+
+static bool frame_crc_ok(uint8_t crc_byte, uint8_t crc)
+{
+    if (crc_byte == crc)
+    {
+        return true;
+    }
+
+    return IS_ENABLED(CONFIG_HEALTHYPI_CMD_LEGACY_FRAMES) && crc_byte == CES_CMDIF_PKT_STOP_1;
+}
+
+static inline void frame_advance(const uint8_t **buf, size_t *len, size_t n)
+{
+    *buf += n;
+    *len -= n;
+}
+
+// A frame that starts at b and lies entirely within the buffer. Returns
+// the bytes it takes up, 0 if b doesn't start a valid frame, or -1 if
+// more input is needed to tell.
+static int frame_in_place(struct hpi_cmd_parser *p, const uint8_t *b, size_t len, struct hpi_cmd_frame *frame)
+{
+    uint16_t plen;
+
+    if (len < 2 + FRAME_HDR_LEN)
+    {
+        return (len < 2 || b[1] == CES_CMDIF_PKT_START_2) ? -1 : 0;
+    }
+    if (b[1] != CES_CMDIF_PKT_START_2)
+    {
+        return 0;
+    }
+
+    plen = sys_get_le16(&b[2]);
+    if (plen > MAX_MSG_SIZE)
+    {
+        p->dropped++;
+        return 0;
+    }
+    if (len < (size_t)FRAME_OVERHEAD + plen)
+    {
+        return -1;
+    }
+
+    if (b[2 + FRAME_HDR_LEN + plen + 1] != CES_CMDIF_PKT_STOP_2 ||
+        !frame_crc_ok(b[2 + FRAME_HDR_LEN + plen], crc8_ccitt(0, &b[2], FRAME_HDR_LEN + plen)))
+    {
+        p->dropped++;
+        return 0;
+    }
+
+    frame->pkt_type = b[4];
+    frame->len = plen;
+    frame->data = &b[2 + FRAME_HDR_LEN];
+    return FRAME_OVERHEAD + plen;
+}
+
+// Drop the frame being assembled and rescan it from the byte after its
+// START_1; the caller moves those bytes to the replay region
+static void frame_reject(struct hpi_cmd_parser *p)
+{
+    p->dropped++;
+    p->state = FRAME_STATE_SOF1;
+    p->rescan = true;
+}
+
+static inline void frame_store(struct hpi_cmd_parser *p, uint8_t c)
+{
+    p->buf[p->raw_len++] = c;
+}
+
+// Scan one source, the caller's buffer or the replay region, until a frame
+// is complete, the input runs out or a frame is rejected
+static bool frame_scan(struct hpi_cmd_parser *p, const uint8_t **buf, size_t *len, struct hpi_cmd_frame *frame)
+{
+    while (*len > 0 && !p->rescan)
+    {
+        uint8_t c;
+
+        if (p->state == FRAME_STATE_SOF1)
+        {
+            const uint8_t *sof = memchr(*buf, CES_CMDIF_PKT_START_1, *len);
+            int n;
+
+            if (sof == NULL)
+            {
+                frame_advance(buf, len, *len);
+                return false;
+            }
+            frame_advance(buf, len, sof - *buf);
+
+            // Common case: the whole frame arrived in one read
+            n = frame_in_place(p, *buf, *len, frame);
+            if (n > 0)
+            {
+                frame_advance(buf, len, n);
+                return true;
+            }
+            if (n == 0)
+            {
+                // Not a frame start after all; look for the next one
+                frame_advance(buf, len, 1);
+                continue;
+            }
+            // Split across reads: assemble it byte by byte below
+        }
+
+        c = **buf;
+        frame_advance(buf, len, 1);
+
+        switch (p->state)
+        {
+        case FRAME_STATE_SOF1:
+            p->raw_len = 0;
+            frame_store(p, c);
+            p->state = FRAME_STATE_SOF2;
+            break;
+
+        case FRAME_STATE_SOF2:
+            if (c == CES_CMDIF_PKT_START_2)
+            {
+                frame_store(p, c);
+                p->state = FRAME_STATE_LEN_LSB;
+            }
+            else if (c != CES_CMDIF_PKT_START_1)
+            {
+                p->state = FRAME_STATE_SOF1;
+            }
+            break;
+
+        case FRAME_STATE_LEN_LSB:
+            frame_store(p, c);
+            p->len = c;
+            p->state = FRAME_STATE_LEN_MSB;
+            break;
+
+        case FRAME_STATE_LEN_MSB:
+            frame_store(p, c);
+            p->len |= (uint16_t)c << 8;
+            if (p->len > MAX_MSG_SIZE)
+            {
+                // Garbage or oversized
+                frame_reject(p);
+                break;
+            }
+            p->state = FRAME_STATE_TYPE;
+            break;
+
+        case FRAME_STATE_TYPE:
+            frame_store(p, c);
+            p->state = (p->len > 0) ? FRAME_STATE_PAYLOAD : FRAME_STATE_CRC;
+            break;
+
+        case FRAME_STATE_PAYLOAD:
+        {
+            // Take as much of the payload as this buffer holds
+            size_t n = MIN((size_t)(FRAME_PAYLOAD_OFS + p->len - p->raw_len) - 1, *len);
+
+            frame_store(p, c);
+            memmove(&p->buf[p->raw_len], *buf, n);
+            p->raw_len += n;
+            frame_advance(buf, len, n);
+            if (p->raw_len == FRAME_PAYLOAD_OFS + p->len)
+            {
+                p->state = FRAME_STATE_CRC;
+            }
+            break;
+        }
+
+        case FRAME_STATE_CRC:
+            frame_store(p, c);
+            if (!frame_crc_ok(c, crc8_ccitt(0, &p->buf[2], FRAME_HDR_LEN + p->len)))
+            {
+                frame_reject(p);
+                break;
+            }
+            p->state = FRAME_STATE_STOP;
+            break;
+
+        case FRAME_STATE_STOP:
+            frame_store(p, c);
+            if (c != CES_CMDIF_PKT_STOP_2)
+            {
+                frame_reject(p);
+                break;
+            }
+            p->state = FRAME_STATE_SOF1;
+            frame->pkt_type = p->buf[FRAME_PAYLOAD_OFS - 1];
+            frame->len = p->len;
+            frame->data = &p->buf[FRAME_PAYLOAD_OFS];
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Queue the bytes after a rejected frame's START_1 for rescanning, ahead of
+// whatever is left of an earlier replay. The frame was assembled at the
+// start of buf, and while replaying it never gets ahead of the replay
+// position, so both moves stay in place.
+static void frame_requeue(struct hpi_cmd_parser *p)
+{
+    uint16_t n = p->raw_len - 1;
+
+    memmove(&p->buf[0], &p->buf[1], n);
+    if (p->replay_len > 0)
+    {
+        memmove(&p->buf[n], &p->buf[p->replay_pos], p->replay_len);
+    }
+    p->replay_pos = 0;
+    p->replay_len += n;
+    p->raw_len = 0;
+    p->rescan = false;
+}
+
+bool hpi_cmd_parser_next(struct hpi_cmd_parser *p, const uint8_t **buf, size_t *len, struct hpi_cmd_frame *frame)
+{
+    for (;;)
+    {
+        bool replay = (p->replay_len > 0);
+        const uint8_t *b = replay ? &p->buf[p->replay_pos] : *buf;
+        size_t n = replay ? p->replay_len : *len;
+        bool found = frame_scan(p, &b, &n, frame);
+
+        // Rejected bytes came before the rest of the input, so they are
+        // rescanned first
+        if (replay)
+        {
+            p->replay_pos = b - p->buf;
+            p->replay_len = n;
+        }
+        else
+        {
+            *buf = b;
+            *len = n;
+        }
+
+        if (found)
+        {
+            return true;
+        }
+        if (p->rescan)
+        {
+            frame_requeue(p);
+        }
+        else if (!replay)
+        {
+            return false;
+        }
+    }
+}
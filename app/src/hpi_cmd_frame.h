@@ -0,0 +1,63 @@
+/*
+ * SPDX-License-Identifier: MIT
+ *
+ * Copyright (c) 2026 Ashwin Whitchurch, ProtoCentral Electronics
+ *
+ * Parser for host command frames on the USB CDC link:
+ *
+ *   START_1 START_2 len_lsb len_msb pkt_type payload[len] CRC STOP_2
+ *
+ * CRC is CRC-8/CCITT (poly 0x07, init 0) over len_lsb through the end of
+ * the payload, in the byte that used to be the fixed STOP_1 (0x00). With
+ * CONFIG_HEALTHYPI_CMD_LEGACY_FRAMES a 0x00 there is also accepted, for
+ * host software that predates the CRC.
+ *
+ * A parser is a plain struct with no globals, so each link can have its
+ * own. It takes whole RX buffers: a frame that lies entirely inside the
+ * buffer is checked in place and returned as a view into it; only a frame
+ * split across reads is assembled in the parser's own buffer. Lengths over
+ * MAX_MSG_SIZE are rejected before any payload byte is stored.
+ *
+ * A rejected frame (bad length, CRC or terminator) only costs its start
+ * byte: the scan resumes at the byte after it, so a good frame that a
+ * truncated one swallowed is still found. An assembled frame is kept whole
+ * in the parser's buffer for that reason.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "cmd_module.h"
+
+// START_1 START_2 len_lsb len_msb pkt_type ... CRC STOP_2
+#define HPI_CMD_FRAME_OVERHEAD 7
+
+// A decoded frame; data stays valid until the next call on the parser or
+// until the caller's RX buffer is reused
+struct hpi_cmd_frame
+{
+    uint8_t pkt_type;
+    uint8_t len;
+    const uint8_t *data;
+};
+
+struct hpi_cmd_parser
+{
+    uint8_t state;
+    bool rescan;            // The frame in buf was rejected
+    uint16_t len;
+    uint16_t raw_len;       // Bytes of the frame being assembled, from START_1
+    uint16_t replay_pos;    // Bytes of a rejected frame still to rescan
+    uint16_t replay_len;
+    uint32_t dropped;       // Frames with a bad length, CRC or terminator
+    uint8_t buf[MAX_MSG_SIZE + HPI_CMD_FRAME_OVERHEAD];
+};
+
+void hpi_cmd_parser_init(struct hpi_cmd_parser *p);
+// Scan *buf for the next complete frame. Returns true with *frame filled
+// in and *buf / *len advanced past the frame, or false once all of the
+// input has been consumed.
+bool hpi_cmd_parser_next(struct hpi_cmd_parser *p, const uint8_t **buf, size_t *len, struct hpi_cmd_frame *frame);
@@ -34,6 +34,9 @@ HealthyPi specific common data types
 #define ECG_POINTS_PER_SAMPLE   8
 #define BIOZ_POINTS_PER_SAMPLE  4
 
+// The MAX30001 driver delivers the 18-bit ECG code shifted up by 8
+#define HPI_ECG_CODE_SHIFT      8
+
 // HR source selection
 enum hpi_hr_source {
     HR_SOURCE_ECG = 0,    // From MAX30001 R-R interval
@@ -67,7 +70,8 @@ struct hpi_sensor_data_point_t
     int32_t bioz_sample;
 
     uint8_t hr;
-    uint8_t rtor;
+    uint16_t rtor;          // ms
+    bool rtor_new;          // A beat was detected since the previous point
     uint8_t ecg_lead_off;
     uint8_t bioz_lead_off;
 
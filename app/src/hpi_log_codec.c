@@ -0,0 +1,241 @@
+/*
+ * SPDX-License-Identifier: MIT
+ *
+ * Copyright (c) 2026 Ashwin Whitchurch, ProtoCentral Electronics
+ *
+ * Delta + adaptive Rice codec for session log blocks. Shifts and adds only,
+ * so it stays cheap on the M0+ (no hardware divider).
+ */
+
+#include <errno.h>
+#include <string.h>
+
+#include "hpi_log_codec.h"
+
+#define CODEC_SEED_BITS 24
+#define CODEC_MAX_K 24
+#define CODEC_RESET 64
+
+// Worst case for a frame (an even and an odd point): four escaped values
+#define CODEC_MAX_VALUE_BITS (HPI_LOG_CODEC_ESC + HPI_LOG_CODEC_RAW_BITS)
+#define CODEC_MAX_FRAME_BITS ((HPI_LOG_CODEC_CHANNELS + 1) * CODEC_MAX_VALUE_BITS)
+
+static void codec_state_init(struct hpi_log_codec_state *st, size_t len)
+{
+    memset(st, 0, sizeof(*st));
+    st->bit_len = len * 8;
+
+    for (int ch = 0; ch < HPI_LOG_CODEC_CHANNELS; ch++)
+    {
+        st->a[ch] = 32;
+        st->n[ch] = 1;
+    }
+}
+
+static uint32_t codec_k(const struct hpi_log_codec_state *st, int ch)
+{
+    uint32_t k = 0;
+
+    while ((st->n[ch] << k) < st->a[ch] && k < CODEC_MAX_K)
+    {
+        k++;
+    }
+
+    return k;
+}
+
+static void codec_update(struct hpi_log_codec_state *st, int ch, uint32_t u)
+{
+    st->a[ch] += u;
+    if (++st->n[ch] == CODEC_RESET)
+    {
+        st->a[ch] >>= 1;
+        st->n[ch] >>= 1;
+    }
+}
+
+static int32_t sign_extend_24(uint32_t v)
+{
+    return (int32_t)(v << 8) >> 8;
+}
+
+static void put_bits(struct hpi_log_encoder *enc, uint32_t value, uint32_t n_bits)
+{
+    while (n_bits-- > 0)
+    {
+        size_t pos = enc->st.bit_pos++;
+
+        if ((value >> n_bits) & 1)
+        {
+            enc->buf[pos >> 3] |= 0x80 >> (pos & 7);
+        }
+    }
+}
+
+static int get_bits(struct hpi_log_decoder *dec, uint32_t n_bits, uint32_t *value)
+{
+    uint32_t v = 0;
+
+    if (dec->st.bit_pos + n_bits > dec->st.bit_len)
+    {
+        return -EIO;
+    }
+
+    while (n_bits-- > 0)
+    {
+        size_t pos = dec->st.bit_pos++;
+
+        v = (v << 1) | ((dec->buf[pos >> 3] >> (7 - (pos & 7))) & 1);
+    }
+
+    *value = v;
+    return 0;
+}
+
+static void encode_value(struct hpi_log_encoder *enc, int ch, int32_t value)
+{
+    int32_t d = sign_extend_24((uint32_t)value) - enc->st.prev[ch];
+    uint32_t u = ((uint32_t)d << 1) ^ (uint32_t)(d >> 31);
+    uint32_t k = codec_k(&enc->st, ch);
+    uint32_t q = u >> k;
+
+    if (q < HPI_LOG_CODEC_ESC)
+    {
+        put_bits(enc, (1u << (q + 1)) - 2, q + 1);
+        put_bits(enc, u, k);
+    }
+    else
+    {
+        put_bits(enc, (1u << HPI_LOG_CODEC_ESC) - 1, HPI_LOG_CODEC_ESC);
+        put_bits(enc, u, HPI_LOG_CODEC_RAW_BITS);
+    }
+
+    enc->st.prev[ch] += d;
+    codec_update(&enc->st, ch, u);
+}
+
+static int decode_value(struct hpi_log_decoder *dec, int ch, int32_t *value)
+{
+    uint32_t k = codec_k(&dec->st, ch);
+    uint32_t q = 0;
+    uint32_t bit, low, u;
+
+    for (;;)
+    {
+        if (q == HPI_LOG_CODEC_ESC)
+        {
+            if (get_bits(dec, HPI_LOG_CODEC_RAW_BITS, &u) != 0)
+            {
+                return -EIO;
+            }
+            break;
+        }
+
+        if (get_bits(dec, 1, &bit) != 0)
+        {
+            return -EIO;
+        }
+
+        if (bit == 0)
+        {
+            if (get_bits(dec, k, &low) != 0)
+            {
+                return -EIO;
+            }
+            u = (q << k) | low;
+            break;
+        }
+
+        q++;
+    }
+
+    dec->st.prev[ch] += (int32_t)(u >> 1) ^ -(int32_t)(u & 1);
+    codec_update(&dec->st, ch, u);
+
+    *value = dec->st.prev[ch];
+    return 0;
+}
+
+void hpi_log_encoder_init(struct hpi_log_encoder *enc, uint8_t *buf, size_t len)
+{
+    codec_state_init(&enc->st, len);
+    enc->buf = buf;
+    memset(buf, 0, len);
+}
+
+bool hpi_log_encoder_add(struct hpi_log_encoder *enc, int32_t ecg, int32_t bioz, int32_t ppg)
+{
+    const int32_t v[HPI_LOG_CODEC_CHANNELS] = {ecg, bioz, ppg};
+    bool even = (enc->st.n_points & 1) == 0;
+
+    if (even && (enc->st.n_points + 2 > HPI_LOG_CODEC_MAX_POINTS ||
+                 enc->st.bit_pos + CODEC_MAX_FRAME_BITS > enc->st.bit_len))
+    {
+        return false;
+    }
+
+    // Can't fail after an accepted even point; guards a caller that skips one
+    if (!even && enc->st.bit_pos + CODEC_MAX_VALUE_BITS > enc->st.bit_len)
+    {
+        return false;
+    }
+
+    if (enc->st.n_points == 0)
+    {
+        for (int ch = 0; ch < HPI_LOG_CODEC_CHANNELS; ch++)
+        {
+            put_bits(enc, (uint32_t)v[ch] & 0xFFFFFF, CODEC_SEED_BITS);
+            enc->st.prev[ch] = sign_extend_24((uint32_t)v[ch]);
+        }
+    }
+    else
+    {
+        for (int ch = 0; ch < (even ? HPI_LOG_CODEC_CHANNELS : 1); ch++)
+        {
+            encode_value(enc, ch, v[ch]);
+        }
+    }
+
+    enc->st.n_points++;
+    return true;
+}
+
+void hpi_log_decoder_init(struct hpi_log_decoder *dec, const uint8_t *buf, size_t len)
+{
+    codec_state_init(&dec->st, len);
+    dec->buf = buf;
+}
+
+int hpi_log_decoder_next(struct hpi_log_decoder *dec, int32_t out[HPI_LOG_CODEC_CHANNELS])
+{
+    bool even = (dec->st.n_points & 1) == 0;
+    int n = even ? HPI_LOG_CODEC_CHANNELS : 1;
+
+    if (dec->st.n_points == 0)
+    {
+        for (int ch = 0; ch < HPI_LOG_CODEC_CHANNELS; ch++)
+        {
+            uint32_t raw;
+
+            if (get_bits(dec, CODEC_SEED_BITS, &raw) != 0)
+            {
+                return -EIO;
+            }
+            dec->st.prev[ch] = sign_extend_24(raw);
+            out[ch] = dec->st.prev[ch];
+        }
+    }
+    else
+    {
+        for (int ch = 0; ch < n; ch++)
+        {
+            if (decode_value(dec, ch, &out[ch]) != 0)
+            {
+                return -EIO;
+            }
+        }
+    }
+
+    dec->st.n_points++;
+    return n;
+}
@@ -0,0 +1,69 @@
+/*
+ * SPDX-License-Identifier: MIT
+ *
+ * Copyright (c) 2026 Ashwin Whitchurch, ProtoCentral Electronics
+ *
+ * Lossless block codec for session logs (HPI_LOG_CODEC_RICE).
+ *
+ * A block's points are coded in order; even points carry ECG, BioZ and
+ * PPG, odd points ECG only, as in the raw frame layout. The first point is
+ * stored as three raw 24-bit values. Every later value is coded as the
+ * zigzag of its difference from the previous value on the same channel,
+ * using a Rice code:
+ *
+ *     q = u >> k; q < ESC: q one bits, a zero bit, then the low k bits of u
+ *                 q >= ESC: ESC one bits, then u in 25 bits
+ *
+ * k adapts per channel from a running mean of u (A / N, halved every 64
+ * values), so no parameters are stored. All coder state restarts at each
+ * block, which keeps blocks independently decodable. Bits are packed MSB
+ * first. scripts/hpi_log_to_csv.py carries the matching host decoder.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define HPI_LOG_CODEC_CHANNELS 3
+#define HPI_LOG_CODEC_ESC 24
+#define HPI_LOG_CODEC_RAW_BITS 25
+// Bounds per-block duration and decoder loops
+#define HPI_LOG_CODEC_MAX_POINTS 1024
+
+struct hpi_log_codec_state
+{
+    int32_t prev[HPI_LOG_CODEC_CHANNELS];
+    uint32_t a[HPI_LOG_CODEC_CHANNELS];
+    uint32_t n[HPI_LOG_CODEC_CHANNELS];
+    size_t bit_pos;
+    size_t bit_len;
+    uint16_t n_points;
+};
+
+struct hpi_log_encoder
+{
+    struct hpi_log_codec_state st;
+    uint8_t *buf;
+};
+
+struct hpi_log_decoder
+{
+    struct hpi_log_codec_state st;
+    const uint8_t *buf;
+};
+
+void hpi_log_encoder_init(struct hpi_log_encoder *enc, uint8_t *buf, size_t len);
+
+// Append one point; BioZ and PPG are ignored on odd points. Returns false
+// without consuming anything if the point might not fit. An even point is
+// only accepted if the odd point after it is sure to fit too, so a block
+// always ends on a whole frame unless the input does.
+bool hpi_log_encoder_add(struct hpi_log_encoder *enc, int32_t ecg, int32_t bioz, int32_t ppg);
+
+void hpi_log_decoder_init(struct hpi_log_decoder *dec, const uint8_t *buf, size_t len);
+
+// Decode the next point into out[] (ECG, BioZ, PPG). Returns the number of
+// values decoded (3 on even points, 1 on odd), or -EIO if the data runs out.
+int hpi_log_decoder_next(struct hpi_log_decoder *dec, int32_t out[HPI_LOG_CODEC_CHANNELS]);
@@ -0,0 +1,355 @@
+/*
+ * SPDX-License-Identifier: MIT
+ *
+ * Copyright (c) 2026 Ashwin Whitchurch, ProtoCentral Electronics
+ *
+ * EDF+ header and data record assembly for the session log writer. No
+ * file I/O here: datalog_module.c stages the records and patches the
+ * header fields.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/util.h>
+
+#include "hpi_log_edf.h"
+
+// Sample shifts down to 16 bits. The log stores the 18-bit ECG code and
+// the driver's 20-bit BioZ; the AFE4400 driver already keeps only the top
+// 14 bits of PPG, so that goes in as is
+#define EDF_ECG_SHIFT 2
+#define EDF_BIOZ_SHIFT 4
+#define EDF_PPG_SHIFT 0
+
+// MAX30001: ECG LSB = VREF / (2^17 * gain), VREF = 1 V
+#define EDF_ECG_LSB_DIV 131072LL
+
+#define EDF_TAL_SEP '\x14'
+
+struct edf_signal
+{
+    const char *label;
+    const char *transducer;
+    const char *dimension;
+    char pmin[9];
+    char pmax[9];
+    const char *dmin;
+    const char *dmax;
+    uint16_t samples;
+};
+
+static void edf_field(uint8_t *dst, size_t width, const char *s)
+{
+    size_t n = MIN(strlen(s), width);
+
+    memcpy(dst, s, n);
+    memset(&dst[n], ' ', width - n);
+}
+
+// Physical values in hundredths, printed with as few decimals as needed
+// to fit the 8-character field
+static void edf_fixed(char *buf, size_t len, int32_t hundredths)
+{
+    uint32_t mag = (hundredths < 0) ? -hundredths : hundredths;
+
+    if (mag % 100 == 0)
+    {
+        snprintf(buf, len, "%s%u", (hundredths < 0) ? "-" : "", (unsigned int)(mag / 100));
+    }
+    else
+    {
+        snprintf(buf, len, "%s%u.%02u", (hundredths < 0) ? "-" : "", (unsigned int)(mag / 100),
+                 (unsigned int)(mag % 100));
+    }
+}
+
+// The range a full-scale 16-bit sample stands for, in raw input codes
+static void edf_code_range(struct edf_signal *sig, int shift)
+{
+    snprintf(sig->pmin, sizeof(sig->pmin), "%d", (int)(INT16_MIN * (1 << shift)));
+    snprintf(sig->pmax, sizeof(sig->pmax), "%d", (int)(INT16_MAX * (1 << shift)));
+}
+
+// A 16-bit ECG sample in uV hundredths, rounded away from zero:
+// (sample << EDF_ECG_SHIFT) LSBs of 1e6 / (2^17 * gain) uV each
+static int32_t edf_ecg_hundredths(int32_t sample, uint32_t gain)
+{
+    int64_t num = (int64_t)sample * (1 << EDF_ECG_SHIFT) * 100000000LL;
+    int64_t den = EDF_ECG_LSB_DIV * gain;
+
+    return (int32_t)((num + ((num < 0) ? -den / 2 : den / 2)) / den);
+}
+
+void hpi_log_edf_init_header(uint8_t *buf, const uint8_t start_time[6], uint32_t ecg_gain)
+{
+    static const char *const months[] = {"JAN", "FEB", "MAR", "APR", "MAY", "JUN",
+                                         "JUL", "AUG", "SEP", "OCT", "NOV", "DEC"};
+    struct edf_signal sig[HPI_LOG_EDF_NUM_SIGNALS] = {
+        {"ECG", "MAX30001 electrodes", "uV", "", "", "-32768", "32767", HPI_LOG_EDF_ECG_SAMPLES},
+        {"BioZ", "MAX30001 electrodes", "raw", "", "", "-32768", "32767", HPI_LOG_EDF_BIOZ_SAMPLES},
+        {"PPG Red", "AFE4400 finger probe", "raw", "", "", "-32768", "32767", HPI_LOG_EDF_PPG_SAMPLES},
+        {"EDF Annotations", "", "", "-1", "1", "-32768", "32767", HPI_LOG_EDF_ANNOT_BYTES / 2},
+    };
+    bool have_date = start_time[1] >= 1 && start_time[1] <= 12;
+    uint8_t *p = &buf[256];
+    char tmp[81];
+
+    edf_fixed(sig[0].pmin, sizeof(sig[0].pmin), edf_ecg_hundredths(INT16_MIN, ecg_gain));
+    edf_fixed(sig[0].pmax, sizeof(sig[0].pmax), edf_ecg_hundredths(INT16_MAX, ecg_gain));
+    edf_code_range(&sig[1], EDF_BIOZ_SHIFT);
+    edf_code_range(&sig[2], EDF_PPG_SHIFT);
+
+    edf_field(&buf[0], 8, "0");
+    edf_field(&buf[8], 80, "X X X X");
+    if (have_date)
+    {
+        snprintf(tmp, sizeof(tmp), "Startdate %02u-%s-20%02u X X HealthyPi_5", start_time[2],
+                 months[start_time[1] - 1], start_time[0]);
+        edf_field(&buf[88], 80, tmp);
+        snprintf(tmp, sizeof(tmp), "%02u.%02u.%02u", start_time[2], start_time[1], start_time[0]);
+        edf_field(&buf[168], 8, tmp);
+        snprintf(tmp, sizeof(tmp), "%02u.%02u.%02u", start_time[3], start_time[4], start_time[5]);
+        edf_field(&buf[176], 8, tmp);
+    }
+    else
+    {
+        edf_field(&buf[88], 80, "Startdate X X X HealthyPi_5");
+        edf_field(&buf[168], 8, "01.01.85");
+        edf_field(&buf[176], 8, "00.00.00");
+    }
+    snprintf(tmp, sizeof(tmp), "%d", HPI_LOG_EDF_HEADER_SIZE);
+    edf_field(&buf[184], 8, tmp);
+    edf_field(&buf[HPI_LOG_EDF_RESERVED_OFFSET], 44, "EDF+C");
+    edf_field(&buf[HPI_LOG_EDF_NUM_RECORDS_OFFSET], HPI_LOG_EDF_NUM_RECORDS_LEN, "-1");
+    edf_field(&buf[244], 8, "1");
+    snprintf(tmp, sizeof(tmp), "%d", HPI_LOG_EDF_NUM_SIGNALS);
+    edf_field(&buf[252], 4, tmp);
+
+    // Signal fields are stored field by field, each across all signals
+    for (int i = 0; i < HPI_LOG_EDF_NUM_SIGNALS; i++, p += 16)
+        edf_field(p, 16, sig[i].label);
+    for (int i = 0; i < HPI_LOG_EDF_NUM_SIGNALS; i++, p += 80)
+        edf_field(p, 80, sig[i].transducer);
+    for (int i = 0; i < HPI_LOG_EDF_NUM_SIGNALS; i++, p += 8)
+        edf_field(p, 8, sig[i].dimension);
+    for (int i = 0; i < HPI_LOG_EDF_NUM_SIGNALS; i++, p += 8)
+        edf_field(p, 8, sig[i].pmin);
+    for (int i = 0; i < HPI_LOG_EDF_NUM_SIGNALS; i++, p += 8)
+        edf_field(p, 8, sig[i].pmax);
+    for (int i = 0; i < HPI_LOG_EDF_NUM_SIGNALS; i++, p += 8)
+        edf_field(p, 8, sig[i].dmin);
+    for (int i = 0; i < HPI_LOG_EDF_NUM_SIGNALS; i++, p += 8)
+        edf_field(p, 8, sig[i].dmax);
+    for (int i = 0; i < HPI_LOG_EDF_NUM_SIGNALS; i++, p += 80)
+        edf_field(p, 80, "");
+    for (int i = 0; i < HPI_LOG_EDF_NUM_SIGNALS; i++, p += 8)
+    {
+        snprintf(tmp, sizeof(tmp), "%u", sig[i].samples);
+        edf_field(p, 8, tmp);
+    }
+    for (int i = 0; i < HPI_LOG_EDF_NUM_SIGNALS; i++, p += 32)
+        edf_field(p, 32, "");
+}
+
+// A header field as a NUL-terminated string
+static const char *edf_get_field(const uint8_t *buf, size_t width, char *out)
+{
+    memcpy(out, buf, width);
+    out[width] = '\0';
+    return out;
+}
+
+int hpi_log_edf_parse_header(const uint8_t *buf, uint8_t start_time[6], int32_t *n_records)
+{
+    unsigned int d, mo, y, h, mi, s;
+    char tmp[17];
+
+    if (memcmp(buf, "0       ", 8) != 0 || memcmp(&buf[HPI_LOG_EDF_RESERVED_OFFSET], "EDF+", 4) != 0 ||
+        atoi(edf_get_field(&buf[184], 8, tmp)) != HPI_LOG_EDF_HEADER_SIZE ||
+        atoi(edf_get_field(&buf[252], 4, tmp)) != HPI_LOG_EDF_NUM_SIGNALS)
+    {
+        return -EINVAL;
+    }
+
+    memset(start_time, 0, 6);
+    if (memcmp(&buf[88], "Startdate X", 11) != 0 &&
+        sscanf(edf_get_field(&buf[168], 8, tmp), "%2u.%2u.%2u", &d, &mo, &y) == 3 &&
+        sscanf(edf_get_field(&buf[176], 8, tmp), "%2u.%2u.%2u", &h, &mi, &s) == 3)
+    {
+        start_time[0] = y;
+        start_time[1] = mo;
+        start_time[2] = d;
+        start_time[3] = h;
+        start_time[4] = mi;
+        start_time[5] = s;
+    }
+
+    *n_records = atoi(edf_get_field(&buf[HPI_LOG_EDF_NUM_RECORDS_OFFSET], HPI_LOG_EDF_NUM_RECORDS_LEN, tmp));
+
+    return 0;
+}
+
+void hpi_log_edf_records_field(char field[HPI_LOG_EDF_NUM_RECORDS_LEN], uint32_t n_records)
+{
+    char tmp[12];
+
+    snprintf(tmp, sizeof(tmp), "%u", (unsigned int)n_records);
+    edf_field((uint8_t *)field, HPI_LOG_EDF_NUM_RECORDS_LEN, tmp);
+}
+
+bool hpi_log_edf_record_valid(const char *annot, size_t len)
+{
+    size_t i = 1;
+
+    if (len < 4 || annot[0] != '+')
+    {
+        return false;
+    }
+
+    while (i < len && ((annot[i] >= '0' && annot[i] <= '9') || annot[i] == '.'))
+    {
+        i++;
+    }
+
+    return i > 1 && i + 1 < len && annot[i] == EDF_TAL_SEP && annot[i + 1] == EDF_TAL_SEP;
+}
+
+// "+<seconds>[.<ms>]", as a TAL onset
+static int edf_onset(char *buf, size_t len, uint32_t ms)
+{
+    if (ms % 1000 == 0)
+    {
+        return snprintf(buf, len, "+%u", (unsigned int)(ms / 1000));
+    }
+
+    return snprintf(buf, len, "+%u.%03u", (unsigned int)(ms / 1000), (unsigned int)(ms % 1000));
+}
+
+// Move whole queued annotations into the record while they fit
+static void edf_drain(struct hpi_log_edf_writer *w)
+{
+    while (w->started && w->pending_len > 0)
+    {
+        size_t n = strnlen(w->pending, w->pending_len) + 1;
+
+        if (w->annot_len + n > HPI_LOG_EDF_ANNOT_BYTES)
+        {
+            break;
+        }
+
+        memcpy(&w->rec.annot[w->annot_len], w->pending, n);
+        w->annot_len += n;
+        w->pending_len -= n;
+        memmove(w->pending, &w->pending[n], w->pending_len);
+    }
+}
+
+static void edf_begin(struct hpi_log_edf_writer *w)
+{
+    int n;
+
+    memset(w->rec.annot, 0, sizeof(w->rec.annot));
+    n = edf_onset(w->rec.annot, sizeof(w->rec.annot), w->rec_onset_ms);
+    w->rec.annot[n++] = EDF_TAL_SEP;
+    w->rec.annot[n++] = EDF_TAL_SEP;
+    w->rec.annot[n++] = '\0';
+    w->annot_len = n;
+    w->n_points = 0;
+
+    edf_drain(w);
+}
+
+void hpi_log_edf_writer_init(struct hpi_log_edf_writer *w)
+{
+    memset(w, 0, sizeof(*w));
+}
+
+void hpi_log_edf_restart(struct hpi_log_edf_writer *w, uint32_t onset_ms)
+{
+    if (w->started)
+    {
+        w->discontinuous = true;
+    }
+    w->started = true;
+    w->rec_onset_ms = onset_ms;
+    edf_begin(w);
+}
+
+uint32_t hpi_log_edf_next_time_ms(const struct hpi_log_edf_writer *w)
+{
+    return w->rec_onset_ms + (uint32_t)w->n_points * 1000 / HPI_LOG_EDF_ECG_SAMPLES;
+}
+
+static int16_t edf_sample(int32_t v, int shift)
+{
+    return (int16_t)CLAMP(v >> shift, INT16_MIN, INT16_MAX);
+}
+
+static void edf_put(struct hpi_log_edf_writer *w)
+{
+    uint16_t i = w->n_points;
+
+    w->rec.ecg[i] = (int16_t)sys_cpu_to_le16(w->last[0]);
+    if ((i & 1) == 0)
+    {
+        w->rec.bioz[i / 2] = (int16_t)sys_cpu_to_le16(w->last[1]);
+        w->rec.ppg[i / 2] = (int16_t)sys_cpu_to_le16(w->last[2]);
+    }
+    w->n_points++;
+}
+
+bool hpi_log_edf_add_point(struct hpi_log_edf_writer *w, int32_t ecg, int32_t bioz, int32_t ppg)
+{
+    w->last[0] = edf_sample(ecg, EDF_ECG_SHIFT);
+    w->last[1] = edf_sample(bioz, EDF_BIOZ_SHIFT);
+    w->last[2] = edf_sample(ppg, EDF_PPG_SHIFT);
+    edf_put(w);
+
+    return w->n_points == HPI_LOG_EDF_RECORD_POINTS;
+}
+
+void hpi_log_edf_next_record(struct hpi_log_edf_writer *w)
+{
+    w->n_records++;
+    w->rec_onset_ms += 1000;
+    edf_begin(w);
+}
+
+bool hpi_log_edf_pad(struct hpi_log_edf_writer *w)
+{
+    if (w->n_points == 0)
+    {
+        return false;
+    }
+
+    while (w->n_points < HPI_LOG_EDF_RECORD_POINTS)
+    {
+        edf_put(w);
+    }
+
+    return true;
+}
+
+void hpi_log_edf_annotate(struct hpi_log_edf_writer *w, uint32_t onset_ms, const char *text)
+{
+    char tal[48];
+    int n = edf_onset(tal, sizeof(tal), onset_ms);
+
+    n += snprintf(&tal[n], sizeof(tal) - n, "%c%s%c", EDF_TAL_SEP, text, EDF_TAL_SEP);
+
+    // Kept with its NUL, which ends the TAL
+    if (n >= (int)sizeof(tal) || w->pending_len + (size_t)n + 1 > sizeof(w->pending))
+    {
+        w->dropped_annots++;
+        return;
+    }
+
+    memcpy(&w->pending[w->pending_len], tal, n + 1);
+    w->pending_len += n + 1;
+
+    edf_drain(w);
+}
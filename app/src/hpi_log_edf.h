@@ -0,0 +1,101 @@
+/*
+ * SPDX-License-Identifier: MIT
+ *
+ * Copyright (c) 2026 Ashwin Whitchurch, ProtoCentral Electronics
+ *
+ * EDF+ session log output (HPI_LOG_FILE_NO_EDF).
+ *
+ * One-second data records of four signals: ECG at 128 SPS, BioZ and PPG at
+ * 64 SPS, and an "EDF Annotations" signal. The 18-bit ECG and 20-bit BioZ
+ * codes are shifted down to 16 bits and the 14-bit PPG is stored as is;
+ * the header's physical range scales ECG to uV and leaves BioZ and PPG in
+ * raw ADC units.
+ *
+ * Each record's annotation area opens with its timekeeping TAL, the
+ * record's onset in seconds from the header start time; lead-off events
+ * follow as annotations. The file is written as EDF+C with the record
+ * count left at -1, and the count is patched in at close. A recording gap
+ * switches the header to EDF+D, after which record onsets are no longer
+ * one second apart.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <zephyr/toolchain.h>
+
+#define HPI_LOG_EDF_NUM_SIGNALS 4
+#define HPI_LOG_EDF_HEADER_SIZE (256 * (HPI_LOG_EDF_NUM_SIGNALS + 1))
+
+#define HPI_LOG_EDF_ECG_SAMPLES 128
+#define HPI_LOG_EDF_BIOZ_SAMPLES 64
+#define HPI_LOG_EDF_PPG_SAMPLES 64
+#define HPI_LOG_EDF_ANNOT_BYTES 120
+#define HPI_LOG_EDF_RECORD_POINTS HPI_LOG_EDF_ECG_SAMPLES
+
+// Header fields rewritten after the header itself has gone out
+#define HPI_LOG_EDF_RESERVED_OFFSET 192
+#define HPI_LOG_EDF_NUM_RECORDS_OFFSET 236
+#define HPI_LOG_EDF_NUM_RECORDS_LEN 8
+
+// Annotations waiting for room in a record
+#define HPI_LOG_EDF_PENDING_BYTES 256
+
+// On-disk layout of a data record, samples little-endian
+struct hpi_log_edf_record
+{
+    int16_t ecg[HPI_LOG_EDF_ECG_SAMPLES];
+    int16_t bioz[HPI_LOG_EDF_BIOZ_SAMPLES];
+    int16_t ppg[HPI_LOG_EDF_PPG_SAMPLES];
+    char annot[HPI_LOG_EDF_ANNOT_BYTES];
+} __packed;
+
+#define HPI_LOG_EDF_RECORD_SIZE sizeof(struct hpi_log_edf_record)
+
+struct hpi_log_edf_writer
+{
+    struct hpi_log_edf_record rec;
+    uint32_t rec_onset_ms;      // Session time of rec's first sample
+    uint32_t n_records;         // Records completed
+    uint16_t n_points;          // ECG samples in rec
+    uint16_t annot_len;
+    uint16_t pending_len;
+    int16_t last[3];            // Padding for a short final record
+    bool started;               // rec has an onset
+    bool discontinuous;         // A gap has been recorded: the file is EDF+D
+    uint32_t dropped_annots;
+    char pending[HPI_LOG_EDF_PENDING_BYTES];
+};
+
+// Fill in the HPI_LOG_EDF_HEADER_SIZE-byte header. start_time is as in
+// the binary log header (year - 2000, month, day, hour, minute, second),
+// all zero if the host never set it; ecg_gain is the MAX30001 gain in V/V.
+void hpi_log_edf_init_header(uint8_t *buf, const uint8_t start_time[6], uint32_t ecg_gain);
+// Start time and record count (-1 while recording) from the first 256
+// bytes of a header written by hpi_log_edf_init_header()
+int hpi_log_edf_parse_header(const uint8_t *buf, uint8_t start_time[6], int32_t *n_records);
+// The number-of-records field, for HPI_LOG_EDF_NUM_RECORDS_OFFSET
+void hpi_log_edf_records_field(char field[HPI_LOG_EDF_NUM_RECORDS_LEN], uint32_t n_records);
+// Whether an annotation area opens with a timekeeping TAL
+bool hpi_log_edf_record_valid(const char *annot, size_t len);
+
+void hpi_log_edf_writer_init(struct hpi_log_edf_writer *w);
+// Begin a record at session time onset_ms, which must be at a record
+// boundary. A restart after the first one marks the file discontinuous.
+void hpi_log_edf_restart(struct hpi_log_edf_writer *w, uint32_t onset_ms);
+// Session time of the next sample
+uint32_t hpi_log_edf_next_time_ms(const struct hpi_log_edf_writer *w);
+// Add one point of raw codes; BioZ and PPG are taken on even points.
+// Returns true once rec is complete: the caller writes it out and calls
+// hpi_log_edf_next_record().
+bool hpi_log_edf_add_point(struct hpi_log_edf_writer *w, int32_t ecg, int32_t bioz, int32_t ppg);
+void hpi_log_edf_next_record(struct hpi_log_edf_writer *w);
+// Complete a partly filled record by repeating the last samples. Returns
+// false if rec holds no samples.
+bool hpi_log_edf_pad(struct hpi_log_edf_writer *w);
+// Queue an annotation at session time onset_ms; it goes into the current
+// record if there is room, else the next ones
+void hpi_log_edf_annotate(struct hpi_log_edf_writer *w, uint32_t onset_ms, const char *text);
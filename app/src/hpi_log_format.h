@@ -0,0 +1,263 @@
+/*
+ * SPDX-License-Identifier: MIT
+ *
+ * Copyright (c) 2026 Ashwin Whitchurch, ProtoCentral Electronics
+ *
+ * On-disk layout of binary session logs ("<session>_LOG.BIN").
+ *
+ * A log is a 512-byte file header followed by 512-byte data blocks, one
+ * sector each. The logger writes runs of whole blocks, normally one
+ * cluster-sized, cluster-aligned chunk at a time (shorter when a sync or
+ * close cuts a chunk short), so no write covers part of a block. All
+ * fields are little endian. scripts/hpi_log_to_csv.py is the reference
+ * reader.
+ *
+ * Each data block holds HPI_LOG_FRAMES_PER_BLOCK frames. A frame covers
+ * two ECG sample periods (ECG runs at 128 SPS, BioZ and PPG at 64 SPS):
+ *
+ *     ECG[n] ECG[n+1] BioZ[n] PPG[n]      (int24 each, 12 bytes)
+ *
+ * With HPI_LOG_CODEC_RICE the payload instead holds a variable number of
+ * points, delta and adaptive Rice coded (see hpi_log_codec.h); blocks stay
+ * 512 bytes and all other fields keep their meaning.
+ *
+ * The block trailer is a CRC-32 (IEEE) over everything before it, so a
+ * reader can drop a torn or corrupted block and carry on with the next.
+ * Every block also carries the random nonce from its file header. Session
+ * ids are reused once a session is deleted, and a new file may be given
+ * clusters still holding blocks of the old one; the nonce tells them apart.
+ *
+ * Record blocks (HPI_LOG_RECORD_MAGIC) share the block layout and sequence
+ * numbering with data blocks and are interleaved with them in time order.
+ * Their payload is a run of typed records (vitals, signal quality, lead-off
+ * and R-R events), each with its own timestamp, and n_points counts
+ * records instead of points. A reader after vitals only can skip every
+ * data block unread.
+ *
+ * When a session is closed, a sparse time index is appended after the last
+ * data block: an index header, then one (timestamp, block) pair every
+ * stride_blocks blocks, zero padded to a whole number of blocks. Its offset
+ * is recorded in the session catalog. Sessions that never closed have no
+ * index; their blocks can still be bisected by timestamp.
+ *
+ * Without an SD card the same blocks go to segment files of a ring on
+ * internal flash (log_ring.h). A segment is a log in this format whose
+ * session_id is the boot count and whose timestamps count from boot; its
+ * start_time is zero, and clock records tie the timeline to wall time.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <zephyr/sys/util.h>
+#include <zephyr/toolchain.h>
+
+#define HPI_LOG_FILE_MAGIC 0x4C495048 // "HPIL"
+#define HPI_LOG_BLOCK_MAGIC 0x42495048 // "HPIB"
+#define HPI_LOG_VERSION 1
+
+#define HPI_LOG_HEADER_SIZE 512
+#define HPI_LOG_BLOCK_SIZE 512
+
+#define HPI_LOG_SAMPLE_BYTES 3
+#define HPI_LOG_POINTS_PER_FRAME 2
+#define HPI_LOG_FRAME_SIZE (4 * HPI_LOG_SAMPLE_BYTES)
+
+#define HPI_LOG_MAX_CHANNELS 4
+
+enum hpi_log_codec
+{
+    HPI_LOG_CODEC_RAW24 = 0,    // Interleaved int24 frames
+    HPI_LOG_CODEC_RICE = 1,     // Per-block delta + adaptive Rice
+};
+
+enum hpi_log_channel_type
+{
+    HPI_LOG_CH_ECG = 1,
+    HPI_LOG_CH_BIOZ = 2,
+    HPI_LOG_CH_PPG = 3,
+};
+
+struct hpi_log_channel_desc
+{
+    uint8_t type;           // enum hpi_log_channel_type
+    uint8_t sample_bytes;   // Stored width, HPI_LOG_SAMPLE_BYTES
+    uint16_t rate_hz;
+    float scale;            // Physical units per LSB
+    char unit[4];           // NUL padded, e.g. "uV"
+} __packed;
+
+struct hpi_log_file_header
+{
+    uint32_t magic;             // HPI_LOG_FILE_MAGIC
+    uint16_t version;
+    uint16_t header_size;       // HPI_LOG_HEADER_SIZE
+    uint16_t block_size;        // HPI_LOG_BLOCK_SIZE
+    uint16_t session_id;
+    uint8_t start_time[6];      // year, month, day, hour, minute, second
+    uint8_t n_channels;
+    uint8_t points_per_frame;   // HPI_LOG_POINTS_PER_FRAME
+    struct hpi_log_channel_desc channels[HPI_LOG_MAX_CHANNELS];
+    uint8_t codec;              // enum hpi_log_codec
+    uint32_t nonce;             // Random per session, never 0
+    uint8_t reserved[HPI_LOG_HEADER_SIZE - 25 - HPI_LOG_MAX_CHANNELS * sizeof(struct hpi_log_channel_desc) - 4];
+    uint32_t crc32;             // Over all preceding header bytes
+} __packed;
+
+struct hpi_log_block_header
+{
+    uint32_t magic;         // HPI_LOG_BLOCK_MAGIC or HPI_LOG_RECORD_MAGIC
+    uint16_t session_id;
+    uint16_t n_points;      // ECG sample periods in this block, or records
+    uint32_t seq;           // Block number within the session, from 0
+    uint32_t timestamp_ms;  // First point or record, relative to session start
+    uint32_t nonce;         // As in the file header
+} __packed;
+
+#define HPI_LOG_BLOCK_PAYLOAD (HPI_LOG_BLOCK_SIZE - sizeof(struct hpi_log_block_header) - sizeof(uint32_t))
+#define HPI_LOG_FRAMES_PER_BLOCK (HPI_LOG_BLOCK_PAYLOAD / HPI_LOG_FRAME_SIZE)
+#define HPI_LOG_POINTS_PER_BLOCK (HPI_LOG_FRAMES_PER_BLOCK * HPI_LOG_POINTS_PER_FRAME)
+
+struct hpi_log_block
+{
+    struct hpi_log_block_header hdr;
+    uint8_t payload[HPI_LOG_BLOCK_PAYLOAD];
+    uint32_t crc32;         // Over hdr and payload
+} __packed;
+
+BUILD_ASSERT(sizeof(struct hpi_log_file_header) == HPI_LOG_HEADER_SIZE, "Log header must be one sector");
+BUILD_ASSERT(sizeof(struct hpi_log_block) == HPI_LOG_BLOCK_SIZE, "Log block must be one sector");
+
+#define HPI_LOG_RECORD_MAGIC 0x52495048 // "HPIR"
+
+enum hpi_log_record_type
+{
+    HPI_LOG_REC_VITALS = 1,         // struct hpi_log_rec_vitals, 1 Hz
+    HPI_LOG_REC_PPG_QUALITY = 2,    // struct hpi_log_rec_ppg_quality, per SpO2 update
+    HPI_LOG_REC_LEAD_OFF = 3,       // struct hpi_log_rec_lead_off, on change
+    HPI_LOG_REC_RR_INTERVAL = 4,    // struct hpi_log_rec_rr_interval, per beat
+    HPI_LOG_REC_CLOCK = 5,          // struct hpi_log_rec_clock, when the host sets the time
+    HPI_LOG_REC_EVENT = 6,          // struct hpi_log_rec_event, per capture trigger
+};
+
+// Precedes every record; len counts the bytes after this header, so a
+// reader can step over types it doesn't know
+struct hpi_log_record_header
+{
+    uint8_t type;           // enum hpi_log_record_type
+    uint8_t len;
+    uint32_t timestamp_ms;  // Relative to session start, like block timestamps
+} __packed;
+
+#define HPI_LOG_REC_FLAG_ECG_LEAD_OFF BIT(0)
+#define HPI_LOG_REC_FLAG_PPG_LEAD_OFF BIT(1)
+
+struct hpi_log_rec_vitals
+{
+    uint8_t hr;             // bpm
+    uint8_t hr_source;      // enum hpi_hr_source
+    uint8_t spo2;           // %
+    uint8_t resp_rate;      // breaths/min
+    int16_t temp;           // 0.01 C
+    uint8_t flags;          // HPI_LOG_REC_FLAG_*
+} __packed;
+
+// spo2_quality_metrics_t, packed
+#define HPI_LOG_REC_PPG_VALID BIT(0)
+#define HPI_LOG_REC_PPG_PROBE_OFF BIT(1)
+#define HPI_LOG_REC_PPG_PROBE_OFF_FILTERED BIT(2)
+
+struct hpi_log_rec_ppg_quality
+{
+    uint16_t perfusion_ir;      // x100
+    uint16_t perfusion_red;     // x100
+    uint16_t signal_strength;
+    uint8_t confidence;         // 0-100
+    uint8_t flags;              // HPI_LOG_REC_PPG_*
+    uint8_t probe_off_reason;   // PROBE_OFF_*
+} __packed;
+
+enum hpi_log_lead
+{
+    HPI_LOG_LEAD_ECG = 0,
+    HPI_LOG_LEAD_PPG = 1,
+};
+
+struct hpi_log_rec_lead_off
+{
+    uint8_t lead;           // enum hpi_log_lead
+    uint8_t lead_off;       // 1 = off, 0 = back on
+} __packed;
+
+struct hpi_log_rec_rr_interval
+{
+    uint16_t rr_ms;
+} __packed;
+
+// Wall clock at the record's timestamp, as in the file header's start_time
+struct hpi_log_rec_clock
+{
+    uint8_t time[6];
+} __packed;
+
+// Detail and value by source (enum hpi_log_event_source, log_event.h):
+// lead-off: enum hpi_log_lead, 1; HR: 0 = low / 1 = high, bpm; SpO2: 0, %
+struct hpi_log_rec_event
+{
+    uint8_t source;
+    uint8_t detail;
+    int16_t value;
+} __packed;
+
+#define HPI_LOG_INDEX_MAGIC 0x58495048 // "HPIX"
+
+struct hpi_log_index_header
+{
+    uint32_t magic;         // HPI_LOG_INDEX_MAGIC
+    uint16_t session_id;
+    uint16_t n_entries;
+    uint32_t stride_blocks; // Data blocks between consecutive entries
+    uint32_t crc32;         // Over the entries that follow
+} __packed;
+
+struct hpi_log_index_entry
+{
+    uint32_t timestamp_ms;  // Of the block's first point
+    uint32_t seq;           // Block number; at HPI_LOG_HEADER_SIZE + seq * HPI_LOG_BLOCK_SIZE
+} __packed;
+
+/*
+ * Session catalog ("HPICAT.BIN" in the SD root): a header followed by one
+ * fixed-size entry per session file, in creation order. Deleted sessions
+ * are tombstoned in place and squeezed out when enough accumulate.
+ */
+
+#define HPI_LOG_CATALOG_MAGIC 0x43495048 // "HPIC"
+#define HPI_LOG_CATALOG_VERSION 1
+
+struct hpi_log_catalog_header
+{
+    uint32_t magic;         // HPI_LOG_CATALOG_MAGIC
+    uint16_t version;
+    uint16_t entry_size;    // sizeof(struct hpi_log_catalog_entry)
+    uint32_t n_entries;     // Including tombstones
+    uint32_t n_live;
+} __packed;
+
+#define HPI_LOG_CAT_OPEN BIT(0)     // Session still recording; size not final
+#define HPI_LOG_CAT_DELETED BIT(1)
+
+struct hpi_log_catalog_entry
+{
+    uint16_t session_id;
+    uint8_t file_no;        // As in the session index: 1-3 CSV, 4 binary, 5 EDF+, 6 event
+    uint8_t flags;          // HPI_LOG_CAT_*
+    uint8_t start_time[6];  // year, month, day, hour, minute, second
+    uint16_t reserved;
+    uint32_t size;          // File size in bytes
+    uint32_t n_points;      // ECG points logged; BioZ/PPG have half as many
+    uint32_t index_offset;  // File offset of the time index, 0 if none
+    uint32_t nonce;         // As in the file header, 0 for other formats
+} __packed;
+
+BUILD_ASSERT(sizeof(struct hpi_log_catalog_entry) == 28, "Catalog entry layout changed");
@@ -30,8 +30,8 @@
 #include "hw_module.h"
 #include "hpi_common_types.h"
 
-/* Helper macro: include each listener only when its module is compiled in,
- * avoiding undefined references to `disp_*_lis` / `bt_*_lis` symbols when
+/* Helper macro: include each observer only when its module is compiled in,
+ * avoiding undefined references to `disp_vitals_lis` / `bt_*_lis` symbols when
  * display_module.c or ble_module.c are excluded from the build.
  *
  * Expansion table:
@@ -54,7 +54,7 @@ ZBUS_CHAN_DEFINE(batt_chan,                     /* Name */
                  struct hpi_batt_status_t,      /* Message type */
                  NULL,                          /* Validator */
                  NULL,                          /* User Data */
-                 HPI_OBSERVERS(disp_batt_lis, bt_batt_lis), 
+                 HPI_OBSERVERS(disp_vitals_lis, bt_batt_lis), 
                  ZBUS_MSG_INIT(0)               /* Initial value {0} */
 );
 
@@ -62,7 +62,7 @@ ZBUS_CHAN_DEFINE(hr_chan,         /* Name */
                  struct hpi_hr_t, /* Message type */
                  NULL,            /* Validator */
                  NULL,            /* User Data */
-                 HPI_OBSERVERS(disp_hr_lis, bt_hr_lis),
+                 HPI_OBSERVERS(disp_vitals_lis, bt_hr_lis),
                  ZBUS_MSG_INIT(.hr = 0, .lead_off = false) /* Initial: no lead-off */
 );
 
@@ -70,7 +70,7 @@ ZBUS_CHAN_DEFINE(temp_chan, /* Name */
                  struct hpi_temp_t,
                  NULL, /* Validator */
                  NULL, /* User Data */
-                 ZBUS_OBSERVERS(disp_temp_lis, bt_temp_lis, data_temp_lis),
+                 ZBUS_OBSERVERS(disp_vitals_lis, bt_temp_lis, data_temp_lis),
                  ZBUS_MSG_INIT(0) /* Initial value {0} */
 );
 
@@ -78,7 +78,7 @@ ZBUS_CHAN_DEFINE(spo2_chan,
                  struct hpi_spo2_t,
                  NULL, 
                  NULL, 
-                 HPI_OBSERVERS(disp_spo2_lis, bt_spo2_lis),
+                 HPI_OBSERVERS(disp_vitals_lis, bt_spo2_lis),
                  ZBUS_MSG_INIT(.spo2 = 0, .lead_off = true) /* Initial: probe off */
 );
 
@@ -86,6 +86,6 @@ ZBUS_CHAN_DEFINE(resp_rate_chan,
                  struct hpi_resp_rate_t,
                  NULL, 
                  NULL, 
-                 HPI_OBSERVERS(disp_resp_rate_lis, bt_resp_rate_lis),
+                 HPI_OBSERVERS(disp_vitals_lis, bt_resp_rate_lis),
                  ZBUS_MSG_INIT(.resp_rate = 0, .lead_off = false) /* Initial: no lead-off */
 );
@@ -40,6 +40,9 @@
 #include <zephyr/usb/usbd.h>
 
 #include "usbd_init.h"
+#ifdef CONFIG_HEALTHYPI_USB_MSC_ENABLED
+#include "usbd_msc_disk.h"
+#endif
 
 #include <zephyr/input/input.h>
 #include <zephyr/dt-bindings/input/input-event-codes.h>
@@ -52,6 +55,7 @@
 #include "hw_module.h"
 #include "fs_module.h"
 #include "hpi_common_types.h"
+#include "log_event.h"
 
 #ifdef CONFIG_DISPLAY
 #include "display_module.h"
@@ -112,6 +116,21 @@ K_SEM_DEFINE(sem_ecg_bioz_thread_start, 0, 1);
 uint8_t ring_buffer[RING_BUF_SIZE];
 struct ring_buf ringbuf_usb_cdc;
 
+/* send_usb_cdc() is called from both data_thread (streaming) and cmd_thread
+ * (command responses). ring_buf is only SPSC-safe, so producers serialise on
+ * this mutex; the ISR remains the single consumer.
+ */
+K_MUTEX_DEFINE(mutex_usb_tx);
+
+// USB CDC RX: host -> device command bytes. Commands are a few tens of bytes,
+// so a small ring is plenty. The ISR is the single producer and the command
+// RX thread (cmd_module.c) the single consumer.
+#define RX_RING_BUF_SIZE 256
+static uint8_t rx_ring_buffer[RX_RING_BUF_SIZE];
+static struct ring_buf ringbuf_usb_cdc_rx;
+static uint32_t usb_rx_overruns = 0;
+K_SEM_DEFINE(sem_usb_rx_data, 0, 1);
+
 // Get USB buffer utilization as percentage (0-100)
 uint8_t get_usb_buffer_utilization(void)
 {
@@ -191,6 +210,8 @@ void send_usb_cdc(const char *buf, size_t len)
         return;
     }
 
+    k_mutex_lock(&mutex_usb_tx, K_FOREVER);
+
     uint32_t space = ring_buf_space_get(&ringbuf_usb_cdc);
 
     if (space < len) {
@@ -205,11 +226,13 @@ void send_usb_cdc(const char *buf, size_t len)
             LOG_WRN("USB buffer full, drops: %u", usb_buffer_drops);
             last_drop_log = usb_buffer_drops;
         }
+        k_mutex_unlock(&mutex_usb_tx);
         return;
     }
     
     int rb_len = ring_buf_put(&ringbuf_usb_cdc, buf, len);
     usb_buffer_writes++;
+    k_mutex_unlock(&mutex_usb_tx);
 
     /* Periodic USB buffer health log: every 120 s, but only if drops have
      * accumulated since the last log (no news = good news, less log spam).
@@ -233,6 +256,56 @@ void send_usb_cdc(const char *buf, size_t len)
     }
 }
 
+int send_usb_cdc_wait(const char *buf, size_t len, k_timeout_t timeout)
+{
+    /* Lossless variant of send_usb_cdc() for command responses and file
+     * transfers: instead of dropping the packet when the ring is full, wait
+     * for the ISR to drain enough space. Waveform streaming must keep using
+     * send_usb_cdc(), it should never block the data thread.
+     */
+    k_timepoint_t end = sys_timepoint_calc(timeout);
+
+    if (len > ring_buf_capacity_get(&ringbuf_usb_cdc)) {
+        return -EMSGSIZE;
+    }
+
+    for (;;) {
+        if (!usb_dtr_state) {
+            usb_dtr_off_drops++;
+            return -ENOTCONN;
+        }
+
+        k_mutex_lock(&mutex_usb_tx, K_FOREVER);
+        if (ring_buf_space_get(&ringbuf_usb_cdc) >= len) {
+            ring_buf_put(&ringbuf_usb_cdc, buf, len);
+            usb_buffer_writes++;
+            k_mutex_unlock(&mutex_usb_tx);
+            uart_irq_tx_enable(usb_dev);
+            return 0;
+        }
+        k_mutex_unlock(&mutex_usb_tx);
+
+        if (sys_timepoint_expired(end)) {
+            usb_buffer_drops++;
+            return -EAGAIN;
+        }
+
+        uart_irq_tx_enable(usb_dev);
+        k_msleep(2);
+    }
+}
+
+uint32_t receive_usb_cdc(uint8_t *buf, uint32_t len, k_timeout_t timeout)
+{
+    uint32_t rx_len = ring_buf_get(&ringbuf_usb_cdc_rx, buf, len);
+
+    if (rx_len == 0 && k_sem_take(&sem_usb_rx_data, timeout) == 0) {
+        rx_len = ring_buf_get(&ringbuf_usb_cdc_rx, buf, len);
+    }
+
+    return rx_len;
+}
+
 static void interrupt_handler(const struct device *dev, void *user_data)
 {
     ARG_UNUSED(user_data);
@@ -241,13 +314,44 @@ static void interrupt_handler(const struct device *dev, void *user_data)
     {
         if (uart_irq_rx_ready(dev))
         {
-            /* Drain host RX into a local scratch and discard. The shared
-             * ringbuf_usb_cdc is TX-only; mixing RX bytes into it caused
-             * stream corruption and races with send_usb_cdc(). If RX needs
-             * to be consumed, do it via a dedicated RX path/queue.
+            /* Host commands go into the dedicated RX ring (never the TX
+             * ring - mixing the two caused stream corruption). Claim a
+             * contiguous span and read straight into it; when the command
+             * thread has fallen behind and the ring is full, drain into a
+             * scratch buffer so the endpoint keeps moving and count the
+             * overrun. The frame parser resynchronises on the next SOF.
              */
-            uint8_t scratch[64];
-            (void)uart_fifo_read(dev, scratch, sizeof(scratch));
+            uint8_t *claim_ptr = NULL;
+            uint32_t claim_len = ring_buf_put_claim(&ringbuf_usb_cdc_rx,
+                                                    &claim_ptr, 64);
+            int recv_len;
+
+            if (claim_len > 0)
+            {
+                recv_len = uart_fifo_read(dev, claim_ptr, claim_len);
+                if (recv_len < 0)
+                {
+                    recv_len = 0;
+                }
+                (void)ring_buf_put_finish(&ringbuf_usb_cdc_rx, recv_len);
+            }
+            else
+            {
+                uint8_t scratch[64];
+
+                (void)ring_buf_put_finish(&ringbuf_usb_cdc_rx, 0);
+                recv_len = uart_fifo_read(dev, scratch, sizeof(scratch));
+                if (recv_len > 0)
+                {
+                    usb_rx_overruns++;
+                }
+                recv_len = 0;
+            }
+
+            if (recv_len > 0)
+            {
+                k_sem_give(&sem_usb_rx_data);
+            }
         }
 
         if (uart_irq_tx_ready(dev))
@@ -305,9 +409,10 @@ static void usb_tx_watchdog_work_handler(struct k_work *work)
      * stalled endpoint nobody is draining.
      */
     if ((watchdog_runs % 240) == 0) {  /* 240 * 250 ms = 60 s */
-        LOG_INF("USB WD: runs=%u ring=%u triggers=%u DTR=%d buf_drops=%u dtr_off_drops=%u",
+        LOG_INF("USB WD: runs=%u ring=%u triggers=%u DTR=%d buf_drops=%u dtr_off_drops=%u rx_overruns=%u",
                 watchdog_runs, ring_used, tx_watchdog_triggers,
-                (int)usb_dtr_state, usb_buffer_drops, usb_dtr_off_drops);
+                (int)usb_dtr_state, usb_buffer_drops, usb_dtr_off_drops,
+                usb_rx_overruns);
     }
 
     if (usb_dtr_state && ring_used > 0 && (now - last_tx_activity) > 500) {
@@ -532,6 +637,16 @@ static void hpi_usbd_msg_cb(struct usbd_context *const ctx,
         return;
     }
 
+    /* Cable pulled or host asleep: nobody is left to eject the SD card, so
+     * take it back. A sleeping host sees the medium removed when it wakes.
+     */
+    if (msg->type == USBD_MSG_SUSPEND) {
+#ifdef CONFIG_HEALTHYPI_USB_MSC_ENABLED
+        hpi_usb_msc_detach_async();
+#endif
+        return;
+    }
+
     if (msg->type == USBD_MSG_CDC_ACM_LINE_CODING) {
         uint32_t baudrate = 0;
         if (uart_line_ctrl_get(msg->dev, UART_LINE_CTRL_BAUD_RATE, &baudrate) == 0) {
@@ -554,6 +669,7 @@ static void usb_init(void)
      * `send_usb_cdc()` from other threads finds a valid buffer.
      */
     ring_buf_init(&ringbuf_usb_cdc, sizeof(ring_buffer), ring_buffer);
+    ring_buf_init(&ringbuf_usb_cdc_rx, sizeof(rx_ring_buffer), rx_ring_buffer);
 
     if (hpi_usbd_init(hpi_usbd_msg_cb) == NULL) {
         LOG_ERR("USBD-next init failed");
@@ -656,6 +772,13 @@ uint8_t hpi_hw_read_batt(void)
 static void gpio_keys_cb_handler(struct input_event *evt, void *user_data)
 {
     ARG_UNUSED(user_data);
+#ifdef CONFIG_HEALTHYPI_LOG_EVENT_CAPTURE
+    // A long press marks an event whatever the display is showing
+    if (evt->value == 1 && evt->code == INPUT_BTN_0)
+    {
+        hpi_log_event_trigger(HPI_LOG_EVENT_BUTTON, 0, 0);
+    }
+#endif
 #ifdef CONFIG_HEALTHYPI_DISPLAY_ENABLED
     if (evt->value == 1)  // Button pressed
     {
@@ -26,7 +26,14 @@
 #ifndef hw_module_h
 #define hw_module_h
 
+#include <zephyr/kernel.h>
+
 void send_usb_cdc(const char *buf, size_t len);
+// Blocking variant for command responses/file transfers; waits for ring space
+// instead of dropping. Returns 0, -ENOTCONN (DTR low), -EAGAIN or -EMSGSIZE.
+int send_usb_cdc_wait(const char *buf, size_t len, k_timeout_t timeout);
+// Read host->device bytes from the CDC RX ring, waiting up to timeout for data
+uint32_t receive_usb_cdc(uint8_t *buf, uint32_t len, k_timeout_t timeout);
 uint8_t get_usb_buffer_utilization(void);  // Returns 0-100% buffer usage
 
 // Thread heartbeat tracking for software watchdog
@@ -0,0 +1,809 @@
+/*
+ * SPDX-License-Identifier: MIT
+ *
+ * Copyright (c) 2026 Ashwin Whitchurch, ProtoCentral Electronics
+ *
+ * Persistent session catalog on the SD card.
+ *
+ * Listing sessions used to walk the SD root with fs_readdir() and open
+ * every file to parse its header, so the cost grew with the number of
+ * sessions on the card. The catalog keeps one fixed-size record per
+ * session file (see hpi_log_format.h). It is updated when a session starts
+ * and ends, and every listing, count and size query reads it instead.
+ *
+ * Cards written by older firmware have no catalog. One is built from a
+ * directory scan the first time the card is mounted, and again if the
+ * catalog is ever found unreadable.
+ *
+ * While a session records, its entry doubles as a journal: the log writer
+ * checkpoints the length known to be on the card at every sync. After a
+ * reset or power loss only the blocks past the checkpoint need checking.
+ *
+ * A small index in RAM records which session file sits in each slot, so
+ * lookups and checkpoints seek straight to their entry, and a miss needs
+ * no card access at all. It is loaded with the catalog and kept in step
+ * with every change to it. A catalog too big for the index is still
+ * served, by scanning the file as before.
+ */
+
+#include <string.h>
+#include <stdio.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/fs/fs.h>
+
+#include "log_catalog.h"
+#include "datalog_module.h"
+
+LOG_MODULE_REGISTER(log_catalog, LOG_LEVEL_INF);
+
+#define CATALOG_PATH "/SD:/HPICAT.BIN"
+#define CATALOG_TMP_PATH "/SD:/HPICAT.TMP"
+
+// Squeeze tombstones out once this many have built up
+#define CATALOG_COMPACT_THRESHOLD 32
+
+// Entries hpi_log_catalog_foreach() copies out per lock
+#define CATALOG_FOREACH_BATCH 8
+
+// Catalog slots the RAM index covers, 4 bytes each
+#define CATALOG_INDEX_MAX 512
+
+extern bool sd_card_present;
+
+struct catalog_slot
+{
+    uint16_t session_id;
+    uint8_t file_no;
+    uint8_t live;
+};
+
+K_MUTEX_DEFINE(mutex_catalog);
+static bool catalog_ready;
+
+// Guarded by mutex_catalog and valid while catalog_ready is set
+static struct catalog_slot catalog_index[CATALOG_INDEX_MAX];
+static uint32_t catalog_index_len;
+// Set when slots past the index exist, or it could not be loaded
+static bool catalog_index_partial;
+
+static off_t catalog_entry_offset(uint32_t slot)
+{
+    return sizeof(struct hpi_log_catalog_header) + (off_t)slot * sizeof(struct hpi_log_catalog_entry);
+}
+
+static void catalog_index_reset(void)
+{
+    catalog_index_len = 0;
+    catalog_index_partial = false;
+}
+
+// Record the entry written to a slot. Only the next slot past the end of
+// the index can be added; anything else leaves it partial.
+static void catalog_index_append(uint32_t slot, const struct hpi_log_catalog_entry *entry)
+{
+    if (slot != catalog_index_len || slot >= ARRAY_SIZE(catalog_index))
+    {
+        catalog_index_partial = true;
+        return;
+    }
+
+    catalog_index[catalog_index_len++] = (struct catalog_slot){
+        .session_id = entry->session_id,
+        .file_no = entry->file_no,
+        .live = !(entry->flags & HPI_LOG_CAT_DELETED),
+    };
+}
+
+// Slot of the live entry for a session file, -ENOENT if there is none, or
+// -EAGAIN if the index does not cover the whole catalog and it must be read
+static int catalog_index_lookup(uint16_t session_id, uint8_t file_no)
+{
+    for (uint32_t i = 0; i < catalog_index_len; i++)
+    {
+        if (catalog_index[i].live && catalog_index[i].session_id == session_id &&
+            catalog_index[i].file_no == file_no)
+        {
+            return (int)i;
+        }
+    }
+
+    return catalog_index_partial ? -EAGAIN : -ENOENT;
+}
+
+// Drop tombstones the same way catalog_compact() does on the card
+static void catalog_index_compact(void)
+{
+    uint32_t n = 0;
+
+    for (uint32_t i = 0; i < catalog_index_len; i++)
+    {
+        if (catalog_index[i].live)
+        {
+            catalog_index[n++] = catalog_index[i];
+        }
+    }
+
+    catalog_index_len = n;
+}
+
+static int catalog_open(const char *path, struct fs_file_t *file, struct hpi_log_catalog_header *hdr)
+{
+    int rc;
+
+    fs_file_t_init(file);
+    rc = fs_open(file, path, FS_O_RDWR);
+    if (rc < 0)
+    {
+        return rc;
+    }
+
+    rc = fs_read(file, hdr, sizeof(*hdr));
+    if (rc != sizeof(*hdr) || hdr->magic != HPI_LOG_CATALOG_MAGIC ||
+        hdr->version != HPI_LOG_CATALOG_VERSION || hdr->entry_size != sizeof(struct hpi_log_catalog_entry))
+    {
+        fs_close(file);
+        return -EBADMSG;
+    }
+
+    return 0;
+}
+
+static int catalog_create(const char *path, struct fs_file_t *file, struct hpi_log_catalog_header *hdr)
+{
+    int rc;
+
+    fs_unlink(path);
+
+    fs_file_t_init(file);
+    rc = fs_open(file, path, FS_O_CREATE | FS_O_RDWR);
+    if (rc < 0)
+    {
+        return rc;
+    }
+
+    hdr->magic = HPI_LOG_CATALOG_MAGIC;
+    hdr->version = HPI_LOG_CATALOG_VERSION;
+    hdr->entry_size = sizeof(struct hpi_log_catalog_entry);
+    hdr->n_entries = 0;
+    hdr->n_live = 0;
+
+    rc = fs_write(file, hdr, sizeof(*hdr));
+    if (rc < 0)
+    {
+        fs_close(file);
+        return rc;
+    }
+
+    return 0;
+}
+
+static int catalog_write_header(struct fs_file_t *file, const struct hpi_log_catalog_header *hdr)
+{
+    int rc = fs_seek(file, 0, FS_SEEK_SET);
+
+    if (rc == 0)
+    {
+        rc = fs_write(file, hdr, sizeof(*hdr));
+    }
+
+    return (rc < 0) ? rc : 0;
+}
+
+static int catalog_write_entry(struct fs_file_t *file, uint32_t slot, const struct hpi_log_catalog_entry *entry)
+{
+    int rc = fs_seek(file, catalog_entry_offset(slot), FS_SEEK_SET);
+
+    if (rc == 0)
+    {
+        rc = fs_write(file, entry, sizeof(*entry));
+    }
+
+    return (rc < 0) ? rc : 0;
+}
+
+// Slot of the live entry for a session file, or -ENOENT
+static int catalog_find_slot(struct fs_file_t *file, const struct hpi_log_catalog_header *hdr,
+                             uint16_t session_id, uint8_t file_no, struct hpi_log_catalog_entry *entry)
+{
+    if (fs_seek(file, catalog_entry_offset(0), FS_SEEK_SET) != 0)
+    {
+        return -EIO;
+    }
+
+    for (uint32_t i = 0; i < hdr->n_entries; i++)
+    {
+        if (fs_read(file, entry, sizeof(*entry)) != sizeof(*entry))
+        {
+            return -EIO;
+        }
+
+        if (!(entry->flags & HPI_LOG_CAT_DELETED) && entry->session_id == session_id &&
+            entry->file_no == file_no)
+        {
+            return (int)i;
+        }
+    }
+
+    return -ENOENT;
+}
+
+// Open the catalog and read the live entry for a session file. Returns its
+// slot with the file left open for the caller to close, or an error with it
+// closed.
+static int catalog_open_entry(uint16_t session_id, uint8_t file_no, struct fs_file_t *file,
+                              struct hpi_log_catalog_header *hdr, struct hpi_log_catalog_entry *entry)
+{
+    int slot = catalog_index_lookup(session_id, file_no);
+    int rc;
+
+    if (slot == -ENOENT)
+    {
+        return slot;
+    }
+
+    rc = catalog_open(CATALOG_PATH, file, hdr);
+    if (rc < 0)
+    {
+        return rc;
+    }
+
+    if (slot < 0)
+    {
+        slot = catalog_find_slot(file, hdr, session_id, file_no, entry);
+    }
+    else if (fs_seek(file, catalog_entry_offset(slot), FS_SEEK_SET) != 0 ||
+             fs_read(file, entry, sizeof(*entry)) != sizeof(*entry))
+    {
+        slot = -EIO;
+    }
+
+    if (slot < 0)
+    {
+        fs_close(file);
+    }
+
+    return slot;
+}
+
+// Copy the live entries to a fresh file and swap it in
+static int catalog_compact(struct fs_file_t *file, struct hpi_log_catalog_header *hdr)
+{
+    struct fs_file_t tmp;
+    struct hpi_log_catalog_header tmp_hdr;
+    struct hpi_log_catalog_entry entry;
+    int rc;
+
+    rc = catalog_create(CATALOG_TMP_PATH, &tmp, &tmp_hdr);
+    if (rc < 0)
+    {
+        return rc;
+    }
+
+    fs_seek(file, catalog_entry_offset(0), FS_SEEK_SET);
+    for (uint32_t i = 0; i < hdr->n_entries; i++)
+    {
+        if (fs_read(file, &entry, sizeof(entry)) != sizeof(entry))
+        {
+            rc = -EIO;
+            break;
+        }
+
+        if (!(entry.flags & HPI_LOG_CAT_DELETED))
+        {
+            rc = fs_write(&tmp, &entry, sizeof(entry));
+            if (rc < 0)
+            {
+                break;
+            }
+            tmp_hdr.n_entries++;
+            tmp_hdr.n_live++;
+        }
+    }
+
+    if (rc >= 0)
+    {
+        rc = catalog_write_header(&tmp, &tmp_hdr);
+    }
+
+    fs_close(&tmp);
+    fs_close(file);
+
+    if (rc < 0)
+    {
+        fs_unlink(CATALOG_TMP_PATH);
+        return rc;
+    }
+
+    fs_unlink(CATALOG_PATH);
+    rc = fs_rename(CATALOG_TMP_PATH, CATALOG_PATH);
+    if (rc < 0)
+    {
+        catalog_ready = false;
+        return rc;
+    }
+
+    catalog_index_compact();
+    LOG_INF("Catalog compacted to %u entries", tmp_hdr.n_live);
+    return 0;
+}
+
+static int catalog_rebuild_locked(void)
+{
+    struct fs_file_t file;
+    struct fs_dir_t dir;
+    struct fs_dirent dirent;
+    struct hpi_log_catalog_header hdr;
+    struct hpi_log_catalog_entry entry;
+    char path[32];
+    int rc;
+
+    catalog_ready = false;
+    catalog_index_reset();
+
+    rc = catalog_create(CATALOG_PATH, &file, &hdr);
+    if (rc < 0)
+    {
+        LOG_ERR("Catalog create failed: %d", rc);
+        return rc;
+    }
+
+    fs_dir_t_init(&dir);
+    rc = fs_opendir(&dir, "/SD:");
+    if (rc < 0)
+    {
+        fs_close(&file);
+        return rc;
+    }
+
+    for (;;)
+    {
+        rc = fs_readdir(&dir, &dirent);
+        if (rc < 0 || dirent.name[0] == 0)
+        {
+            break;
+        }
+
+        if (dirent.type == FS_DIR_ENTRY_DIR)
+        {
+            continue;
+        }
+
+        snprintf(path, sizeof(path), "/SD:/%s", dirent.name);
+        if (hpi_datalog_describe_file(path, &entry) != 0)
+        {
+            continue;
+        }
+
+        rc = fs_write(&file, &entry, sizeof(entry));
+        if (rc < 0)
+        {
+            break;
+        }
+        catalog_index_append(hdr.n_entries, &entry);
+        hdr.n_entries++;
+        hdr.n_live++;
+    }
+
+    fs_closedir(&dir);
+
+    if (rc >= 0)
+    {
+        rc = catalog_write_header(&file, &hdr);
+    }
+    fs_close(&file);
+
+    if (rc < 0)
+    {
+        LOG_ERR("Catalog rebuild failed: %d", rc);
+        return rc;
+    }
+
+    catalog_ready = true;
+    LOG_INF("Catalog rebuilt: %u sessions", hdr.n_live);
+    return 0;
+}
+
+// Index every entry. Entries still marked open belong to a session that
+// never ended cleanly; recover them from their last checkpoint.
+static void catalog_load_locked(struct fs_file_t *file, struct hpi_log_catalog_header *hdr)
+{
+    struct hpi_log_catalog_entry entry;
+    char path[32];
+
+    catalog_index_reset();
+
+    for (uint32_t i = 0; i < hdr->n_entries; i++)
+    {
+        fs_seek(file, catalog_entry_offset(i), FS_SEEK_SET);
+        if (fs_read(file, &entry, sizeof(entry)) != sizeof(entry))
+        {
+            // Leave the rest to a scan of the file
+            catalog_index_partial = true;
+            return;
+        }
+
+        if ((entry.flags & (HPI_LOG_CAT_OPEN | HPI_LOG_CAT_DELETED)) != HPI_LOG_CAT_OPEN)
+        {
+            catalog_index_append(i, &entry);
+            continue;
+        }
+
+        hpi_datalog_session_path(entry.session_id, entry.file_no, path, sizeof(path));
+        if (hpi_datalog_recover_file(path, &entry) != 0)
+        {
+            LOG_WRN("Session %u was not closed and is unreadable, dropping it", entry.session_id);
+            entry.flags = HPI_LOG_CAT_DELETED;
+            hdr->n_live--;
+            catalog_write_header(file, hdr);
+        }
+        else
+        {
+            LOG_WRN("Session %u was not closed, recovered %u bytes", entry.session_id, entry.size);
+        }
+
+        catalog_write_entry(file, i, &entry);
+        catalog_index_append(i, &entry);
+    }
+}
+
+// Called with mutex_catalog held
+static int catalog_ensure_locked(void)
+{
+    struct fs_file_t file;
+    struct hpi_log_catalog_header hdr;
+
+    if (!sd_card_present)
+    {
+        return -ENODEV;
+    }
+
+    if (catalog_ready)
+    {
+        return 0;
+    }
+
+    if (catalog_open(CATALOG_PATH, &file, &hdr) != 0)
+    {
+        LOG_INF("No valid session catalog, scanning card");
+        return catalog_rebuild_locked();
+    }
+
+    catalog_load_locked(&file, &hdr);
+    fs_close(&file);
+
+    catalog_ready = true;
+    LOG_INF("Catalog loaded: %u sessions", hdr.n_live);
+    return 0;
+}
+
+int hpi_log_catalog_init(void)
+{
+    int rc;
+
+    k_mutex_lock(&mutex_catalog, K_FOREVER);
+    catalog_ready = false;
+    rc = catalog_ensure_locked();
+    k_mutex_unlock(&mutex_catalog);
+
+    return rc;
+}
+
+int hpi_log_catalog_rebuild(void)
+{
+    int rc = -ENODEV;
+
+    k_mutex_lock(&mutex_catalog, K_FOREVER);
+    if (sd_card_present)
+    {
+        rc = catalog_rebuild_locked();
+    }
+    k_mutex_unlock(&mutex_catalog);
+
+    return rc;
+}
+
+int hpi_log_catalog_add(const struct hpi_log_catalog_entry *entry)
+{
+    struct fs_file_t file;
+    struct hpi_log_catalog_header hdr;
+    int rc;
+
+    k_mutex_lock(&mutex_catalog, K_FOREVER);
+
+    rc = catalog_ensure_locked();
+    if (rc == 0)
+    {
+        rc = catalog_open(CATALOG_PATH, &file, &hdr);
+    }
+
+    if (rc == 0)
+    {
+        uint32_t slot = hdr.n_entries;
+
+        rc = catalog_write_entry(&file, slot, entry);
+        if (rc == 0)
+        {
+            hdr.n_entries++;
+            hdr.n_live++;
+            rc = catalog_write_header(&file, &hdr);
+        }
+        if (rc == 0)
+        {
+            catalog_index_append(slot, entry);
+        }
+        fs_close(&file);
+    }
+
+    k_mutex_unlock(&mutex_catalog);
+
+    return rc;
+}
+
+int hpi_log_catalog_update(const struct hpi_log_catalog_entry *entry)
+{
+    struct fs_file_t file;
+    struct hpi_log_catalog_header hdr;
+    struct hpi_log_catalog_entry old;
+    int rc;
+
+    k_mutex_lock(&mutex_catalog, K_FOREVER);
+
+    rc = catalog_ensure_locked();
+    if (rc == 0)
+    {
+        rc = catalog_open_entry(entry->session_id, entry->file_no, &file, &hdr, &old);
+        if (rc >= 0)
+        {
+            rc = catalog_write_entry(&file, (uint32_t)rc, entry);
+            fs_close(&file);
+        }
+    }
+
+    k_mutex_unlock(&mutex_catalog);
+
+    return rc;
+}
+
+int hpi_log_catalog_checkpoint(uint16_t session_id, uint8_t file_no, uint32_t size, uint32_t n_points)
+{
+    struct fs_file_t file;
+    struct hpi_log_catalog_header hdr;
+    struct hpi_log_catalog_entry entry;
+    int rc;
+
+    k_mutex_lock(&mutex_catalog, K_FOREVER);
+
+    rc = catalog_ensure_locked();
+    if (rc == 0)
+    {
+        rc = catalog_open_entry(session_id, file_no, &file, &hdr, &entry);
+        if (rc >= 0)
+        {
+            if (entry.flags & HPI_LOG_CAT_OPEN)
+            {
+                entry.size = size;
+                entry.n_points = n_points;
+                rc = catalog_write_entry(&file, (uint32_t)rc, &entry);
+            }
+            fs_close(&file);
+        }
+    }
+
+    k_mutex_unlock(&mutex_catalog);
+
+    return (rc < 0) ? rc : 0;
+}
+
+int hpi_log_catalog_find(uint16_t session_id, uint8_t file_no, struct hpi_log_catalog_entry *entry)
+{
+    struct fs_file_t file;
+    struct hpi_log_catalog_header hdr;
+    int rc;
+
+    k_mutex_lock(&mutex_catalog, K_FOREVER);
+
+    rc = catalog_ensure_locked();
+    if (rc == 0)
+    {
+        rc = catalog_open_entry(session_id, file_no, &file, &hdr, entry);
+        if (rc >= 0)
+        {
+            fs_close(&file);
+            rc = 0;
+        }
+    }
+
+    k_mutex_unlock(&mutex_catalog);
+
+    return rc;
+}
+
+bool hpi_log_catalog_has_session(uint16_t session_id)
+{
+    struct fs_file_t file;
+    struct hpi_log_catalog_header hdr;
+    struct hpi_log_catalog_entry entry;
+    bool found = false;
+
+    k_mutex_lock(&mutex_catalog, K_FOREVER);
+
+    if (catalog_ensure_locked() == 0)
+    {
+        for (uint32_t i = 0; i < catalog_index_len && !found; i++)
+        {
+            found = catalog_index[i].live && catalog_index[i].session_id == session_id;
+        }
+
+        if (!found && catalog_index_partial && catalog_open(CATALOG_PATH, &file, &hdr) == 0)
+        {
+            fs_seek(&file, catalog_entry_offset(0), FS_SEEK_SET);
+            for (uint32_t i = 0; i < hdr.n_entries && !found; i++)
+            {
+                if (fs_read(&file, &entry, sizeof(entry)) != sizeof(entry))
+                {
+                    break;
+                }
+                found = !(entry.flags & HPI_LOG_CAT_DELETED) && entry.session_id == session_id;
+            }
+            fs_close(&file);
+        }
+    }
+
+    k_mutex_unlock(&mutex_catalog);
+
+    return found;
+}
+
+int hpi_log_catalog_remove(uint16_t session_id, uint8_t file_no)
+{
+    struct fs_file_t file;
+    struct hpi_log_catalog_header hdr;
+    struct hpi_log_catalog_entry entry;
+    int rc;
+
+    k_mutex_lock(&mutex_catalog, K_FOREVER);
+
+    rc = catalog_ensure_locked();
+    if (rc == 0)
+    {
+        rc = catalog_open_entry(session_id, file_no, &file, &hdr, &entry);
+    }
+
+    if (rc >= 0)
+    {
+        uint32_t slot = (uint32_t)rc;
+
+        entry.flags |= HPI_LOG_CAT_DELETED;
+        rc = catalog_write_entry(&file, slot, &entry);
+        if (rc == 0)
+        {
+            if (slot < catalog_index_len)
+            {
+                catalog_index[slot].live = 0;
+            }
+            hdr.n_live--;
+            rc = catalog_write_header(&file, &hdr);
+        }
+
+        if (rc == 0 && (hdr.n_entries - hdr.n_live) >= CATALOG_COMPACT_THRESHOLD)
+        {
+            // Closes the file
+            rc = catalog_compact(&file, &hdr);
+        }
+        else
+        {
+            fs_close(&file);
+        }
+    }
+
+    k_mutex_unlock(&mutex_catalog);
+
+    return rc;
+}
+
+int hpi_log_catalog_clear(void)
+{
+    struct fs_file_t file;
+    struct hpi_log_catalog_header hdr;
+    int rc = -ENODEV;
+
+    k_mutex_lock(&mutex_catalog, K_FOREVER);
+
+    if (sd_card_present)
+    {
+        rc = catalog_create(CATALOG_PATH, &file, &hdr);
+        if (rc == 0)
+        {
+            fs_close(&file);
+        }
+        catalog_index_reset();
+        catalog_ready = (rc == 0);
+    }
+
+    k_mutex_unlock(&mutex_catalog);
+
+    return rc;
+}
+
+int hpi_log_catalog_foreach(hpi_log_catalog_cb_t cb, void *user_data)
+{
+    struct fs_file_t file;
+    struct hpi_log_catalog_header hdr;
+    struct hpi_log_catalog_entry batch[CATALOG_FOREACH_BATCH];
+    uint32_t slot = 0;
+    int rc;
+
+    // Callbacks may block on the card or the host, so entries are copied
+    // out a batch at a time and the lock dropped around them
+    for (;;)
+    {
+        int n = 0;
+
+        k_mutex_lock(&mutex_catalog, K_FOREVER);
+
+        rc = catalog_ensure_locked();
+        if (rc == 0)
+        {
+            rc = catalog_open(CATALOG_PATH, &file, &hdr);
+        }
+
+        if (rc == 0)
+        {
+            if (slot < hdr.n_entries && fs_seek(&file, catalog_entry_offset(slot), FS_SEEK_SET) != 0)
+            {
+                rc = -EIO;
+            }
+
+            for (; rc == 0 && slot < hdr.n_entries && n < ARRAY_SIZE(batch); slot++)
+            {
+                if (fs_read(&file, &batch[n], sizeof(batch[n])) != sizeof(batch[n]))
+                {
+                    rc = -EIO;
+                    break;
+                }
+
+                if (!(batch[n].flags & HPI_LOG_CAT_DELETED))
+                {
+                    n++;
+                }
+            }
+            fs_close(&file);
+        }
+
+        k_mutex_unlock(&mutex_catalog);
+
+        for (int i = 0; i < n; i++)
+        {
+            if (cb(&batch[i], user_data) != 0)
+            {
+                return rc;
+            }
+        }
+
+        if (rc != 0 || slot >= hdr.n_entries)
+        {
+            return rc;
+        }
+    }
+}
+
+uint32_t hpi_log_catalog_count(void)
+{
+    struct fs_file_t file;
+    struct hpi_log_catalog_header hdr;
+    uint32_t count = 0;
+
+    k_mutex_lock(&mutex_catalog, K_FOREVER);
+
+    if (catalog_ensure_locked() == 0 && catalog_open(CATALOG_PATH, &file, &hdr) == 0)
+    {
+        count = hdr.n_live;
+        fs_close(&file);
+    }
+
+    k_mutex_unlock(&mutex_catalog);
+
+    return count;
+}
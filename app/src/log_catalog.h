@@ -0,0 +1,38 @@
+/*
+ * SPDX-License-Identifier: MIT
+ *
+ * Copyright (c) 2026 Ashwin Whitchurch, ProtoCentral Electronics
+ *
+ * Persistent catalog of logged sessions on the SD card.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "hpi_log_format.h"
+
+typedef int (*hpi_log_catalog_cb_t)(const struct hpi_log_catalog_entry *entry, void *user_data);
+
+// Load the catalog after the card is mounted, rebuilding it from a
+// directory scan if it is missing or unreadable
+int hpi_log_catalog_init(void);
+int hpi_log_catalog_rebuild(void);
+
+int hpi_log_catalog_add(const struct hpi_log_catalog_entry *entry);
+int hpi_log_catalog_update(const struct hpi_log_catalog_entry *entry);
+// Journal the length of an open session known to be on the card; a no-op
+// once the session is closed
+int hpi_log_catalog_checkpoint(uint16_t session_id, uint8_t file_no, uint32_t size, uint32_t n_points);
+int hpi_log_catalog_find(uint16_t session_id, uint8_t file_no, struct hpi_log_catalog_entry *entry);
+// True if any file of the session is catalogued; answered from RAM
+bool hpi_log_catalog_has_session(uint16_t session_id);
+int hpi_log_catalog_remove(uint16_t session_id, uint8_t file_no);
+int hpi_log_catalog_clear(void);
+
+// Calls cb for every live entry in creation order, without the catalog
+// locked; a non-zero return stops the walk. An entry added or compacted
+// away while the walk runs may be missed or seen twice.
+int hpi_log_catalog_foreach(hpi_log_catalog_cb_t cb, void *user_data);
+uint32_t hpi_log_catalog_count(void);
@@ -0,0 +1,694 @@
+/*
+ * SPDX-License-Identifier: MIT
+ *
+ * Copyright (c) 2026 Ashwin Whitchurch, ProtoCentral Electronics
+ *
+ * Pre-trigger RAM ring and event-triggered capture to the SD card.
+ *
+ * data_thread Rice codes every point straight into a ring of 512-byte
+ * blocks in RAM, as the flash ring does, so the ring holds two to four
+ * times the waveform time of raw samples. The block being filled takes
+ * the place of the oldest one. Nothing touches the card until a trigger.
+ *
+ * Triggers are queued from any context to a thread at the SD log writer's
+ * priority; a capture never runs while a session is being logged, so the
+ * two don't compete for the card. It opens the capture file, writes the
+ * blocks from pre_s before the trigger, and then each block as it
+ * completes until one starts after the end of the post-trigger window.
+ * A trigger during a capture extends the window, up to EVENT_MAX_MS from
+ * the first. Each trigger's event record is held back until the drain
+ * reaches the first block that starts after it, so records and blocks
+ * stay in time order. The thread copies a block out of the ring under the
+ * lock and writes the copy, so data_thread never waits on the card; if
+ * the card falls so far behind that the producer laps it, the overwritten
+ * blocks are skipped and counted.
+ *
+ * Block timestamps are uptime in the ring and are rebased to the start of
+ * the capture as they are written. The header start time comes from the
+ * host's last clock setting, carried forward on the uptime clock.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/fs/fs.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/crc.h>
+#include <zephyr/sys/timeutil.h>
+
+#include "log_event.h"
+#include "log_catalog.h"
+#include "datalog_module.h"
+#include "hpi_common_types.h"
+#include "hpi_log_format.h"
+#include "hpi_log_codec.h"
+#ifdef CONFIG_HEALTHYPI_LOG_FLASH_RING
+#include "log_ring.h"
+#endif
+
+LOG_MODULE_REGISTER(log_event, LOG_LEVEL_INF);
+
+extern bool settings_log_data_enabled;
+extern bool sd_card_present;
+
+#define EVENT_RING_BLOCKS (((uint32_t)CONFIG_HEALTHYPI_LOG_EVENT_RAM_KB * 1024) / HPI_LOG_BLOCK_SIZE)
+// Points in a block are taken as evenly spaced, so a longer pause in the
+// stream starts a new block
+#define EVENT_GAP_MS 250
+#define EVENT_MAX_MS (10 * 60 * 1000)
+// How often a capture in progress looks for completed blocks
+#define EVENT_POLL_MS 200
+// A capture whose window has passed is closed this long after, even if
+// no block has completed since (the stream was stopped)
+#define EVENT_CLOSE_GRACE_MS 5000
+#define EVENT_CHECKPOINT_INTERVAL_MS 5000
+// Event records waiting for the drain to catch up with their trigger
+#define EVENT_PENDING_MAX 8
+// A threshold event re-arms once the value is this far back in range
+#define EVENT_HR_HYSTERESIS 5
+#define EVENT_SPO2_HYSTERESIS 2
+
+BUILD_ASSERT(EVENT_RING_BLOCKS >= 4, "Event ring too small");
+
+struct event_trigger
+{
+    uint32_t timestamp_ms;  // Uptime
+    uint8_t source;
+    uint8_t detail;
+    int16_t value;
+};
+
+K_MSGQ_DEFINE(q_event_trigger, sizeof(struct event_trigger), 8, 4);
+
+// Ring state, shared with data_thread
+K_MUTEX_DEFINE(mutex_event);
+// Capture file, held by the event thread while it writes
+K_MUTEX_DEFINE(mutex_event_file);
+K_MUTEX_DEFINE(mutex_event_config);
+
+static struct hpi_log_block event_ring[EVENT_RING_BLOCKS];
+static struct hpi_log_encoder event_enc;
+// Blocks completed since boot; the one being filled is
+// event_ring[event_written % EVENT_RING_BLOCKS]
+static uint32_t event_written;
+static bool event_block_open;
+
+static struct hpi_log_event_config event_config = {
+    .source_mask = CONFIG_HEALTHYPI_LOG_EVENT_SOURCES,
+    .pre_s = CONFIG_HEALTHYPI_LOG_EVENT_PRE_S,
+    .post_s = CONFIG_HEALTHYPI_LOG_EVENT_POST_S,
+    .hr_low = CONFIG_HEALTHYPI_LOG_EVENT_HR_LOW,
+    .hr_high = CONFIG_HEALTHYPI_LOG_EVENT_HR_HIGH,
+    .spo2_low = CONFIG_HEALTHYPI_LOG_EVENT_SPO2_LOW,
+};
+
+// Wall clock: seconds since 1970 at uptime event_clock_uptime_ms
+static int64_t event_clock_epoch;
+static uint32_t event_clock_uptime_ms;
+static bool event_clock_set;
+
+// Capture in progress, owned by the event thread
+static bool event_capturing;
+static uint32_t event_captures;
+static struct fs_file_t event_file;
+static struct hpi_log_block event_out;
+static uint16_t event_session_id;
+static uint32_t event_read;         // Next ring block to write
+static uint32_t event_base_ms;      // Uptime of time 0 in the file
+static uint32_t event_first_ms;     // First trigger
+static uint32_t event_end_ms;       // End of the post-trigger window
+static uint32_t event_seq;
+static uint32_t event_nonce;
+static uint32_t event_points;
+static uint32_t event_size;
+static uint32_t event_lost;
+static int64_t event_last_checkpoint;
+static struct event_trigger event_pending[EVENT_PENDING_MAX];
+static uint8_t event_n_pending;
+static struct hpi_log_block event_rec_out;
+
+static inline uint32_t event_block_time(uint32_t n)
+{
+    return sys_le32_to_cpu(event_ring[n % EVENT_RING_BLOCKS].hdr.timestamp_ms);
+}
+
+// Oldest completed block still in the ring. Called with mutex_event held.
+static inline uint32_t event_oldest(void)
+{
+    return (event_written >= EVENT_RING_BLOCKS - 1) ? event_written - (EVENT_RING_BLOCKS - 1) : 0;
+}
+
+// Called with mutex_event held
+static void event_complete_block(void)
+{
+    struct hpi_log_block *block = &event_ring[event_written % EVENT_RING_BLOCKS];
+
+    block->hdr.magic = sys_cpu_to_le32(HPI_LOG_BLOCK_MAGIC);
+    block->hdr.n_points = sys_cpu_to_le16(event_enc.st.n_points);
+    event_written++;
+    event_block_open = false;
+}
+
+void hpi_log_event_add_point(const struct hpi_sensor_data_point_t *point)
+{
+    uint32_t now = k_uptime_get_32();
+
+    k_mutex_lock(&mutex_event, K_FOREVER);
+
+    if (event_block_open &&
+        now > event_block_time(event_written) + (uint32_t)event_enc.st.n_points * 1000 / 128 + EVENT_GAP_MS)
+    {
+        event_complete_block();
+    }
+
+    for (int tries = 0; tries < 2; tries++)
+    {
+        if (!event_block_open)
+        {
+            struct hpi_log_block *block = &event_ring[event_written % EVENT_RING_BLOCKS];
+
+            hpi_log_encoder_init(&event_enc, block->payload, sizeof(block->payload));
+            block->hdr.timestamp_ms = sys_cpu_to_le32(now);
+            event_block_open = true;
+        }
+
+        if (hpi_log_encoder_add(&event_enc, point->ecg_sample, point->bioz_sample, point->ppg_sample_red))
+        {
+            break;
+        }
+        event_complete_block();
+    }
+
+    k_mutex_unlock(&mutex_event);
+}
+
+void hpi_log_event_trigger(enum hpi_log_event_source source, uint8_t detail, int16_t value)
+{
+    struct event_trigger trig = {
+        .timestamp_ms = k_uptime_get_32(),
+        .source = source,
+        .detail = detail,
+        .value = value,
+    };
+
+    // One byte, so a read without the lock is safe from an interrupt
+    if (source >= HPI_LOG_EVENT_SOURCE_COUNT || !(event_config.source_mask & BIT(source)))
+    {
+        return;
+    }
+
+    if (k_msgq_put(&q_event_trigger, &trig, K_NO_WAIT) != 0)
+    {
+        LOG_WRN("Event trigger queue full, source %u dropped", source);
+    }
+}
+
+void hpi_log_event_check_vitals(int16_t hr, int16_t spo2)
+{
+    static bool hr_low_active;
+    static bool hr_high_active;
+    static bool spo2_low_active;
+    struct hpi_log_event_config cfg;
+
+    hpi_log_event_get_config(&cfg);
+
+    if (hr > 0)
+    {
+        if (cfg.hr_low != 0 && !hr_low_active && hr < cfg.hr_low)
+        {
+            hr_low_active = true;
+            hpi_log_event_trigger(HPI_LOG_EVENT_HR, 0, hr);
+        }
+        else if (hr_low_active && hr >= cfg.hr_low + EVENT_HR_HYSTERESIS)
+        {
+            hr_low_active = false;
+        }
+
+        if (cfg.hr_high != 0 && !hr_high_active && hr > cfg.hr_high)
+        {
+            hr_high_active = true;
+            hpi_log_event_trigger(HPI_LOG_EVENT_HR, 1, hr);
+        }
+        else if (hr_high_active && hr <= cfg.hr_high - EVENT_HR_HYSTERESIS)
+        {
+            hr_high_active = false;
+        }
+    }
+
+    if (spo2 > 0)
+    {
+        if (cfg.spo2_low != 0 && !spo2_low_active && spo2 < cfg.spo2_low)
+        {
+            spo2_low_active = true;
+            hpi_log_event_trigger(HPI_LOG_EVENT_SPO2, 0, spo2);
+        }
+        else if (spo2_low_active && spo2 >= cfg.spo2_low + EVENT_SPO2_HYSTERESIS)
+        {
+            spo2_low_active = false;
+        }
+    }
+}
+
+void hpi_log_event_get_config(struct hpi_log_event_config *config)
+{
+    k_mutex_lock(&mutex_event_config, K_FOREVER);
+    *config = event_config;
+    k_mutex_unlock(&mutex_event_config);
+}
+
+int hpi_log_event_set_config(const struct hpi_log_event_config *config)
+{
+    if ((config->source_mask & ~(BIT(HPI_LOG_EVENT_SOURCE_COUNT) - 1)) != 0 || config->post_s == 0 ||
+        (uint32_t)config->post_s * 1000 > EVENT_MAX_MS ||
+        (config->hr_low != 0 && config->hr_high != 0 && config->hr_low >= config->hr_high) ||
+        config->spo2_low > 100)
+    {
+        return -EINVAL;
+    }
+
+    k_mutex_lock(&mutex_event_config, K_FOREVER);
+    event_config = *config;
+    k_mutex_unlock(&mutex_event_config);
+
+    return 0;
+}
+
+void hpi_log_event_set_clock(const uint8_t time[6])
+{
+    struct tm tm = {
+        .tm_year = time[0] + 100,
+        .tm_mon = time[1] - 1,
+        .tm_mday = time[2],
+        .tm_hour = time[3],
+        .tm_min = time[4],
+        .tm_sec = time[5],
+    };
+
+    if (time[1] == 0 || time[2] == 0)
+    {
+        return;
+    }
+
+    k_mutex_lock(&mutex_event_config, K_FOREVER);
+    event_clock_epoch = timeutil_timegm64(&tm);
+    event_clock_uptime_ms = k_uptime_get_32();
+    event_clock_set = true;
+    k_mutex_unlock(&mutex_event_config);
+}
+
+// Wall-clock time at uptime_ms, if the host has set the clock
+static bool event_wall_time(uint32_t uptime_ms, struct healthypi_time_t *t)
+{
+    struct tm tm;
+    time_t secs;
+    bool set;
+
+    k_mutex_lock(&mutex_event_config, K_FOREVER);
+    set = event_clock_set;
+    secs = (time_t)(event_clock_epoch + (int32_t)(uptime_ms - event_clock_uptime_ms) / 1000);
+    k_mutex_unlock(&mutex_event_config);
+
+    if (!set || gmtime_r(&secs, &tm) == NULL)
+    {
+        return false;
+    }
+
+    t->year = tm.tm_year - 100;
+    t->month = tm.tm_mon + 1;
+    t->day = tm.tm_mday;
+    t->hour = tm.tm_hour;
+    t->minute = tm.tm_min;
+    t->second = tm.tm_sec;
+    return true;
+}
+
+bool hpi_log_event_capturing(void)
+{
+    return event_capturing;
+}
+
+uint32_t hpi_log_event_captures(void)
+{
+    return event_captures;
+}
+
+static int event_write_block(struct hpi_log_block *block, uint32_t timestamp_ms)
+{
+    int rc;
+
+    block->hdr.session_id = sys_cpu_to_le16(event_session_id);
+    block->hdr.seq = sys_cpu_to_le32(event_seq);
+    block->hdr.nonce = event_nonce;
+    block->hdr.timestamp_ms = sys_cpu_to_le32(timestamp_ms - event_base_ms);
+    block->crc32 = sys_cpu_to_le32(crc32_ieee((const uint8_t *)block, offsetof(struct hpi_log_block, crc32)));
+
+    rc = fs_write(&event_file, block, sizeof(*block));
+    if (rc < 0)
+    {
+        LOG_ERR("Event capture write failed: %d", rc);
+        return rc;
+    }
+
+    event_seq++;
+    event_size += sizeof(*block);
+    if (sys_le32_to_cpu(block->hdr.magic) == HPI_LOG_BLOCK_MAGIC)
+    {
+        event_points += sys_le16_to_cpu(block->hdr.n_points);
+    }
+
+    return 0;
+}
+
+// Write the pending event records triggered before uptime before_ms, in
+// one record block. They are queued in trigger order.
+static int event_write_records(uint32_t before_ms)
+{
+    const size_t rec_size = sizeof(struct hpi_log_record_header) + sizeof(struct hpi_log_rec_event);
+    uint32_t first_ms = event_pending[0].timestamp_ms;
+    uint8_t n = 0;
+
+    while (n < event_n_pending && (int32_t)(event_pending[n].timestamp_ms - before_ms) < 0)
+    {
+        n++;
+    }
+    if (n == 0)
+    {
+        return 0;
+    }
+
+    BUILD_ASSERT(EVENT_PENDING_MAX * (sizeof(struct hpi_log_record_header) + sizeof(struct hpi_log_rec_event)) <=
+                     HPI_LOG_BLOCK_PAYLOAD,
+                 "Pending event records must fit one block");
+
+    memset(&event_rec_out, 0, sizeof(event_rec_out));
+    event_rec_out.hdr.magic = sys_cpu_to_le32(HPI_LOG_RECORD_MAGIC);
+    event_rec_out.hdr.n_points = sys_cpu_to_le16(n);
+
+    for (uint8_t i = 0; i < n; i++)
+    {
+        const struct event_trigger *trig = &event_pending[i];
+        struct hpi_log_record_header rec = {
+            .type = HPI_LOG_REC_EVENT,
+            .len = sizeof(struct hpi_log_rec_event),
+            .timestamp_ms = sys_cpu_to_le32(trig->timestamp_ms - event_base_ms),
+        };
+        struct hpi_log_rec_event ev = {
+            .source = trig->source,
+            .detail = trig->detail,
+            .value = sys_cpu_to_le16(trig->value),
+        };
+
+        memcpy(&event_rec_out.payload[i * rec_size], &rec, sizeof(rec));
+        memcpy(&event_rec_out.payload[i * rec_size + sizeof(rec)], &ev, sizeof(ev));
+    }
+
+    event_n_pending -= n;
+    memmove(&event_pending[0], &event_pending[n], event_n_pending * sizeof(event_pending[0]));
+
+    return event_write_block(&event_rec_out, first_ms);
+}
+
+static void event_close(void)
+{
+    struct hpi_log_catalog_entry entry;
+
+    if (!event_capturing)
+    {
+        return;
+    }
+
+    // Triggers after the last block written still get their records
+    if (event_n_pending > 0)
+    {
+        event_write_records(event_pending[event_n_pending - 1].timestamp_ms + 1);
+        event_n_pending = 0;
+    }
+    fs_close(&event_file);
+    event_capturing = false;
+
+    if (hpi_log_catalog_find(event_session_id, HPI_LOG_FILE_NO_EVENT, &entry) == 0)
+    {
+        entry.size = event_size;
+        entry.n_points = event_points;
+        entry.flags &= ~HPI_LOG_CAT_OPEN;
+        hpi_log_catalog_update(&entry);
+    }
+
+    if (event_lost > 0)
+    {
+        LOG_WRN("Event capture %u: %u blocks overwritten before they were written", event_session_id,
+                event_lost);
+    }
+    LOG_INF("Event capture %u closed, %u points", event_session_id, event_points);
+}
+
+static int event_open(const struct event_trigger *trig)
+{
+    struct hpi_log_catalog_entry entry = {0};
+    struct hpi_log_file_header hdr;
+    struct healthypi_time_t start;
+    struct hpi_log_event_config cfg;
+    uint32_t from_ms;
+    uint32_t first;
+    char path[32];
+    int rc;
+
+    hpi_log_event_get_config(&cfg);
+    from_ms = trig->timestamp_ms - (uint32_t)cfg.pre_s * 1000;
+
+    // Start from the last block that begins at or before the pre-trigger
+    // window, or the oldest one if the ring doesn't reach back that far
+    k_mutex_lock(&mutex_event, K_FOREVER);
+    first = event_oldest();
+    for (uint32_t n = first + 1; n < event_written && (int32_t)(event_block_time(n) - from_ms) <= 0; n++)
+    {
+        first = n;
+    }
+
+    if (first < event_written || event_block_open)
+    {
+        event_base_ms = event_block_time(first);
+    }
+    else
+    {
+        event_base_ms = trig->timestamp_ms;
+    }
+    k_mutex_unlock(&mutex_event);
+
+    if ((int32_t)(trig->timestamp_ms - event_base_ms) < 0)
+    {
+        event_base_ms = trig->timestamp_ms;
+    }
+
+    rc = hpi_datalog_new_session_id(&event_session_id);
+    if (rc < 0)
+    {
+        LOG_ERR("No free session id for the capture");
+        return rc;
+    }
+
+    hpi_datalog_init_header(&hdr, event_session_id, event_wall_time(event_base_ms, &start) ? &start : NULL,
+                            HPI_LOG_CODEC_RICE);
+    hpi_datalog_session_path(event_session_id, HPI_LOG_FILE_NO_EVENT, path, sizeof(path));
+
+    fs_file_t_init(&event_file);
+    rc = fs_open(&event_file, path, FS_O_CREATE | FS_O_WRITE | FS_O_TRUNC);
+    if (rc < 0)
+    {
+        LOG_ERR("Open %s failed: %d", path, rc);
+        return rc;
+    }
+
+    rc = fs_write(&event_file, &hdr, sizeof(hdr));
+    if (rc < 0)
+    {
+        LOG_ERR("Header write to %s failed: %d", path, rc);
+        fs_close(&event_file);
+        fs_unlink(path);
+        return rc;
+    }
+
+    entry.session_id = event_session_id;
+    entry.file_no = HPI_LOG_FILE_NO_EVENT;
+    entry.flags = HPI_LOG_CAT_OPEN;
+    entry.size = sizeof(hdr);
+    entry.nonce = sys_le32_to_cpu(hdr.nonce);
+    memcpy(entry.start_time, hdr.start_time, sizeof(entry.start_time));
+    hpi_log_catalog_add(&entry);
+
+    event_capturing = true;
+    event_captures++;
+    event_read = first;
+    event_first_ms = trig->timestamp_ms;
+    event_end_ms = trig->timestamp_ms;
+    event_seq = 0;
+    event_nonce = hdr.nonce;
+    event_points = 0;
+    event_size = sizeof(hdr);
+    event_lost = 0;
+    event_n_pending = 0;
+    event_last_checkpoint = k_uptime_get();
+
+    LOG_INF("Event capture %u started (source %u), %u s before the trigger", event_session_id, trig->source,
+            (trig->timestamp_ms - event_base_ms) / 1000);
+    return 0;
+}
+
+// Write the ring's completed blocks up to the end of the window. With
+// final set, the block being filled is completed first, so a stopped
+// stream's last points make it into the file.
+static void event_drain(bool final)
+{
+    uint32_t ts;
+
+    if (final)
+    {
+        k_mutex_lock(&mutex_event, K_FOREVER);
+        if (event_block_open && event_enc.st.n_points > 0)
+        {
+            event_complete_block();
+        }
+        k_mutex_unlock(&mutex_event);
+    }
+
+    while (event_capturing)
+    {
+        k_mutex_lock(&mutex_event, K_FOREVER);
+        if (event_read < event_oldest())
+        {
+            event_lost += event_oldest() - event_read;
+            event_read = event_oldest();
+        }
+        if (event_read >= event_written)
+        {
+            k_mutex_unlock(&mutex_event);
+            break;
+        }
+        memcpy(&event_out, &event_ring[event_read % EVENT_RING_BLOCKS], sizeof(event_out));
+        k_mutex_unlock(&mutex_event);
+
+        ts = sys_le32_to_cpu(event_out.hdr.timestamp_ms);
+        if ((int32_t)(ts - event_end_ms) >= 0)
+        {
+            event_close();
+            return;
+        }
+
+        if (event_write_records(ts) < 0 || event_write_block(&event_out, ts) < 0)
+        {
+            event_close();
+            return;
+        }
+        event_read++;
+    }
+
+    if (final)
+    {
+        event_close();
+    }
+}
+
+static void event_handle(const struct event_trigger *trig)
+{
+    struct hpi_log_event_config cfg;
+    struct hpi_log_rec_event rec = {
+        .source = trig->source,
+        .detail = trig->detail,
+        .value = sys_cpu_to_le16(trig->value),
+    };
+    uint32_t end_ms;
+
+    // On the session or flash ring timeline as well, whether or not a
+    // capture follows
+    if (settings_log_data_enabled)
+    {
+        hpi_datalog_add_record(HPI_LOG_REC_EVENT, &rec, sizeof(rec));
+    }
+#ifdef CONFIG_HEALTHYPI_LOG_FLASH_RING
+    hpi_log_ring_add_record(HPI_LOG_REC_EVENT, &rec, sizeof(rec));
+#endif
+
+    if (!sd_card_present || settings_log_data_enabled)
+    {
+        LOG_INF("Event (source %u) logged, no capture", trig->source);
+        return;
+    }
+
+    if (!event_capturing && event_open(trig) < 0)
+    {
+        return;
+    }
+
+    hpi_log_event_get_config(&cfg);
+    end_ms = trig->timestamp_ms + (uint32_t)cfg.post_s * 1000;
+    if ((int32_t)(end_ms - (event_first_ms + EVENT_MAX_MS)) > 0)
+    {
+        end_ms = event_first_ms + EVENT_MAX_MS;
+    }
+    if ((int32_t)(end_ms - event_end_ms) > 0)
+    {
+        event_end_ms = end_ms;
+    }
+
+    // Written by event_drain() once it reaches the trigger time
+    if (event_n_pending < EVENT_PENDING_MAX)
+    {
+        event_pending[event_n_pending++] = *trig;
+    }
+    else
+    {
+        LOG_WRN("Event record (source %u) not written to the capture", trig->source);
+    }
+}
+
+void hpi_log_event_seal(void)
+{
+    k_mutex_lock(&mutex_event_file, K_FOREVER);
+    event_close();
+    k_mutex_unlock(&mutex_event_file);
+}
+
+static void log_event_thread(void)
+{
+    struct event_trigger trig;
+
+    for (;;)
+    {
+        int rc = k_msgq_get(&q_event_trigger, &trig, event_capturing ? K_MSEC(EVENT_POLL_MS) : K_FOREVER);
+
+        k_mutex_lock(&mutex_event_file, K_FOREVER);
+
+        if (rc == 0)
+        {
+            event_handle(&trig);
+        }
+
+        if (event_capturing)
+        {
+            bool overdue = (int32_t)(k_uptime_get_32() - (event_end_ms + EVENT_CLOSE_GRACE_MS)) > 0;
+
+            event_drain(overdue);
+        }
+
+        if (event_capturing && k_uptime_get() - event_last_checkpoint >= EVENT_CHECKPOINT_INTERVAL_MS)
+        {
+            if (fs_sync(&event_file) == 0)
+            {
+                hpi_log_catalog_checkpoint(event_session_id, HPI_LOG_FILE_NO_EVENT, event_size, event_points);
+            }
+            event_last_checkpoint = k_uptime_get();
+        }
+
+        k_mutex_unlock(&mutex_event_file);
+    }
+}
+
+#define LOG_EVENT_THREAD_STACKSIZE 2048
+// Same as the SD log writer: captures and sessions never run together
+#define LOG_EVENT_THREAD_PRIORITY 10
+
+K_THREAD_DEFINE(log_event_thread_id, LOG_EVENT_THREAD_STACKSIZE, log_event_thread, NULL, NULL, NULL,
+                LOG_EVENT_THREAD_PRIORITY, 0, 0);
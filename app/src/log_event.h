@@ -0,0 +1,66 @@
+/*
+ * SPDX-License-Identifier: MIT
+ *
+ * Copyright (c) 2026 Ashwin Whitchurch, ProtoCentral Electronics
+ *
+ * Event-triggered capture to the SD card.
+ *
+ * The last few tens of seconds of ECG, BioZ and PPG are kept compressed in
+ * a RAM ring at all times. A trigger (the OK key held down, a lead coming
+ * off, heart rate or SpO2 crossing a threshold, or a host command) writes
+ * the ring from pre_s before the trigger onwards to <id>_EVT.BIN, and
+ * keeps writing until post_s after the last trigger. The file is a binary
+ * log in the hpi_log_format.h layout with one HPI_LOG_REC_EVENT record per
+ * trigger, and appears in the session catalog as file number 6.
+ *
+ * A capture only starts when an SD card is mounted and no continuous
+ * session is recording; otherwise the trigger is logged as a record on the
+ * session or flash ring timeline, which already holds the waveforms.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+enum hpi_log_event_source
+{
+    HPI_LOG_EVENT_BUTTON = 0,   // OK key long press
+    HPI_LOG_EVENT_LEAD_OFF = 1, // ECG or PPG lead coming off
+    HPI_LOG_EVENT_HR = 2,       // Heart rate below hr_low or above hr_high
+    HPI_LOG_EVENT_SPO2 = 3,     // SpO2 below spo2_low
+    HPI_LOG_EVENT_EXTERNAL = 4, // Host command or a firmware detector
+    HPI_LOG_EVENT_SOURCE_COUNT,
+};
+
+struct hpi_log_event_config
+{
+    uint8_t source_mask;    // BIT(enum hpi_log_event_source) per enabled source
+    uint8_t pre_s;          // Seconds kept from before the trigger
+    uint8_t post_s;         // Seconds written after the last trigger
+    uint8_t hr_low;         // bpm, 0 = off
+    uint8_t hr_high;        // bpm, 0 = off
+    uint8_t spo2_low;       // %, 0 = off
+};
+
+struct hpi_sensor_data_point_t;
+
+// Called by data_thread for every point; never blocks on the card
+void hpi_log_event_add_point(const struct hpi_sensor_data_point_t *point);
+// Safe from any context, including interrupts. Ignored if the source is
+// masked off.
+void hpi_log_event_trigger(enum hpi_log_event_source source, uint8_t detail, int16_t value);
+// Triggers HR and SpO2 events as the values cross their thresholds; 0
+// means no reading
+void hpi_log_event_check_vitals(int16_t hr, int16_t spo2);
+
+void hpi_log_event_get_config(struct hpi_log_event_config *config);
+int hpi_log_event_set_config(const struct hpi_log_event_config *config);
+// Wall-clock time of now, as set by the host (year - 2000, month, day,
+// hour, minute, second), for the start time in capture headers
+void hpi_log_event_set_clock(const uint8_t time[6]);
+
+// Close any capture in progress, before the card is unmounted
+void hpi_log_event_seal(void);
+bool hpi_log_event_capturing(void);
+uint32_t hpi_log_event_captures(void);
@@ -0,0 +1,566 @@
+/*
+ * SPDX-License-Identifier: MIT
+ *
+ * Copyright (c) 2026 Ashwin Whitchurch, ProtoCentral Electronics
+ *
+ * Ring log on the internal LittleFS partition for boards without an SD
+ * card.
+ *
+ * data_thread hands points and records over as it does to the SD logger.
+ * Points are Rice coded straight into waveform blocks (the SD logger codes
+ * in its writer thread; here there is no raw stage to size for). Full
+ * blocks go to a writer thread below every other application thread.
+ *
+ * Flash is scheduled around sampling. On the RP2040 every erase and
+ * program runs with interrupts off and XIP stopped, so the writer waits
+ * for the sampling work item to drain the MAX30001 FIFO before each flash
+ * operation and issues one operation per wait. The FIFO's headroom then
+ * covers a sector erase. Writes are whole 512-byte blocks, and the file
+ * metadata is committed every RING_SYNC_INTERVAL_MS or when a segment
+ * fills, not per block.
+ *
+ * Segments are numbered upwards across boots and the oldest of a ring is
+ * deleted before a new one would put it over budget (or leave the
+ * partition short). LittleFS allocates new blocks across the whole
+ * partition and relocates metadata blocks as they wear (block_cycles), so
+ * the free space beyond the two budgets takes part in wear levelling.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/fs/fs.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/crc.h>
+
+#include "log_ring.h"
+#include "datalog_module.h"
+#include "hpi_common_types.h"
+#include "hpi_log_format.h"
+#include "hpi_log_codec.h"
+
+LOG_MODULE_REGISTER(log_ring, LOG_LEVEL_INF);
+
+extern struct fs_mount_t *mp_lfs;
+
+#define RING_DIR "/lfs/ring"
+#define RING_BOOT_PATH RING_DIR "/BOOT"
+
+#define RING_SEGMENT_BYTES ((uint32_t)CONFIG_HEALTHYPI_LOG_RING_SEGMENT_KB * 1024)
+#define RING_NUM_BLOCKS 4
+#define RING_SYNC_INTERVAL_MS 30000
+// A record block is handed over once it is this old, full or not
+#define RING_RECORD_MAX_AGE_MS RING_SYNC_INTERVAL_MS
+// Points in a block are taken as evenly spaced, so a longer pause in the
+// stream starts a new block
+#define RING_GAP_MS 250
+// Flash work goes ahead without a sampling slot if none comes in this
+// long, e.g. before the sensors are started
+#define RING_SLOT_TIMEOUT_MS 50
+
+struct log_ring
+{
+    char prefix;
+    uint32_t budget;        // Bytes, including the open segment
+    uint32_t first;         // Oldest segment on flash
+    uint32_t next;          // Segment being written, or the next to open
+    struct fs_file_t file;
+    bool open;
+    bool dirty;
+    uint32_t seq;           // Blocks in the open segment
+    uint32_t nonce;         // From the open segment's header
+};
+
+static struct log_ring rings[HPI_LOG_RING_COUNT] = {
+    [HPI_LOG_RING_TREND] = {.prefix = 'T', .budget = (uint32_t)CONFIG_HEALTHYPI_LOG_RING_TREND_KB * 1024},
+    [HPI_LOG_RING_WAVE] = {.prefix = 'W', .budget = (uint32_t)CONFIG_HEALTHYPI_LOG_RING_WAVE_KB * 1024},
+};
+
+static struct hpi_log_block ring_blocks[RING_NUM_BLOCKS];
+K_MSGQ_DEFINE(q_ring_free, sizeof(struct hpi_log_block *), RING_NUM_BLOCKS, 4);
+K_MSGQ_DEFINE(q_ring_full, sizeof(struct hpi_log_block *), RING_NUM_BLOCKS, 4);
+K_SEM_DEFINE(sem_ring_start, 0, 1);
+K_SEM_DEFINE(sem_ring_slot, 0, 1);
+
+// Producer state
+K_MUTEX_DEFINE(mutex_ring);
+// Segment numbers, read by the command thread
+K_MUTEX_DEFINE(mutex_ring_files);
+
+static bool ring_active;
+static uint16_t ring_boot_id;
+static int64_t ring_last_sync;
+static atomic_t ring_dropped;
+
+static struct hpi_log_block *ring_wave_block;
+static struct hpi_log_encoder ring_enc;
+static struct hpi_log_block *ring_rec_block;
+static uint16_t ring_rec_count;
+static uint16_t ring_rec_len;
+static uint32_t ring_rec_first_ms;
+
+void hpi_log_ring_start(void)
+{
+    k_sem_give(&sem_ring_start);
+}
+
+bool hpi_log_ring_active(void)
+{
+    return ring_active;
+}
+
+void hpi_log_ring_sampling_done(void)
+{
+    if (ring_active)
+    {
+        k_sem_give(&sem_ring_slot);
+    }
+}
+
+// Called with mutex_ring held; never blocks
+static void ring_submit_wave(void)
+{
+    if (ring_wave_block == NULL || ring_enc.st.n_points == 0)
+    {
+        return;
+    }
+
+    ring_wave_block->hdr.magic = sys_cpu_to_le32(HPI_LOG_BLOCK_MAGIC);
+    ring_wave_block->hdr.session_id = sys_cpu_to_le16(ring_boot_id);
+    ring_wave_block->hdr.n_points = sys_cpu_to_le16(ring_enc.st.n_points);
+
+    // One slot per block, so this can't fail
+    k_msgq_put(&q_ring_full, &ring_wave_block, K_NO_WAIT);
+    ring_wave_block = NULL;
+}
+
+static void ring_submit_records(void)
+{
+    if (ring_rec_block == NULL || ring_rec_count == 0)
+    {
+        return;
+    }
+
+    ring_rec_block->hdr.magic = sys_cpu_to_le32(HPI_LOG_RECORD_MAGIC);
+    ring_rec_block->hdr.session_id = sys_cpu_to_le16(ring_boot_id);
+    ring_rec_block->hdr.n_points = sys_cpu_to_le16(ring_rec_count);
+    ring_rec_block->hdr.timestamp_ms = sys_cpu_to_le32(ring_rec_first_ms);
+
+    k_msgq_put(&q_ring_full, &ring_rec_block, K_NO_WAIT);
+    ring_rec_block = NULL;
+    ring_rec_count = 0;
+    ring_rec_len = 0;
+}
+
+void hpi_log_ring_add_point(const struct hpi_sensor_data_point_t *point)
+{
+    uint32_t now;
+
+    if (!ring_active)
+    {
+        return;
+    }
+
+    now = k_uptime_get_32();
+    k_mutex_lock(&mutex_ring, K_FOREVER);
+
+    if (ring_wave_block != NULL && ring_enc.st.n_points > 0 &&
+        now > sys_le32_to_cpu(ring_wave_block->hdr.timestamp_ms) + (uint32_t)ring_enc.st.n_points * 1000 / 128 +
+                  RING_GAP_MS)
+    {
+        ring_submit_wave();
+    }
+
+    for (int tries = 0; tries < 2; tries++)
+    {
+        if (ring_wave_block == NULL)
+        {
+            // Writer has fallen behind: drop the point rather than wait
+            if (k_msgq_get(&q_ring_free, &ring_wave_block, K_NO_WAIT) != 0)
+            {
+                ring_wave_block = NULL;
+                atomic_inc(&ring_dropped);
+                break;
+            }
+
+            hpi_log_encoder_init(&ring_enc, ring_wave_block->payload, sizeof(ring_wave_block->payload));
+            ring_wave_block->hdr.timestamp_ms = sys_cpu_to_le32(now);
+        }
+
+        if (hpi_log_encoder_add(&ring_enc, point->ecg_sample, point->bioz_sample, point->ppg_sample_red))
+        {
+            break;
+        }
+        ring_submit_wave();
+    }
+
+    k_mutex_unlock(&mutex_ring);
+}
+
+void hpi_log_ring_add_record(uint8_t type, const void *data, uint8_t len)
+{
+    struct hpi_log_record_header rec;
+    uint32_t now;
+
+    if (!ring_active || sizeof(rec) + len > HPI_LOG_BLOCK_PAYLOAD)
+    {
+        return;
+    }
+
+    now = k_uptime_get_32();
+    k_mutex_lock(&mutex_ring, K_FOREVER);
+
+    if (ring_rec_count > 0 &&
+        (ring_rec_len + sizeof(rec) + len > HPI_LOG_BLOCK_PAYLOAD || now - ring_rec_first_ms >= RING_RECORD_MAX_AGE_MS))
+    {
+        ring_submit_records();
+    }
+
+    if (ring_rec_count == 0)
+    {
+        if (ring_rec_block == NULL && k_msgq_get(&q_ring_free, &ring_rec_block, K_NO_WAIT) != 0)
+        {
+            ring_rec_block = NULL;
+            atomic_inc(&ring_dropped);
+            k_mutex_unlock(&mutex_ring);
+            return;
+        }
+
+        memset(ring_rec_block->payload, 0, sizeof(ring_rec_block->payload));
+        ring_rec_first_ms = now;
+    }
+
+    rec.type = type;
+    rec.len = len;
+    rec.timestamp_ms = sys_cpu_to_le32(now);
+    memcpy(&ring_rec_block->payload[ring_rec_len], &rec, sizeof(rec));
+    memcpy(&ring_rec_block->payload[ring_rec_len + sizeof(rec)], data, len);
+    ring_rec_len += sizeof(rec) + len;
+    ring_rec_count++;
+
+    k_mutex_unlock(&mutex_ring);
+}
+
+// Block until the sampling work item has just emptied the sensor FIFO
+static void ring_wait_slot(void)
+{
+    k_sem_reset(&sem_ring_slot);
+    k_sem_take(&sem_ring_slot, K_MSEC(RING_SLOT_TIMEOUT_MS));
+}
+
+static void ring_segment_path(const struct log_ring *ring, uint32_t segment, char *path, size_t len)
+{
+    snprintf(path, len, RING_DIR "/%c%07u.BIN", ring->prefix, (unsigned int)segment);
+}
+
+// Drop the oldest segments until the one about to be opened fits the
+// budget and leaves the partition some slack
+static void ring_trim(struct log_ring *ring)
+{
+    struct fs_statvfs sbuf;
+    char path[32];
+    int rc;
+
+    while (ring->first < ring->next)
+    {
+        bool low = fs_statvfs(mp_lfs->mnt_point, &sbuf) == 0 &&
+                   (uint64_t)sbuf.f_bfree * sbuf.f_frsize < 2 * RING_SEGMENT_BYTES;
+
+        if (!low && (ring->next - ring->first + 1) * RING_SEGMENT_BYTES <= ring->budget)
+        {
+            break;
+        }
+
+        ring_segment_path(ring, ring->first, path, sizeof(path));
+        ring_wait_slot();
+        rc = fs_unlink(path);
+        if (rc < 0 && rc != -ENOENT)
+        {
+            LOG_ERR("Delete %s failed: %d", path, rc);
+        }
+
+        k_mutex_lock(&mutex_ring_files, K_FOREVER);
+        ring->first++;
+        k_mutex_unlock(&mutex_ring_files);
+    }
+}
+
+static int ring_open(struct log_ring *ring)
+{
+    struct hpi_log_file_header hdr;
+    char path[32];
+    int rc;
+
+    ring_trim(ring);
+
+    ring_segment_path(ring, ring->next, path, sizeof(path));
+    hpi_datalog_init_header(&hdr, ring_boot_id, NULL, HPI_LOG_CODEC_RICE);
+
+    ring_wait_slot();
+    fs_unlink(path);
+    fs_file_t_init(&ring->file);
+    rc = fs_open(&ring->file, path, FS_O_CREATE | FS_O_WRITE);
+    if (rc < 0)
+    {
+        LOG_ERR("Open %s failed: %d", path, rc);
+        return rc;
+    }
+
+    ring_wait_slot();
+    rc = fs_write(&ring->file, &hdr, sizeof(hdr));
+    if (rc < 0)
+    {
+        LOG_ERR("Header write to %s failed: %d", path, rc);
+        fs_close(&ring->file);
+        fs_unlink(path);
+        return rc;
+    }
+
+    k_mutex_lock(&mutex_ring_files, K_FOREVER);
+    ring->open = true;
+    k_mutex_unlock(&mutex_ring_files);
+    ring->dirty = true;
+    ring->seq = 0;
+    ring->nonce = hdr.nonce;
+
+    return 0;
+}
+
+static void ring_close(struct log_ring *ring)
+{
+    if (!ring->open)
+    {
+        return;
+    }
+
+    ring_wait_slot();
+    fs_close(&ring->file);
+
+    k_mutex_lock(&mutex_ring_files, K_FOREVER);
+    ring->open = false;
+    ring->next++;
+    k_mutex_unlock(&mutex_ring_files);
+    ring->dirty = false;
+}
+
+static void ring_write(struct log_ring *ring, struct hpi_log_block *block)
+{
+    int rc;
+
+    if (!ring->open && ring_open(ring) < 0)
+    {
+        atomic_inc(&ring_dropped);
+        return;
+    }
+
+    block->hdr.seq = sys_cpu_to_le32(ring->seq);
+    block->hdr.nonce = ring->nonce;
+    block->crc32 = sys_cpu_to_le32(crc32_ieee((const uint8_t *)block, offsetof(struct hpi_log_block, crc32)));
+
+    ring_wait_slot();
+    rc = fs_write(&ring->file, block, sizeof(*block));
+    if (rc < 0)
+    {
+        // Start over in a fresh segment, trimming first (e.g. on -ENOSPC)
+        LOG_ERR("Ring block write failed: %d", rc);
+        atomic_inc(&ring_dropped);
+        ring_close(ring);
+        return;
+    }
+
+    ring->seq++;
+    ring->dirty = true;
+
+    if (HPI_LOG_HEADER_SIZE + ring->seq * HPI_LOG_BLOCK_SIZE + HPI_LOG_BLOCK_SIZE > RING_SEGMENT_BYTES)
+    {
+        ring_close(ring);
+    }
+}
+
+static void ring_sync(void)
+{
+    for (int i = 0; i < HPI_LOG_RING_COUNT; i++)
+    {
+        if (rings[i].open && rings[i].dirty)
+        {
+            ring_wait_slot();
+            fs_sync(&rings[i].file);
+            rings[i].dirty = false;
+        }
+    }
+
+    ring_last_sync = k_uptime_get();
+}
+
+// Continue numbering after the segments already on flash
+static void ring_scan(void)
+{
+    static struct fs_dirent entry;
+    struct fs_dir_t dir;
+    bool found[HPI_LOG_RING_COUNT] = {false};
+
+    fs_dir_t_init(&dir);
+    if (fs_opendir(&dir, RING_DIR) != 0)
+    {
+        return;
+    }
+
+    while (fs_readdir(&dir, &entry) == 0 && entry.name[0] != 0)
+    {
+        for (int i = 0; i < HPI_LOG_RING_COUNT; i++)
+        {
+            struct log_ring *ring = &rings[i];
+            char *end;
+            uint32_t n;
+
+            if (entry.type != FS_DIR_ENTRY_FILE || entry.name[0] != ring->prefix)
+            {
+                continue;
+            }
+
+            n = strtoul(&entry.name[1], &end, 10);
+            if (end == &entry.name[1] || strcmp(end, ".BIN") != 0)
+            {
+                continue;
+            }
+
+            if (!found[i] || n < ring->first)
+            {
+                ring->first = n;
+            }
+            if (!found[i] || n >= ring->next)
+            {
+                ring->next = n + 1;
+            }
+            found[i] = true;
+        }
+    }
+
+    fs_closedir(&dir);
+}
+
+// Segment headers carry the boot count as their session id
+static void ring_load_boot_id(void)
+{
+    struct fs_file_t file;
+    uint16_t id = 0;
+
+    fs_file_t_init(&file);
+    if (fs_open(&file, RING_BOOT_PATH, FS_O_CREATE | FS_O_RDWR) != 0)
+    {
+        return;
+    }
+
+    if (fs_read(&file, &id, sizeof(id)) == sizeof(id))
+    {
+        id = sys_le16_to_cpu(id) + 1;
+    }
+    ring_boot_id = id;
+
+    id = sys_cpu_to_le16(id);
+    fs_seek(&file, 0, FS_SEEK_SET);
+    fs_write(&file, &id, sizeof(id));
+    fs_close(&file);
+}
+
+static void log_ring_thread(void)
+{
+    struct hpi_log_block *block;
+    int rc;
+
+    k_sem_take(&sem_ring_start, K_FOREVER);
+
+    rc = fs_mkdir(RING_DIR);
+    if (rc < 0 && rc != -EEXIST)
+    {
+        LOG_ERR("Cannot create %s: %d", RING_DIR, rc);
+        return;
+    }
+
+    ring_load_boot_id();
+    ring_scan();
+
+    for (int i = 0; i < RING_NUM_BLOCKS; i++)
+    {
+        block = &ring_blocks[i];
+        k_msgq_put(&q_ring_free, &block, K_NO_WAIT);
+    }
+
+    ring_last_sync = k_uptime_get();
+    ring_active = true;
+    LOG_INF("No SD card, logging to flash (boot %u, %u trend and %u wave segments kept)", ring_boot_id,
+            (unsigned int)(rings[HPI_LOG_RING_TREND].next - rings[HPI_LOG_RING_TREND].first),
+            (unsigned int)(rings[HPI_LOG_RING_WAVE].next - rings[HPI_LOG_RING_WAVE].first));
+
+    for (;;)
+    {
+        int64_t due = ring_last_sync + RING_SYNC_INTERVAL_MS - k_uptime_get();
+
+        if (k_msgq_get(&q_ring_full, &block, K_MSEC(MAX(due, 0))) == 0)
+        {
+            bool records = sys_le32_to_cpu(block->hdr.magic) == HPI_LOG_RECORD_MAGIC;
+
+            ring_write(&rings[records ? HPI_LOG_RING_TREND : HPI_LOG_RING_WAVE], block);
+            k_msgq_put(&q_ring_free, &block, K_NO_WAIT);
+        }
+
+        if (k_uptime_get() - ring_last_sync >= RING_SYNC_INTERVAL_MS)
+        {
+            ring_sync();
+
+            if (atomic_get(&ring_dropped) > 0)
+            {
+                LOG_WRN("%ld ring log points or blocks dropped", (long)atomic_set(&ring_dropped, 0));
+            }
+        }
+    }
+}
+
+#define LOG_RING_THREAD_STACKSIZE 2048
+// Below the SD log writer: flash work only runs when nothing else will
+#define LOG_RING_THREAD_PRIORITY 11
+
+K_THREAD_DEFINE(log_ring_thread_id, LOG_RING_THREAD_STACKSIZE, log_ring_thread, NULL, NULL, NULL,
+                LOG_RING_THREAD_PRIORITY, 0, 0);
+
+int hpi_log_ring_get_info(enum hpi_log_ring_id ring, struct hpi_log_ring_info *info)
+{
+    if (ring >= HPI_LOG_RING_COUNT)
+    {
+        return -EINVAL;
+    }
+    if (!ring_active)
+    {
+        return -ENODEV;
+    }
+
+    k_mutex_lock(&mutex_ring_files, K_FOREVER);
+    info->first = rings[ring].first;
+    info->count = rings[ring].next - rings[ring].first + (rings[ring].open ? 1 : 0);
+    k_mutex_unlock(&mutex_ring_files);
+
+    return 0;
+}
+
+int hpi_log_ring_send_segment(enum hpi_log_ring_id ring, uint32_t segment)
+{
+    struct hpi_log_ring_info info;
+    char path[32];
+    int rc;
+
+    rc = hpi_log_ring_get_info(ring, &info);
+    if (rc < 0)
+    {
+        return rc;
+    }
+    if (segment < info.first || segment - info.first >= info.count)
+    {
+        return -ENOENT;
+    }
+
+    ring_segment_path(&rings[ring], segment, path, sizeof(path));
+    return hpi_datalog_send_file(path);
+}
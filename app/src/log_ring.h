@@ -0,0 +1,52 @@
+/*
+ * SPDX-License-Identifier: MIT
+ *
+ * Copyright (c) 2026 Ashwin Whitchurch, ProtoCentral Electronics
+ *
+ * Fallback log on internal flash, used when no SD card is mounted.
+ *
+ * Two rings of segment files on the LittleFS partition: a trend ring of
+ * record blocks (vitals, signal quality, lead-off, R-R, clock) and a
+ * shorter waveform ring of compressed data blocks. Each segment is a
+ * binary log in the hpi_log_format.h layout, so scripts/hpi_log_to_csv.py
+ * reads it unchanged. When a ring exceeds its budget the oldest segment is
+ * deleted; LittleFS spreads the rewrites over the whole partition.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+enum hpi_log_ring_id
+{
+    HPI_LOG_RING_TREND = 0,
+    HPI_LOG_RING_WAVE = 1,
+    HPI_LOG_RING_COUNT,
+};
+
+struct hpi_log_ring_info
+{
+    uint32_t first;         // Oldest segment still on flash
+    uint32_t count;         // Segments, including the one being written
+};
+
+struct hpi_sensor_data_point_t;
+
+// Start logging to flash; called once at boot when no SD card was found
+void hpi_log_ring_start(void);
+bool hpi_log_ring_active(void);
+
+// Same contract as hpi_datalog_add_point/add_record: never block on flash
+void hpi_log_ring_add_point(const struct hpi_sensor_data_point_t *point);
+void hpi_log_ring_add_record(uint8_t type, const void *data, uint8_t len);
+
+// Called by the sampling work item after it has drained the sensor FIFO.
+// The ring writer waits for this before each flash operation, since erase
+// and program lock out interrupts and XIP on the RP2040.
+void hpi_log_ring_sampling_done(void);
+
+int hpi_log_ring_get_info(enum hpi_log_ring_id ring, struct hpi_log_ring_info *info);
+// Send one segment over the command link, as hpi_datalog_send_file() does.
+// The segment being written is read as of its last sync.
+int hpi_log_ring_send_segment(enum hpi_log_ring_id ring, uint32_t segment);
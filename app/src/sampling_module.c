@@ -33,6 +33,7 @@
 
 #include "hpi_common_types.h"
 #include "hw_module.h"
+#include "log_ring.h"
 
 LOG_MODULE_REGISTER(sampling_module, CONFIG_SENSOR_LOG_LEVEL);
 
@@ -130,6 +131,12 @@ void work_sample_handler(struct k_work *work)
         }
     }
 
+    // Hold a beat reported by a batch without ECG samples for the next
+    // point pushed, so no R-R interval is dropped
+    if (edata->rri_new) {
+        hpi_sensor_data_point.rtor_new = true;
+    }
+
     if (n_samples_ecg > 0) {
         // BioZ runs at 64 SPS (half of ECG's 128 SPS), interleave samples
         int bioz_idx = 0;
@@ -154,8 +161,14 @@ void work_sample_handler(struct k_work *work)
             }
 
             k_msgq_put(&q_hpi_data_sample, &hpi_sensor_data_point, K_NO_WAIT);
+            hpi_sensor_data_point.rtor_new = false;
         }
     }
+
+#ifdef CONFIG_HEALTHYPI_LOG_FLASH_RING
+    // FIFO just emptied: the flash ring writer may now stall the bus
+    hpi_log_ring_sampling_done();
+#endif
 }
 
 K_WORK_DEFINE(work_sample, work_sample_handler);
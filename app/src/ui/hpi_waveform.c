@@ -0,0 +1,354 @@
+/*
+ * SPDX-License-Identifier: MIT
+ *
+ * Copyright (c) 2026 Ashwin Whitchurch, ProtoCentral Electronics
+ *
+ * Sweep-style waveform widget (see hpi_waveform.h).
+ */
+
+#include <string.h>
+
+#include <zephyr/kernel.h>
+#include <lvgl.h>
+
+#include "hpi_waveform.h"
+
+// Blank columns kept ahead of the cursor
+#define HPI_WAVEFORM_GAP 8
+
+// A column whose top is below its bottom is drawn as background
+#define COL_BLANK_TOP 0xFF
+#define COL_BLANK_BOTTOM 0x00
+
+struct hpi_waveform
+{
+    lv_color_t color;
+    uint16_t width;
+    uint16_t height;
+
+    uint16_t cursor;        // Column being filled
+    uint16_t dirty_from;    // First column changed since the last refresh
+    uint16_t dirty_cols;    // Columns completed since the last refresh
+
+    uint32_t step_q8;       // Samples per column, Q8
+    uint32_t acc_q8;
+    int32_t col_min;
+    int32_t col_max;
+    int32_t col_last;
+
+    uint8_t prev_y;         // Last sample of the previous column, to join the columns up
+    bool have_prev;
+
+    int32_t lo;             // Scale of the current sweep
+    int32_t span;
+    int32_t min_span;
+    int32_t sweep_lo;       // Range seen so far in this sweep, for the next one
+    int32_t sweep_hi;
+    bool scaled;            // A full sweep has set the scale
+
+    uint8_t *col_top;
+    uint8_t *col_bottom;
+};
+
+// Called per sample, so no lv_obj_is_valid() walk of the object tree here;
+// the owning screen checks that once per pass
+static struct hpi_waveform *waveform_get(lv_obj_t *obj)
+{
+    if (obj == NULL)
+    {
+        return NULL;
+    }
+
+    return lv_obj_get_user_data(obj);
+}
+
+static void waveform_fit(struct hpi_waveform *wf, int32_t lo, int32_t hi)
+{
+    int64_t span = (int64_t)hi - lo;
+    int64_t mid = ((int64_t)lo + hi) / 2;
+
+    // Leave a little headroom above and below the peaks
+    span += span / 8;
+    span = MAX(span, (int64_t)wf->min_span);
+    span = MAX(span, 1);
+
+    wf->lo = (int32_t)(mid - span / 2);
+    wf->span = (int32_t)span;
+}
+
+static uint8_t waveform_y(const struct hpi_waveform *wf, int32_t value)
+{
+    int64_t y = ((int64_t)value - wf->lo) * (wf->height - 1) / wf->span;
+
+    y = CLAMP(y, 0, wf->height - 1);
+    return (uint8_t)(wf->height - 1 - y);
+}
+
+static void waveform_reset(struct hpi_waveform *wf)
+{
+    memset(wf->col_top, COL_BLANK_TOP, wf->width);
+    memset(wf->col_bottom, COL_BLANK_BOTTOM, wf->width);
+
+    wf->cursor = 0;
+    wf->dirty_from = 0;
+    wf->dirty_cols = 0;
+    wf->acc_q8 = 0;
+    wf->col_min = INT32_MAX;
+    wf->col_max = INT32_MIN;
+    wf->have_prev = false;
+    wf->sweep_lo = INT32_MAX;
+    wf->sweep_hi = INT32_MIN;
+    wf->scaled = false;
+}
+
+static void waveform_close_column(struct hpi_waveform *wf)
+{
+    uint16_t col = wf->cursor;
+    uint8_t top = waveform_y(wf, wf->col_max);
+    uint8_t bottom = waveform_y(wf, wf->col_min);
+
+    if (wf->have_prev)
+    {
+        top = MIN(top, wf->prev_y);
+        bottom = MAX(bottom, wf->prev_y);
+    }
+    wf->col_top[col] = top;
+    wf->col_bottom[col] = bottom;
+    wf->prev_y = waveform_y(wf, wf->col_last);
+    wf->have_prev = true;
+
+    // Erase bar
+    col = (col + HPI_WAVEFORM_GAP) % wf->width;
+    wf->col_top[col] = COL_BLANK_TOP;
+    wf->col_bottom[col] = COL_BLANK_BOTTOM;
+
+    if (wf->dirty_cols < wf->width)
+    {
+        wf->dirty_cols++;
+    }
+
+    wf->col_min = INT32_MAX;
+    wf->col_max = INT32_MIN;
+
+    if (++wf->cursor == wf->width)
+    {
+        // New sweep: scale it to the one just finished
+        wf->cursor = 0;
+        wf->have_prev = false;
+        waveform_fit(wf, wf->sweep_lo, wf->sweep_hi);
+        wf->sweep_lo = INT32_MAX;
+        wf->sweep_hi = INT32_MIN;
+        wf->scaled = true;
+    }
+}
+
+static void waveform_draw_cb(lv_event_t *e)
+{
+    lv_obj_t *obj = lv_event_get_target(e);
+    struct hpi_waveform *wf = lv_obj_get_user_data(obj);
+    lv_layer_t *layer = lv_event_get_layer(e);
+    lv_draw_rect_dsc_t dsc;
+    lv_area_t coords;
+    int32_t from;
+    int32_t to;
+
+    if (wf == NULL)
+    {
+        return;
+    }
+
+    lv_obj_get_coords(obj, &coords);
+
+    // Only the invalidated strip is being rendered
+    from = MAX(layer->_clip_area.x1 - coords.x1, 0);
+    to = MIN(layer->_clip_area.x2 - coords.x1, wf->width - 1);
+
+    lv_draw_rect_dsc_init(&dsc);
+    dsc.bg_color = wf->color;
+    dsc.bg_opa = LV_OPA_COVER;
+
+    for (int32_t x = from; x <= to; x++)
+    {
+        uint8_t top = wf->col_top[x];
+        uint8_t bottom = wf->col_bottom[x];
+        int32_t run = x;
+
+        if (top > bottom)
+        {
+            continue;
+        }
+
+        // Flat stretches go out as one rectangle
+        while (run < to && wf->col_top[run + 1] == top && wf->col_bottom[run + 1] == bottom)
+        {
+            run++;
+        }
+
+        lv_area_t area = {
+            .x1 = coords.x1 + x,
+            .y1 = coords.y1 + top,
+            .x2 = coords.x1 + run,
+            .y2 = coords.y1 + bottom,
+        };
+        lv_draw_rect(layer, &dsc, &area);
+        x = run;
+    }
+}
+
+static void waveform_delete_cb(lv_event_t *e)
+{
+    lv_obj_t *obj = lv_event_get_target(e);
+
+    lv_free(lv_obj_get_user_data(obj));
+    lv_obj_set_user_data(obj, NULL);
+}
+
+lv_obj_t *hpi_waveform_create(lv_obj_t *parent, int32_t width, int32_t height, lv_color_t color)
+{
+    lv_obj_t *obj = lv_obj_create(parent);
+    struct hpi_waveform *wf;
+
+    height = CLAMP(height, 2, 255);
+    width = MAX(width, HPI_WAVEFORM_GAP + 1);
+
+    lv_obj_set_size(obj, width, height);
+    lv_obj_clear_flag(obj, LV_OBJ_FLAG_SCROLLABLE | LV_OBJ_FLAG_CLICKABLE);
+
+    // Opaque and square, so refreshing a strip doesn't redraw the parents
+    lv_obj_set_style_bg_color(obj, lv_color_black(), LV_PART_MAIN);
+    lv_obj_set_style_bg_opa(obj, LV_OPA_COVER, LV_PART_MAIN);
+    lv_obj_set_style_border_width(obj, 0, LV_PART_MAIN);
+    lv_obj_set_style_radius(obj, 0, LV_PART_MAIN);
+    lv_obj_set_style_pad_all(obj, 0, LV_PART_MAIN);
+
+    wf = lv_malloc(sizeof(*wf) + 2 * width);
+    if (wf == NULL)
+    {
+        LV_LOG_ERROR("No memory for waveform");
+        return obj;
+    }
+
+    memset(wf, 0, sizeof(*wf));
+    wf->color = color;
+    wf->width = width;
+    wf->height = height;
+    wf->step_q8 = 256;
+    wf->min_span = 1;
+    wf->col_top = (uint8_t *)(wf + 1);
+    wf->col_bottom = wf->col_top + width;
+    waveform_reset(wf);
+
+    lv_obj_set_user_data(obj, wf);
+    lv_obj_add_event_cb(obj, waveform_draw_cb, LV_EVENT_DRAW_MAIN, NULL);
+    lv_obj_add_event_cb(obj, waveform_delete_cb, LV_EVENT_DELETE, NULL);
+
+    return obj;
+}
+
+void hpi_waveform_set_sweep(lv_obj_t *obj, uint16_t sample_rate_hz, uint16_t sweep_ms)
+{
+    struct hpi_waveform *wf = waveform_get(obj);
+
+    if (wf == NULL)
+    {
+        return;
+    }
+
+    wf->step_q8 = (uint32_t)(((uint64_t)sample_rate_hz * sweep_ms * 256) / (1000U * wf->width));
+    wf->step_q8 = MAX(wf->step_q8, 256);
+    wf->acc_q8 = 0;
+}
+
+void hpi_waveform_set_min_span(lv_obj_t *obj, int32_t min_span)
+{
+    struct hpi_waveform *wf = waveform_get(obj);
+
+    if (wf != NULL)
+    {
+        wf->min_span = MAX(min_span, 1);
+    }
+}
+
+void hpi_waveform_add_sample(lv_obj_t *obj, int32_t value)
+{
+    struct hpi_waveform *wf = waveform_get(obj);
+
+    if (wf == NULL)
+    {
+        return;
+    }
+
+    wf->sweep_lo = MIN(wf->sweep_lo, value);
+    wf->sweep_hi = MAX(wf->sweep_hi, value);
+
+    // Until a sweep has completed, grow the scale to whatever has been seen
+    if (!wf->scaled && (wf->span == 0 || value < wf->lo || (int64_t)value > (int64_t)wf->lo + wf->span))
+    {
+        waveform_fit(wf, wf->sweep_lo, wf->sweep_hi);
+    }
+
+    wf->col_min = MIN(wf->col_min, value);
+    wf->col_max = MAX(wf->col_max, value);
+    wf->col_last = value;
+
+    wf->acc_q8 += 256;
+    if (wf->acc_q8 >= wf->step_q8)
+    {
+        wf->acc_q8 -= wf->step_q8;
+        waveform_close_column(wf);
+    }
+}
+
+void hpi_waveform_clear(lv_obj_t *obj)
+{
+    struct hpi_waveform *wf = waveform_get(obj);
+
+    if (wf == NULL)
+    {
+        return;
+    }
+
+    waveform_reset(wf);
+    wf->span = 0;
+    lv_obj_invalidate(obj);
+}
+
+static void waveform_invalidate_cols(lv_obj_t *obj, const lv_area_t *coords, uint16_t first, uint16_t count)
+{
+    lv_area_t area = {
+        .x1 = coords->x1 + first,
+        .y1 = coords->y1,
+        .x2 = coords->x1 + first + count - 1,
+        .y2 = coords->y2,
+    };
+
+    lv_obj_invalidate_area(obj, &area);
+}
+
+void hpi_waveform_refresh(lv_obj_t *obj)
+{
+    struct hpi_waveform *wf = waveform_get(obj);
+    lv_area_t coords;
+    uint16_t count;
+    uint16_t run;
+
+    if (wf == NULL || wf->dirty_cols == 0)
+    {
+        return;
+    }
+
+    lv_obj_get_coords(obj, &coords);
+
+    // The new columns plus the erase bar they pushed ahead, split at the
+    // right edge if the sweep wrapped
+    count = MIN(wf->dirty_cols + HPI_WAVEFORM_GAP, wf->width);
+    run = MIN(count, wf->width - wf->dirty_from);
+    waveform_invalidate_cols(obj, &coords, wf->dirty_from, run);
+    if (run < count)
+    {
+        waveform_invalidate_cols(obj, &coords, 0, count - run);
+    }
+
+    wf->dirty_from = wf->cursor;
+    wf->dirty_cols = 0;
+}
@@ -0,0 +1,65 @@
+/*
+ * SPDX-License-Identifier: MIT
+ *
+ * Copyright (c) 2026 Ashwin Whitchurch, ProtoCentral Electronics
+ *
+ * Sweep-style waveform widget for the live ECG, respiration and PPG traces.
+ *
+ * Unlike lv_chart, which redraws the whole series on every new point, the
+ * trace is kept as one min/max envelope per pixel column. Samples are
+ * decimated into the column under the cursor; when a column is complete
+ * it is drawn as a single vertical span, the cursor moves one pixel right
+ * and a short blank gap (the erase bar) runs just ahead of it, wrapping at
+ * the right edge. Only the columns that changed since the last refresh
+ * are invalidated, so each frame is a few narrow strips on the SPI bus
+ * rather than the whole chart.
+ *
+ * The vertical scale follows the signal: each sweep is drawn with the
+ * range seen during the previous one.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <lvgl.h>
+
+/**
+ * @brief Create a waveform of a fixed size
+ *
+ * @param parent Parent object
+ * @param width  Width in pixels, one column per pixel
+ * @param height Height in pixels, at most 255
+ * @param color  Trace color
+ */
+lv_obj_t *hpi_waveform_create(lv_obj_t *parent, int32_t width, int32_t height, lv_color_t color);
+
+/**
+ * @brief Set how long one sweep across the widget takes
+ *
+ * A sweep is never shorter than one sample per column.
+ */
+void hpi_waveform_set_sweep(lv_obj_t *obj, uint16_t sample_rate_hz, uint16_t sweep_ms);
+
+/**
+ * @brief Set the smallest range the autoscale will zoom into, in sample units
+ *
+ * Keeps the baseline noise of a flat signal from filling the height.
+ */
+void hpi_waveform_set_min_span(lv_obj_t *obj, int32_t min_span);
+
+/**
+ * @brief Add one sample; cheap enough to call for every point
+ */
+void hpi_waveform_add_sample(lv_obj_t *obj, int32_t value);
+
+/**
+ * @brief Blank the trace and restart the sweep and scale from the left edge
+ */
+void hpi_waveform_clear(lv_obj_t *obj);
+
+/**
+ * @brief Invalidate the columns that changed since the last call
+ *
+ * Call once per display loop, after adding the samples that arrived.
+ */
+void hpi_waveform_refresh(lv_obj_t *obj);
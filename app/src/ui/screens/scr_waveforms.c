@@ -0,0 +1,141 @@
+/*
+ * SPDX-License-Identifier: MIT
+ *
+ * Copyright (c) 2026 Ashwin Whitchurch, ProtoCentral Electronics
+ *
+ * Live waveform screen: ECG, respiration (BioZ) and PPG as sweep traces,
+ * fed from q_hpi_plot_all_sample by the display thread.
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <lvgl.h>
+
+#include "display_module.h"
+#include "hpi_common_types.h"
+#include "hpi_waveform.h"
+
+LOG_MODULE_REGISTER(scr_waveforms, LOG_LEVEL_WRN);
+
+lv_obj_t *scr_waveforms;
+
+// GUI Components
+static lv_obj_t *wave_ecg = NULL;
+static lv_obj_t *wave_resp = NULL;
+static lv_obj_t *wave_ppg = NULL;
+static lv_obj_t *label_ecg_lead_off = NULL;
+static lv_obj_t *label_resp_lead_off = NULL;
+static lv_obj_t *label_ppg_lead_off = NULL;
+
+// Trace configuration
+#define WAVE_WIDTH 460
+#define WAVE_HEIGHT 66
+#define WAVE_ROW_HEIGHT 90
+#define WAVE_SWEEP_MS 4000  // ~25 mm/s across the panel
+
+// Smallest ranges the autoscale zooms into, in raw sensor counts
+#define WAVE_ECG_MIN_SPAN 2000
+#define WAVE_RESP_MIN_SPAN 2000
+#define WAVE_PPG_MIN_SPAN 500
+
+static lv_obj_t *draw_wave_row(lv_obj_t *parent, int row, const char *title, lv_palette_t palette,
+                               int32_t min_span, lv_obj_t **label_lead_off)
+{
+    lv_obj_t *label_title = lv_label_create(parent);
+    lv_label_set_text(label_title, title);
+    lv_obj_set_pos(label_title, 2, row * WAVE_ROW_HEIGHT);
+    lv_obj_add_style(label_title, &style_text_14, LV_STATE_DEFAULT);
+    lv_obj_set_style_text_color(label_title, lv_palette_lighten(palette, 1), LV_STATE_DEFAULT);
+
+    *label_lead_off = lv_label_create(parent);
+    lv_label_set_text(*label_lead_off, LV_SYMBOL_WARNING " LEAD OFF");
+    lv_obj_align(*label_lead_off, LV_ALIGN_TOP_RIGHT, -2, row * WAVE_ROW_HEIGHT);
+    lv_obj_add_style(*label_lead_off, &style_text_14, LV_STATE_DEFAULT);
+    lv_obj_set_style_text_color(*label_lead_off, lv_color_make(255, 180, 0), LV_STATE_DEFAULT);
+    lv_obj_add_flag(*label_lead_off, LV_OBJ_FLAG_HIDDEN);
+
+    lv_obj_t *wave = hpi_waveform_create(parent, WAVE_WIDTH, WAVE_HEIGHT, lv_palette_main(palette));
+    lv_obj_set_pos(wave, 0, row * WAVE_ROW_HEIGHT + 20);
+    hpi_waveform_set_sweep(wave, SAMPLE_RATE, WAVE_SWEEP_MS);
+    hpi_waveform_set_min_span(wave, min_span);
+
+    return wave;
+}
+
+void draw_scr_waveforms(enum scroll_dir m_scroll_dir)
+{
+    scr_waveforms = lv_obj_create(NULL);
+    draw_header(scr_waveforms, true);
+
+    // Main container
+    lv_obj_t *main_container = lv_obj_create(scr_waveforms);
+    lv_obj_set_size(main_container, 480, 290);
+    lv_obj_set_pos(main_container, 0, 30);
+    lv_obj_set_style_bg_color(main_container, lv_color_black(), LV_PART_MAIN);
+    lv_obj_set_style_border_width(main_container, 0, LV_PART_MAIN);
+    lv_obj_set_style_radius(main_container, 0, LV_PART_MAIN);
+    lv_obj_set_style_pad_all(main_container, 10, LV_PART_MAIN);
+    lv_obj_clear_flag(main_container, LV_OBJ_FLAG_SCROLLABLE);
+
+    wave_ecg = draw_wave_row(main_container, 0, "ECG", LV_PALETTE_GREEN, WAVE_ECG_MIN_SPAN, &label_ecg_lead_off);
+    wave_resp = draw_wave_row(main_container, 1, "RESP", LV_PALETTE_YELLOW, WAVE_RESP_MIN_SPAN, &label_resp_lead_off);
+    wave_ppg = draw_wave_row(main_container, 2, "PPG", LV_PALETTE_CYAN, WAVE_PPG_MIN_SPAN, &label_ppg_lead_off);
+
+    // Set as current screen and show
+    hpi_disp_set_curr_screen(SCR_WAVEFORMS);
+    hpi_show_screen(scr_waveforms, m_scroll_dir);
+}
+
+bool hpi_scr_waveforms_is_valid(void)
+{
+    return scr_waveforms != NULL && lv_obj_is_valid(scr_waveforms);
+}
+
+// Called per sample: the caller checks hpi_scr_waveforms_is_valid() once
+// per batch rather than walking the object tree here
+void hpi_scr_waveforms_add_point(const struct hpi_sensor_data_point_t *point)
+{
+    hpi_waveform_add_sample(wave_ecg, point->ecg_sample);
+    hpi_waveform_add_sample(wave_resp, point->bioz_sample);
+    hpi_waveform_add_sample(wave_ppg, point->ppg_sample_ir);
+}
+
+static void set_lead_off(lv_obj_t *label, bool lead_off)
+{
+    if (label == NULL || !lv_obj_is_valid(label)) {
+        return;
+    }
+
+    // Changing the flag invalidates the label even if it is already set
+    if (lv_obj_has_flag(label, LV_OBJ_FLAG_HIDDEN) != lead_off) {
+        return;
+    }
+
+    if (lead_off) {
+        lv_obj_clear_flag(label, LV_OBJ_FLAG_HIDDEN);
+    } else {
+        lv_obj_add_flag(label, LV_OBJ_FLAG_HIDDEN);
+    }
+}
+
+void update_scr_waveforms(bool ecg_lead_off, bool ppg_lead_off)
+{
+    // CRITICAL: Validate screen exists first before touching any objects
+    if (!hpi_scr_waveforms_is_valid()) {
+        return;
+    }
+
+    if (hpi_disp_get_curr_screen() != SCR_WAVEFORMS) {
+        return;
+    }
+
+    // Respiration is measured through the ECG electrodes
+    set_lead_off(label_ecg_lead_off, ecg_lead_off);
+    set_lead_off(label_resp_lead_off, ecg_lead_off);
+    set_lead_off(label_ppg_lead_off, ppg_lead_off);
+
+    // Invalidate only the columns the new samples touched
+    hpi_waveform_refresh(wave_ecg);
+    hpi_waveform_refresh(wave_resp);
+    hpi_waveform_refresh(wave_ppg);
+}
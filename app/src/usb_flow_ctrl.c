@@ -0,0 +1,386 @@
+/*
+ * SPDX-License-Identifier: MIT
+ *
+ * Copyright (c) 2026 Ashwin Whitchurch, ProtoCentral Electronics
+ *
+ * Credit-based flow control for the USB streaming path.
+ *
+ * Without flow control the only backpressure is the TX ring itself: once
+ * the host falls behind, send_usb_cdc() drops whatever packet happens to
+ * arrive next. In flow-control mode the host grants credits (bytes or
+ * packets) over the command channel as it consumes data, every streamed
+ * packet spends credit, and when credit runs low the device degrades
+ * according to a host-selected policy instead of dropping at random.
+ *
+ * The low-water mark is a quarter of the most recent grant. Below it vitals
+ * packets are shed first; what happens to waveform packets depends on the
+ * policy. All outcomes are counted and reported via hpi_usb_fc_get_stats().
+ */
+
+#include <string.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/ring_buffer.h>
+#include <zephyr/fs/fs.h>
+
+#include "usb_flow_ctrl.h"
+#include "hw_module.h"
+#include "datalog_module.h"
+
+#ifdef CONFIG_HEALTHYPI_USB_BULK_ENABLED
+#include "usbd_hpi_bulk.h"
+#endif
+
+LOG_MODULE_REGISTER(usb_flow_ctrl, LOG_LEVEL_INF);
+
+static bool m_fc_enabled = false;
+static enum hpi_usb_fc_credit_unit m_fc_unit = HPI_USB_FC_UNIT_BYTES;
+static enum hpi_usb_fc_policy m_fc_policy = HPI_USB_FC_POLICY_DROP;
+
+// Granted by the USB RX thread, spent by data_thread
+static atomic_t fc_credits = ATOMIC_INIT(0);
+static atomic_t fc_window = ATOMIC_INIT(0);
+
+static enum hpi_usb_transport m_usb_transport = HPI_USB_TRANSPORT_CDC;
+
+// Guards the mode, fc_stats and fc_decimate_count: data_thread updates
+// them per packet while the command thread reconfigures and reads them
+static struct k_spinlock fc_lock;
+static struct hpi_usb_fc_stats fc_stats;
+static uint32_t fc_decimate_count = 0;
+
+static void fc_stat_inc(uint32_t *stat)
+{
+    k_spinlock_key_t key = k_spin_lock(&fc_lock);
+
+    (*stat)++;
+    k_spin_unlock(&fc_lock, key);
+}
+
+#ifdef CONFIG_HEALTHYPI_SD_CARD_ENABLED
+#define USB_FC_SPOOL_PATH "/SD:/USBSPOOL.BIN"
+#define USB_FC_SPOOL_STAGING_SIZE 2048
+#define USB_FC_SPOOL_FLUSH_THRESHOLD 512
+
+extern bool sd_card_present;
+
+// RAM staging between data_thread (producer) and the spool thread
+// (consumer), so the data thread never touches the SD card itself
+static uint8_t spool_staging[USB_FC_SPOOL_STAGING_SIZE];
+static struct ring_buf spool_rb;
+K_MUTEX_DEFINE(mutex_spool_file);
+K_SEM_DEFINE(sem_spool_flush, 0, 1);
+
+// Drain the staging ring into the spool file. Called with mutex_spool_file
+// held, which also makes the caller the ring's only consumer.
+static void spool_flush_locked(void)
+{
+    struct fs_file_t file;
+    uint8_t *claim_ptr;
+    uint32_t claim_len;
+    int rc;
+
+    if (ring_buf_is_empty(&spool_rb))
+    {
+        return;
+    }
+
+    fs_file_t_init(&file);
+    rc = fs_open(&file, USB_FC_SPOOL_PATH, FS_O_CREATE | FS_O_WRITE | FS_O_APPEND);
+    if (rc < 0)
+    {
+        LOG_ERR("Spool open failed: %d", rc);
+        // Discard rather than let the staging ring wedge full. Only from
+        // the consumer end: a reset would race data_thread's puts
+        ring_buf_get(&spool_rb, NULL, USB_FC_SPOOL_STAGING_SIZE);
+        return;
+    }
+
+    while ((claim_len = ring_buf_get_claim(&spool_rb, &claim_ptr, USB_FC_SPOOL_STAGING_SIZE)) > 0)
+    {
+        rc = fs_write(&file, claim_ptr, claim_len);
+        ring_buf_get_finish(&spool_rb, claim_len);
+        if (rc < 0)
+        {
+            LOG_ERR("Spool write failed: %d", rc);
+            ring_buf_get(&spool_rb, NULL, USB_FC_SPOOL_STAGING_SIZE);
+            break;
+        }
+    }
+
+    fs_close(&file);
+}
+
+// FAT writes can stall for the length of a card erase, so the spool gets
+// its own low-priority thread rather than the system workqueue
+static void spool_flush_thread(void)
+{
+    for (;;)
+    {
+        k_sem_take(&sem_spool_flush, K_FOREVER);
+
+        do
+        {
+            // Let a trickle collect for a second rather than open the
+            // file for every packet
+            if (ring_buf_size_get(&spool_rb) < USB_FC_SPOOL_FLUSH_THRESHOLD)
+            {
+                k_sem_take(&sem_spool_flush, K_SECONDS(1));
+            }
+
+            k_mutex_lock(&mutex_spool_file, K_FOREVER);
+            spool_flush_locked();
+            k_mutex_unlock(&mutex_spool_file);
+        } while (!ring_buf_is_empty(&spool_rb));
+    }
+}
+
+#define USB_FC_SPOOL_THREAD_STACKSIZE 2048
+// Alongside the log writer, below the data and command threads
+#define USB_FC_SPOOL_THREAD_PRIORITY 10
+
+K_THREAD_DEFINE(usb_fc_spool_thread_id, USB_FC_SPOOL_THREAD_STACKSIZE, spool_flush_thread, NULL, NULL, NULL,
+                USB_FC_SPOOL_THREAD_PRIORITY, 0, 0);
+
+static bool spool_packet(const uint8_t *buf, size_t len)
+{
+    if (!sd_card_present || ring_buf_space_get(&spool_rb) < len)
+    {
+        fc_stat_inc(&fc_stats.spool_dropped);
+        return false;
+    }
+
+    uint32_t staged = ring_buf_size_get(&spool_rb);
+
+    ring_buf_put(&spool_rb, buf, len);
+    fc_stat_inc(&fc_stats.spooled);
+
+    // Wake the spool thread for the first packet staged and again once
+    // enough has built up to flush straight away
+    if (staged == 0 || (staged < USB_FC_SPOOL_FLUSH_THRESHOLD && staged + len >= USB_FC_SPOOL_FLUSH_THRESHOLD))
+    {
+        k_sem_give(&sem_spool_flush);
+    }
+
+    return true;
+}
+
+void hpi_usb_fc_spool_fetch(void)
+{
+    k_mutex_lock(&mutex_spool_file, K_FOREVER);
+    // Push anything still staged in RAM out to the file first
+    spool_flush_locked();
+    if (hpi_datalog_send_file(USB_FC_SPOOL_PATH) == 0)
+    {
+        fs_unlink(USB_FC_SPOOL_PATH);
+    }
+    k_mutex_unlock(&mutex_spool_file);
+}
+
+void hpi_usb_fc_spool_hold(void)
+{
+    k_mutex_lock(&mutex_spool_file, K_FOREVER);
+    spool_flush_locked();
+}
+
+void hpi_usb_fc_spool_release(void)
+{
+    k_mutex_unlock(&mutex_spool_file);
+}
+#else
+static bool spool_packet(const uint8_t *buf, size_t len)
+{
+    ARG_UNUSED(buf);
+    ARG_UNUSED(len);
+
+    fc_stat_inc(&fc_stats.spool_dropped);
+    return false;
+}
+
+void hpi_usb_fc_spool_fetch(void)
+{
+}
+
+void hpi_usb_fc_spool_hold(void)
+{
+}
+
+void hpi_usb_fc_spool_release(void)
+{
+}
+#endif
+
+void hpi_usb_fc_configure(bool enable, enum hpi_usb_fc_credit_unit unit, enum hpi_usb_fc_policy policy)
+{
+#ifdef CONFIG_HEALTHYPI_SD_CARD_ENABLED
+    static bool spool_inited = false;
+
+    if (!spool_inited)
+    {
+        ring_buf_init(&spool_rb, sizeof(spool_staging), spool_staging);
+        spool_inited = true;
+    }
+#endif
+
+    k_spinlock_key_t key = k_spin_lock(&fc_lock);
+
+    // Start from zero credit: the host grants its first window right after
+    // enabling, so nothing is sent that it hasn't accounted for
+    atomic_set(&fc_credits, 0);
+    atomic_set(&fc_window, 0);
+    memset(&fc_stats, 0, sizeof(fc_stats));
+    fc_decimate_count = 0;
+
+    m_fc_unit = unit;
+    m_fc_policy = policy;
+    m_fc_enabled = enable;
+    k_spin_unlock(&fc_lock, key);
+
+    LOG_INF("USB flow control %s (unit=%d policy=%d)", enable ? "enabled" : "disabled", unit, policy);
+}
+
+bool hpi_usb_fc_enabled(void)
+{
+    return m_fc_enabled;
+}
+
+void hpi_usb_fc_grant(uint32_t credits)
+{
+    k_spinlock_key_t key = k_spin_lock(&fc_lock);
+
+    // Grants only count while flow control is on; enabling it starts the
+    // host's window from zero
+    if (m_fc_enabled)
+    {
+        atomic_add(&fc_credits, (atomic_val_t)credits);
+        atomic_set(&fc_window, (atomic_val_t)credits);
+    }
+    k_spin_unlock(&fc_lock, key);
+}
+
+void hpi_usb_fc_get_stats(struct hpi_usb_fc_stats *stats)
+{
+    k_spinlock_key_t key = k_spin_lock(&fc_lock);
+
+    *stats = fc_stats;
+    k_spin_unlock(&fc_lock, key);
+    stats->credits = (uint32_t)atomic_get(&fc_credits);
+}
+
+int hpi_usb_set_transport(enum hpi_usb_transport transport)
+{
+    switch (transport)
+    {
+    case HPI_USB_TRANSPORT_CDC:
+        break;
+#ifdef CONFIG_HEALTHYPI_USB_BULK_ENABLED
+    case HPI_USB_TRANSPORT_BULK:
+        break;
+#endif
+    default:
+        return -ENOTSUP;
+    }
+
+    m_usb_transport = transport;
+    LOG_INF("USB stream transport: %s", (transport == HPI_USB_TRANSPORT_BULK) ? "bulk" : "CDC");
+
+    return 0;
+}
+
+static void usb_stream_write(const uint8_t *buf, size_t len)
+{
+#ifdef CONFIG_HEALTHYPI_USB_BULK_ENABLED
+    // Fall back to CDC until the host has configured the bulk interface, so
+    // a driverless host still gets data on the serial port
+    if (m_usb_transport == HPI_USB_TRANSPORT_BULK && hpi_usb_bulk_is_ready())
+    {
+        hpi_usb_bulk_send(buf, len);
+        return;
+    }
+#endif
+    send_usb_cdc((const char *)buf, len);
+}
+
+// Whether a packet may go out now, counting the outcome; *spool is set for
+// a packet to divert to the SD spool instead. Called with fc_lock held.
+static bool fc_admit(enum hpi_usb_pkt_class pkt_class, size_t len, bool *spool)
+{
+    atomic_val_t cost = (m_fc_unit == HPI_USB_FC_UNIT_BYTES) ? (atomic_val_t)len : 1;
+    atomic_val_t credits = atomic_get(&fc_credits);
+    atomic_val_t low_water = atomic_get(&fc_window) / 4;
+    bool send = (credits >= cost);
+
+    if (send && credits < low_water)
+    {
+        if (pkt_class == HPI_USB_PKT_VITALS)
+        {
+            fc_stats.dropped_vitals++;
+            return false;
+        }
+
+        if (m_fc_policy == HPI_USB_FC_POLICY_DECIMATE)
+        {
+            // Halve the rate below the low-water mark, quarter it below half of it
+            uint32_t factor = (credits < low_water / 2) ? 4 : 2;
+
+            if ((fc_decimate_count++ % factor) != 0)
+            {
+                fc_stats.decimated++;
+                return false;
+            }
+        }
+    }
+
+    if (!send)
+    {
+        if (m_fc_policy == HPI_USB_FC_POLICY_SPOOL_SD)
+        {
+            *spool = true;
+        }
+        else if (pkt_class == HPI_USB_PKT_VITALS)
+        {
+            fc_stats.dropped_vitals++;
+        }
+        else
+        {
+            fc_stats.dropped_waveform++;
+        }
+        return false;
+    }
+
+    // data_thread is the only spender, so check-then-subtract can't go negative
+    atomic_sub(&fc_credits, cost);
+    fc_stats.sent++;
+
+    return true;
+}
+
+bool hpi_usb_stream_send(enum hpi_usb_pkt_class pkt_class, const uint8_t *buf, size_t len)
+{
+    k_spinlock_key_t key;
+    bool spool = false;
+    bool send;
+
+    if (!m_fc_enabled)
+    {
+        usb_stream_write(buf, len);
+        return true;
+    }
+
+    key = k_spin_lock(&fc_lock);
+    send = fc_admit(pkt_class, len, &spool);
+    k_spin_unlock(&fc_lock, key);
+
+    if (spool)
+    {
+        spool_packet(buf, len);
+    }
+    else if (send)
+    {
+        usb_stream_write(buf, len);
+    }
+
+    return send;
+}
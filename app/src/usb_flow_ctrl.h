@@ -0,0 +1,76 @@
+/*
+ * SPDX-License-Identifier: MIT
+ *
+ * Copyright (c) 2026 Ashwin Whitchurch, ProtoCentral Electronics
+ *
+ * Credit-based flow control for the USB streaming path.
+ */
+
+#ifndef usb_flow_ctrl_h
+#define usb_flow_ctrl_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Streamed packet classes, in the order they are shed under pressure
+enum hpi_usb_pkt_class
+{
+    HPI_USB_PKT_VITALS = 0,     // Low-rate vitals/status, dropped first
+    HPI_USB_PKT_WAVEFORM,       // Sample packets
+};
+
+enum hpi_usb_fc_credit_unit
+{
+    HPI_USB_FC_UNIT_BYTES = 0,
+    HPI_USB_FC_UNIT_PACKETS,
+};
+
+// What to do with waveform packets once credits run low
+enum hpi_usb_fc_policy
+{
+    HPI_USB_FC_POLICY_DROP = 0,     // Shed vitals, then drop waveforms at zero credit
+    HPI_USB_FC_POLICY_DECIMATE,     // Send every 2nd/4th waveform packet as credit drains
+    HPI_USB_FC_POLICY_SPOOL_SD,     // Divert uncredited packets to an SD spool file
+};
+
+// Where streamed packets go; commands and responses always use CDC-ACM
+enum hpi_usb_transport
+{
+    HPI_USB_TRANSPORT_CDC = 0,
+    HPI_USB_TRANSPORT_BULK,         // Vendor bulk-IN interface (CONFIG_HEALTHYPI_USB_BULK_ENABLED)
+};
+
+struct hpi_usb_fc_stats
+{
+    uint32_t credits;           // Credits currently available
+    uint32_t sent;              // Packets sent against credit
+    uint32_t dropped_vitals;
+    uint32_t dropped_waveform;
+    uint32_t decimated;         // Waveform packets skipped by decimation
+    uint32_t spooled;           // Packets diverted to the SD spool
+    uint32_t spool_dropped;     // Spool RAM staging full, packet lost
+};
+
+void hpi_usb_fc_configure(bool enable, enum hpi_usb_fc_credit_unit unit, enum hpi_usb_fc_policy policy);
+bool hpi_usb_fc_enabled(void);
+void hpi_usb_fc_grant(uint32_t credits);
+void hpi_usb_fc_get_stats(struct hpi_usb_fc_stats *stats);
+
+// Returns -ENOTSUP if the transport isn't built into this image
+int hpi_usb_set_transport(enum hpi_usb_transport transport);
+
+// Send one complete framed packet on the USB stream, over the selected
+// transport. Skips credit accounting when flow control is off. Returns true
+// if it was queued.
+bool hpi_usb_stream_send(enum hpi_usb_pkt_class pkt_class, const uint8_t *buf, size_t len);
+
+// Stream the SD spool file to the command requester and truncate it
+void hpi_usb_fc_spool_fetch(void);
+
+// Flush the staged spool to the card and keep the spool file closed until
+// released, so the card can be unmounted under it
+void hpi_usb_fc_spool_hold(void);
+void hpi_usb_fc_spool_release(void);
+
+#endif
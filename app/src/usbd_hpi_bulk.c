@@ -0,0 +1,288 @@
+/*
+ * SPDX-License-Identifier: MIT
+ *
+ * Copyright (c) 2026 Ashwin Whitchurch, ProtoCentral Electronics
+ *
+ * Vendor-specific USBD-next class with a single bulk-IN endpoint for
+ * waveform streaming.
+ *
+ * The CDC-ACM path goes through the UART emulation layer: a ring buffer
+ * drained 128 bytes per TX-ready IRQ through uart_fifo_fill(). This class
+ * bypasses that. Producers append framed packets into the current transfer
+ * buffer; a buffer is queued once it is full (HPI_BULK_XFER_SIZE, a whole
+ * number of 64-byte max packets) or after HPI_BULK_FLUSH_MS. The UDC
+ * driver then moves it as back-to-back max-size packets with one completion
+ * per transfer instead of one IRQ per 128 bytes.
+ *
+ * CDC-ACM stays in the configuration for the console and host commands.
+ */
+
+#include "usbd_hpi_bulk.h"
+
+#include <zephyr/kernel.h>
+#include <zephyr/usb/usbd.h>
+#include <zephyr/drivers/usb/udc.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/logging/log.h>
+
+LOG_MODULE_REGISTER(hpi_usbd_bulk, LOG_LEVEL_INF);
+
+#define HPI_BULK_MPS        64
+#define HPI_BULK_XFER_SIZE  (8 * HPI_BULK_MPS)
+#define HPI_BULK_NUM_BUFS   8
+#define HPI_BULK_FLUSH_MS   20
+
+UDC_BUF_POOL_DEFINE(hpi_bulk_pool, HPI_BULK_NUM_BUFS, HPI_BULK_XFER_SIZE,
+		    sizeof(struct udc_buf_info), NULL);
+
+struct hpi_bulk_desc {
+	struct usb_if_descriptor if0;
+	struct usb_ep_descriptor if0_in_ep;
+	struct usb_desc_header nil_desc;
+};
+
+static struct hpi_bulk_desc hpi_bulk_desc = {
+	.if0 = {
+		.bLength = sizeof(struct usb_if_descriptor),
+		.bDescriptorType = USB_DESC_INTERFACE,
+		.bInterfaceNumber = 0,
+		.bAlternateSetting = 0,
+		.bNumEndpoints = 1,
+		.bInterfaceClass = USB_BCC_VENDOR,
+		.bInterfaceSubClass = 0,
+		.bInterfaceProtocol = 0,
+		.iInterface = 0,
+	},
+	.if0_in_ep = {
+		.bLength = sizeof(struct usb_ep_descriptor),
+		.bDescriptorType = USB_DESC_ENDPOINT,
+		.bEndpointAddress = 0x81,
+		.bmAttributes = USB_EP_TYPE_BULK,
+		.wMaxPacketSize = sys_cpu_to_le16(HPI_BULK_MPS),
+		.bInterval = 0,
+	},
+	.nil_desc = {
+		.bLength = 0,
+		.bDescriptorType = 0,
+	},
+};
+
+static const struct usb_desc_header *hpi_bulk_fs_desc[] = {
+	(struct usb_desc_header *)&hpi_bulk_desc.if0,
+	(struct usb_desc_header *)&hpi_bulk_desc.if0_in_ep,
+	(struct usb_desc_header *)&hpi_bulk_desc.nil_desc,
+};
+
+static struct usbd_class_data *hpi_bulk_c_data;
+/* Producers run in data_thread, completions and enable/disable in the USBD
+ * thread: all thread context, and usbd_ep_enqueue() may block on the UDC
+ * driver lock, so this is a mutex rather than a spinlock.
+ */
+static K_MUTEX_DEFINE(hpi_bulk_lock);
+static K_FIFO_DEFINE(hpi_bulk_tx_fifo);
+static struct net_buf *hpi_bulk_cur;	/* Buffer being filled by producers */
+static bool hpi_bulk_enabled;
+static bool hpi_bulk_in_flight;
+static struct hpi_usb_bulk_stats hpi_bulk_stats;
+
+static void hpi_bulk_flush_handler(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(hpi_bulk_flush_work, hpi_bulk_flush_handler);
+
+/* Start the next queued transfer if the endpoint is idle. Called with
+ * hpi_bulk_lock held; one transfer in flight keeps ordering trivial and the
+ * FIFO behind it absorbs host scheduling jitter.
+ */
+static void hpi_bulk_kick_locked(void)
+{
+	struct net_buf *buf;
+
+	if (!hpi_bulk_enabled || hpi_bulk_in_flight) {
+		return;
+	}
+
+	buf = k_fifo_get(&hpi_bulk_tx_fifo, K_NO_WAIT);
+	if (buf == NULL) {
+		return;
+	}
+
+	if (usbd_ep_enqueue(hpi_bulk_c_data, buf) != 0) {
+		hpi_bulk_stats.dropped++;
+		net_buf_unref(buf);
+		return;
+	}
+
+	hpi_bulk_in_flight = true;
+}
+
+static void hpi_bulk_submit_cur_locked(void)
+{
+	if (hpi_bulk_cur == NULL || hpi_bulk_cur->len == 0) {
+		return;
+	}
+
+	k_fifo_put(&hpi_bulk_tx_fifo, hpi_bulk_cur);
+	hpi_bulk_cur = NULL;
+	hpi_bulk_kick_locked();
+}
+
+static void hpi_bulk_flush_handler(struct k_work *work)
+{
+	ARG_UNUSED(work);
+
+	k_mutex_lock(&hpi_bulk_lock, K_FOREVER);
+	hpi_bulk_submit_cur_locked();
+	k_mutex_unlock(&hpi_bulk_lock);
+}
+
+static void hpi_bulk_purge_locked(void)
+{
+	struct net_buf *buf;
+
+	while ((buf = k_fifo_get(&hpi_bulk_tx_fifo, K_NO_WAIT)) != NULL) {
+		net_buf_unref(buf);
+	}
+
+	if (hpi_bulk_cur != NULL) {
+		net_buf_unref(hpi_bulk_cur);
+		hpi_bulk_cur = NULL;
+	}
+}
+
+int hpi_usb_bulk_send(const uint8_t *buf, size_t len)
+{
+	if (len > HPI_BULK_XFER_SIZE) {
+		return -EMSGSIZE;
+	}
+
+	k_mutex_lock(&hpi_bulk_lock, K_FOREVER);
+
+	if (!hpi_bulk_enabled) {
+		k_mutex_unlock(&hpi_bulk_lock);
+		return -ENOTCONN;
+	}
+
+	/* Packets never straddle transfers, so the host can resync on any
+	 * transfer boundary if it ever loses one.
+	 */
+	if (hpi_bulk_cur != NULL && net_buf_tailroom(hpi_bulk_cur) < len) {
+		hpi_bulk_submit_cur_locked();
+	}
+
+	if (hpi_bulk_cur == NULL) {
+		hpi_bulk_cur = net_buf_alloc(&hpi_bulk_pool, K_NO_WAIT);
+		if (hpi_bulk_cur == NULL) {
+			/* Host isn't draining: every buffer is queued or in flight */
+			hpi_bulk_stats.dropped++;
+			k_mutex_unlock(&hpi_bulk_lock);
+			return -ENOMEM;
+		}
+
+		udc_get_buf_info(hpi_bulk_cur)->ep =
+			hpi_bulk_desc.if0_in_ep.bEndpointAddress;
+	}
+
+	net_buf_add_mem(hpi_bulk_cur, buf, len);
+	hpi_bulk_stats.packets++;
+
+	if (net_buf_tailroom(hpi_bulk_cur) == 0) {
+		hpi_bulk_submit_cur_locked();
+	}
+
+	k_mutex_unlock(&hpi_bulk_lock);
+
+	/* Bound latency for partially filled transfers */
+	k_work_schedule(&hpi_bulk_flush_work, K_MSEC(HPI_BULK_FLUSH_MS));
+
+	return 0;
+}
+
+bool hpi_usb_bulk_is_ready(void)
+{
+	return hpi_bulk_enabled;
+}
+
+void hpi_usb_bulk_get_stats(struct hpi_usb_bulk_stats *stats)
+{
+	k_mutex_lock(&hpi_bulk_lock, K_FOREVER);
+	*stats = hpi_bulk_stats;
+	k_mutex_unlock(&hpi_bulk_lock);
+}
+
+static int hpi_bulk_request(struct usbd_class_data *const c_data,
+			    struct net_buf *buf, int err)
+{
+	ARG_UNUSED(c_data);
+
+	k_mutex_lock(&hpi_bulk_lock, K_FOREVER);
+
+	if (err == 0) {
+		hpi_bulk_stats.transfers++;
+		hpi_bulk_stats.bytes += buf->len;
+	} else if (err != -ECONNABORTED) {
+		LOG_WRN("Bulk IN transfer failed (%d)", err);
+	}
+
+	net_buf_unref(buf);
+	hpi_bulk_in_flight = false;
+	hpi_bulk_kick_locked();
+
+	k_mutex_unlock(&hpi_bulk_lock);
+
+	return 0;
+}
+
+static void hpi_bulk_enable(struct usbd_class_data *const c_data)
+{
+	ARG_UNUSED(c_data);
+
+	k_mutex_lock(&hpi_bulk_lock, K_FOREVER);
+
+	hpi_bulk_enabled = true;
+	hpi_bulk_in_flight = false;
+	k_mutex_unlock(&hpi_bulk_lock);
+
+	LOG_INF("Bulk streaming interface enabled");
+}
+
+static void hpi_bulk_disable(struct usbd_class_data *const c_data)
+{
+	ARG_UNUSED(c_data);
+
+	k_mutex_lock(&hpi_bulk_lock, K_FOREVER);
+
+	/* The stack cancels the in-flight transfer and hands it back through
+	 * the request callback with -ECONNABORTED.
+	 */
+	hpi_bulk_enabled = false;
+	hpi_bulk_purge_locked();
+	k_mutex_unlock(&hpi_bulk_lock);
+
+	LOG_INF("Bulk streaming interface disabled");
+}
+
+static int hpi_bulk_init(struct usbd_class_data *const c_data)
+{
+	hpi_bulk_c_data = c_data;
+
+	return 0;
+}
+
+static void *hpi_bulk_get_desc(struct usbd_class_data *const c_data,
+			       const enum usbd_speed speed)
+{
+	ARG_UNUSED(c_data);
+	ARG_UNUSED(speed);
+
+	/* RP2040 is Full-Speed only */
+	return hpi_bulk_fs_desc;
+}
+
+static const struct usbd_class_api hpi_bulk_api = {
+	.request = hpi_bulk_request,
+	.enable = hpi_bulk_enable,
+	.disable = hpi_bulk_disable,
+	.init = hpi_bulk_init,
+	.get_desc = hpi_bulk_get_desc,
+};
+
+USBD_DEFINE_CLASS(hpi_bulk, &hpi_bulk_api, NULL, NULL);
@@ -0,0 +1,35 @@
+/*
+ * SPDX-License-Identifier: MIT
+ *
+ * Copyright (c) 2026 Ashwin Whitchurch, ProtoCentral Electronics
+ */
+
+#ifndef HEALTHYPI_USBD_HPI_BULK_H
+#define HEALTHYPI_USBD_HPI_BULK_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+struct hpi_usb_bulk_stats {
+	uint32_t packets;	/* Stream packets accepted */
+	uint32_t transfers;	/* Bulk-IN transfers completed */
+	uint32_t bytes;		/* Bytes moved by completed transfers */
+	uint32_t dropped;	/* Packets lost because no buffer was free */
+};
+
+/*
+ * Queue one framed stream packet on the vendor bulk-IN endpoint.
+ *
+ * Returns 0 on success, -ENOTCONN if the host hasn't configured the
+ * interface, -ENOMEM if all transfer buffers are busy (packet dropped) or
+ * -EMSGSIZE if the packet can't fit in a single transfer.
+ */
+int hpi_usb_bulk_send(const uint8_t *buf, size_t len);
+
+/* True once the host has configured the bulk interface */
+bool hpi_usb_bulk_is_ready(void);
+
+void hpi_usb_bulk_get_stats(struct hpi_usb_bulk_stats *stats);
+
+#endif /* HEALTHYPI_USBD_HPI_BULK_H */
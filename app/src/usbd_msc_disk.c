@@ -0,0 +1,261 @@
+/*
+ * SPDX-License-Identifier: MIT
+ *
+ * Copyright (c) 2026 Ashwin Whitchurch, ProtoCentral Electronics
+ *
+ * USB Mass Storage access to the SD card.
+ *
+ * FatFS on the device and the host's own filesystem driver must never
+ * have the card at the same time. So the MSC LUN is not bound to the SD
+ * disk itself but to a proxy disk, registered here, that reports
+ * DISK_STATUS_NOMEDIA while the firmware owns the card. To the host the
+ * device looks like a card reader with no card in it.
+ *
+ * Handover (hpi_usb_msc_attach, from the command worker):
+ *   0. refuse if another command or an L2CAP download may have a file open
+ *   1. stop recording and wait for the log writer to close the session
+ *   2. flush the USB flow-control spool and hold its file closed
+ *   3. unmount FatFS; sd_card_present goes false, so the logger, catalog,
+ *      spool and fetch commands leave the card alone
+ *   4. let the proxy pass sectors through to the SD disk
+ *
+ * The card comes back when the host ejects it (the MSC class deinits the
+ * LUN's disk), when the bus is suspended (cable pulled, host asleep) or
+ * on the detach command. Eject and suspend queue the detach command on
+ * the command worker, since the remount and catalog rebuild can take
+ * seconds. The proxy stops passing sectors through first, under the same
+ * lock as every pass-through, so no host access is in flight when FatFS
+ * is remounted.
+ */
+
+#include "usbd_msc_disk.h"
+
+#include <zephyr/kernel.h>
+#include <zephyr/init.h>
+#include <zephyr/drivers/disk.h>
+#include <zephyr/storage/disk_access.h>
+#include <zephyr/usb/class/usbd_msc.h>
+#include <zephyr/logging/log.h>
+
+#include "cmd_module.h"
+#include "datalog_module.h"
+#include "fs_module.h"
+#include "log_event.h"
+#include "usb_flow_ctrl.h"
+#ifdef CONFIG_HEALTHYPI_BLE_ENABLED
+#include "ble_module.h"
+#endif
+
+LOG_MODULE_REGISTER(hpi_usbd_msc, LOG_LEVEL_INF);
+
+#define HPI_MSC_DISK_NAME	"HPIMSC"
+/* The disk FatFS mounts as "/SD:" */
+#define HPI_MSC_SD_DISK_NAME	"SD"
+
+USBD_DEFINE_MSC_LUN(sd, HPI_MSC_DISK_NAME, "ProtoCen", "HealthyPi 5 SD", "1.00");
+
+K_MUTEX_DEFINE(msc_lock);
+static bool msc_attached;
+
+#define MSC_DETACH_RETRY_MS 100
+
+static void msc_detach_queue(void);
+
+/* Only requeues the detach; the card work itself runs on the command worker */
+static void msc_detach_retry_handler(struct k_work *work)
+{
+	ARG_UNUSED(work);
+
+	msc_detach_queue();
+}
+
+K_WORK_DELAYABLE_DEFINE(msc_detach_retry, msc_detach_retry_handler);
+
+static void msc_detach_queue(void)
+{
+	if (hpi_cmd_submit_local(HPI_CMD_USB_MSC_DETACH) < 0) {
+		k_work_schedule(&msc_detach_retry, K_MSEC(MSC_DETACH_RETRY_MS));
+	}
+}
+
+static int msc_disk_init(struct disk_info *disk)
+{
+	ARG_UNUSED(disk);
+
+	/* The SD disk is initialized by FatFS at mount */
+	return 0;
+}
+
+static int msc_disk_status(struct disk_info *disk)
+{
+	int status = DISK_STATUS_NOMEDIA;
+
+	ARG_UNUSED(disk);
+
+	k_mutex_lock(&msc_lock, K_FOREVER);
+	if (msc_attached) {
+		status = disk_access_status(HPI_MSC_SD_DISK_NAME);
+	}
+	k_mutex_unlock(&msc_lock);
+
+	return status;
+}
+
+static int msc_disk_read(struct disk_info *disk, uint8_t *buf,
+			 uint32_t sector, uint32_t count)
+{
+	int rc = -EIO;
+
+	ARG_UNUSED(disk);
+
+	k_mutex_lock(&msc_lock, K_FOREVER);
+	if (msc_attached) {
+		rc = disk_access_read(HPI_MSC_SD_DISK_NAME, buf, sector, count);
+	}
+	k_mutex_unlock(&msc_lock);
+
+	return rc;
+}
+
+static int msc_disk_write(struct disk_info *disk, const uint8_t *buf,
+			  uint32_t sector, uint32_t count)
+{
+	int rc = -EIO;
+
+	ARG_UNUSED(disk);
+
+	k_mutex_lock(&msc_lock, K_FOREVER);
+	if (msc_attached) {
+		rc = disk_access_write(HPI_MSC_SD_DISK_NAME, buf, sector, count);
+	}
+	k_mutex_unlock(&msc_lock);
+
+	return rc;
+}
+
+static int msc_disk_ioctl(struct disk_info *disk, uint8_t cmd, void *buf)
+{
+	int rc = -EIO;
+
+	ARG_UNUSED(disk);
+
+	switch (cmd) {
+	case DISK_IOCTL_CTRL_INIT:
+		return 0;
+	case DISK_IOCTL_CTRL_DEINIT:
+		/* The host ejected the medium; never deinit the SD disk itself */
+		hpi_usb_msc_detach_async();
+		return 0;
+	default:
+		break;
+	}
+
+	k_mutex_lock(&msc_lock, K_FOREVER);
+	if (msc_attached) {
+		rc = disk_access_ioctl(HPI_MSC_SD_DISK_NAME, cmd, buf);
+	}
+	k_mutex_unlock(&msc_lock);
+
+	return rc;
+}
+
+static const struct disk_operations msc_disk_ops = {
+	.init = msc_disk_init,
+	.status = msc_disk_status,
+	.read = msc_disk_read,
+	.write = msc_disk_write,
+	.ioctl = msc_disk_ioctl,
+};
+
+static struct disk_info msc_disk = {
+	.name = HPI_MSC_DISK_NAME,
+	.ops = &msc_disk_ops,
+};
+
+/* Before USBD init, which looks the LUN's disk up */
+static int msc_disk_register(void)
+{
+	return disk_access_register(&msc_disk);
+}
+
+SYS_INIT(msc_disk_register, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
+
+int hpi_usb_msc_attach(void)
+{
+	int rc;
+
+	if (msc_attached) {
+		return 0;
+	}
+
+	/* Anything else reading the card would have its files pulled away */
+	if (hpi_cmd_worker_busy()) {
+		LOG_WRN("Card in use by a queued command, not handed over");
+		return -EBUSY;
+	}
+#ifdef CONFIG_HEALTHYPI_BLE_ENABLED
+	if (ble_l2cap_xfer_busy()) {
+		LOG_WRN("Card in use by an L2CAP download, not handed over");
+		return -EBUSY;
+	}
+#endif
+
+	/* Stops data_thread adding points, then drains and closes the file */
+	rc = hpi_datalog_seal();
+	if (rc < 0) {
+		LOG_WRN("Log writer still has its file open (%d)", rc);
+		return -EBUSY;
+	}
+#ifdef CONFIG_HEALTHYPI_LOG_EVENT_CAPTURE
+	hpi_log_event_seal();
+#endif
+
+	hpi_usb_fc_spool_hold();
+	rc = hpi_fs_sd_unmount();
+	hpi_usb_fc_spool_release();
+	if (rc < 0) {
+		LOG_ERR("Cannot hand the SD card over (%d)", rc);
+		return rc;
+	}
+
+	k_mutex_lock(&msc_lock, K_FOREVER);
+	msc_attached = true;
+	k_mutex_unlock(&msc_lock);
+
+	LOG_INF("SD card handed to the USB host");
+	return 0;
+}
+
+int hpi_usb_msc_detach(void)
+{
+	int rc;
+
+	k_mutex_lock(&msc_lock, K_FOREVER);
+	if (!msc_attached) {
+		k_mutex_unlock(&msc_lock);
+		return 0;
+	}
+	msc_attached = false;
+	k_mutex_unlock(&msc_lock);
+
+	rc = hpi_fs_sd_remount();
+	if (rc < 0) {
+		LOG_ERR("SD card remount failed (%d)", rc);
+		return rc;
+	}
+
+	LOG_INF("SD card back from the USB host");
+	return 0;
+}
+
+void hpi_usb_msc_detach_async(void)
+{
+	if (msc_attached) {
+		msc_detach_queue();
+	}
+}
+
+bool hpi_usb_msc_is_attached(void)
+{
+	return msc_attached;
+}
@@ -0,0 +1,35 @@
+/*
+ * SPDX-License-Identifier: MIT
+ *
+ * Copyright (c) 2026 Ashwin Whitchurch, ProtoCentral Electronics
+ */
+
+#ifndef HEALTHYPI_USBD_MSC_DISK_H
+#define HEALTHYPI_USBD_MSC_DISK_H
+
+#include <stdbool.h>
+
+/*
+ * Hand the SD card to the USB host: stop any recording, unmount FatFS and
+ * let the mass storage LUN report the medium. Runs in the caller's thread
+ * and waits for the log writer to close the session file.
+ *
+ * Returns 0 on success (or if the host already has the card), -EBUSY if
+ * another command, an L2CAP download or the log writer still has a file
+ * open, -ENODEV if no card is mounted, or the fs_unmount() error.
+ */
+int hpi_usb_msc_attach(void);
+
+/*
+ * Take the card back from the host and remount it. The session catalog is
+ * rebuilt, since the host may have added or removed files. Runs on the
+ * command worker, for a host eject, a USB suspend and the detach command.
+ */
+int hpi_usb_msc_detach(void);
+
+/* Queue hpi_usb_msc_detach() on the command worker; safe from any context */
+void hpi_usb_msc_detach_async(void);
+
+bool hpi_usb_msc_is_attached(void);
+
+#endif /* HEALTHYPI_USBD_MSC_DISK_H */
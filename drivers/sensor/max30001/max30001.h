@@ -397,6 +397,9 @@ struct max30001_encoded_data
 
 	uint8_t ecg_lead_off;
 	uint8_t bioz_lead_off;
+
+	/* Set when RRINT reported a new R-R interval in this batch */
+	uint8_t rri_new;
 };
 
 void max30001_submit(const struct device *dev, struct rtio_iodev_sqe *iodev_sqe);
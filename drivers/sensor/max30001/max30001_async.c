@@ -7,7 +7,7 @@ LOG_MODULE_REGISTER(MAX30001_ASYNC, CONFIG_SENSOR_LOG_LEVEL);
 
 static int max30001_async_sample_fetch(const struct device *dev,
                                        uint32_t *num_samples_ecg, uint32_t *num_samples_bioz, int32_t ecg_samples[32],
-                                       int32_t bioz_samples[32], uint16_t *rri, uint16_t *hr,
+                                       int32_t bioz_samples[32], uint16_t *rri, uint8_t *rri_new, uint16_t *hr,
                                        uint8_t *ecg_lead_off, uint8_t *bioz_lead_off)
 {
     struct max30001_data *data = dev->data;
@@ -34,6 +34,8 @@ static int max30001_async_sample_fetch(const struct device *dev,
 
     uint32_t max30001_rtor = 0;
 
+    *rri_new = 0;
+
     max30001_status = max30001_read_status(dev);
 
     if ((max30001_status & MAX30001_STATUS_MASK_DCLOFF) == MAX30001_STATUS_MASK_DCLOFF)
@@ -207,6 +209,7 @@ static int max30001_async_sample_fetch(const struct device *dev,
         {
             data->lastRRI = (uint16_t)((max30001_rtor >> 10) * 7.8125);
             data->lastHR = (uint16_t)(60 * 1000 / data->lastRRI);
+            *rri_new = 1;
         }
     }
 
@@ -239,7 +242,7 @@ void max30001_submit(const struct device *dev, struct rtio_iodev_sqe *iodev_sqe)
     m_edata = (struct max30001_encoded_data *)buf;
     m_edata->header.timestamp = k_ticks_to_ns_floor64(k_uptime_ticks());
     ret = max30001_async_sample_fetch(dev, &m_edata->num_samples_ecg, &m_edata->num_samples_bioz,
-                                      m_edata->ecg_samples, m_edata->bioz_samples, &m_edata->rri, &m_edata->hr, &m_edata->ecg_lead_off, &m_edata->bioz_lead_off);
+                                      m_edata->ecg_samples, m_edata->bioz_samples, &m_edata->rri, &m_edata->rri_new, &m_edata->hr, &m_edata->ecg_lead_off, &m_edata->bioz_lead_off);
 
     if (ret != 0)
     {
@@ -0,0 +1,267 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: MIT
+#
+# Copyright (c) 2026 Ashwin Whitchurch, ProtoCentral Electronics
+#
+# Convert a HealthyPi binary session log (<session>_LOG.BIN), an event
+# capture (<session>_EVT.BIN) or a flash ring segment (T*.BIN / W*.BIN,
+# timed from boot), to CSV.
+# The on-disk format is described in app/src/hpi_log_format.h.
+#
+# usage: hpi_log_to_csv.py [--scaled] [--records REC.CSV [--records-only]] LOG.BIN [OUT.CSV]
+
+import argparse
+import struct
+import sys
+import zlib
+
+FILE_MAGIC = 0x4C495048
+BLOCK_MAGIC = 0x42495048
+INDEX_MAGIC = 0x58495048
+RECORD_MAGIC = 0x52495048
+
+HEADER_SIZE = 512
+LOG_VERSION = 1
+BLOCK_HDR = struct.Struct("<IHHIII")
+CHANNEL_DESC = struct.Struct("<BBHf4s")
+FRAME_SIZE = 12
+
+CODEC_RAW24, CODEC_RICE = 0, 1
+RICE_ESC = 24
+RICE_RAW_BITS = 25
+RICE_MAX_K = 24
+RICE_RESET = 64
+
+CH_ECG, CH_BIOZ, CH_PPG = 1, 2, 3
+
+# Typed records in record blocks: name and (field, struct format) pairs
+RECORD_HDR = struct.Struct("<BBI")
+RECORD_TYPES = {
+    1: ("vitals", [("hr", "B"), ("hr_source", "B"), ("spo2", "B"), ("resp_rate", "B"),
+                   ("temp_c", "h"), ("flags", "B")]),
+    2: ("ppg_quality", [("perfusion_ir", "H"), ("perfusion_red", "H"), ("signal_strength", "H"),
+                        ("confidence", "B"), ("flags", "B"), ("probe_off_reason", "B")]),
+    3: ("lead_off", [("lead", "B"), ("lead_off", "B")]),
+    4: ("rr_interval", [("rr_ms", "H")]),
+    5: ("clock", [("year", "B"), ("month", "B"), ("day", "B"), ("hour", "B"), ("minute", "B"),
+                  ("second", "B")]),
+    6: ("event", [("source", "B"), ("detail", "B"), ("value", "h")]),
+}
+RECORD_FIELDS = []
+for _, fields in RECORD_TYPES.values():
+    RECORD_FIELDS += [f for f, _ in fields if f not in RECORD_FIELDS]
+
+
+def int24(buf, off):
+    v = buf[off] | (buf[off + 1] << 8) | (buf[off + 2] << 16)
+    return v - (1 << 24) if v & 0x800000 else v
+
+
+class BitReader:
+    def __init__(self, buf):
+        self.value = int.from_bytes(buf, "big")
+        self.n_bits = len(buf) * 8
+        self.pos = 0
+
+    def get(self, n):
+        if self.pos + n > self.n_bits:
+            raise EOFError
+        self.pos += n
+        return (self.value >> (self.n_bits - self.pos)) & ((1 << n) - 1)
+
+
+def rice_points(payload, n_points):
+    # Mirrors app/src/hpi_log_codec.c; yields (ecg, bioz, ppg), with bioz and
+    # ppg None on odd points
+    bits = BitReader(payload)
+    prev = [0, 0, 0]
+    a = [32, 32, 32]
+    n = [1, 1, 1]
+
+    def value(ch):
+        k = 0
+        while (n[ch] << k) < a[ch] and k < RICE_MAX_K:
+            k += 1
+        q = 0
+        while q < RICE_ESC and bits.get(1):
+            q += 1
+        u = bits.get(RICE_RAW_BITS) if q == RICE_ESC else (q << k) | bits.get(k)
+        prev[ch] += (u >> 1) ^ -(u & 1)
+        a[ch] += u
+        n[ch] += 1
+        if n[ch] == RICE_RESET:
+            a[ch] >>= 1
+            n[ch] >>= 1
+        return prev[ch]
+
+    try:
+        for i in range(n_points):
+            if i == 0:
+                for ch in range(3):
+                    v = bits.get(24)
+                    prev[ch] = v - (1 << 24) if v & 0x800000 else v
+                yield tuple(prev)
+            elif i % 2 == 0:
+                yield value(0), value(1), value(2)
+            else:
+                yield value(0), None, None
+    except EOFError:
+        print("warning: compressed block ends early", file=sys.stderr)
+
+
+def raw_points(payload, n_points):
+    for i in range(n_points):
+        frame = (i // 2) * FRAME_SIZE
+        if i % 2 == 0:
+            yield int24(payload, frame), int24(payload, frame + 6), int24(payload, frame + 9)
+        else:
+            yield int24(payload, frame + 3), None, None
+
+
+def read_records(payload, n_records):
+    # Yields (timestamp_ms, name, {field: value}); unknown types are skipped
+    off = 0
+    for _ in range(n_records):
+        if off + RECORD_HDR.size > len(payload):
+            break
+        rec_type, rec_len, ts_ms = RECORD_HDR.unpack_from(payload, off)
+        body = payload[off + RECORD_HDR.size:off + RECORD_HDR.size + rec_len]
+        off += RECORD_HDR.size + rec_len
+
+        if rec_type not in RECORD_TYPES:
+            continue
+        name, fields = RECORD_TYPES[rec_type]
+        fmt = struct.Struct("<" + "".join(f for _, f in fields))
+        if len(body) < fmt.size:
+            continue
+        values = dict(zip((f for f, _ in fields), fmt.unpack_from(body, 0)))
+        if "temp_c" in values:
+            values["temp_c"] /= 100.0
+        yield ts_ms, name, values
+
+
+def read_header(data):
+    if len(data) < HEADER_SIZE:
+        sys.exit("file too short for a log header")
+
+    magic, version, header_size, block_size, session_id = struct.unpack_from("<IHHHH", data, 0)
+    if magic != FILE_MAGIC:
+        sys.exit("not a HealthyPi binary log")
+    if version != LOG_VERSION:
+        sys.exit("unsupported log version %d" % version)
+
+    (crc,) = struct.unpack_from("<I", data, HEADER_SIZE - 4)
+    if zlib.crc32(data[:HEADER_SIZE - 4]) != crc:
+        print("warning: header CRC mismatch", file=sys.stderr)
+
+    start = tuple(data[12:18])
+    n_channels = data[18]
+    channels = {}
+    for i in range(n_channels):
+        ch_type, _, rate, scale, unit = CHANNEL_DESC.unpack_from(data, 20 + i * CHANNEL_DESC.size)
+        channels[ch_type] = (rate, scale, unit.rstrip(b"\0").decode("ascii", "replace"))
+
+    codec = data[20 + 4 * CHANNEL_DESC.size]
+    (nonce,) = struct.unpack_from("<I", data, 21 + 4 * CHANNEL_DESC.size)
+
+    return {
+        "version": version,
+        "header_size": header_size,
+        "block_size": block_size,
+        "session_id": session_id,
+        "start": start,
+        "channels": channels,
+        "codec": codec,
+        "nonce": nonce,
+    }
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument("log")
+    parser.add_argument("csv", nargs="?")
+    parser.add_argument("--scaled", action="store_true", help="apply the per-channel scale from the header")
+    parser.add_argument("--records", metavar="REC.CSV", help="write vitals, quality and event records here")
+    parser.add_argument("--records-only", action="store_true", help="skip the waveform data")
+    args = parser.parse_args()
+
+    with open(args.log, "rb") as f:
+        data = f.read()
+
+    hdr = read_header(data)
+    block_size = hdr["block_size"]
+    if hdr["codec"] not in (CODEC_RAW24, CODEC_RICE):
+        sys.exit("unknown block codec %d" % hdr["codec"])
+    points = rice_points if hdr["codec"] == CODEC_RICE else raw_points
+    ecg_rate, ecg_scale, _ = hdr["channels"].get(CH_ECG, (128, 1.0, ""))
+    _, bioz_scale, _ = hdr["channels"].get(CH_BIOZ, (64, 1.0, ""))
+    _, ppg_scale, _ = hdr["channels"].get(CH_PPG, (64, 1.0, ""))
+    if not args.scaled:
+        ecg_scale = bioz_scale = ppg_scale = 1.0
+
+    y, mo, d, h, mi, s = hdr["start"]
+    started = "# session %d started 20%02d-%02d-%02d %02d:%02d:%02d\n" % (hdr["session_id"], y, mo, d, h, mi, s)
+
+    out = None
+    if not args.records_only:
+        out = open(args.csv, "w") if args.csv else sys.stdout
+        out.write(started)
+        out.write("time_s,ecg,bioz,ppg\n")
+
+    rec_out = None
+    if args.records:
+        rec_out = open(args.records, "w")
+        rec_out.write(started)
+        rec_out.write("time_s,record," + ",".join(RECORD_FIELDS) + "\n")
+
+    bad = 0
+    expected_seq = 0
+    for off in range(hdr["header_size"], len(data) - block_size + 1, block_size):
+        block = data[off:off + block_size]
+        magic, session_id, n_points, seq, ts_ms, nonce = BLOCK_HDR.unpack_from(block, 0)
+        (crc,) = struct.unpack_from("<I", block, block_size - 4)
+
+        # The time index trails the last data block
+        if magic == INDEX_MAGIC:
+            break
+
+        # A block with another nonce is left over from a deleted session
+        if magic not in (BLOCK_MAGIC, RECORD_MAGIC) or session_id != hdr["session_id"] or \
+                nonce != hdr["nonce"] or zlib.crc32(block[:-4]) != crc:
+            bad += 1
+            continue
+
+        if seq != expected_seq:
+            print("warning: blocks %d..%d missing" % (expected_seq, seq - 1), file=sys.stderr)
+        expected_seq = seq + 1
+
+        payload = block[BLOCK_HDR.size:-4]
+
+        if magic == RECORD_MAGIC:
+            if rec_out:
+                for rec_ts, name, values in read_records(payload, n_points):
+                    rec_out.write("%.3f,%s,%s\n" % (rec_ts / 1000.0, name,
+                                                    ",".join(str(values.get(f, "")) for f in RECORD_FIELDS)))
+            continue
+
+        if out is None:
+            continue
+
+        for i, (ecg, bioz, ppg) in enumerate(points(payload, n_points)):
+            t = ts_ms / 1000.0 + i / ecg_rate
+            if bioz is not None:
+                out.write("%.4f,%g,%g,%g\n" % (t, ecg * ecg_scale, bioz * bioz_scale, ppg * ppg_scale))
+            else:
+                out.write("%.4f,%g,,\n" % (t, ecg * ecg_scale))
+
+    if bad:
+        print("warning: skipped %d corrupt block(s)" % bad, file=sys.stderr)
+
+    if out is not None and out is not sys.stdout:
+        out.close()
+    if rec_out:
+        rec_out.close()
+
+
+if __name__ == "__main__":
+    main()